@@ -0,0 +1,474 @@
+/* a2l_gen.cpp
+ *
+ * Generates an ASAP2 (A2L) description for the signal-to-can XCP slave.
+ *
+ * Symbol addresses are taken from the firmware ELF (static and global objects
+ * from .symtab) or, if only the linker map is at hand, from the per-object
+ * .data.<name>/.bss.<name> input sections (the project builds with -fdata-sections).
+ * What each symbol contains is described by a measurement spec; a default spec
+ * covering the processing state and CAN debug counters is built in.
+ *
+ * Usage:
+ *   stc_a2l_gen <signal_to_can.elf|signal_to_can.map> [-n node_id] [-b baud]
+ *               [-s spec_file] [-o out.a2l]
+ *
+ * Spec lines (blank lines and '#' comments ignored):
+ *   [file.c:]symbol[.field]  TYPE  [count]  [byte_offset]
+ * TYPE is one of UBYTE SBYTE UWORD SWORD ULONG SLONG FLOAT32_IEEE.
+ */
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace {
+
+struct Symbol {
+    uint32_t addr = 0;
+    uint32_t size = 0;
+};
+
+/* Keyed by "name" and by "file.c:name"; a bare name that occurs in more than
+ * one translation unit is marked ambiguous and must be qualified in the spec.
+ */
+class SymbolTable {
+public:
+    void add(const std::string &file, const std::string &name, Symbol sym)
+    {
+        if (!file.empty()) {
+            qualified_[file + ":" + name] = sym;
+        }
+        auto it = plain_.find(name);
+        if (it == plain_.end()) {
+            plain_[name] = sym;
+        } else if (it->second.addr != sym.addr) {
+            ambiguous_[name] = true;
+        }
+    }
+
+    bool find(const std::string &key, Symbol &out, std::string &err) const
+    {
+        auto q = qualified_.find(key);
+        if (q != qualified_.end()) {
+            out = q->second;
+            return true;
+        }
+        if (ambiguous_.count(key)) {
+            err = "symbol '" + key + "' is defined in several files; qualify it as file.c:" + key;
+            return false;
+        }
+        auto p = plain_.find(key);
+        if (p == plain_.end()) {
+            err = "symbol '" + key + "' not found";
+            return false;
+        }
+        out = p->second;
+        return true;
+    }
+
+    size_t size() const { return plain_.size(); }
+
+private:
+    std::map<std::string, Symbol> plain_;
+    std::map<std::string, Symbol> qualified_;
+    std::map<std::string, bool> ambiguous_;
+};
+
+uint16_t rd16(const std::vector<uint8_t> &b, size_t off)
+{
+    return static_cast<uint16_t>(b[off] | (b[off + 1] << 8));
+}
+
+uint32_t rd32(const std::vector<uint8_t> &b, size_t off)
+{
+    return static_cast<uint32_t>(b[off]) | (static_cast<uint32_t>(b[off + 1]) << 8) |
+           (static_cast<uint32_t>(b[off + 2]) << 16) | (static_cast<uint32_t>(b[off + 3]) << 24);
+}
+
+std::string base_name(const std::string &path)
+{
+    const size_t slash = path.find_last_of("/\\");
+    return (slash == std::string::npos) ? path : path.substr(slash + 1);
+}
+
+/* Loads OBJECT symbols from a 32-bit little-endian ELF. STT_FILE entries that
+ * precede local symbols give the source file used for qualification.
+ */
+bool load_elf(const std::string &path, SymbolTable &table, std::string &err)
+{
+    std::ifstream in(path, std::ios::binary);
+    if (!in) {
+        err = "cannot open " + path;
+        return false;
+    }
+    std::vector<uint8_t> b((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    if (b.size() < 52 || std::memcmp(b.data(), "\x7f" "ELF", 4) != 0 || b[4] != 1 || b[5] != 1) {
+        err = path + " is not a 32-bit little-endian ELF";
+        return false;
+    }
+
+    const uint32_t shoff = rd32(b, 0x20);
+    const uint16_t shentsize = rd16(b, 0x2E);
+    const uint16_t shnum = rd16(b, 0x30);
+    if (shoff == 0 || static_cast<size_t>(shoff) + static_cast<size_t>(shnum) * shentsize > b.size()) {
+        err = "bad section header table in " + path;
+        return false;
+    }
+
+    for (uint16_t i = 0; i < shnum; ++i) {
+        const size_t sh = shoff + static_cast<size_t>(i) * shentsize;
+        if (rd32(b, sh + 4) != 2u /* SHT_SYMTAB */) {
+            continue;
+        }
+        const uint32_t sym_off = rd32(b, sh + 16);
+        const uint32_t sym_size = rd32(b, sh + 20);
+        const uint32_t link = rd32(b, sh + 24);
+        const size_t str_sh = shoff + static_cast<size_t>(link) * shentsize;
+        const uint32_t str_off = rd32(b, str_sh + 16);
+        const uint32_t str_size = rd32(b, str_sh + 20);
+        if (static_cast<size_t>(sym_off) + sym_size > b.size() ||
+            static_cast<size_t>(str_off) + str_size > b.size()) {
+            err = "truncated symbol table in " + path;
+            return false;
+        }
+
+        std::string file;
+        for (uint32_t s = 0; s + 16 <= sym_size; s += 16) {
+            const size_t e = sym_off + s;
+            const uint32_t name_idx = rd32(b, e);
+            const uint8_t info = b[e + 12];
+            if (name_idx >= str_size) {
+                continue;
+            }
+            const std::string name(reinterpret_cast<const char *>(&b[str_off + name_idx]));
+            const uint8_t type = info & 0x0Fu;
+            const uint8_t bind = info >> 4;
+            if (type == 4u /* STT_FILE */) {
+                file = base_name(name);
+            } else if (type == 1u /* STT_OBJECT */ && !name.empty()) {
+                Symbol sym;
+                sym.addr = rd32(b, e + 4);
+                sym.size = rd32(b, e + 8);
+                table.add(bind == 0u ? file : std::string(), name, sym);
+            }
+        }
+        return true;
+    }
+
+    err = path + " has no symbol table (stripped?)";
+    return false;
+}
+
+/* Loads .data.<name>/.bss.<name> input sections from a GNU ld map. The address
+ * and size follow either on the same line or, for long names, on the next one.
+ */
+bool load_map(const std::string &path, SymbolTable &table, std::string &err)
+{
+    std::ifstream in(path);
+    if (!in) {
+        err = "cannot open " + path;
+        return false;
+    }
+
+    std::string line;
+    bool in_memory_map = false;
+    std::string pending;
+    while (std::getline(in, line)) {
+        if (!in_memory_map) {
+            in_memory_map = (line.find("Linker script and memory map") != std::string::npos);
+            continue;
+        }
+
+        std::istringstream ls(line);
+        std::string first;
+        ls >> first;
+
+        std::string name;
+        if (!pending.empty()) {
+            name = pending;
+            pending.clear();
+            ls.clear();
+            ls.str(line);
+        } else if (first.rfind(".data.", 0) == 0 || first.rfind(".bss.", 0) == 0) {
+            name = first.substr(first.find('.', 1) + 1);
+        } else {
+            continue;
+        }
+
+        std::string addr_s, size_s, obj;
+        if (!(ls >> addr_s)) {
+            pending = name;   /* values are on the next line */
+            continue;
+        }
+        if (!(ls >> size_s >> obj)) {
+            continue;
+        }
+        Symbol sym;
+        sym.addr = static_cast<uint32_t>(std::strtoul(addr_s.c_str(), nullptr, 16));
+        sym.size = static_cast<uint32_t>(std::strtoul(size_s.c_str(), nullptr, 16));
+        std::string file = base_name(obj);
+        if (file.size() > 2 && file.compare(file.size() - 2, 2, ".o") == 0) {
+            file.replace(file.size() - 2, 2, ".c");
+        }
+        table.add(file, name, sym);
+    }
+
+    if (table.size() == 0) {
+        err = "no data symbols found in " + path + " (built without -fdata-sections?)";
+        return false;
+    }
+    return true;
+}
+
+struct Measurement {
+    std::string symbol;   /* lookup key, possibly file-qualified */
+    std::string label;    /* A2L name */
+    std::string type;
+    uint32_t count = 1;
+    uint32_t offset = 0;
+};
+
+uint32_t type_size(const std::string &type)
+{
+    if (type == "UBYTE" || type == "SBYTE") return 1;
+    if (type == "UWORD" || type == "SWORD") return 2;
+    if (type == "ULONG" || type == "SLONG" || type == "FLOAT32_IEEE") return 4;
+    return 0;
+}
+
+const char *type_limits(const std::string &type)
+{
+    if (type == "UBYTE") return "0 255";
+    if (type == "SBYTE") return "-128 127";
+    if (type == "UWORD") return "0 65535";
+    if (type == "SWORD") return "-32768 32767";
+    if (type == "ULONG") return "0 4294967295";
+    if (type == "SLONG") return "-2147483648 2147483647";
+    return "-1e12 1e12";
+}
+
+const char *k_default_spec =
+    "# processing state (process_signals.c)\n"
+    "s_raw                     UWORD        8\n"
+    "s_v_pin                   FLOAT32_IEEE 8\n"
+    "s_v_in                    FLOAT32_IEEE 8\n"
+    "s_v_in_mV                 UWORD        8\n"
+    "s_oor_mask                UBYTE        1\n"
+    "# live DMA target (adc_module.c)\n"
+    "s_adc_raw                 UWORD        8\n"
+    "# CAN debug counters (main.c)\n"
+    "g_can_dbg.last_tx_status  UBYTE        1 0\n"
+    "g_can_dbg.last_hal_error  ULONG        1 4\n"
+    "g_can_dbg.last_esr        ULONG        1 8\n"
+    "g_can_dbg.last_tsr        ULONG        1 12\n"
+    "g_can_dbg.tx_ok_count     ULONG        1 16\n"
+    "g_can_dbg.tx_error_count  ULONG        1 20\n"
+    "# XCP slave (xcp_module.c)\n"
+    "s_overrun_count           ULONG        1\n";
+
+bool parse_spec(std::istream &in, std::vector<Measurement> &out, std::string &err)
+{
+    std::string line;
+    int line_no = 0;
+    while (std::getline(in, line)) {
+        ++line_no;
+        const size_t hash = line.find('#');
+        if (hash != std::string::npos) {
+            line.erase(hash);
+        }
+        std::istringstream ls(line);
+        std::string key;
+        if (!(ls >> key)) {
+            continue;
+        }
+        Measurement m;
+        if (!(ls >> m.type) || type_size(m.type) == 0) {
+            err = "spec line " + std::to_string(line_no) + ": missing or unknown type";
+            return false;
+        }
+        ls >> m.count;
+        ls >> m.offset;
+        if (m.count == 0) {
+            m.count = 1;
+        }
+
+        const size_t dot = key.find('.', key.find(':') == std::string::npos ? 0 : key.find(':'));
+        m.symbol = (dot == std::string::npos) ? key : key.substr(0, dot);
+        m.label = key;
+        for (char &c : m.label) {
+            if (c == ':' ) c = '_';
+        }
+        out.push_back(m);
+    }
+    return true;
+}
+
+void write_a2l(std::ostream &os, const std::vector<std::pair<Measurement, uint32_t>> &items,
+               uint32_t node_id, uint32_t baud)
+{
+    os << "ASAP2_VERSION 1 71\n"
+          "/begin PROJECT signal_to_can \"signal-to-can device\"\n"
+          "  /begin HEADER \"\"\n"
+          "    VERSION \"generated by stc_a2l_gen\"\n"
+          "  /end HEADER\n"
+          "  /begin MODULE STC \"\"\n"
+          "    /begin MOD_COMMON \"\"\n"
+          "      BYTE_ORDER MSB_LAST\n"
+          "      ALIGNMENT_BYTE 1\n"
+          "      ALIGNMENT_WORD 2\n"
+          "      ALIGNMENT_LONG 4\n"
+          "      ALIGNMENT_FLOAT32_IEEE 4\n"
+          "    /end MOD_COMMON\n"
+          "    /begin IF_DATA XCP\n"
+          "      /begin PROTOCOL_LAYER 0x0101 25 25 25 25 25 25 25 8 8\n"
+          "        BYTE_ORDER_MSB_LAST ADDRESS_GRANULARITY_BYTE\n"
+          "        OPTIONAL_CMD GET_COMM_MODE_INFO\n"
+          "        OPTIONAL_CMD SET_MTA\n"
+          "        OPTIONAL_CMD UPLOAD\n"
+          "        OPTIONAL_CMD SHORT_UPLOAD\n"
+          "        OPTIONAL_CMD CLEAR_DAQ_LIST\n"
+          "        OPTIONAL_CMD GET_DAQ_LIST_MODE\n"
+          "        OPTIONAL_CMD GET_DAQ_PROCESSOR_INFO\n"
+          "        OPTIONAL_CMD GET_DAQ_RESOLUTION_INFO\n"
+          "        OPTIONAL_CMD GET_DAQ_EVENT_INFO\n"
+          "        OPTIONAL_CMD FREE_DAQ\n"
+          "        OPTIONAL_CMD ALLOC_DAQ\n"
+          "        OPTIONAL_CMD ALLOC_ODT\n"
+          "        OPTIONAL_CMD ALLOC_ODT_ENTRY\n"
+          "      /end PROTOCOL_LAYER\n"
+          "      /begin DAQ DYNAMIC 4 2 1\n"
+          "        OPTIMISATION_TYPE_DEFAULT ADDRESS_EXTENSION_FREE\n"
+          "        IDENTIFICATION_FIELD_TYPE_ABSOLUTE\n"
+          "        GRANULARITY_ODT_ENTRY_SIZE_DAQ_BYTE 7 NO_OVERLOAD_INDICATION\n"
+          "        /begin EVENT \"ADC_SCAN\" \"ADC\" 0 DAQ 0xFF 0 0 255 /end EVENT\n"
+          "        /begin EVENT \"PROCESS\" \"PROC\" 1 DAQ 0xFF 0 0 0 /end EVENT\n"
+          "      /end DAQ\n";
+    char ids[160];
+    std::snprintf(ids, sizeof(ids),
+                  "      /begin XCP_ON_CAN 0x0100\n"
+                  "        CAN_ID_MASTER 0x%03X\n"
+                  "        CAN_ID_SLAVE 0x%03X\n"
+                  "        BAUDRATE %u\n",
+                  node_id + 0x7u, node_id + 0x8u, baud);
+    os << ids <<
+          "        SAMPLE_POINT 87 SAMPLE_RATE SINGLE BTL_CYCLES 16 SJW 1 SYNC_EDGE SINGLE\n"
+          "        MAX_DLC_REQUIRED\n"
+          "      /end XCP_ON_CAN\n"
+          "    /end IF_DATA\n"
+          "    /begin COMPU_METHOD CM_IDENTICAL \"\" IDENTICAL \"%12.4\" \"\" /end COMPU_METHOD\n";
+
+    for (const auto &item : items) {
+        const Measurement &m = item.first;
+        char addr[16];
+        std::snprintf(addr, sizeof(addr), "0x%08X", item.second);
+        os << "    /begin MEASUREMENT " << m.label << " \"\" " << m.type << " CM_IDENTICAL 0 0 "
+           << type_limits(m.type) << "\n"
+           << "      ECU_ADDRESS " << addr << "\n";
+        if (m.count > 1) {
+            os << "      MATRIX_DIM " << m.count << "\n";
+        }
+        os << "    /end MEASUREMENT\n";
+    }
+
+    os << "  /end MODULE\n"
+          "/end PROJECT\n";
+}
+
+void usage()
+{
+    std::cerr << "usage: stc_a2l_gen <firmware.elf|firmware.map> [-n node_id] [-b baud]"
+                 " [-s spec_file] [-o out.a2l]\n";
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    std::string input, spec_path, out_path;
+    uint32_t node_id = 0x500u;
+    uint32_t baud = 500000u;
+
+    for (int i = 1; i < argc; ++i) {
+        const std::string a = argv[i];
+        if ((a == "-n" || a == "-b" || a == "-s" || a == "-o") && i + 1 < argc) {
+            const char *v = argv[++i];
+            if (a == "-n") node_id = static_cast<uint32_t>(std::strtoul(v, nullptr, 0));
+            if (a == "-b") baud = static_cast<uint32_t>(std::strtoul(v, nullptr, 0));
+            if (a == "-s") spec_path = v;
+            if (a == "-o") out_path = v;
+        } else if (input.empty() && a[0] != '-') {
+            input = a;
+        } else {
+            usage();
+            return 2;
+        }
+    }
+    if (input.empty()) {
+        usage();
+        return 2;
+    }
+
+    SymbolTable table;
+    std::string err;
+    const bool is_map = input.size() > 4 && input.compare(input.size() - 4, 4, ".map") == 0;
+    if (!(is_map ? load_map(input, table, err) : load_elf(input, table, err))) {
+        std::cerr << "stc_a2l_gen: " << err << "\n";
+        return 1;
+    }
+
+    std::vector<Measurement> spec;
+    if (spec_path.empty()) {
+        std::istringstream def(k_default_spec);
+        parse_spec(def, spec, err);
+    } else {
+        std::ifstream sf(spec_path);
+        if (!sf || !parse_spec(sf, spec, err)) {
+            std::cerr << "stc_a2l_gen: " << (sf ? err : "cannot open " + spec_path) << "\n";
+            return 1;
+        }
+    }
+
+    std::vector<std::pair<Measurement, uint32_t>> items;
+    int missing = 0;
+    for (const Measurement &m : spec) {
+        Symbol sym;
+        if (!table.find(m.symbol, sym, err)) {
+            std::cerr << "stc_a2l_gen: warning: " << err << ", skipping " << m.label << "\n";
+            ++missing;
+            continue;
+        }
+        const uint32_t bytes = m.offset + m.count * type_size(m.type);
+        if (sym.size != 0 && bytes > sym.size) {
+            std::cerr << "stc_a2l_gen: warning: " << m.label << " needs " << bytes << " bytes but '"
+                      << m.symbol << "' is only " << sym.size << ", skipping\n";
+            ++missing;
+            continue;
+        }
+        items.emplace_back(m, sym.addr + m.offset);
+    }
+
+    if (out_path.empty()) {
+        write_a2l(std::cout, items, node_id, baud);
+    } else {
+        std::ofstream os(out_path);
+        if (!os) {
+            std::cerr << "stc_a2l_gen: cannot write " << out_path << "\n";
+            return 1;
+        }
+        write_a2l(os, items, node_id, baud);
+    }
+
+    std::cerr << "stc_a2l_gen: " << items.size() << " measurements written";
+    if (missing) {
+        std::cerr << ", " << missing << " skipped";
+    }
+    std::cerr << "\n";
+    return 0;
+}
@@ -0,0 +1,674 @@
+/* bus_plan.cpp
+ *
+ * CAN bus schedule planner for several signal-to-can nodes on one bus.
+ *
+ * The message set is the DBC template (IDs relative to a template node base)
+ * repeated for every node. For each message the planner computes the
+ * worst-case frame time including bit stuffing and the worst-case response
+ * time with the revised classical CAN schedulability analysis (Davis, Burns,
+ * Bril, Lukkien 2007): non-preemptive fixed priority, queuing jitter, blocking
+ * by one lower priority frame and multiple instances in the busy period.
+ * All arithmetic is done in integer bit times.
+ *
+ * It then suggests
+ *  - a node ID order (D-J monotonic: shortest period minus jitter gets the
+ *    lowest node ID) and re-analyses it, and
+ *  - per-node transmit phases (1 ms grid) that spread the bursts of nodes
+ *    with equal or harmonic periods over the hyperperiod.
+ *
+ * The analysis is checked against a frame-level discrete-event simulation of
+ * the bus (priority arbitration at every idle point, random release jitter,
+ * worst-case or random stuffing). Observed response times above the computed
+ * bound are reported as violations.
+ *
+ * Usage:
+ *   stc_bus_plan <signal_to_can.dbc> [-b baud] [-B template_base]
+ *                [-N nodes -f first_node_id -s id_stride] [-c nodes_file]
+ *                [-p period_ms] [-j jitter_ms] [-P offset=period_ms]...
+ *                [--sim seconds] [--seed n] [--stuff worst|random] [--summary]
+ *
+ * Nodes file lines (blank lines and '#' comments ignored):
+ *   node_id  period_ms  [jitter_ms]
+ *
+ * Message periods: -P for that ID offset, else GenMsgCycleTime from the DBC,
+ * else the node period.
+ *
+ * Exit status: 0 schedulable, 3 not schedulable, 1/2 input or usage errors.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <numeric>
+#include <queue>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace {
+
+using bits_t = int64_t;
+
+struct TemplateMsg {
+    uint32_t offset = 0;        /* ID relative to the template base */
+    uint32_t dlc = 8;
+    std::string name;
+    double cycle_ms = 0.0;      /* 0 = use the node period */
+};
+
+struct Node {
+    uint32_t node_id = 0;
+    double period_ms = 0.0;
+    double jitter_ms = 0.0;
+};
+
+struct Message {
+    uint32_t id = 0;
+    size_t node = 0;            /* index into the node list */
+    std::string name;
+    uint32_t dlc = 8;
+    bits_t c = 0;               /* worst-case frame time */
+    bits_t c_min = 0;           /* frame time without stuff bits */
+    bits_t t = 0;               /* period */
+    bits_t d = 0;               /* deadline (= period) */
+    bits_t j = 0;               /* queuing jitter */
+    bits_t phase = 0;           /* release offset, simulation only */
+    bits_t r = 0;               /* analysed worst-case response time, -1 = unbounded */
+    bits_t sim_max = 0;         /* largest simulated response time */
+};
+
+struct Options {
+    uint32_t baud = 500000u;
+    uint32_t template_base = 0x500u;
+    uint32_t nodes = 1u;
+    uint32_t first_node = 0x500u;
+    uint32_t stride = 0x10u;
+    double period_ms = 20.0;
+    double jitter_ms = 0.0;
+    std::map<uint32_t, double> period_override;
+    std::string nodes_file;
+    double sim_s = 0.0;
+    uint32_t seed = 1u;
+    bool random_stuff = false;
+    bool summary = false;
+};
+
+/* ===== Frame timing ===== */
+
+/* Worst-case length of a standard data frame including stuff bits and the
+ * 3-bit interframe space: 34 stuffable header bits, 8*dlc data bits, 13 fixed
+ * bits, at most one stuff bit per 4 bits after the first.
+ */
+bits_t frame_bits_worst(uint32_t dlc)
+{
+    const bits_t g = 34;
+    const bits_t s = static_cast<bits_t>(dlc);
+    return g + 8 * s + 13 + (g + 8 * s - 1) / 4;
+}
+
+bits_t frame_bits_nominal(uint32_t dlc)
+{
+    return 47 + 8 * static_cast<bits_t>(dlc);
+}
+
+bits_t ms_to_bits(double ms, uint32_t baud)
+{
+    return static_cast<bits_t>(std::llround(ms * 1e-3 * baud));
+}
+
+double bits_to_us(bits_t b, uint32_t baud)
+{
+    return static_cast<double>(b) * 1e6 / baud;
+}
+
+bits_t ceil_div(bits_t a, bits_t b)
+{
+    return (a + b - 1) / b;
+}
+
+/* ===== DBC template ===== */
+
+bool load_dbc(const std::string &path, uint32_t base, std::vector<TemplateMsg> &out, std::string &err)
+{
+    std::ifstream in(path);
+    if (!in) {
+        err = "cannot open " + path;
+        return false;
+    }
+    std::map<uint32_t, TemplateMsg> by_id;
+    std::string line;
+    while (std::getline(in, line)) {
+        std::istringstream ls(line);
+        std::string kw;
+        ls >> kw;
+        if (kw == "BO_") {
+            uint32_t id = 0, dlc = 0;
+            std::string name;
+            ls >> id >> name >> dlc;
+            if (!ls || (id & 0x80000000u) != 0u) {
+                continue;   /* extended IDs are not part of the template */
+            }
+            if (!name.empty() && name.back() == ':') name.pop_back();
+            if (id < base || id - base > 0x7FFu) {
+                std::cerr << "stc_bus_plan: ignoring " << name << " (ID below template base)\n";
+                continue;
+            }
+            TemplateMsg &m = by_id[id];
+            m.offset = id - base;
+            m.dlc = std::min(dlc, 8u);
+            m.name = name;
+        } else if (kw == "BA_") {
+            /* BA_ "GenMsgCycleTime" BO_ <id> <ms>; */
+            std::string attr, obj;
+            uint32_t id = 0;
+            double ms = 0.0;
+            ls >> attr >> obj >> id >> ms;
+            if (ls && attr == "\"GenMsgCycleTime\"" && obj == "BO_") {
+                by_id[id].cycle_ms = ms;
+            }
+        }
+    }
+    for (auto &kv : by_id) {
+        if (!kv.second.name.empty()) {
+            out.push_back(kv.second);
+        }
+    }
+    if (out.empty()) {
+        err = "no standard-ID messages at or above the template base in " + path;
+        return false;
+    }
+    return true;
+}
+
+bool load_nodes(const std::string &path, std::vector<Node> &out, std::string &err)
+{
+    std::ifstream in(path);
+    if (!in) {
+        err = "cannot open " + path;
+        return false;
+    }
+    std::string line;
+    int lineno = 0;
+    while (std::getline(in, line)) {
+        ++lineno;
+        const size_t hash = line.find('#');
+        if (hash != std::string::npos) line.erase(hash);
+        std::istringstream ls(line);
+        std::string id;
+        Node n;
+        if (!(ls >> id)) continue;
+        if (!(ls >> n.period_ms) || n.period_ms <= 0.0) {
+            err = path + ":" + std::to_string(lineno) + ": expected node_id period_ms [jitter_ms]";
+            return false;
+        }
+        ls >> n.jitter_ms;
+        n.node_id = static_cast<uint32_t>(std::strtoul(id.c_str(), nullptr, 0));
+        out.push_back(n);
+    }
+    return true;
+}
+
+/* ===== Message set ===== */
+
+std::vector<Message> build_messages(const std::vector<TemplateMsg> &tmpl, const std::vector<Node> &nodes,
+                                    const Options &opt)
+{
+    std::vector<Message> msgs;
+    for (size_t n = 0; n < nodes.size(); ++n) {
+        for (const TemplateMsg &tm : tmpl) {
+            Message m;
+            m.id = nodes[n].node_id + tm.offset;
+            m.node = n;
+            m.name = tm.name;
+            m.dlc = tm.dlc;
+            m.c = frame_bits_worst(tm.dlc);
+            m.c_min = frame_bits_nominal(tm.dlc);
+            double period = nodes[n].period_ms;
+            auto ov = opt.period_override.find(tm.offset);
+            if (ov != opt.period_override.end()) {
+                period = ov->second;
+            } else if (tm.cycle_ms > 0.0) {
+                period = tm.cycle_ms;
+            }
+            m.t = std::max<bits_t>(1, ms_to_bits(period, opt.baud));
+            m.d = m.t;
+            m.j = ms_to_bits(nodes[n].jitter_ms, opt.baud);
+            msgs.push_back(m);
+        }
+    }
+    std::sort(msgs.begin(), msgs.end(), [](const Message &a, const Message &b) { return a.id < b.id; });
+    return msgs;
+}
+
+/* Returns the first duplicate or out-of-range identifier, or 0 if there is none. */
+uint32_t id_conflict(const std::vector<Message> &msgs)
+{
+    for (size_t i = 0; i < msgs.size(); ++i) {
+        if (msgs[i].id > 0x7FFu) return msgs[i].id;
+        if (i > 0 && msgs[i].id == msgs[i - 1].id) return msgs[i].id;
+    }
+    return 0u;
+}
+
+/* ===== Response-time analysis ===== */
+
+/* msgs must be sorted by ID (index order = priority order). Returns true if
+ * every message meets its deadline.
+ */
+bool analyse(std::vector<Message> &msgs, bits_t tbit)
+{
+    const size_t n = msgs.size();
+
+    /* Blocking: longest frame of lower priority, i.e. the suffix maximum of C. */
+    std::vector<bits_t> blocking(n + 1, 0);
+    for (size_t i = n; i-- > 0;) {
+        blocking[i] = std::max(blocking[i + 1], msgs[i].c);
+    }
+
+    bool ok = true;
+    for (size_t m = 0; m < n; ++m) {
+        Message &mm = msgs[m];
+        const bits_t b = blocking[m + 1];
+        /* Give up once a window exceeds this: the message is unbounded. */
+        const bits_t limit = 1000 * std::max(mm.t, mm.d) + mm.j;
+
+        /* Length of the priority level-m busy period. */
+        bits_t t = mm.c;
+        for (;;) {
+            bits_t next = b;
+            for (size_t k = 0; k <= m; ++k) {
+                next += ceil_div(t + msgs[k].j, msgs[k].t) * msgs[k].c;
+            }
+            if (next == t || next > limit) {
+                t = next;
+                break;
+            }
+            t = next;
+        }
+        if (t > limit) {
+            mm.r = -1;
+            ok = false;
+            continue;
+        }
+
+        const bits_t q_max = ceil_div(t + mm.j, mm.t);
+        bits_t r = 0;
+        bits_t w = b;
+        for (bits_t q = 0; q < q_max && r >= 0; ++q) {
+            w = std::max(w, b + q * mm.c);
+            for (;;) {
+                bits_t next = b + q * mm.c;
+                for (size_t k = 0; k < m; ++k) {
+                    next += ceil_div(w + msgs[k].j + tbit, msgs[k].t) * msgs[k].c;
+                }
+                if (next == w || next > limit) {
+                    w = next;
+                    break;
+                }
+                w = next;
+            }
+            if (w > limit) {
+                r = -1;
+                break;
+            }
+            r = std::max(r, mm.j + w - q * mm.t + mm.c);
+        }
+        mm.r = r;
+        if (r < 0 || r > mm.d) {
+            ok = false;
+        }
+    }
+    return ok;
+}
+
+/* ===== Suggestions ===== */
+
+/* D-J monotonic node order: node IDs first_node + k*stride are handed out by
+ * increasing (shortest message deadline - jitter) of the node.
+ */
+std::vector<Node> suggest_ids(const std::vector<Node> &nodes, const std::vector<TemplateMsg> &tmpl,
+                              const Options &opt)
+{
+    std::vector<size_t> order(nodes.size());
+    std::iota(order.begin(), order.end(), size_t{0});
+    auto key = [&](size_t i) {
+        double d = nodes[i].period_ms;
+        for (const TemplateMsg &tm : tmpl) {
+            auto ov = opt.period_override.find(tm.offset);
+            const double p = ov != opt.period_override.end() ? ov->second
+                           : tm.cycle_ms > 0.0 ? tm.cycle_ms : nodes[i].period_ms;
+            d = std::min(d, p);
+        }
+        return d - nodes[i].jitter_ms;
+    };
+    std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) { return key(a) < key(b); });
+
+    std::vector<uint32_t> ids;
+    for (const Node &n : nodes) ids.push_back(n.node_id);
+    std::sort(ids.begin(), ids.end());
+
+    std::vector<Node> out(nodes.size());
+    for (size_t k = 0; k < order.size(); ++k) {
+        out[order[k]] = nodes[order[k]];
+        out[order[k]].node_id = ids[k];
+    }
+    return out;
+}
+
+/* Greedy phase assignment on a 1 ms grid over the hyperperiod (capped at
+ * 10 s): every node, in priority order, takes the phase whose releases meet
+ * the least already-placed traffic in their slot.
+ */
+std::vector<uint32_t> suggest_phases(const std::vector<Message> &msgs, size_t node_count, uint32_t baud)
+{
+    std::vector<bits_t> burst(node_count, 0);
+    std::vector<bits_t> period(node_count, 0);
+    std::vector<size_t> first_msg(node_count, msgs.size());
+    for (size_t i = 0; i < msgs.size(); ++i) {
+        const Message &m = msgs[i];
+        burst[m.node] += m.c;
+        period[m.node] = period[m.node] == 0 ? m.t : std::min(period[m.node], m.t);
+        first_msg[m.node] = std::min(first_msg[m.node], i);
+    }
+
+    const bits_t slot = std::max<bits_t>(1, ms_to_bits(1.0, baud));
+    int64_t hyper = 1;
+    for (size_t n = 0; n < node_count; ++n) {
+        const int64_t p = std::max<int64_t>(1, period[n] / slot);
+        hyper = std::min<int64_t>(std::lcm(hyper, p), 10000);
+    }
+
+    std::vector<size_t> order(node_count);
+    std::iota(order.begin(), order.end(), size_t{0});
+    std::sort(order.begin(), order.end(), [&](size_t a, size_t b) { return first_msg[a] < first_msg[b]; });
+
+    std::vector<bits_t> load(static_cast<size_t>(hyper), 0);
+    std::vector<uint32_t> phase(node_count, 0u);
+    for (size_t n : order) {
+        const int64_t p = std::max<int64_t>(1, period[n] / slot);
+        bits_t best_peak = -1, best_sum = 0;
+        int64_t best = 0;
+        for (int64_t ph = 0; ph < p; ++ph) {
+            bits_t peak = 0, sum = 0;
+            for (int64_t s = ph; s < hyper; s += p) {
+                peak = std::max(peak, load[static_cast<size_t>(s)]);
+                sum += load[static_cast<size_t>(s)];
+            }
+            if (best_peak < 0 || peak < best_peak || (peak == best_peak && sum < best_sum)) {
+                best_peak = peak;
+                best_sum = sum;
+                best = ph;
+            }
+        }
+        for (int64_t s = best; s < hyper; s += p) {
+            load[static_cast<size_t>(s)] += burst[n];
+        }
+        phase[n] = static_cast<uint32_t>(best);
+    }
+    return phase;
+}
+
+/* ===== Discrete-event bus simulation ===== */
+
+struct Pending {
+    bits_t release;     /* nominal release (response time is measured from here) */
+    bits_t arrive;      /* release plus jitter: when the frame enters arbitration */
+    size_t msg;
+};
+
+/* Frame-level simulation: whenever the bus goes idle, the lowest ID among the
+ * queued frames wins and occupies the bus for its frame time. Records the
+ * largest response time per message in sim_max.
+ */
+void simulate(std::vector<Message> &msgs, bits_t duration, uint32_t seed, bool random_stuff)
+{
+    std::mt19937_64 rng(seed);
+    struct Later {
+        bool operator()(const Pending &a, const Pending &b) const { return a.arrive > b.arrive; }
+    };
+    std::priority_queue<Pending, std::vector<Pending>, Later> future;
+    std::map<uint32_t, std::vector<Pending>> ready;   /* by ID, FIFO per message */
+
+    std::vector<bits_t> next_release(msgs.size());
+    auto release = [&](size_t i) {
+        const Message &m = msgs[i];
+        const bits_t rel = next_release[i];
+        const bits_t jit = m.j > 0 ? static_cast<bits_t>(rng() % static_cast<uint64_t>(m.j + 1)) : 0;
+        future.push(Pending{ rel, rel + jit, i });
+        next_release[i] += m.t;
+    };
+    for (size_t i = 0; i < msgs.size(); ++i) {
+        msgs[i].sim_max = 0;
+        next_release[i] = msgs[i].phase;
+        release(i);
+    }
+
+    bits_t now = 0;
+    while (now < duration) {
+        while (!future.empty() && future.top().arrive <= now) {
+            const Pending p = future.top();
+            future.pop();
+            ready[msgs[p.msg].id].push_back(p);
+            if (next_release[p.msg] < duration) release(p.msg);
+        }
+        if (ready.empty()) {
+            if (future.empty()) break;
+            now = future.top().arrive;
+            continue;
+        }
+
+        auto win = ready.begin();
+        const Pending p = win->second.front();
+        win->second.erase(win->second.begin());
+        if (win->second.empty()) ready.erase(win);
+
+        Message &m = msgs[p.msg];
+        bits_t len = m.c;
+        if (random_stuff && m.c > m.c_min) {
+            len = m.c_min + static_cast<bits_t>(rng() % static_cast<uint64_t>(m.c - m.c_min + 1));
+        }
+        now += len;
+        m.sim_max = std::max(m.sim_max, now - p.release);
+    }
+}
+
+/* ===== Report ===== */
+
+struct Summary {
+    double util_worst = 0.0;
+    double util_nominal = 0.0;
+    bool schedulable = false;
+    bits_t worst_r = 0;
+    size_t misses = 0;
+};
+
+Summary summarise(const std::vector<Message> &msgs, bool ok)
+{
+    Summary s;
+    s.schedulable = ok;
+    for (const Message &m : msgs) {
+        s.util_worst += static_cast<double>(m.c) / static_cast<double>(m.t);
+        s.util_nominal += static_cast<double>(m.c_min) / static_cast<double>(m.t);
+        if (m.r < 0 || m.r > m.d) s.misses++;
+        if (m.r < 0 || s.worst_r < 0) s.worst_r = -1;
+        else s.worst_r = std::max(s.worst_r, m.r);
+    }
+    return s;
+}
+
+void print_table(const std::vector<Message> &msgs, const std::vector<Node> &nodes, uint32_t baud, bool sim)
+{
+    std::printf("  ID     node   message               C[us]    T[ms]    J[us]    R[us]  slack[us]%s\n",
+                sim ? "  sim[us]" : "");
+    for (const Message &m : msgs) {
+        std::printf("  0x%03X  0x%03X  %-20.20s %7.1f %8.2f %8.1f ",
+                    m.id, nodes[m.node].node_id, m.name.c_str(),
+                    bits_to_us(m.c, baud), bits_to_us(m.t, baud) / 1e3, bits_to_us(m.j, baud));
+        if (m.r < 0) {
+            std::printf("%8s %10s", "unbound", "-");
+        } else {
+            std::printf("%8.1f %10.1f", bits_to_us(m.r, baud), bits_to_us(m.d - m.r, baud));
+        }
+        if (sim) {
+            std::printf(" %8.1f%s", bits_to_us(m.sim_max, baud),
+                        (m.r >= 0 && m.sim_max > m.r) ? "  VIOLATION" : "");
+        }
+        std::printf("%s\n", (m.r < 0 || m.r > m.d) ? "  MISS" : "");
+    }
+}
+
+void print_summary(const char *title, const Summary &s, uint32_t baud)
+{
+    std::printf("%s: utilisation %.1f%% worst case (%.1f%% without stuffing), %s",
+                title, 100.0 * s.util_worst, 100.0 * s.util_nominal,
+                s.schedulable ? "schedulable" : "NOT schedulable");
+    if (s.worst_r >= 0) {
+        std::printf(", max R %.1f us", bits_to_us(s.worst_r, baud));
+    }
+    if (s.misses > 0) {
+        std::printf(", %zu deadline misses", s.misses);
+    }
+    std::printf("\n");
+}
+
+/* Runs the simulation and prints observed worst responses against the bound. */
+void validate(std::vector<Message> &msgs, const Options &opt, const char *what)
+{
+    simulate(msgs, ms_to_bits(opt.sim_s * 1e3, opt.baud), opt.seed, opt.random_stuff);
+    size_t violations = 0;
+    bits_t worst = 0;
+    for (const Message &m : msgs) {
+        if (m.r >= 0 && m.sim_max > m.r) violations++;
+        worst = std::max(worst, m.sim_max);
+    }
+    std::printf("simulation (%s, %.1f s): max observed R %.1f us, %zu bound violations\n",
+                what, opt.sim_s, bits_to_us(worst, opt.baud), violations);
+}
+
+void usage()
+{
+    std::cerr << "usage: stc_bus_plan <file.dbc> [-b baud] [-B template_base]\n"
+                 "                    [-N nodes] [-f first_node_id] [-s id_stride] [-c nodes_file]\n"
+                 "                    [-p period_ms] [-j jitter_ms] [-P offset=period_ms]...\n"
+                 "                    [--sim seconds] [--seed n] [--stuff worst|random] [--summary]\n";
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    Options opt;
+    std::string dbc;
+
+    for (int i = 1; i < argc; ++i) {
+        const std::string a = argv[i];
+        const bool has_value = i + 1 < argc;
+        if (a == "--summary") {
+            opt.summary = true;
+        } else if (has_value && (a == "-b" || a == "-B" || a == "-N" || a == "-f" || a == "-s" ||
+                                 a == "-p" || a == "-j" || a == "-c" || a == "-P" || a == "--sim" ||
+                                 a == "--seed" || a == "--stuff")) {
+            const char *v = argv[++i];
+            if (a == "-b") opt.baud = static_cast<uint32_t>(std::strtoul(v, nullptr, 0));
+            if (a == "-B") opt.template_base = static_cast<uint32_t>(std::strtoul(v, nullptr, 0));
+            if (a == "-N") opt.nodes = static_cast<uint32_t>(std::strtoul(v, nullptr, 0));
+            if (a == "-f") opt.first_node = static_cast<uint32_t>(std::strtoul(v, nullptr, 0));
+            if (a == "-s") opt.stride = static_cast<uint32_t>(std::strtoul(v, nullptr, 0));
+            if (a == "-p") opt.period_ms = std::strtod(v, nullptr);
+            if (a == "-j") opt.jitter_ms = std::strtod(v, nullptr);
+            if (a == "-c") opt.nodes_file = v;
+            if (a == "--sim") opt.sim_s = std::strtod(v, nullptr);
+            if (a == "--seed") opt.seed = static_cast<uint32_t>(std::strtoul(v, nullptr, 0));
+            if (a == "--stuff") opt.random_stuff = (std::string(v) == "random");
+            if (a == "-P") {
+                const std::string s = v;
+                const size_t eq = s.find('=');
+                if (eq == std::string::npos) {
+                    usage();
+                    return 2;
+                }
+                opt.period_override[static_cast<uint32_t>(std::strtoul(s.substr(0, eq).c_str(), nullptr, 0))] =
+                    std::strtod(s.c_str() + eq + 1, nullptr);
+            }
+        } else if (dbc.empty() && a[0] != '-') {
+            dbc = a;
+        } else {
+            usage();
+            return 2;
+        }
+    }
+    if (dbc.empty() || opt.baud == 0u || opt.period_ms <= 0.0) {
+        usage();
+        return 2;
+    }
+
+    std::string err;
+    std::vector<TemplateMsg> tmpl;
+    std::vector<Node> nodes;
+    if (!load_dbc(dbc, opt.template_base, tmpl, err) ||
+        (!opt.nodes_file.empty() && !load_nodes(opt.nodes_file, nodes, err))) {
+        std::cerr << "stc_bus_plan: " << err << "\n";
+        return 1;
+    }
+    if (opt.nodes_file.empty()) {
+        for (uint32_t k = 0; k < opt.nodes; ++k) {
+            nodes.push_back(Node{ opt.first_node + k * opt.stride, opt.period_ms, opt.jitter_ms });
+        }
+    }
+    if (nodes.empty()) {
+        std::cerr << "stc_bus_plan: no nodes\n";
+        return 1;
+    }
+
+    const auto t0 = std::chrono::steady_clock::now();
+    std::vector<Message> msgs = build_messages(tmpl, nodes, opt);
+    const uint32_t conflict = id_conflict(msgs);
+    if (conflict != 0u) {
+        std::cerr << "stc_bus_plan: identifier 0x" << std::hex << conflict
+                  << " is used twice or exceeds 11 bits; increase the node ID stride\n";
+        return 1;
+    }
+    const bool ok = analyse(msgs, 1);
+
+    std::vector<Node> sug_nodes = suggest_ids(nodes, tmpl, opt);
+    std::vector<Message> sug = build_messages(tmpl, sug_nodes, opt);
+    const bool sug_ok = analyse(sug, 1);
+    const std::vector<uint32_t> phases = suggest_phases(sug, sug_nodes.size(), opt.baud);
+    const auto t1 = std::chrono::steady_clock::now();
+
+    std::printf("%zu nodes, %zu messages, %u bit/s, analysis %.2f ms\n", nodes.size(), msgs.size(),
+                opt.baud, std::chrono::duration<double, std::milli>(t1 - t0).count());
+
+    if (opt.sim_s > 0.0) {
+        validate(msgs, opt, "configured IDs, zero phase");
+    }
+    if (!opt.summary) {
+        print_table(msgs, nodes, opt.baud, opt.sim_s > 0.0);
+    }
+    print_summary("configured", summarise(msgs, ok), opt.baud);
+
+    if (!opt.summary) {
+        std::printf("\nsuggested node IDs (D-J monotonic) and phases:\n");
+        for (size_t n = 0; n < sug_nodes.size(); ++n) {
+            std::printf("  node 0x%03X -> 0x%03X  phase %u ms\n", nodes[n].node_id, sug_nodes[n].node_id,
+                        phases[n]);
+        }
+    }
+    if (id_conflict(sug) == 0u) {
+        print_summary("suggested", summarise(sug, sug_ok), opt.baud);
+    }
+    if (opt.sim_s > 0.0) {
+        for (Message &m : sug) {
+            m.phase = ms_to_bits(phases[m.node], opt.baud);
+        }
+        validate(sug, opt, "suggested IDs and phases");
+    }
+    return ok ? 0 : 3;
+}
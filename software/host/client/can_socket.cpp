@@ -0,0 +1,196 @@
+/* can_socket.cpp
+ *
+ * Batched, non-blocking raw CAN socket I/O for the client library.
+ */
+
+#include "can_socket.h"
+
+#include <cerrno>
+#include <cstring>
+#include <ctime>
+#include <fcntl.h>
+#include <linux/can.h>
+#include <linux/can/raw.h>
+#include <net/if.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#ifndef SO_RXQ_OVFL
+#define SO_RXQ_OVFL 40
+#endif
+
+namespace stc {
+
+namespace {
+
+int64_t realtime_ns()
+{
+    timespec ts{};
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return static_cast<int64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+} // namespace
+
+CanSocket::~CanSocket()
+{
+    if (fd_ >= 0) ::close(fd_);
+}
+
+bool CanSocket::open(const std::string &ifname, std::string &err)
+{
+    const int fd = ::socket(PF_CAN, SOCK_RAW | SOCK_NONBLOCK | SOCK_CLOEXEC, CAN_RAW);
+    if (fd < 0) {
+        err = std::string("socket(PF_CAN): ") + std::strerror(errno);
+        return false;
+    }
+    ifreq ifr{};
+    std::strncpy(ifr.ifr_name, ifname.c_str(), IFNAMSIZ - 1);
+    if (::ioctl(fd, SIOCGIFINDEX, &ifr) < 0) {
+        err = ifname + ": " + std::strerror(errno);
+        ::close(fd);
+        return false;
+    }
+    sockaddr_can addr{};
+    addr.can_family = AF_CAN;
+    addr.can_ifindex = ifr.ifr_ifindex;
+    if (::bind(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) < 0) {
+        err = ifname + ": bind: " + std::strerror(errno);
+        ::close(fd);
+        return false;
+    }
+    name_ = ifname;
+    fd_ = fd;
+    return setup(err);
+}
+
+bool CanSocket::attach(int fd, std::string &err)
+{
+    const int flags = ::fcntl(fd, F_GETFL);
+    if (flags < 0 || ::fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0) {
+        err = std::string("fcntl: ") + std::strerror(errno);
+        return false;
+    }
+    name_ = "fd" + std::to_string(fd);
+    fd_ = fd;
+    return setup(err);
+}
+
+bool CanSocket::setup(std::string &err)
+{
+    const int on = 1;
+    if (::setsockopt(fd_, SOL_SOCKET, SO_TIMESTAMPNS, &on, sizeof(on)) < 0) {
+        err = std::string("SO_TIMESTAMPNS: ") + std::strerror(errno);
+        return false;
+    }
+    /* Both are best effort: a plain socketpair has no drop counter, and the
+     * kernel caps the buffer at rmem_max. */
+    (void)::setsockopt(fd_, SOL_SOCKET, SO_RXQ_OVFL, &on, sizeof(on));
+    (void)::setsockopt(fd_, SOL_SOCKET, SO_RCVBUF, &RCVBUF, sizeof(RCVBUF));
+    return true;
+}
+
+size_t CanSocket::receive(std::vector<CanFrame> &out)
+{
+    size_t total = 0;
+    can_frame frames[BATCH];
+    iovec iov[BATCH];
+    mmsghdr msgs[BATCH];
+    alignas(cmsghdr) char ctrl[BATCH][CMSG_SPACE(sizeof(timespec)) + CMSG_SPACE(sizeof(uint32_t))];
+
+    for (;;) {
+        for (size_t i = 0; i < BATCH; ++i) {
+            iov[i].iov_base = &frames[i];
+            iov[i].iov_len = sizeof(can_frame);
+            std::memset(&msgs[i], 0, sizeof(mmsghdr));
+            msgs[i].msg_hdr.msg_iov = &iov[i];
+            msgs[i].msg_hdr.msg_iovlen = 1;
+            msgs[i].msg_hdr.msg_control = ctrl[i];
+            msgs[i].msg_hdr.msg_controllen = sizeof(ctrl[i]);
+        }
+        const int n = ::recvmmsg(fd_, msgs, BATCH, MSG_DONTWAIT, nullptr);
+        if (n <= 0) {
+            break;
+        }
+        for (int i = 0; i < n; ++i) {
+            int64_t t_ns = 0;
+            for (cmsghdr *c = CMSG_FIRSTHDR(&msgs[i].msg_hdr); c != nullptr;
+                 c = CMSG_NXTHDR(&msgs[i].msg_hdr, c)) {
+                if (c->cmsg_level != SOL_SOCKET) continue;
+                if (c->cmsg_type == SCM_TIMESTAMPNS) {
+                    timespec ts{};
+                    std::memcpy(&ts, CMSG_DATA(c), sizeof(ts));
+                    t_ns = static_cast<int64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+                } else if (c->cmsg_type == SO_RXQ_OVFL) {
+                    uint32_t drops = 0;
+                    std::memcpy(&drops, CMSG_DATA(c), sizeof(drops));
+                    stats_.rx_dropped += static_cast<uint32_t>(drops - kernel_drops_);
+                    kernel_drops_ = drops;
+                }
+            }
+            const can_frame &cf = frames[i];
+            if (msgs[i].msg_len != sizeof(can_frame) || (cf.can_id & (CAN_EFF_FLAG | CAN_ERR_FLAG)) != 0u) {
+                stats_.rx_ignored++;
+                continue;
+            }
+            CanFrame f;
+            f.id = static_cast<uint16_t>(cf.can_id & CAN_SFF_MASK);
+            f.rtr = (cf.can_id & CAN_RTR_FLAG) != 0u;
+            f.dlc = cf.len > 8u ? 8u : cf.len;
+            std::memcpy(f.data, cf.data, 8);
+            f.t_ns = t_ns != 0 ? t_ns : realtime_ns();
+            out.push_back(f);
+            stats_.rx++;
+            total++;
+        }
+        if (static_cast<size_t>(n) < BATCH) {
+            break;
+        }
+    }
+    return total;
+}
+
+void CanSocket::queue(const CanFrame &f)
+{
+    if (out_.size() >= MAX_QUEUED) {
+        stats_.tx_dropped++;
+        return;
+    }
+    out_.push_back(f);
+}
+
+void CanSocket::flush()
+{
+    can_frame frames[BATCH];
+    iovec iov[BATCH];
+    mmsghdr msgs[BATCH];
+
+    while (!out_.empty()) {
+        const size_t n = out_.size() < BATCH ? out_.size() : BATCH;
+        for (size_t i = 0; i < n; ++i) {
+            const CanFrame &f = out_[i];
+            std::memset(&frames[i], 0, sizeof(can_frame));
+            frames[i].can_id = f.id | (f.rtr ? CAN_RTR_FLAG : 0u);
+            frames[i].len = f.dlc > 8u ? 8u : f.dlc;
+            std::memcpy(frames[i].data, f.data, 8);
+            iov[i].iov_base = &frames[i];
+            iov[i].iov_len = sizeof(can_frame);
+            std::memset(&msgs[i], 0, sizeof(mmsghdr));
+            msgs[i].msg_hdr.msg_iov = &iov[i];
+            msgs[i].msg_hdr.msg_iovlen = 1;
+        }
+        const int sent = ::sendmmsg(fd_, msgs, static_cast<unsigned>(n), MSG_DONTWAIT);
+        if (sent <= 0) {
+            if (sent < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != ENOBUFS) {
+                stats_.tx_dropped += out_.size();   /* interface gone: discard */
+                out_.clear();
+            }
+            break;
+        }
+        out_.erase(out_.begin(), out_.begin() + sent);
+        stats_.tx += static_cast<uint64_t>(sent);
+    }
+}
+
+} // namespace stc
@@ -0,0 +1,80 @@
+/* can_socket.h
+ *
+ * Non-blocking Linux SocketCAN socket for the host client library.
+ * Frames are read and written in batches (recvmmsg / sendmmsg). Every
+ * received frame carries its kernel receive timestamp (SO_TIMESTAMPNS,
+ * CLOCK_REALTIME), and frames the kernel dropped because the receive queue
+ * was full are counted (SO_RXQ_OVFL). Waiting is left to the caller's event
+ * loop: poll fd() for input, and for output while pending() is non-zero.
+ */
+
+#ifndef STC_CLIENT_CAN_SOCKET_H
+#define STC_CLIENT_CAN_SOCKET_H
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <vector>
+
+namespace stc {
+
+/* Classic CAN frame with an 11-bit identifier. */
+struct CanFrame {
+    uint16_t id = 0;
+    uint8_t dlc = 0;
+    bool rtr = false;
+    uint8_t data[8] = {};
+    int64_t t_ns = 0;           /* kernel receive time, CLOCK_REALTIME; 0 for TX */
+};
+
+struct SocketStats {
+    uint64_t rx = 0;
+    uint64_t tx = 0;
+    uint64_t rx_ignored = 0;    /* extended, error or FD frames */
+    uint64_t rx_dropped = 0;    /* lost in the kernel (receive queue full) */
+    uint64_t tx_dropped = 0;    /* send queue overflow or interface gone */
+};
+
+class CanSocket {
+public:
+    CanSocket() = default;
+    ~CanSocket();
+    CanSocket(const CanSocket &) = delete;
+    CanSocket &operator=(const CanSocket &) = delete;
+
+    /* Opens a raw CAN socket bound to ifname (e.g. "can0"). */
+    bool open(const std::string &ifname, std::string &err);
+    /* Takes over an already open datagram socket carrying struct can_frame. */
+    bool attach(int fd, std::string &err);
+
+    /* Reads everything that is pending without blocking; appends to out and returns the count. */
+    size_t receive(std::vector<CanFrame> &out);
+    /* Queues a frame for the next flush(). */
+    void queue(const CanFrame &f);
+    /* Writes queued frames without blocking; keeps what the socket did not take. */
+    void flush();
+    /* Frames still queued after the last flush(). */
+    size_t pending() const { return out_.size(); }
+
+    int fd() const { return fd_; }
+    const std::string &name() const { return name_; }
+    const SocketStats &stats() const { return stats_; }
+
+private:
+    bool setup(std::string &err);
+
+    static constexpr size_t BATCH = 64u;
+    static constexpr size_t MAX_QUEUED = 65536u;
+    static constexpr int RCVBUF = 1 << 20;
+
+    int fd_ = -1;
+    std::string name_;
+    std::deque<CanFrame> out_;
+    uint32_t kernel_drops_ = 0;     /* last SO_RXQ_OVFL counter */
+    SocketStats stats_;
+};
+
+} // namespace stc
+
+#endif
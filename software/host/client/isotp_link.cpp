@@ -0,0 +1,201 @@
+/* isotp_link.cpp
+ *
+ * Tester-side ISO-TP segmentation, reassembly and flow control.
+ */
+
+#include "isotp_link.h"
+
+#include <algorithm>
+#include <climits>
+#include <cstring>
+
+namespace stc {
+
+namespace {
+
+constexpr uint8_t PCI_SF = 0x0u;
+constexpr uint8_t PCI_FF = 0x1u;
+constexpr uint8_t PCI_CF = 0x2u;
+constexpr uint8_t PCI_FC = 0x3u;
+
+constexpr uint8_t FC_CTS = 0x0u;
+constexpr uint8_t FC_WAIT = 0x1u;
+constexpr uint8_t FC_OVFLW = 0x2u;
+
+IsoTpFrame &new_frame(std::vector<IsoTpFrame> &out)
+{
+    out.emplace_back();
+    IsoTpFrame &f = out.back();
+    std::memset(f.data, IsoTpLink::PADDING, sizeof(f.data));
+    return f;
+}
+
+/* STmin 0x00..0x7F is in ms, 0xF1..0xF9 is 100..900 us; reserved values mean 127 ms. */
+int64_t st_min_ns(uint8_t v)
+{
+    if (v <= 0x7Fu) return static_cast<int64_t>(v) * 1000000;
+    if (v >= 0xF1u && v <= 0xF9u) return static_cast<int64_t>(v - 0xF0u) * 100000;
+    return 127000000;
+}
+
+} // namespace
+
+void IsoTpLink::reset()
+{
+    tx_state_ = TxState::Idle;
+    tx_.clear();
+    rx_active_ = false;
+    rx_.clear();
+}
+
+bool IsoTpLink::send(const uint8_t *data, size_t len, int64_t now, std::vector<IsoTpFrame> &out)
+{
+    if (len == 0u || len > MAX_LEN) {
+        return false;
+    }
+    rx_active_ = false;
+    rx_.clear();
+    if (len <= 7u) {
+        IsoTpFrame &f = new_frame(out);
+        f.data[0] = static_cast<uint8_t>((PCI_SF << 4) | len);
+        std::memcpy(&f.data[1], data, len);
+        tx_state_ = TxState::Idle;
+        return true;
+    }
+    tx_.assign(data, data + len);
+    IsoTpFrame &f = new_frame(out);
+    f.data[0] = static_cast<uint8_t>((PCI_FF << 4) | (len >> 8));
+    f.data[1] = static_cast<uint8_t>(len & 0xFFu);
+    std::memcpy(&f.data[2], data, 6);
+    tx_pos_ = 6u;
+    tx_sn_ = 1u;
+    tx_state_ = TxState::WaitFc;
+    tx_next_ = now + N_BS_NS;
+    return true;
+}
+
+void IsoTpLink::send_cfs(int64_t now, std::vector<IsoTpFrame> &out)
+{
+    while (tx_state_ == TxState::SendCf && now >= tx_next_) {
+        const size_t chunk = std::min<size_t>(7u, tx_.size() - tx_pos_);
+        IsoTpFrame &f = new_frame(out);
+        f.data[0] = static_cast<uint8_t>((PCI_CF << 4) | tx_sn_);
+        std::memcpy(&f.data[1], &tx_[tx_pos_], chunk);
+        tx_pos_ += chunk;
+        tx_sn_ = static_cast<uint8_t>((tx_sn_ + 1u) & 0x0Fu);
+
+        if (tx_pos_ >= tx_.size()) {
+            tx_state_ = TxState::Idle;
+            tx_.clear();
+        } else if (block_size_ != 0u && --block_left_ == 0u) {
+            tx_state_ = TxState::WaitFc;
+            tx_next_ = now + N_BS_NS;
+        } else if (st_min_ns_ > 0) {
+            tx_next_ = now + st_min_ns_;
+        }
+    }
+}
+
+IsoTpLink::Result IsoTpLink::on_frame(const uint8_t *data, uint8_t dlc, int64_t now,
+                                      std::vector<IsoTpFrame> &out)
+{
+    if (dlc < 1u) {
+        return Result::Busy;
+    }
+    switch (data[0] >> 4) {
+    case PCI_SF: {
+        const size_t len = data[0] & 0x0Fu;
+        if (len == 0u || len > static_cast<size_t>(dlc - 1u)) {
+            return Result::Busy;
+        }
+        rx_active_ = false;
+        rx_.assign(data + 1, data + 1 + len);
+        return Result::Received;
+    }
+    case PCI_FF: {
+        const size_t len = (static_cast<size_t>(data[0] & 0x0Fu) << 8) | data[1];
+        if (dlc < 8u || len < 8u) {
+            return Result::Busy;
+        }
+        rx_.assign(data + 2, data + 8);
+        rx_len_ = len;
+        rx_sn_ = 1u;
+        rx_active_ = true;
+        rx_deadline_ = now + N_CR_NS;
+        IsoTpFrame &f = new_frame(out);
+        f.data[0] = static_cast<uint8_t>((PCI_FC << 4) | FC_CTS);
+        f.data[1] = 0u;
+        f.data[2] = 0u;
+        return Result::Busy;
+    }
+    case PCI_CF: {
+        if (!rx_active_) {
+            return Result::Busy;
+        }
+        if ((data[0] & 0x0Fu) != rx_sn_) {
+            reset();
+            return Result::Error;
+        }
+        const size_t chunk = std::min<size_t>(rx_len_ - rx_.size(), 7u);
+        if (chunk > static_cast<size_t>(dlc - 1u)) {
+            reset();
+            return Result::Error;
+        }
+        rx_.insert(rx_.end(), data + 1, data + 1 + chunk);
+        rx_sn_ = static_cast<uint8_t>((rx_sn_ + 1u) & 0x0Fu);
+        if (rx_.size() >= rx_len_) {
+            rx_active_ = false;
+            return Result::Received;
+        }
+        rx_deadline_ = now + N_CR_NS;
+        return Result::Busy;
+    }
+    case PCI_FC:
+        if (tx_state_ != TxState::WaitFc || dlc < 3u) {
+            return Result::Busy;
+        }
+        switch (data[0] & 0x0Fu) {
+        case FC_CTS:
+            block_size_ = data[1];
+            block_left_ = data[1];
+            st_min_ns_ = st_min_ns(data[2]);
+            tx_state_ = TxState::SendCf;
+            tx_next_ = now;
+            send_cfs(now, out);
+            return Result::Busy;
+        case FC_WAIT:
+            tx_next_ = now + N_BS_NS;
+            return Result::Busy;
+        case FC_OVFLW:
+        default:
+            reset();
+            return Result::Error;
+        }
+    default:
+        return Result::Busy;
+    }
+}
+
+IsoTpLink::Result IsoTpLink::poll(int64_t now, std::vector<IsoTpFrame> &out)
+{
+    if (tx_state_ == TxState::WaitFc && now >= tx_next_) {
+        reset();
+        return Result::Error;
+    }
+    if (rx_active_ && now >= rx_deadline_) {
+        reset();
+        return Result::Error;
+    }
+    send_cfs(now, out);
+    return Result::Busy;
+}
+
+int64_t IsoTpLink::deadline() const
+{
+    int64_t t = INT64_MAX;
+    if (tx_state_ != TxState::Idle) t = tx_next_;
+    if (rx_active_) t = std::min(t, rx_deadline_);
+    return t;
+}
+
+} // namespace stc
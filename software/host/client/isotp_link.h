@@ -0,0 +1,78 @@
+/* isotp_link.h
+ *
+ * Tester side of one ISO 15765-2 (ISO-TP) connection, without I/O.
+ *
+ * The link turns a request into single / first / consecutive frames and
+ * reassembles the response, answering its first frame with flow control
+ * (BS = 0, STmin = 0). Consecutive frames of a request follow the server's
+ * BS and STmin. Frames to send are appended to a caller-supplied vector of
+ * 8-byte payloads, padded with 0xCC like the firmware's transport; the
+ * caller owns the CAN IDs and the clock (monotonic nanoseconds).
+ */
+
+#ifndef STC_CLIENT_ISOTP_LINK_H
+#define STC_CLIENT_ISOTP_LINK_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace stc {
+
+struct IsoTpFrame {
+    uint8_t data[8];
+};
+
+class IsoTpLink {
+public:
+    enum class Result {
+        Busy,           /* nothing finished yet */
+        Received,       /* a whole response is in message() */
+        Error,          /* overflow, bad sequence or N_Bs / N_Cr timeout; link is idle again */
+    };
+
+    static constexpr size_t MAX_LEN = 4095u;
+    static constexpr uint8_t PADDING = 0xCCu;
+    static constexpr int64_t N_BS_NS = 1000000000;     /* FC wait after a first frame */
+    static constexpr int64_t N_CR_NS = 1000000000;     /* CF wait while receiving */
+
+    /* Drops any transfer in progress. */
+    void reset();
+
+    /* Starts sending a request (1..MAX_LEN bytes); false if len is out of range. */
+    bool send(const uint8_t *data, size_t len, int64_t now, std::vector<IsoTpFrame> &out);
+    /* Feeds one frame received on the response ID. */
+    Result on_frame(const uint8_t *data, uint8_t dlc, int64_t now, std::vector<IsoTpFrame> &out);
+    /* Runs timers: paced consecutive frames and the N_Bs / N_Cr timeouts. */
+    Result poll(int64_t now, std::vector<IsoTpFrame> &out);
+
+    /* Earliest time poll() has work, or INT64_MAX. */
+    int64_t deadline() const;
+    /* True while a request is still being sent. */
+    bool sending() const { return tx_state_ != TxState::Idle; }
+    const std::vector<uint8_t> &message() const { return rx_; }
+
+private:
+    enum class TxState { Idle, WaitFc, SendCf };
+
+    void send_cfs(int64_t now, std::vector<IsoTpFrame> &out);
+
+    TxState tx_state_ = TxState::Idle;
+    std::vector<uint8_t> tx_;
+    size_t tx_pos_ = 0;
+    uint8_t tx_sn_ = 0;
+    uint8_t block_size_ = 0;
+    uint8_t block_left_ = 0;
+    int64_t st_min_ns_ = 0;
+    int64_t tx_next_ = 0;           /* next CF (SendCf) or FC deadline (WaitFc) */
+
+    bool rx_active_ = false;
+    std::vector<uint8_t> rx_;
+    size_t rx_len_ = 0;
+    uint8_t rx_sn_ = 0;
+    int64_t rx_deadline_ = 0;
+};
+
+} // namespace stc
+
+#endif
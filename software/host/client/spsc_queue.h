@@ -0,0 +1,94 @@
+/* spsc_queue.h
+ *
+ * Bounded lock-free single-producer / single-consumer ring.
+ *
+ * One thread calls push(), one other thread calls pop(); neither blocks.
+ * The capacity is rounded up to a power of two. Head and tail live on their
+ * own cache lines and each side keeps a cached copy of the other's index,
+ * so the shared lines are only touched when the ring looks full or empty.
+ */
+
+#ifndef STC_CLIENT_SPSC_QUEUE_H
+#define STC_CLIENT_SPSC_QUEUE_H
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <type_traits>
+
+namespace stc {
+
+template <typename T>
+class SpscQueue {
+    static_assert(std::is_trivially_copyable<T>::value, "SpscQueue holds trivially copyable items");
+
+public:
+    explicit SpscQueue(size_t capacity)
+    {
+        size_t n = 2u;
+        while (n < capacity) n <<= 1;
+        mask_ = n - 1u;
+        items_.reset(new T[n]);
+    }
+    SpscQueue(const SpscQueue &) = delete;
+    SpscQueue &operator=(const SpscQueue &) = delete;
+
+    /* Producer side. Returns false (and drops v) when the ring is full. */
+    bool push(const T &v)
+    {
+        const size_t t = tail_.load(std::memory_order_relaxed);
+        if (t - head_cache_ > mask_) {
+            head_cache_ = head_.load(std::memory_order_acquire);
+            if (t - head_cache_ > mask_) return false;
+        }
+        items_[t & mask_] = v;
+        tail_.store(t + 1u, std::memory_order_release);
+        return true;
+    }
+
+    /* Consumer side. Returns false when the ring is empty. */
+    bool pop(T &v)
+    {
+        const size_t h = head_.load(std::memory_order_relaxed);
+        if (h == tail_cache_) {
+            tail_cache_ = tail_.load(std::memory_order_acquire);
+            if (h == tail_cache_) return false;
+        }
+        v = items_[h & mask_];
+        head_.store(h + 1u, std::memory_order_release);
+        return true;
+    }
+
+    /* Consumer side: pops up to max items into out; returns the count. */
+    size_t pop_bulk(T *out, size_t max)
+    {
+        const size_t h = head_.load(std::memory_order_relaxed);
+        tail_cache_ = tail_.load(std::memory_order_acquire);
+        size_t n = tail_cache_ - h;
+        if (n > max) n = max;
+        for (size_t i = 0; i < n; ++i) out[i] = items_[(h + i) & mask_];
+        head_.store(h + n, std::memory_order_release);
+        return n;
+    }
+
+    /* Approximate fill level; exact only when called from one side while the other is idle. */
+    size_t size() const
+    {
+        return tail_.load(std::memory_order_acquire) - head_.load(std::memory_order_acquire);
+    }
+    size_t capacity() const { return mask_ + 1u; }
+
+private:
+    static constexpr size_t LINE = 64u;
+
+    alignas(LINE) std::atomic<size_t> head_{0};
+    size_t tail_cache_ = 0;             /* consumer's view of tail_ */
+    alignas(LINE) std::atomic<size_t> tail_{0};
+    size_t head_cache_ = 0;             /* producer's view of head_ */
+    alignas(LINE) size_t mask_ = 0;
+    std::unique_ptr<T[]> items_;
+};
+
+} // namespace stc
+
+#endif
@@ -0,0 +1,1117 @@
+/* stc_client.cpp
+ *
+ * Event loop, sample decoding, the UDS request pipeline, the windowed
+ * configuration command pipeline and paced broadcasts of stc::Client.
+ */
+
+#include "stc_client.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+namespace stc {
+
+namespace {
+
+/* Frame kinds in the routing table; the value is the ID offset from node_id. */
+constexpr uint32_t KIND_DATA1 = 0x1u;
+constexpr uint32_t KIND_DATA2 = 0x2u;
+constexpr uint32_t KIND_STATUS = 0x3u;
+constexpr uint32_t KIND_DATA4 = 0x4u;
+constexpr uint32_t KIND_CMD_REPLY = 0x6u;
+constexpr uint16_t CMD_OFFSET = 0x5u;
+constexpr uint32_t KIND_RESPONSE = 0xAu;
+constexpr uint16_t REQUEST_OFFSET = 0x9u;
+
+constexpr uint8_t SID_NEGATIVE = 0x7Fu;
+constexpr uint8_t NRC_RESPONSE_PENDING = 0x78u;
+constexpr uint8_t POSITIVE_OFFSET = 0x40u;
+
+/* Configuration commands (firmware cmd_module.h). */
+constexpr uint8_t CMD_GET_VALUE = 0x05u;
+constexpr uint8_t CMD_SYNC = 0x10u;
+constexpr uint8_t CMD_BEGIN = 0x11u;
+constexpr uint8_t CMD_COMMIT = 0x12u;
+constexpr uint8_t CMD_ABORT = 0x13u;
+constexpr uint8_t CMD_FLAG_WINDOWED = 0x80u;
+constexpr uint8_t CMD_FLAG_ACK_REQ = 0x40u;
+constexpr uint8_t CMD_RSP_ACK = 0x80u;
+constexpr uint8_t CMD_RSP_VALUE = 0x81u;
+constexpr uint32_t CMD_WINDOW_MAX = 32u;
+
+/* Commands that change the node's sequence or transaction state go alone:
+ * sent once everything before them is acked, and nothing follows until they are. */
+bool is_fence(uint8_t code)
+{
+    return code >= CMD_SYNC;
+}
+
+/* Consecutive CRC errors after which an Auto node's layout is detected again. */
+constexpr uint32_t AUTO_CRC_LIMIT = 16u;
+
+int64_t mono_ns()
+{
+    timespec ts{};
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<int64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+uint16_t be16(const uint8_t *p)
+{
+    return static_cast<uint16_t>((p[0] << 8) | p[1]);
+}
+
+/* CRC-8 SAE J1850 (poly 0x1D, init 0xFF, xor-out 0xFF) over the ID and bytes
+ * 1..7; must match e2e_crc8() in pdo_module.c. */
+uint8_t e2e_crc8(uint16_t id, const uint8_t *d)
+{
+    static const auto table = [] {
+        struct { uint8_t v[256]; } t{};
+        for (unsigned i = 0; i < 256u; ++i) {
+            uint8_t c = static_cast<uint8_t>(i);
+            for (int b = 0; b < 8; ++b) {
+                c = (c & 0x80u) ? static_cast<uint8_t>((c << 1) ^ 0x1Du) : static_cast<uint8_t>(c << 1);
+            }
+            t.v[i] = c;
+        }
+        return t;
+    }();
+    uint8_t crc = 0xFFu;
+    crc = table.v[crc ^ static_cast<uint8_t>(id & 0xFFu)];
+    crc = table.v[crc ^ static_cast<uint8_t>(id >> 8)];
+    for (int i = 1; i < 8; ++i) {
+        crc = table.v[crc ^ d[i]];
+    }
+    return static_cast<uint8_t>(crc ^ 0xFFu);
+}
+
+uint64_t pack_status(const uint8_t *d)
+{
+    uint64_t v = 0;
+    for (int i = 0; i < 8; ++i) v = (v << 8) | d[i];
+    return v;
+}
+
+void bump(std::atomic<uint64_t> &c, uint64_t n = 1u)
+{
+    /* Single writer (the loop thread): a plain store is enough. */
+    c.store(c.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+}
+
+} // namespace
+
+const char *to_string(Reply::Status s)
+{
+    switch (s) {
+    case Reply::Status::Ok: return "ok";
+    case Reply::Status::Negative: return "negative";
+    case Reply::Status::Timeout: return "timeout";
+    case Reply::Status::Transport: return "transport error";
+    case Reply::Status::Invalid: return "invalid response";
+    case Reply::Status::Rejected: return "rejected";
+    case Reply::Status::Cancelled: return "cancelled";
+    }
+    return "?";
+}
+
+struct Client::Pending {
+    size_t node = 0;
+    std::vector<uint8_t> req;
+    size_t echo = 0;                /* request bytes after the SID the response repeats */
+    bool strip = false;             /* drop SID and echo from Reply::data */
+    std::promise<Reply> promise;
+    int64_t sent_ns = 0;
+};
+
+struct Client::CmdJob {
+    size_t node = 0;
+    std::vector<Command> cmds;
+    bool txn = false;
+    std::promise<Reply> promise;
+    size_t open = 0;                /* slots not completed yet */
+    Reply::Status status = Reply::Status::Ok;
+    std::vector<uint8_t> data;
+    int64_t sent_ns = 0;            /* first frame sent */
+};
+
+struct Client::Broadcast {
+    std::vector<CanFrame> frames;
+    int64_t gap_ns = 0;
+    size_t next = 0;
+    int64_t due = 0;                /* send time of frames[next] */
+    int64_t start_ns = 0;           /* 0 until the first frame */
+    std::promise<Reply> promise;
+};
+
+/* One command frame of a job (or the SYNC of the pipeline, without a job). */
+struct Client::CmdSlot {
+    Command cmd;
+    std::shared_ptr<CmdJob> job;
+    uint8_t seq = 0;
+    uint32_t tries = 0;
+    int64_t deadline = INT64_MAX;
+};
+
+struct Client::Node {
+    explicit Node(const NodeConfig &c) : cfg(c), queue(c.queue_depth) {}
+
+    NodeConfig cfg;
+    SpscQueue<Sample> queue;
+
+    /* Decoding state (loop thread). */
+    Layout layout = Layout::Plain;  /* effective layout; Auto while detecting */
+    bool seen_data1 = false;        /* Auto: a +1 frame since detection started */
+    uint32_t crc_run = 0;
+    Sample cur;
+    bool have_alive[3] = {};
+    uint8_t last_alive[3] = {};
+
+    /* Command pipeline (loop thread). */
+    IsoTpLink link;
+    std::deque<std::unique_ptr<Pending>> waiting;
+    std::unique_ptr<Pending> active;
+    int64_t deadline = INT64_MAX;   /* P2 / P2*, armed once the request is sent */
+
+    /* Configuration command pipeline (loop thread). */
+    std::deque<CmdSlot> cmd_queue;  /* not sent yet */
+    std::deque<CmdSlot> cmd_flight; /* sent, in sequence order */
+    size_t cmd_jobs = 0;            /* jobs queued or in flight */
+    bool cmd_synced = false;
+    uint8_t cmd_seq = 0;
+
+    /* Read by other threads. */
+    std::atomic<uint64_t> frames{0};
+    std::atomic<uint64_t> samples{0};
+    std::atomic<uint64_t> partial{0};
+    std::atomic<uint64_t> overruns{0};
+    std::atomic<uint64_t> crc_errors{0};
+    std::atomic<uint64_t> lost{0};
+    std::atomic<uint64_t> duplicates{0};
+    std::atomic<uint64_t> requests{0};
+    std::atomic<uint64_t> negative{0};
+    std::atomic<uint64_t> timeouts{0};
+    std::atomic<uint64_t> errors{0};
+    std::atomic<uint64_t> retransmits{0};
+    std::atomic<uint64_t> status_word{0};
+    std::atomic<int64_t> status_t{0};
+};
+
+Client::Client() : route_(ID_COUNT, NO_ROUTE) {}
+
+Client::~Client()
+{
+    stop();
+    cancel_all();
+    if (wake_ >= 0) ::close(wake_);
+    if (epoll_ >= 0) ::close(epoll_);
+}
+
+bool Client::open(const std::string &ifname, std::string &err)
+{
+    return sock_.open(ifname, err) && setup(err);
+}
+
+bool Client::attach(int fd, std::string &err)
+{
+    return sock_.attach(fd, err) && setup(err);
+}
+
+bool Client::setup(std::string &err)
+{
+    epoll_ = ::epoll_create1(EPOLL_CLOEXEC);
+    wake_ = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (epoll_ < 0 || wake_ < 0) {
+        err = std::string("epoll / eventfd: ") + std::strerror(errno);
+        return false;
+    }
+    epoll_event ev{};
+    ev.events = EPOLLIN;
+    ev.data.fd = sock_.fd();
+    epoll_event wev{};
+    wev.events = EPOLLIN;
+    wev.data.fd = wake_;
+    if (::epoll_ctl(epoll_, EPOLL_CTL_ADD, sock_.fd(), &ev) < 0 ||
+        ::epoll_ctl(epoll_, EPOLL_CTL_ADD, wake_, &wev) < 0) {
+        err = std::string("epoll_ctl: ") + std::strerror(errno);
+        return false;
+    }
+    return true;
+}
+
+int Client::add_node(const NodeConfig &cfg, std::string &err)
+{
+    if (running_.load()) {
+        err = "add_node() after start()";
+        return -1;
+    }
+    const uint32_t kinds[] = { KIND_DATA1, KIND_DATA2, KIND_STATUS, KIND_DATA4, KIND_CMD_REPLY, KIND_RESPONSE };
+    for (uint32_t k : kinds) {
+        const uint32_t id = cfg.node_id + k;
+        if (id >= ID_COUNT || route_[id] != NO_ROUTE) {
+            char buf[96];
+            std::snprintf(buf, sizeof(buf), "node 0x%03X: ID 0x%03X %s", cfg.node_id, id,
+                          id >= ID_COUNT ? "is not an 11-bit ID" : "overlaps another node");
+            err = buf;
+            return -1;
+        }
+    }
+    const uint32_t index = static_cast<uint32_t>(nodes_.size());
+    for (uint32_t k : kinds) {
+        route_[cfg.node_id + k] = (index << 4) | k;
+    }
+    nodes_.push_back(std::make_unique<Node>(cfg));
+    nodes_.back()->layout = cfg.layout;
+    return static_cast<int>(index);
+}
+
+const NodeConfig &Client::config(size_t node) const
+{
+    return nodes_.at(node)->cfg;
+}
+
+bool Client::start(std::string &err)
+{
+    if (epoll_ < 0) {
+        err = "no socket";
+        return false;
+    }
+    if (running_.exchange(true)) {
+        return true;
+    }
+    stop_.store(false);
+    thread_ = std::thread(&Client::loop, this);
+    return true;
+}
+
+void Client::stop()
+{
+    if (!running_.load()) {
+        return;
+    }
+    stop_.store(true);
+    const uint64_t one = 1u;
+    (void)::write(wake_, &one, sizeof(one));
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+    running_.store(false);
+    cancel_all();
+}
+
+void Client::loop()
+{
+    while (!stop_.load(std::memory_order_relaxed)) {
+        step(-1);
+    }
+}
+
+int64_t Client::next_deadline() const
+{
+    int64_t t = INT64_MAX;
+    for (const auto &n : nodes_) {
+        if (n->active) {
+            t = std::min({ t, n->deadline, n->link.deadline() });
+        }
+        for (const CmdSlot &s : n->cmd_flight) {
+            t = std::min(t, s.deadline);
+        }
+    }
+    if (!bcasts_.empty()) {
+        t = std::min(t, bcasts_.front()->due);
+    }
+    return t;
+}
+
+void Client::step(int timeout_ms)
+{
+    int64_t now = mono_ns();
+    const int64_t deadline = next_deadline();
+    if (deadline != INT64_MAX) {
+        const int64_t ms = deadline <= now ? 0 : (deadline - now + 999999) / 1000000;
+        if (timeout_ms < 0 || ms < timeout_ms) {
+            timeout_ms = static_cast<int>(std::min<int64_t>(ms, INT_MAX));
+        }
+    }
+    epoll_event ev[4];
+    const int n = ::epoll_wait(epoll_, ev, 4, timeout_ms);
+    for (int i = 0; i < n; ++i) {
+        if (ev[i].data.fd == wake_) {
+            uint64_t v = 0;
+            (void)::read(wake_, &v, sizeof(v));
+        }
+    }
+
+    now = mono_ns();
+    take_inbox();
+    rx_.clear();
+    sock_.receive(rx_);
+    for (const CanFrame &f : rx_) {
+        on_frame(f, now);
+    }
+    run_timers(now);
+    for (auto &node : nodes_) {
+        if (!node->active && !node->waiting.empty()) {
+            dispatch(*node, now);
+        }
+        if (!node->cmd_queue.empty()) {
+            pump_commands(*node, now);
+        }
+    }
+    pump_broadcast(now);
+    sock_.flush();
+    update_out_interest();
+
+    const SocketStats &s = sock_.stats();
+    sock_rx_.store(s.rx, std::memory_order_relaxed);
+    sock_tx_.store(s.tx, std::memory_order_relaxed);
+    sock_rx_ignored_.store(s.rx_ignored, std::memory_order_relaxed);
+    sock_rx_dropped_.store(s.rx_dropped, std::memory_order_relaxed);
+    sock_tx_dropped_.store(s.tx_dropped, std::memory_order_relaxed);
+}
+
+void Client::update_out_interest()
+{
+    const bool want = sock_.pending() != 0u;
+    if (want != want_out_) {
+        epoll_event ev{};
+        ev.events = EPOLLIN | (want ? EPOLLOUT : 0u);
+        ev.data.fd = sock_.fd();
+        ::epoll_ctl(epoll_, EPOLL_CTL_MOD, sock_.fd(), &ev);
+        want_out_ = want;
+    }
+}
+
+/* ---- samples ---- */
+
+void Client::on_frame(const CanFrame &f, int64_t now)
+{
+    const uint32_t route = route_[f.id];
+    if (route == NO_ROUTE || f.rtr) {
+        return;
+    }
+    Node &n = *nodes_[route >> 4];
+    const uint32_t kind = route & 0x0Fu;
+    if (kind == KIND_RESPONSE) {
+        on_response(n, f, now);
+        return;
+    }
+    if (kind == KIND_CMD_REPLY) {
+        on_cmd_reply(n, f, now);
+        return;
+    }
+    bump(n.frames);
+    if (kind == KIND_STATUS) {
+        if (f.dlc >= 8u) {
+            n.status_word.store(pack_status(f.data), std::memory_order_relaxed);
+            n.status_t.store(f.t_ns, std::memory_order_release);
+        }
+        return;
+    }
+    if (f.dlc < 8u) {
+        return;
+    }
+    on_data(n, kind, f);
+}
+
+void Client::on_data(Node &n, uint32_t kind, const CanFrame &f)
+{
+    const bool crc_ok = e2e_crc8(f.id, f.data) == f.data[0];
+
+    if (n.cfg.layout == Layout::Auto && n.layout != Layout::E2E) {
+        if (kind == KIND_DATA4 && crc_ok) {
+            n.layout = Layout::E2E;         /* the next +1 frame starts the first sample */
+            n.cur = Sample{};
+            return;
+        }
+        if (n.layout == Layout::Plain || (kind == KIND_DATA1 && n.seen_data1)) {
+            n.layout = Layout::Plain;
+        } else {
+            n.seen_data1 = n.seen_data1 || kind == KIND_DATA1;
+            return;
+        }
+    }
+
+    if (n.layout == Layout::Plain) {
+        if (kind == KIND_DATA1) {
+            if (n.cur.valid != 0u) emit(n);
+            for (int i = 0; i < 4; ++i) n.cur.mv[i] = be16(&f.data[2 * i]);
+            n.cur.valid = 0x0Fu;
+            n.cur.t_ns = f.t_ns;
+        } else if (kind == KIND_DATA2) {
+            for (int i = 0; i < 4; ++i) n.cur.mv[4 + i] = be16(&f.data[2 * i]);
+            n.cur.valid |= 0xF0u;
+            n.cur.t_ns = f.t_ns;
+            emit(n);
+        }
+        return;
+    }
+
+    /* E2E */
+    if (!crc_ok) {
+        bump(n.crc_errors);
+        if (n.cfg.layout == Layout::Auto && ++n.crc_run >= AUTO_CRC_LIMIT) {
+            n.layout = Layout::Auto;        /* the node left E2E mode: detect again */
+            n.seen_data1 = false;
+            n.crc_run = 0;
+            n.cur = Sample{};
+            std::fill(std::begin(n.have_alive), std::end(n.have_alive), false);
+        }
+        return;
+    }
+    n.crc_run = 0;
+    const int slot = kind == KIND_DATA1 ? 0 : kind == KIND_DATA2 ? 1 : 2;
+    const uint8_t alive = f.data[1] & 0x0Fu;
+    if (n.have_alive[slot]) {
+        const uint8_t gap = static_cast<uint8_t>((alive - n.last_alive[slot]) & 0x0Fu);
+        if (gap == 0u) {
+            bump(n.duplicates);
+            return;
+        }
+        if (gap > 1u) bump(n.lost, gap - 1u);
+    }
+    n.have_alive[slot] = true;
+    n.last_alive[slot] = alive;
+
+    if (kind == KIND_DATA1) {
+        if (n.cur.valid != 0u) emit(n);
+        for (int i = 0; i < 3; ++i) n.cur.mv[i] = be16(&f.data[2 + 2 * i]);
+        n.cur.valid = 0x07u;
+    } else if (kind == KIND_DATA2) {
+        for (int i = 0; i < 3; ++i) n.cur.mv[3 + i] = be16(&f.data[2 + 2 * i]);
+        n.cur.valid |= 0x38u;
+    } else {
+        n.cur.mv[6] = be16(&f.data[2]);
+        n.cur.mv[7] = be16(&f.data[4]);
+        n.cur.oor = f.data[6];
+        n.cur.valid |= 0xC0u;
+    }
+    n.cur.t_ns = f.t_ns;
+    n.cur.alive = alive;
+    n.cur.flags = SAMPLE_E2E;
+    if (kind == KIND_DATA4) {
+        emit(n);
+    }
+}
+
+void Client::emit(Node &n)
+{
+    if (n.cur.valid != 0xFFu) bump(n.partial);
+    if (n.queue.push(n.cur)) {
+        bump(n.samples);
+    } else {
+        bump(n.overruns);
+    }
+    n.cur = Sample{};
+}
+
+/* ---- commands ---- */
+
+std::future<Reply> Client::submit(size_t node, std::vector<uint8_t> req, size_t echo, bool strip)
+{
+    auto p = std::make_unique<Pending>();
+    p->node = node;
+    p->req = std::move(req);
+    p->echo = echo;
+    p->strip = strip;
+    std::future<Reply> fut = p->promise.get_future();
+    if (node >= nodes_.size() || p->req.empty() || p->req.size() > IsoTpLink::MAX_LEN) {
+        Reply r;
+        r.status = Reply::Status::Rejected;
+        p->promise.set_value(std::move(r));
+        return fut;
+    }
+    {
+        std::lock_guard<std::mutex> lock(inbox_mutex_);
+        inbox_.push_back(std::move(p));
+    }
+    const uint64_t one = 1u;
+    (void)::write(wake_, &one, sizeof(one));
+    return fut;
+}
+
+std::future<Reply> Client::request(size_t node, std::vector<uint8_t> req)
+{
+    return submit(node, std::move(req), 0u, false);
+}
+
+std::future<Reply> Client::read_did(size_t node, uint16_t did)
+{
+    return submit(node, { 0x22u, static_cast<uint8_t>(did >> 8), static_cast<uint8_t>(did) }, 2u, true);
+}
+
+std::future<Reply> Client::write_did(size_t node, uint16_t did, const std::vector<uint8_t> &value)
+{
+    std::vector<uint8_t> req = { 0x2Eu, static_cast<uint8_t>(did >> 8), static_cast<uint8_t>(did) };
+    req.insert(req.end(), value.begin(), value.end());
+    return submit(node, std::move(req), 2u, true);
+}
+
+std::future<Reply> Client::session(size_t node, uint8_t type)
+{
+    return submit(node, { 0x10u, type }, 1u, true);
+}
+
+std::future<Reply> Client::routine(size_t node, uint8_t control, uint16_t rid, const std::vector<uint8_t> &option)
+{
+    std::vector<uint8_t> req = { 0x31u, control, static_cast<uint8_t>(rid >> 8), static_cast<uint8_t>(rid) };
+    req.insert(req.end(), option.begin(), option.end());
+    return submit(node, std::move(req), 3u, true);
+}
+
+void Client::take_inbox()
+{
+    std::vector<std::unique_ptr<Pending>> batch;
+    std::vector<std::shared_ptr<CmdJob>> jobs;
+    std::vector<std::unique_ptr<Broadcast>> bcasts;
+    {
+        std::lock_guard<std::mutex> lock(inbox_mutex_);
+        batch.swap(inbox_);
+        jobs.swap(cmd_inbox_);
+        bcasts.swap(bcast_inbox_);
+    }
+    for (auto &b : bcasts) {
+        bcasts_.push_back(std::move(b));
+    }
+    for (auto &job : jobs) {
+        Node &n = *nodes_[job->node];
+        if (n.cmd_jobs >= n.cfg.max_queued) {
+            Reply r;
+            r.status = Reply::Status::Rejected;
+            job->promise.set_value(std::move(r));
+            continue;
+        }
+        n.cmd_jobs++;
+        CmdSlot s;
+        s.job = job;
+        if (job->txn) {
+            s.cmd.code = CMD_BEGIN;
+            n.cmd_queue.push_back(s);
+        }
+        for (const Command &c : job->cmds) {
+            s.cmd = c;
+            n.cmd_queue.push_back(s);
+        }
+        if (job->txn) {
+            s.cmd = Command();
+            s.cmd.code = CMD_COMMIT;
+            s.cmd.d[0] = static_cast<uint8_t>(job->cmds.size() >> 8);
+            s.cmd.d[1] = static_cast<uint8_t>(job->cmds.size());
+            n.cmd_queue.push_back(s);
+        }
+        job->open = job->cmds.size() + (job->txn ? 2u : 0u);
+    }
+    for (auto &p : batch) {
+        Node &n = *nodes_[p->node];
+        if (n.waiting.size() >= n.cfg.max_queued) {
+            Reply r;
+            r.status = Reply::Status::Rejected;
+            p->promise.set_value(std::move(r));
+            continue;
+        }
+        n.waiting.push_back(std::move(p));
+    }
+}
+
+void Client::dispatch(Node &n, int64_t now)
+{
+    n.active = std::move(n.waiting.front());
+    n.waiting.pop_front();
+    n.active->sent_ns = now;
+    n.deadline = INT64_MAX;
+    tp_out_.clear();
+    n.link.reset();
+    n.link.send(n.active->req.data(), n.active->req.size(), now, tp_out_);
+    send_isotp(n, now);
+}
+
+/* Sends the link's frames; arms P2 once the whole request is out. */
+void Client::send_isotp(Node &n, int64_t now)
+{
+    for (const IsoTpFrame &tf : tp_out_) {
+        CanFrame f;
+        f.id = static_cast<uint16_t>(n.cfg.node_id + REQUEST_OFFSET);
+        f.dlc = 8u;
+        std::memcpy(f.data, tf.data, 8);
+        sock_.queue(f);
+    }
+    tp_out_.clear();
+    if (n.active && n.deadline == INT64_MAX && !n.link.sending()) {
+        n.deadline = now + static_cast<int64_t>(n.cfg.p2_ms) * 1000000;
+    }
+}
+
+void Client::on_response(Node &n, const CanFrame &f, int64_t now)
+{
+    tp_out_.clear();
+    const IsoTpLink::Result r = n.link.on_frame(f.data, f.dlc, now, tp_out_);
+    if (!n.active) {
+        tp_out_.clear();            /* stray response: drop, and never send flow control for it */
+        return;
+    }
+    send_isotp(n, now);
+    if (r == IsoTpLink::Result::Received) {
+        on_message(n, now);
+    } else if (r == IsoTpLink::Result::Error) {
+        finish(n, Reply::Status::Transport, 0u, now);
+    }
+}
+
+void Client::on_message(Node &n, int64_t now)
+{
+    const std::vector<uint8_t> &rsp = n.link.message();
+    const std::vector<uint8_t> &req = n.active->req;
+    if (rsp.size() >= 3u && rsp[0] == SID_NEGATIVE && rsp[1] == req[0]) {
+        if (rsp[2] == NRC_RESPONSE_PENDING) {
+            n.deadline = now + static_cast<int64_t>(n.cfg.p2_star_ms) * 1000000;
+            return;
+        }
+        finish(n, Reply::Status::Negative, rsp[2], now);
+        return;
+    }
+    const size_t echo = n.active->echo;
+    if (rsp.empty() || rsp[0] != static_cast<uint8_t>(req[0] + POSITIVE_OFFSET) || rsp.size() < 1u + echo ||
+        req.size() < 1u + echo || !std::equal(rsp.begin() + 1, rsp.begin() + 1 + static_cast<long>(echo),
+                                              req.begin() + 1)) {
+        finish(n, Reply::Status::Invalid, 0u, now);
+        return;
+    }
+    finish(n, Reply::Status::Ok, 0u, now);
+}
+
+void Client::finish(Node &n, Reply::Status status, uint8_t nrc, int64_t now)
+{
+    Reply r;
+    r.status = status;
+    r.nrc = nrc;
+    r.rtt_ns = now - n.active->sent_ns;
+    if (status == Reply::Status::Ok) {
+        const std::vector<uint8_t> &rsp = n.link.message();
+        const size_t skip = n.active->strip ? 1u + n.active->echo : 0u;
+        r.data.assign(rsp.begin() + static_cast<long>(skip), rsp.end());
+    }
+    bump(n.requests);
+    if (status == Reply::Status::Negative) bump(n.negative);
+    if (status == Reply::Status::Timeout) bump(n.timeouts);
+    if (status == Reply::Status::Transport || status == Reply::Status::Invalid) bump(n.errors);
+
+    n.active->promise.set_value(std::move(r));
+    n.active.reset();
+    n.deadline = INT64_MAX;
+    n.link.reset();
+}
+
+void Client::run_timers(int64_t now)
+{
+    for (auto &node : nodes_) {
+        Node &n = *node;
+        for (size_t i = 0; i < n.cmd_flight.size();) {
+            CmdSlot &s = n.cmd_flight[i];
+            if (now < s.deadline) {
+                ++i;
+            } else if (s.tries <= n.cfg.cmd_retries) {
+                /* Same sequence number: the node re-acks instead of running it again. */
+                send_command(n, s, true);
+                s.deadline = now + static_cast<int64_t>(n.cfg.cmd_timeout_ms) * 1000000;
+                bump(n.retransmits);
+                ++i;
+            } else {
+                CmdSlot dead = std::move(s);
+                n.cmd_flight.erase(n.cmd_flight.begin() + static_cast<long>(i));
+                complete_command(n, dead, Reply::Status::Timeout, now);
+            }
+        }
+        if (!n.active) {
+            continue;
+        }
+        if (now >= n.link.deadline()) {
+            tp_out_.clear();
+            if (n.link.poll(now, tp_out_) == IsoTpLink::Result::Error) {
+                tp_out_.clear();
+                finish(n, Reply::Status::Transport, 0u, now);
+                continue;
+            }
+            send_isotp(n, now);
+        }
+        if (now >= n.deadline) {
+            finish(n, Reply::Status::Timeout, 0u, now);
+        }
+    }
+}
+
+/* ---- configuration commands ---- */
+
+Command Command::set_baud(uint8_t baud_enum)
+{
+    Command c;
+    c.code = 0x01u;
+    c.d[0] = baud_enum;
+    return c;
+}
+
+Command Command::set_sample_rate(uint16_t hz)
+{
+    Command c;
+    c.code = 0x02u;
+    c.d[0] = static_cast<uint8_t>(hz >> 8);
+    c.d[1] = static_cast<uint8_t>(hz);
+    return c;
+}
+
+Command Command::set_channel(uint8_t ch, bool enable, uint16_t scale_milli, int16_t offset_mv)
+{
+    const uint16_t off = static_cast<uint16_t>(offset_mv);
+    Command c;
+    c.code = 0x03u;
+    c.d[0] = ch;
+    c.d[1] = enable ? 1u : 0u;
+    c.d[2] = static_cast<uint8_t>(scale_milli >> 8);
+    c.d[3] = static_cast<uint8_t>(scale_milli);
+    c.d[4] = static_cast<uint8_t>(off >> 8);
+    c.d[5] = static_cast<uint8_t>(off);
+    return c;
+}
+
+Command Command::set_channel_range(uint8_t ch, uint16_t min_mv, uint16_t max_mv)
+{
+    Command c;
+    c.code = 0x04u;
+    c.d[0] = ch;
+    c.d[1] = static_cast<uint8_t>(min_mv >> 8);
+    c.d[2] = static_cast<uint8_t>(min_mv);
+    c.d[3] = static_cast<uint8_t>(max_mv >> 8);
+    c.d[4] = static_cast<uint8_t>(max_mv);
+    return c;
+}
+
+Command Command::get_value(uint8_t ch, uint8_t selection)
+{
+    Command c;
+    c.code = CMD_GET_VALUE;
+    c.d[0] = ch;
+    c.d[1] = selection;
+    return c;
+}
+
+std::future<Reply> Client::submit_cmd(size_t node, const std::vector<Command> &cmds, bool txn)
+{
+    auto job = std::make_shared<CmdJob>();
+    job->node = node;
+    job->cmds = cmds;
+    job->txn = txn;
+    std::future<Reply> fut = job->promise.get_future();
+    const bool bad_code = std::any_of(cmds.begin(), cmds.end(), [txn](const Command &c) {
+        return c.code == 0u || is_fence(c.code) || (txn && c.code == CMD_GET_VALUE);
+    });
+    if (node >= nodes_.size() || cmds.empty() || bad_code || cmds.size() > UINT16_MAX) {
+        Reply r;
+        r.status = Reply::Status::Rejected;
+        job->promise.set_value(std::move(r));
+        return fut;
+    }
+    {
+        std::lock_guard<std::mutex> lock(inbox_mutex_);
+        cmd_inbox_.push_back(std::move(job));
+    }
+    const uint64_t one = 1u;
+    (void)::write(wake_, &one, sizeof(one));
+    return fut;
+}
+
+std::future<Reply> Client::command(size_t node, const Command &cmd)
+{
+    return submit_cmd(node, { cmd }, false);
+}
+
+std::future<Reply> Client::configure(size_t node, const std::vector<Command> &cmds)
+{
+    return submit_cmd(node, cmds, true);
+}
+
+/* Sends queued commands while the window and the fences allow. */
+void Client::pump_commands(Node &n, int64_t now)
+{
+    if (!n.cmd_synced && n.cmd_flight.empty()) {
+        /* First command, or the node stopped answering: start a fresh sequence. */
+        CmdSlot sync;
+        sync.cmd.code = CMD_SYNC;
+        n.cmd_queue.push_front(sync);
+        n.cmd_synced = true;
+    }
+    const size_t window = std::min<size_t>(std::max<uint32_t>(n.cfg.cmd_window, 1u), CMD_WINDOW_MAX);
+    const size_t first = n.cmd_flight.size();
+    while (!n.cmd_queue.empty() && n.cmd_flight.size() < window) {
+        CmdSlot &s = n.cmd_queue.front();
+        if (!n.cmd_flight.empty() && (is_fence(s.cmd.code) || is_fence(n.cmd_flight.back().cmd.code))) {
+            break;
+        }
+        if (s.job && s.job->txn && s.job->status != Reply::Status::Ok) {
+            /* The transaction failed: skip the rest and abort instead of committing. */
+            if (s.cmd.code != CMD_COMMIT) {
+                CmdSlot skipped = std::move(s);
+                n.cmd_queue.pop_front();
+                complete_command(n, skipped, Reply::Status::Ok, now);
+                continue;
+            }
+            s.cmd = Command();
+            s.cmd.code = CMD_ABORT;
+        }
+        s.seq = n.cmd_seq++;
+        s.deadline = now + static_cast<int64_t>(n.cfg.cmd_timeout_ms) * 1000000;
+        if (s.job && s.job->sent_ns == 0) {
+            s.job->sent_ns = now;
+        }
+        n.cmd_flight.push_back(std::move(s));
+        n.cmd_queue.pop_front();
+    }
+    /* The last frame of the burst asks for the ack at once. */
+    for (size_t i = first; i < n.cmd_flight.size(); ++i) {
+        send_command(n, n.cmd_flight[i], i + 1u == n.cmd_flight.size());
+    }
+}
+
+void Client::send_command(Node &n, CmdSlot &s, bool ack_req)
+{
+    CanFrame f;
+    f.id = static_cast<uint16_t>(n.cfg.node_id + CMD_OFFSET);
+    f.dlc = 8u;
+    f.data[0] = static_cast<uint8_t>(CMD_FLAG_WINDOWED | (ack_req ? CMD_FLAG_ACK_REQ : 0u) | s.cmd.code);
+    f.data[1] = s.seq;
+    std::memcpy(&f.data[2], s.cmd.d, 6);
+    sock_.queue(f);
+    s.tries++;
+}
+
+void Client::on_cmd_reply(Node &n, const CanFrame &f, int64_t now)
+{
+    if (f.dlc < 8u) {
+        return;
+    }
+    auto find = [&n](uint8_t seq) {
+        return std::find_if(n.cmd_flight.begin(), n.cmd_flight.end(),
+                            [seq](const CmdSlot &s) { return s.seq == seq; });
+    };
+    if (f.data[0] == CMD_RSP_VALUE) {
+        auto it = find(f.data[1]);
+        if (it != n.cmd_flight.end() && it->cmd.code == CMD_GET_VALUE && it->cmd.d[0] == f.data[3] &&
+            it->cmd.d[1] == f.data[4]) {
+            CmdSlot s = std::move(*it);
+            n.cmd_flight.erase(it);
+            if (f.data[2] != 0u) {
+                s.job->data.assign(&f.data[5], &f.data[7]);
+            }
+            complete_command(n, s, f.data[2] != 0u ? Reply::Status::Ok : Reply::Status::Negative, now);
+        }
+        return;
+    }
+    if (f.data[0] != CMD_RSP_ACK) {
+        return;
+    }
+    const uint32_t bits = (static_cast<uint32_t>(f.data[4]) << 24) | (static_cast<uint32_t>(f.data[5]) << 16) |
+                          (static_cast<uint32_t>(f.data[6]) << 8) | f.data[7];
+    const uint32_t count = std::min<uint32_t>(f.data[2], CMD_WINDOW_MAX);
+    for (uint32_t i = 0; i < count; ++i) {
+        auto it = find(static_cast<uint8_t>(f.data[1] + i));
+        if (it == n.cmd_flight.end() || it->cmd.code == CMD_GET_VALUE) {
+            continue;               /* stale, or answered by its value frame */
+        }
+        CmdSlot s = std::move(*it);
+        n.cmd_flight.erase(it);
+        complete_command(n, s, ((bits >> i) & 1u) != 0u ? Reply::Status::Ok : Reply::Status::Negative, now);
+    }
+}
+
+void Client::complete_command(Node &n, CmdSlot &s, Reply::Status status, int64_t now)
+{
+    if (!s.job) {
+        if (status != Reply::Status::Ok) {
+            /* SYNC lost: the node is not answering; fail everything queued. */
+            n.cmd_synced = false;
+            std::deque<CmdSlot> queued;
+            queued.swap(n.cmd_queue);
+            for (CmdSlot &q : queued) {
+                complete_command(n, q, Reply::Status::Timeout, now);
+            }
+        }
+        return;
+    }
+    CmdJob &job = *s.job;
+    if (job.open == 0u) {
+        return;
+    }
+    /* An ABORT only cleans up after the failure already recorded. */
+    if (status != Reply::Status::Ok && job.status == Reply::Status::Ok && s.cmd.code != CMD_ABORT) {
+        job.status = status;
+    }
+    if (--job.open != 0u) {
+        return;
+    }
+    Reply r;
+    r.status = job.status;
+    r.rtt_ns = now - job.sent_ns;
+    if (r.status == Reply::Status::Ok) {
+        r.data = std::move(job.data);
+    }
+    bump(n.requests);
+    if (r.status == Reply::Status::Negative) bump(n.negative);
+    if (r.status == Reply::Status::Timeout) bump(n.timeouts);
+    n.cmd_jobs--;
+    job.promise.set_value(std::move(r));
+}
+
+void Client::cancel_all()
+{
+    std::vector<std::unique_ptr<Pending>> all;
+    {
+        std::lock_guard<std::mutex> lock(inbox_mutex_);
+        all.swap(inbox_);
+    }
+    std::vector<std::shared_ptr<CmdJob>> jobs;
+    {
+        std::lock_guard<std::mutex> lock(inbox_mutex_);
+        jobs.swap(cmd_inbox_);
+        for (auto &b : bcast_inbox_) {
+            bcasts_.push_back(std::move(b));
+        }
+        bcast_inbox_.clear();
+    }
+    for (auto &b : bcasts_) {
+        Reply r;
+        r.status = Reply::Status::Cancelled;
+        b->promise.set_value(std::move(r));
+    }
+    bcasts_.clear();
+    for (auto &node : nodes_) {
+        for (const CmdSlot &s : node->cmd_flight) {
+            if (s.job && s.job->open != 0u) jobs.push_back(s.job);
+        }
+        for (const CmdSlot &s : node->cmd_queue) {
+            if (s.job && s.job->open != 0u) jobs.push_back(s.job);
+        }
+        node->cmd_flight.clear();
+        node->cmd_queue.clear();
+        node->cmd_jobs = 0u;
+        node->cmd_synced = false;
+        if (node->active) all.push_back(std::move(node->active));
+        for (auto &p : node->waiting) all.push_back(std::move(p));
+        node->waiting.clear();
+        node->link.reset();
+        node->deadline = INT64_MAX;
+    }
+    for (auto &p : all) {
+        Reply r;
+        r.status = Reply::Status::Cancelled;
+        p->promise.set_value(std::move(r));
+    }
+    for (auto &job : jobs) {
+        if (job->open != 0u) {
+            job->open = 0u;
+            Reply r;
+            r.status = Reply::Status::Cancelled;
+            job->promise.set_value(std::move(r));
+        }
+    }
+}
+
+/* ---- broadcasts ---- */
+
+std::future<Reply> Client::broadcast(std::vector<CanFrame> frames, uint32_t gap_us)
+{
+    auto b = std::make_unique<Broadcast>();
+    b->frames = std::move(frames);
+    b->gap_ns = static_cast<int64_t>(gap_us) * 1000;
+    std::future<Reply> fut = b->promise.get_future();
+    {
+        std::lock_guard<std::mutex> lock(inbox_mutex_);
+        bcast_inbox_.push_back(std::move(b));
+    }
+    const uint64_t one = 1u;
+    (void)::write(wake_, &one, sizeof(one));
+    return fut;
+}
+
+void Client::pump_broadcast(int64_t now)
+{
+    while (!bcasts_.empty()) {
+        Broadcast &b = *bcasts_.front();
+        if (b.start_ns == 0) {
+            b.start_ns = now;
+            b.due = now;
+        }
+        /* After a late wake-up catch up by a few frames only, so the bus
+         * never sees a long burst. */
+        b.due = std::max(b.due, now - 2 * b.gap_ns);
+        while (b.next < b.frames.size() && b.due <= now) {
+            sock_.queue(b.frames[b.next++]);
+            b.due += b.gap_ns;
+        }
+        if (b.next < b.frames.size()) {
+            return;
+        }
+        Reply r;
+        r.rtt_ns = now - b.start_ns;
+        b.promise.set_value(std::move(r));
+        bcasts_.pop_front();
+    }
+}
+
+/* ---- getters ---- */
+
+SpscQueue<Sample> &Client::samples(size_t node)
+{
+    return nodes_.at(node)->queue;
+}
+
+NodeStats Client::stats(size_t node) const
+{
+    const Node &n = *nodes_.at(node);
+    NodeStats s;
+    s.frames = n.frames.load(std::memory_order_relaxed);
+    s.samples = n.samples.load(std::memory_order_relaxed);
+    s.partial = n.partial.load(std::memory_order_relaxed);
+    s.overruns = n.overruns.load(std::memory_order_relaxed);
+    s.crc_errors = n.crc_errors.load(std::memory_order_relaxed);
+    s.lost = n.lost.load(std::memory_order_relaxed);
+    s.duplicates = n.duplicates.load(std::memory_order_relaxed);
+    s.requests = n.requests.load(std::memory_order_relaxed);
+    s.negative = n.negative.load(std::memory_order_relaxed);
+    s.timeouts = n.timeouts.load(std::memory_order_relaxed);
+    s.errors = n.errors.load(std::memory_order_relaxed);
+    s.retransmits = n.retransmits.load(std::memory_order_relaxed);
+    return s;
+}
+
+DeviceStatus Client::device_status(size_t node) const
+{
+    const Node &n = *nodes_.at(node);
+    DeviceStatus d;
+    /* The word and its time are two stores; a reader racing an update may pair
+     * a new word with the previous time, which is harmless for a status. */
+    d.t_ns = n.status_t.load(std::memory_order_acquire);
+    const uint64_t w = n.status_word.load(std::memory_order_relaxed);
+    d.valid = d.t_ns != 0;
+    d.adc_status = static_cast<uint16_t>(w >> 48);
+    d.uptime_s = static_cast<uint16_t>(w >> 32);
+    d.v_supply_mv = static_cast<uint16_t>(w >> 16);
+    d.fw_version = static_cast<uint16_t>(w);
+    return d;
+}
+
+SocketStats Client::socket_stats() const
+{
+    SocketStats s;
+    s.rx = sock_rx_.load(std::memory_order_relaxed);
+    s.tx = sock_tx_.load(std::memory_order_relaxed);
+    s.rx_ignored = sock_rx_ignored_.load(std::memory_order_relaxed);
+    s.rx_dropped = sock_rx_dropped_.load(std::memory_order_relaxed);
+    s.tx_dropped = sock_tx_dropped_.load(std::memory_order_relaxed);
+    return s;
+}
+
+} // namespace stc
@@ -0,0 +1,267 @@
+/* stc_client.h
+ *
+ * Asynchronous host client for a fleet of signal-to-can nodes on one
+ * SocketCAN interface.
+ *
+ * One event-loop thread (start()) owns the socket. It:
+ *  - decodes the data frames of every node (node_id + 0x1, 0x2 and, with E2E
+ *    protection, 0x4) into one Sample per transmit cycle, and pushes it into
+ *    that node's lock-free single-producer / single-consumer queue;
+ *  - keeps the latest device status frame (node_id + 0x3) per node;
+ *  - runs UDS requests over ISO-TP (node_id + 0x9 / 0xA) and configuration
+ *    commands (node_id + 0x5 / 0x6). Both are submitted from any thread and
+ *    complete a std::future<Reply>.
+ *
+ * Each node has its own command pipeline: up to NodeConfig::max_queued
+ * requests wait behind the outstanding one and are sent back to back from
+ * the loop thread, without a round trip through the caller. The firmware's
+ * ISO-TP transport serves one request at a time, so a node's UDS window is
+ * one; requests to different nodes run in parallel. Each outstanding request
+ * has a P2 response timeout, extended to P2* by NRC 0x78 (response pending).
+ *
+ * Configuration commands use the firmware's windowed protocol: up to
+ * NodeConfig::cmd_window sequence-numbered commands are in flight per node,
+ * the node answers with coalesced acks, and a command whose ack is missing is
+ * sent again with the same sequence number (the node never runs it twice).
+ * configure() wraps commands in a BEGIN / COMMIT transaction, so a node
+ * applies the whole set at once or nothing of it.
+ *
+ * broadcast() sends frames that belong to no node (the multicast image
+ * frames of stc_update.h) at a fixed pace, in between the node traffic.
+ *
+ * Frames are read and written in batches, and a sample costs one queue slot,
+ * so one loop thread keeps up with a fully loaded bus of 50+ nodes.
+ *
+ * Threading: add_node() before start(); samples(n) is consumed by one
+ * thread per node; request() and the stats getters are thread-safe. Without
+ * start(), step() runs one loop pass in the caller's thread instead.
+ */
+
+#ifndef STC_CLIENT_STC_CLIENT_H
+#define STC_CLIENT_STC_CLIENT_H
+
+#include "can_socket.h"
+#include "isotp_link.h"
+#include "spsc_queue.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace stc {
+
+/* Data frame layout of a node (UDS DID 0x0203). */
+enum class Layout : uint8_t {
+    Plain,      /* +1: ch0-3, +2: ch4-7 */
+    E2E,        /* +1: ch0-2, +2: ch3-5, +4: ch6-7 and oor_mask, CRC-8 and alive counter each */
+    Auto,       /* follows the node: E2E on a valid +4 frame, plain after two +1 frames without one */
+};
+
+struct NodeConfig {
+    uint16_t node_id = 0x500;
+    Layout layout = Layout::Auto;
+    size_t queue_depth = 1024;      /* samples buffered for the consumer */
+    uint32_t p2_ms = 250;           /* response timeout */
+    uint32_t p2_star_ms = 5000;     /* response timeout after NRC 0x78 */
+    size_t max_queued = 64;         /* requests waiting behind the outstanding one */
+    uint32_t cmd_window = 4;        /* configuration commands in flight (1..32) */
+    uint32_t cmd_timeout_ms = 50;   /* ack timeout of a configuration command */
+    uint32_t cmd_retries = 3;       /* times a command is sent again before it times out */
+};
+
+/* Configuration command (README command table). */
+struct Command {
+    uint8_t code = 0;
+    uint8_t d[6] = {};
+
+    static Command set_baud(uint8_t baud_enum);         /* 0 125k, 1 250k, 2 500k, 3 1M */
+    static Command set_sample_rate(uint16_t hz);
+    /* V_in = scale_milli / 1000 * V_pin + offset_mv / 1000 */
+    static Command set_channel(uint8_t ch, bool enable, uint16_t scale_milli, int16_t offset_mv);
+    static Command set_channel_range(uint8_t ch, uint16_t min_mv, uint16_t max_mv);
+    /* selection: 0 sample rate, 1 scale, 2 offset, 3 oor_min, 4 oor_max */
+    static Command get_value(uint8_t ch, uint8_t selection);
+};
+
+/* Sample::flags */
+constexpr uint8_t SAMPLE_E2E = 0x01u;       /* decoded from CRC-checked E2E frames */
+
+/* One transmit cycle of a node. */
+struct Sample {
+    int64_t t_ns = 0;               /* receive time of the cycle's last frame, CLOCK_REALTIME */
+    uint16_t mv[8] = {};
+    uint8_t valid = 0;              /* bit per channel present; 0xFF unless frames were lost */
+    uint8_t oor = 0;                /* out-of-range mask (E2E only) */
+    uint8_t flags = 0;
+    uint8_t alive = 0;              /* alive counter of the last frame (E2E only) */
+};
+
+/* Device status frame, node_id + 0x3. */
+struct DeviceStatus {
+    bool valid = false;             /* false until the first frame */
+    int64_t t_ns = 0;
+    uint16_t adc_status = 0;
+    uint16_t uptime_s = 0;
+    uint16_t v_supply_mv = 0;
+    uint16_t fw_version = 0;
+};
+
+struct NodeStats {
+    uint64_t frames = 0;            /* data and status frames */
+    uint64_t samples = 0;
+    uint64_t partial = 0;           /* samples with channels missing */
+    uint64_t overruns = 0;          /* samples dropped because the queue was full */
+    uint64_t crc_errors = 0;
+    uint64_t lost = 0;              /* frames missing from the alive counter sequence */
+    uint64_t duplicates = 0;
+    uint64_t requests = 0;          /* completed, whatever the outcome */
+    uint64_t negative = 0;
+    uint64_t timeouts = 0;
+    uint64_t errors = 0;            /* transport errors and malformed responses */
+    uint64_t retransmits = 0;       /* configuration commands sent again */
+};
+
+struct Reply {
+    enum class Status {
+        Ok,
+        Negative,       /* negative response; nrc holds the code (0 for a command the node rejected) */
+        Timeout,        /* no response within P2 / P2*, or no ack after the retries */
+        Transport,      /* ISO-TP error (overflow, sequence, N_Bs / N_Cr) */
+        Invalid,        /* positive response that does not match the request */
+        Rejected,       /* bad node, bad length or pipeline full */
+        Cancelled,      /* client stopped */
+    };
+
+    Status status = Status::Ok;
+    uint8_t nrc = 0;
+    std::vector<uint8_t> data;      /* see the request functions */
+    int64_t rtt_ns = 0;             /* from sending the request to completion */
+
+    bool ok() const { return status == Status::Ok; }
+};
+
+const char *to_string(Reply::Status s);
+
+class Client {
+public:
+    Client();
+    ~Client();
+    Client(const Client &) = delete;
+    Client &operator=(const Client &) = delete;
+
+    /* Opens a raw CAN socket bound to ifname. */
+    bool open(const std::string &ifname, std::string &err);
+    /* Takes over an already open datagram socket carrying struct can_frame. */
+    bool attach(int fd, std::string &err);
+
+    /* Adds a node; returns its index, or -1 if its IDs overlap another node's or the loop runs. */
+    int add_node(const NodeConfig &cfg, std::string &err);
+    size_t node_count() const { return nodes_.size(); }
+    const NodeConfig &config(size_t node) const;
+
+    /* Starts / stops the event-loop thread. stop() cancels outstanding requests. */
+    bool start(std::string &err);
+    void stop();
+    /* One loop pass in the caller's thread, waiting up to timeout_ms for input. */
+    void step(int timeout_ms);
+
+    /* Sample stream of a node; pop from one consumer thread. */
+    SpscQueue<Sample> &samples(size_t node);
+    NodeStats stats(size_t node) const;
+    DeviceStatus device_status(size_t node) const;
+    SocketStats socket_stats() const;
+
+    /* Raw UDS request; data is the whole positive response. */
+    std::future<Reply> request(size_t node, std::vector<uint8_t> req);
+    /* ReadDataByIdentifier (0x22); data is the DID's value. */
+    std::future<Reply> read_did(size_t node, uint16_t did);
+    /* WriteDataByIdentifier (0x2E); data is empty. */
+    std::future<Reply> write_did(size_t node, uint16_t did, const std::vector<uint8_t> &value);
+    /* DiagnosticSessionControl (0x10); data is the session parameter record. */
+    std::future<Reply> session(size_t node, uint8_t type);
+    /* RoutineControl (0x31); data is the routine status record. */
+    std::future<Reply> routine(size_t node, uint8_t control, uint16_t rid,
+                               const std::vector<uint8_t> &option = {});
+
+    /* Configuration command; data is GET_VALUE's value (2 bytes, big-endian), else empty. */
+    std::future<Reply> command(size_t node, const Command &cmd);
+    /* Applies the commands as one transaction; fails with the first rejected or
+     * lost command, in which case the transaction is aborted and nothing applied.
+     * data is empty. */
+    std::future<Reply> configure(size_t node, const std::vector<Command> &cmds);
+
+    /* Sends the frames in order, one every gap_us (in bursts of up to three
+     * when the loop wakes late); broadcasts queue behind each other. data is
+     * empty; rtt_ns is the time from the first frame to the last. */
+    std::future<Reply> broadcast(std::vector<CanFrame> frames, uint32_t gap_us);
+
+private:
+    struct Node;
+    struct Pending;
+    struct Broadcast;
+    struct CmdJob;
+    struct CmdSlot;
+
+    static constexpr uint16_t ID_COUNT = 0x800u;
+    static constexpr uint32_t NO_ROUTE = UINT32_MAX;
+
+    bool setup(std::string &err);
+    std::future<Reply> submit(size_t node, std::vector<uint8_t> req, size_t echo, bool strip);
+    std::future<Reply> submit_cmd(size_t node, const std::vector<Command> &cmds, bool txn);
+    void loop();
+    void take_inbox();
+    void on_frame(const CanFrame &f, int64_t now);
+    void on_data(Node &n, uint32_t kind, const CanFrame &f);
+    void on_response(Node &n, const CanFrame &f, int64_t now);
+    void on_message(Node &n, int64_t now);
+    void emit(Node &n);
+    void run_timers(int64_t now);
+    void dispatch(Node &n, int64_t now);
+    void send_isotp(Node &n, int64_t now);
+    void finish(Node &n, Reply::Status status, uint8_t nrc, int64_t now);
+    void on_cmd_reply(Node &n, const CanFrame &f, int64_t now);
+    void pump_commands(Node &n, int64_t now);
+    void send_command(Node &n, CmdSlot &s, bool ack_req);
+    void complete_command(Node &n, CmdSlot &s, Reply::Status status, int64_t now);
+    void pump_broadcast(int64_t now);
+    void cancel_all();
+    int64_t next_deadline() const;
+    void update_out_interest();
+
+    CanSocket sock_;
+    int epoll_ = -1;
+    int wake_ = -1;                 /* eventfd: submissions and stop */
+    bool want_out_ = false;
+    std::vector<std::unique_ptr<Node>> nodes_;
+    std::vector<uint32_t> route_;   /* CAN ID -> node index << 4 | frame kind */
+    std::vector<CanFrame> rx_;
+    std::vector<IsoTpFrame> tp_out_;
+
+    std::mutex inbox_mutex_;
+    std::vector<std::unique_ptr<Pending>> inbox_;
+    std::vector<std::shared_ptr<CmdJob>> cmd_inbox_;
+    std::vector<std::unique_ptr<Broadcast>> bcast_inbox_;
+    std::deque<std::unique_ptr<Broadcast>> bcasts_;    /* front is being sent (loop thread) */
+
+    std::thread thread_;
+    std::atomic<bool> running_{false};
+    std::atomic<bool> stop_{false};
+
+    /* Socket counters mirrored for other threads. */
+    std::atomic<uint64_t> sock_rx_{0};
+    std::atomic<uint64_t> sock_tx_{0};
+    std::atomic<uint64_t> sock_rx_ignored_{0};
+    std::atomic<uint64_t> sock_rx_dropped_{0};
+    std::atomic<uint64_t> sock_tx_dropped_{0};
+};
+
+} // namespace stc
+
+#endif
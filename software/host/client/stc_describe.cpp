@@ -0,0 +1,216 @@
+/* stc_describe.cpp
+ *
+ * DID 0x0800 layout description: parser and DBC writer.
+ */
+
+#include "stc_describe.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdarg>
+#include <cstdio>
+#include <cstring>
+#include <map>
+
+namespace stc {
+
+namespace {
+
+/* Firmware uds_module.c. */
+constexpr uint8_t DESC_FORMAT = 1u;
+constexpr size_t HEADER_SIZE = 8u;
+constexpr size_t CHANNEL_SIZE = 12u;
+constexpr size_t FRAME_HEADER_SIZE = 6u;
+constexpr size_t ENTRY_SIZE = 5u;
+constexpr uint8_t NUM_SOURCES = 15u;
+
+struct SourceInfo {
+    const char *name;                   /* "%u" takes the channel index */
+    const char *unit;
+    double factor;
+};
+
+const SourceInfo SOURCES[NUM_SOURCES] = {
+    { "const",        "",     1.0 },
+    { "channel_%u",   "mV",   1.0 },
+    { "raw_%u",       "V",    1.0 },    /* factor and offset per channel */
+    { "oor_mask",     "",     1.0 },
+    { "enabled_mask", "",     1.0 },
+    { "min_%u",       "mV",   1.0 },
+    { "max_%u",       "mV",   1.0 },
+    { "mean_%u",      "mV",   1.0 },
+    { "stat_count",   "",     1.0 },
+    { "uptime",       "ms",   1.0 },
+    { "time_us",      "us",   1.0 },
+    { "scan_count",   "",     1.0 },
+    { "cpu_load",     "%",    0.1 },
+    { "alive",        "",     1.0 },
+    { "crc",          "",     1.0 },
+};
+
+const char *const LAYOUTS[] = { "plain", "E2E", "custom" };
+
+uint16_t get_u16(const uint8_t *p)
+{
+    return static_cast<uint16_t>((p[0] << 8) | p[1]);
+}
+
+float get_f32(const uint8_t *p)
+{
+    const uint32_t v = (static_cast<uint32_t>(p[0]) << 24) | (static_cast<uint32_t>(p[1]) << 16) |
+                       (static_cast<uint32_t>(p[2]) << 8) | p[3];
+    float f;
+    std::memcpy(&f, &v, sizeof(f));
+    return f;
+}
+
+std::string format(const char *fmt, ...) __attribute__((format(printf, 1, 2)));
+
+std::string format(const char *fmt, ...)
+{
+    char buf[256];
+    va_list ap;
+    va_start(ap, fmt);
+    std::vsnprintf(buf, sizeof(buf), fmt, ap);
+    va_end(ap);
+    return buf;
+}
+
+std::string node_name(const Description &d)
+{
+    return format("STC_%02X", d.node_id);
+}
+
+/* DBC start bit: the LSB for Intel, the MSB in DBC bit numbering for Motorola. */
+unsigned start_bit(const DescEntry &e)
+{
+    if (!e.big_endian) {
+        return e.bit_offset;
+    }
+    const unsigned q = e.bit_offset;    /* MSB-first position of the field's MSB */
+    return (q & ~7u) | (7u - (q & 7u));
+}
+
+} // namespace
+
+bool parse_description(const std::vector<uint8_t> &record, Description &out)
+{
+    const uint8_t *p = record.data();
+    const size_t n = record.size();
+    if (n < HEADER_SIZE || get_u16(p) != n || p[2] != DESC_FORMAT) {
+        return false;
+    }
+    Description d;
+    d.node_id = p[3];
+    d.layout = p[4];
+    d.enabled_mask = p[5];
+    const size_t channels = p[6];
+    const size_t frames = p[7];
+    size_t pos = HEADER_SIZE;
+    if (pos + channels * CHANNEL_SIZE > n) {
+        return false;
+    }
+    for (size_t ch = 0; ch < channels; ++ch, pos += CHANNEL_SIZE) {
+        DescChannel c;
+        c.raw_factor = get_f32(&p[pos]);
+        c.offset_v = get_f32(&p[pos + 4u]);
+        c.oor_min_mv = get_u16(&p[pos + 8u]);
+        c.oor_max_mv = get_u16(&p[pos + 10u]);
+        d.channels.push_back(c);
+    }
+    for (size_t f = 0; f < frames; ++f) {
+        if (pos + FRAME_HEADER_SIZE > n) {
+            return false;
+        }
+        DescFrame fr;
+        fr.id = get_u16(&p[pos]);
+        fr.period_ms = get_u16(&p[pos + 2u]);
+        fr.dlc = p[pos + 4u];
+        const size_t entries = p[pos + 5u];
+        pos += FRAME_HEADER_SIZE;
+        if (pos + entries * ENTRY_SIZE > n) {
+            return false;
+        }
+        for (size_t k = 0; k < entries; ++k, pos += ENTRY_SIZE) {
+            DescEntry e;
+            if (p[pos] >= NUM_SOURCES) {
+                return false;
+            }
+            e.source = static_cast<Source>(p[pos]);
+            e.index = p[pos + 1u];
+            e.bit_offset = p[pos + 2u];
+            e.bit_length = p[pos + 3u];
+            e.big_endian = p[pos + 4u] == 0u;
+            fr.entries.push_back(e);
+        }
+        d.frames.push_back(fr);
+    }
+    if (pos != n) {
+        return false;
+    }
+    out = std::move(d);
+    return true;
+}
+
+std::string to_dbc(const std::vector<Description> &nodes)
+{
+    std::string s = "VERSION \"\"\n\n\nNS_ :\n\tCM_\n\tBA_DEF_\n\tBA_\n\tBA_DEF_DEF_\n\nBS_:\n\nBU_:";
+    for (const Description &d : nodes) {
+        s += " " + node_name(d);
+    }
+    s += "\n\n";
+
+    std::string comments, attributes;
+    for (const Description &d : nodes) {
+        const std::string node = node_name(d);
+        comments += format("CM_ BU_ %s \"signal-to-can node 0x%02X, %s layout\";\n", node.c_str(), d.node_id,
+                           d.layout < 3u ? LAYOUTS[d.layout] : "unknown");
+        for (size_t f = 0; f < d.frames.size(); ++f) {
+            const DescFrame &fr = d.frames[f];
+            s += format("BO_ %u %s_Frame_%zu: %u %s\n", fr.id, node.c_str(), f + 1u, fr.dlc, node.c_str());
+            attributes += format("BA_ \"GenMsgCycleTime\" BO_ %u %u;\n", fr.id, fr.period_ms);
+
+            std::map<std::string, unsigned> used;
+            for (const DescEntry &e : fr.entries) {
+                const SourceInfo &src = SOURCES[static_cast<uint8_t>(e.source)];
+                std::string name = format(src.name, e.index);
+                if (used[name]++ != 0u) {
+                    name += format("_%u", used[name]);
+                }
+                double factor = src.factor;
+                double offset = 0.0;
+                const bool channel = e.index < d.channels.size();
+                if (e.source == Source::Raw && channel) {
+                    factor = d.channels[e.index].raw_factor;
+                    offset = d.channels[e.index].offset_v;
+                }
+                const double top = std::ldexp(1.0, e.bit_length) - 1.0;
+                double lo = offset, hi = offset + factor * top;
+                if (e.source == Source::Const) {
+                    lo = hi = e.index;
+                } else if (hi < lo) {
+                    std::swap(lo, hi);
+                }
+                s += format(" SG_ %s : %u|%u@%c+ (%.9g,%.9g) [%.9g|%.9g] \"%s\" Vector__XXX\n", name.c_str(),
+                            start_bit(e), e.bit_length, e.big_endian ? '0' : '1', factor, offset, lo, hi, src.unit);
+
+                if ((e.source == Source::Mv || e.source == Source::Raw) && channel) {
+                    const DescChannel &c = d.channels[e.index];
+                    const bool enabled = ((d.enabled_mask >> e.index) & 1u) != 0u;
+                    comments += format("CM_ SG_ %u %s \"Channel %u device input%s; out of range below %u mV or "
+                                       "above %u mV\";\n", fr.id, name.c_str(), e.index,
+                                       enabled ? "" : " (disabled)", c.oor_min_mv, c.oor_max_mv);
+                }
+            }
+            s += "\n";
+        }
+    }
+
+    s += "\n" + comments;
+    s += "BA_DEF_ BO_ \"GenMsgCycleTime\" INT 0 65535;\n";
+    s += "BA_DEF_DEF_ \"GenMsgCycleTime\" 0;\n";
+    s += attributes;
+    return s;
+}
+
+} // namespace stc
@@ -0,0 +1,74 @@
+/* stc_describe.h
+ *
+ * Frame layout of signal-to-can nodes as the devices describe it
+ * (UDS DID 0x0800, firmware uds_module.h), expanded into a DBC database.
+ *
+ * The description is generated by each node from its live state: the
+ * mapping table with the CAN IDs it sends on, the period of every frame and
+ * the channel calibration. A logger configured from it decodes exactly what
+ * the node sends, whatever was changed since signal_to_can.dbc was written.
+ *
+ * Signals are named after their source (channel_N for device-input mV,
+ * raw_N for ADC counts, ...). Raw counts are scaled to device-input volts
+ * with the node's gain and offset; everything else is sent in its unit.
+ */
+
+#ifndef STC_CLIENT_STC_DESCRIBE_H
+#define STC_CLIENT_STC_DESCRIBE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace stc {
+
+/* Firmware uds_module.h. */
+constexpr uint16_t DID_LAYOUT_DESC = 0x0800u;
+
+/* Firmware pdo_source_t. */
+enum class Source : uint8_t {
+    Const, Mv, Raw, OorMask, EnabledMask, StatMin, StatMax, StatMean, StatCount,
+    UptimeMs, TimeUs, ScanCount, CpuLoad, Alive, Crc8,
+};
+
+struct DescEntry {
+    Source source = Source::Const;
+    uint8_t index = 0;
+    uint8_t bit_offset = 0;
+    uint8_t bit_length = 0;
+    bool big_endian = true;             /* PDO_ENC_BE, else PDO_ENC_LE */
+};
+
+struct DescFrame {
+    uint16_t id = 0;                    /* 11-bit CAN ID */
+    uint16_t period_ms = 0;
+    uint8_t dlc = 0;
+    std::vector<DescEntry> entries;
+};
+
+struct DescChannel {
+    float raw_factor = 0.0f;            /* device-input V per ADC count */
+    float offset_v = 0.0f;
+    uint16_t oor_min_mv = 0;
+    uint16_t oor_max_mv = 0;
+};
+
+struct Description {
+    uint8_t node_id = 0;
+    uint8_t layout = 0;                 /* 0 plain, 1 E2E, 2 custom */
+    uint8_t enabled_mask = 0;
+    std::vector<DescChannel> channels;
+    std::vector<DescFrame> frames;
+};
+
+/* Parses a DID 0x0800 record. False (out untouched) if it is malformed or of
+ * an unknown format. */
+bool parse_description(const std::vector<uint8_t> &record, Description &out);
+
+/* DBC database with one node (BU_) per description, named STC_<node ID>. */
+std::string to_dbc(const std::vector<Description> &nodes);
+
+} // namespace stc
+
+#endif
@@ -0,0 +1,228 @@
+/* stc_update.cpp
+ *
+ * Multicast image download: session start, paced broadcast and selective
+ * repeat of the blocks any node is missing.
+ */
+
+#include "stc_update.h"
+
+#include <algorithm>
+#include <chrono>
+#include <future>
+#include <thread>
+
+namespace stc {
+
+namespace {
+
+/* Firmware update_module.h. */
+constexpr uint16_t RID_UPDATE = 0x0206u;
+constexpr uint16_t DID_UPDATE_STATUS = 0x0700u;
+constexpr uint16_t DID_UPDATE_MISSING = 0x0701u;
+constexpr uint8_t ROUTINE_START = 0x01u;
+constexpr uint8_t ROUTINE_STOP = 0x02u;
+constexpr uint8_t SESSION_EXTENDED = 0x03u;
+constexpr size_t FRAME_BYTES = 6u;
+constexpr size_t BLOCK_FRAMES = 8u;
+constexpr uint32_t TAG_MASK = 0x7u;
+
+constexpr auto POLL_INTERVAL = std::chrono::milliseconds(20);
+
+using Clock = std::chrono::steady_clock;
+
+double since(Clock::time_point t0)
+{
+    return std::chrono::duration<double>(Clock::now() - t0).count();
+}
+
+void put_u32(std::vector<uint8_t> &v, uint32_t x)
+{
+    v.push_back(static_cast<uint8_t>(x >> 24));
+    v.push_back(static_cast<uint8_t>(x >> 16));
+    v.push_back(static_cast<uint8_t>(x >> 8));
+    v.push_back(static_cast<uint8_t>(x));
+}
+
+struct Session {
+    Session(Client &c, const std::vector<size_t> &n, const std::vector<uint8_t> &i, const UpdateOptions &o)
+        : client(c), nodes(n), image(i), opt(o), res(n.size()), live(n.size(), true) {}
+
+    Client &client;
+    const std::vector<size_t> &nodes;
+    const std::vector<uint8_t> &image;
+    const UpdateOptions &opt;
+    uint8_t tag = 0;
+    size_t n_frames = 0;
+    std::vector<UpdateNodeResult> res;
+    std::vector<bool> live;             /* still taking part */
+
+    CanFrame frame(size_t n) const
+    {
+        CanFrame f;
+        f.id = opt.mcast_id;
+        f.dlc = 8u;
+        const uint16_t word = static_cast<uint16_t>((tag << 13) | n);
+        f.data[0] = static_cast<uint8_t>(word >> 8);
+        f.data[1] = static_cast<uint8_t>(word);
+        for (size_t k = 0; k < FRAME_BYTES; ++k) {
+            const size_t i = n * FRAME_BYTES + k;
+            f.data[2u + k] = i < image.size() ? image[i] : 0xFFu;
+        }
+        return f;
+    }
+
+    void drop(size_t k, const Reply &r)
+    {
+        res[k].status = r.status;
+        res[k].nrc = r.nrc;
+        live[k] = false;
+    }
+
+    /* Reads DID 0x0700 of the live nodes; false if none is in `state` any more. */
+    bool any_in(UpdateState state)
+    {
+        std::vector<std::future<Reply>> f(nodes.size());
+        for (size_t k = 0; k < nodes.size(); ++k) {
+            if (live[k]) f[k] = client.read_did(nodes[k], DID_UPDATE_STATUS);
+        }
+        bool any = false;
+        for (size_t k = 0; k < nodes.size(); ++k) {
+            if (!live[k]) continue;
+            const Reply r = f[k].get();
+            if (!r.ok() || r.data.size() < 8u) {
+                drop(k, r);
+                continue;
+            }
+            res[k].state = static_cast<UpdateState>(r.data[0]);
+            res[k].error = r.data[1];
+            res[k].missing = static_cast<uint16_t>((r.data[6] << 8) | r.data[7]);
+            if (res[k].state == UpdateState::Failed || res[k].state == UpdateState::Idle) {
+                live[k] = false;
+            }
+            any = any || res[k].state == state;
+        }
+        return any;
+    }
+
+    /* Polls until no live node is in `state` or the timeout passes. */
+    void wait_while(UpdateState state, uint32_t timeout_ms)
+    {
+        const auto t0 = Clock::now();
+        while (any_in(state) && since(t0) * 1e3 < timeout_ms) {
+            std::this_thread::sleep_for(POLL_INTERVAL);
+        }
+    }
+
+    /* Union of the missing blocks of the live receiving nodes. */
+    std::vector<bool> missing_blocks(size_t n_blocks)
+    {
+        std::vector<bool> miss(n_blocks, false);
+        std::vector<std::future<Reply>> f(nodes.size());
+        for (size_t k = 0; k < nodes.size(); ++k) {
+            if (live[k] && res[k].state == UpdateState::Receiving && res[k].missing != 0u) {
+                f[k] = client.read_did(nodes[k], DID_UPDATE_MISSING);
+            }
+        }
+        for (size_t k = 0; k < nodes.size(); ++k) {
+            if (!f[k].valid()) continue;
+            const Reply r = f[k].get();
+            if (!r.ok()) {
+                drop(k, r);
+                continue;
+            }
+            for (size_t b = 0; b < n_blocks && b / 8u < r.data.size(); ++b) {
+                if ((r.data[b / 8u] >> (b % 8u)) & 1u) miss[b] = true;
+            }
+        }
+        return miss;
+    }
+};
+
+} // namespace
+
+uint32_t update_crc32(const uint8_t *data, size_t len)
+{
+    uint32_t crc = 0xFFFFFFFFu;
+    for (size_t i = 0; i < len; ++i) {
+        crc ^= data[i];
+        for (int b = 0; b < 8; ++b) {
+            crc = (crc >> 1) ^ (0xEDB88320u & (0u - (crc & 1u)));
+        }
+    }
+    return crc ^ 0xFFFFFFFFu;
+}
+
+UpdateResult update(Client &client, const std::vector<size_t> &nodes, const std::vector<uint8_t> &image,
+                    const UpdateOptions &opt)
+{
+    const auto t0 = Clock::now();
+    const uint32_t crc = update_crc32(image.data(), image.size());
+    Session s(client, nodes, image, opt);
+    s.tag = static_cast<uint8_t>(crc & TAG_MASK);
+    s.n_frames = (image.size() + FRAME_BYTES - 1u) / FRAME_BYTES;
+    UpdateResult out;
+
+    /* 1. Start everywhere; the erase runs on all nodes at once. */
+    std::vector<uint8_t> params = { s.tag };
+    put_u32(params, static_cast<uint32_t>(image.size()));
+    put_u32(params, crc);
+    std::vector<std::future<Reply>> sessions, starts;
+    for (size_t node : nodes) {
+        sessions.push_back(client.session(node, SESSION_EXTENDED));
+        starts.push_back(client.routine(node, ROUTINE_START, RID_UPDATE, params));
+    }
+    for (size_t k = 0; k < nodes.size(); ++k) {
+        const Reply a = sessions[k].get();
+        const Reply b = starts[k].get();
+        if (!a.ok()) s.drop(k, a);
+        else if (!b.ok()) s.drop(k, b);
+    }
+    s.wait_while(UpdateState::Erasing, opt.erase_timeout_ms);
+    out.erase_s = since(t0);
+
+    /* 2. and 3. First pass with every block, then only the missing ones. */
+    const size_t n_blocks = (s.n_frames + BLOCK_FRAMES - 1u) / BLOCK_FRAMES;
+    std::vector<bool> send(n_blocks, true);
+    for (uint32_t round = 0; round <= opt.rounds; ++round) {
+        std::vector<CanFrame> frames;
+        for (size_t b = 0; b < n_blocks; ++b) {
+            if (!send[b]) continue;
+            for (size_t n = b * BLOCK_FRAMES; n < std::min(s.n_frames, (b + 1u) * BLOCK_FRAMES); ++n) {
+                frames.push_back(s.frame(n));
+            }
+        }
+        if (frames.empty()) {
+            break;
+        }
+        out.frames += frames.size();
+        out.rounds = round;
+        (void)client.broadcast(std::move(frames), opt.gap_us).get();
+        std::this_thread::sleep_for(POLL_INTERVAL);   /* last frames programmed */
+        if (!s.any_in(UpdateState::Receiving)) {
+            break;
+        }
+        send = s.missing_blocks(n_blocks);
+    }
+    s.wait_while(UpdateState::Verifying, opt.verify_timeout_ms);
+
+    /* 4. Leave update mode. */
+    if (opt.leave) {
+        std::vector<std::future<Reply>> stops;
+        for (size_t node : nodes) {
+            stops.push_back(client.routine(node, ROUTINE_STOP, RID_UPDATE));
+        }
+        for (auto &f : stops) {
+            (void)f.get();
+        }
+    }
+
+    out.ok = !nodes.empty();
+    for (const UpdateNodeResult &r : s.res) {
+        out.ok = out.ok && r.state == UpdateState::Done;
+    }
+    out.nodes = std::move(s.res);
+    out.total_s = since(t0);
+    return out;
+}
+
+} // namespace stc
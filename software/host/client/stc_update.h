@@ -0,0 +1,70 @@
+/* stc_update.h
+ *
+ * Multicast image download to many signal-to-can nodes at once
+ * (firmware update_module.h).
+ *
+ * update() runs the whole session on a started Client:
+ *  1. extended session and routine 0x0206 start (session tag, size, CRC-32)
+ *     on every node; each erases its staging area;
+ *  2. once no node is erasing, every image frame is broadcast once on the
+ *     multicast ID, paced by UpdateOptions::gap_us, and all nodes program it
+ *     at the same time;
+ *  3. selective repeat: the missing-block bitmaps (DID 0x0701) of the nodes
+ *     that are not complete are merged and only those blocks are broadcast
+ *     again, until every node has verified its image or the rounds run out;
+ *  4. routine 0x0206 stop on every node, which resumes its data frames.
+ * The bus time of steps 2 and 3 hardly depends on the number of nodes.
+ */
+
+#ifndef STC_CLIENT_STC_UPDATE_H
+#define STC_CLIENT_STC_UPDATE_H
+
+#include "stc_client.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace stc {
+
+struct UpdateOptions {
+    uint16_t mcast_id = 0x7F0u;         /* firmware UPDATE_MCAST_ID */
+    uint32_t gap_us = 300;              /* between image frames; a node programs one in about 160 us */
+    uint32_t rounds = 8;                /* selective-repeat rounds after the first pass */
+    uint32_t erase_timeout_ms = 10000;
+    uint32_t verify_timeout_ms = 2000;
+    bool leave = true;                  /* stop the routine at the end (data frames resume) */
+};
+
+/* Firmware update_state_t. */
+enum class UpdateState : uint8_t {
+    Idle, Erasing, Receiving, Verifying, Done, Failed,
+};
+
+struct UpdateNodeResult {
+    UpdateState state = UpdateState::Idle;
+    uint8_t error = 0;                  /* firmware update_error_t */
+    uint16_t missing = 0;               /* blocks */
+    Reply::Status status = Reply::Status::Ok;   /* last failed request, if any */
+    uint8_t nrc = 0;
+};
+
+struct UpdateResult {
+    bool ok = false;                    /* every node reached Done */
+    std::vector<UpdateNodeResult> nodes;        /* in the order of update()'s nodes */
+    uint32_t rounds = 0;                /* repeat rounds used */
+    size_t frames = 0;                  /* image frames broadcast */
+    double erase_s = 0.0;               /* start until no node was erasing */
+    double total_s = 0.0;
+};
+
+/* CRC-32 (IEEE 802.3, as zlib), the checksum routine 0x0206 expects. */
+uint32_t update_crc32(const uint8_t *data, size_t len);
+
+/* Downloads image to the given nodes of client (started). Blocks until done. */
+UpdateResult update(Client &client, const std::vector<size_t> &nodes, const std::vector<uint8_t> &image,
+                    const UpdateOptions &opt = UpdateOptions());
+
+} // namespace stc
+
+#endif
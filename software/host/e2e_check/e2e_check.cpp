@@ -0,0 +1,252 @@
+/* e2e_check.cpp
+ *
+ * Checks a candump log of E2E-protected signal-to-can data frames.
+ *
+ * For every data frame ID of the node (node_id + 0x1, 0x2, 0x4) the CRC-8 and
+ * the 4-bit alive counter are verified and the following are reported:
+ * frames received, CRC errors, frames lost (counter gaps), duplicates (repeated
+ * counter), loss rate and the inter-arrival time mean / standard deviation /
+ * min / max.
+ *
+ * A counter gap of n means n-1 frames were lost. The counter wraps every 16
+ * frames, so outages longer than 15 frames are undercounted; the maximum
+ * inter-arrival time shows them.
+ *
+ * Usage:
+ *   stc_e2e_check [-n node_id] [candump.log]      (reads stdin without a file)
+ *
+ * Exit status: 0 ok, 1/2 input or usage errors, 3 a CRC error, or no frame
+ * of the node in the log.
+ *
+ * Accepted line formats:
+ *   candump -L :   (1697040000.123456) can0 501#0102030405060708
+ *   candump -ta:   (1697040000.123456)  can0  501   [8]  01 02 03 04 05 06 07 08
+ */
+
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace {
+
+const uint32_t k_frame_offsets[] = { 0x1u, 0x2u, 0x4u };
+
+struct Frame {
+    double   t = 0.0;
+    uint32_t id = 0;
+    std::vector<uint8_t> data;
+};
+
+struct IdStats {
+    uint64_t frames = 0;
+    uint64_t crc_errors = 0;
+    uint64_t lost = 0;
+    uint64_t duplicates = 0;
+    bool     have_last = false;
+    uint8_t  last_alive = 0;
+    double   last_t = 0.0;
+    /* Inter-arrival statistics over CRC-valid frames. */
+    uint64_t gaps = 0;
+    double   gap_sum = 0.0;
+    double   gap_sq_sum = 0.0;
+    double   gap_min = 0.0;
+    double   gap_max = 0.0;
+};
+
+/* CRC-8 SAE J1850 (poly 0x1D, init 0xFF, xor-out 0xFF), bitwise; must match
+ * e2e_crc8() in pdo_module.c.
+ */
+uint8_t crc8_update(uint8_t crc, uint8_t byte)
+{
+    crc ^= byte;
+    for (int b = 0; b < 8; ++b) {
+        crc = (crc & 0x80u) ? static_cast<uint8_t>((crc << 1) ^ 0x1Du)
+                            : static_cast<uint8_t>(crc << 1);
+    }
+    return crc;
+}
+
+uint8_t e2e_crc8(uint32_t id, const std::vector<uint8_t> &d)
+{
+    uint8_t crc = 0xFFu;
+    crc = crc8_update(crc, static_cast<uint8_t>(id & 0xFFu));
+    crc = crc8_update(crc, static_cast<uint8_t>((id >> 8) & 0xFFu));
+    for (size_t i = 1; i < d.size(); ++i) {
+        crc = crc8_update(crc, d[i]);
+    }
+    return static_cast<uint8_t>(crc ^ 0xFFu);
+}
+
+bool parse_hex_bytes(const std::string &s, std::vector<uint8_t> &out)
+{
+    if (s.size() % 2u != 0u) {
+        return false;
+    }
+    for (size_t i = 0; i < s.size(); i += 2u) {
+        char *end = nullptr;
+        const std::string byte = s.substr(i, 2u);
+        const unsigned long v = std::strtoul(byte.c_str(), &end, 16);
+        if (*end != '\0') {
+            return false;
+        }
+        out.push_back(static_cast<uint8_t>(v));
+    }
+    return true;
+}
+
+/* Parses one candump line (-L or -ta). Returns false for anything else. */
+bool parse_line(const std::string &line, Frame &f)
+{
+    std::istringstream in(line);
+    std::string ts, iface, tok;
+    if (!(in >> ts >> iface >> tok)) {
+        return false;
+    }
+    if (ts.size() < 3u || ts.front() != '(' || ts.back() != ')') {
+        return false;
+    }
+    f.t = std::strtod(ts.c_str() + 1, nullptr);
+    f.data.clear();
+
+    const size_t hash = tok.find('#');
+    if (hash != std::string::npos) {
+        /* -L: ID#DATA (remote frames "ID#R" are not data frames) */
+        f.id = static_cast<uint32_t>(std::strtoul(tok.substr(0, hash).c_str(), nullptr, 16));
+        return parse_hex_bytes(tok.substr(hash + 1u), f.data);
+    }
+
+    /* -ta: ID [DLC] bytes... */
+    f.id = static_cast<uint32_t>(std::strtoul(tok.c_str(), nullptr, 16));
+    std::string dlc;
+    if (!(in >> dlc) || dlc.size() < 3u || dlc.front() != '[') {
+        return false;
+    }
+    const unsigned long n = std::strtoul(dlc.c_str() + 1, nullptr, 10);
+    for (unsigned long i = 0; i < n; ++i) {
+        std::string b;
+        if (!(in >> b) || !parse_hex_bytes(b, f.data) || f.data.size() != i + 1u) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void account(IdStats &s, const Frame &f)
+{
+    s.frames++;
+    if (f.data.size() != 8u || e2e_crc8(f.id, f.data) != f.data[0]) {
+        s.crc_errors++;
+        return;   /* the counter of a corrupted frame cannot be trusted */
+    }
+
+    const uint8_t alive = f.data[1] & 0x0Fu;
+    if (s.have_last) {
+        const uint8_t step = static_cast<uint8_t>((alive - s.last_alive) & 0x0Fu);
+        if (step == 0u) {
+            s.duplicates++;
+            return;
+        }
+        s.lost += step - 1u;
+
+        const double gap = f.t - s.last_t;
+        if (s.gaps == 0u || gap < s.gap_min) s.gap_min = gap;
+        if (s.gaps == 0u || gap > s.gap_max) s.gap_max = gap;
+        s.gap_sum += gap;
+        s.gap_sq_sum += gap * gap;
+        s.gaps++;
+    }
+    s.have_last = true;
+    s.last_alive = alive;
+    s.last_t = f.t;
+}
+
+void report(uint32_t id, const IdStats &s)
+{
+    const uint64_t good = s.frames - s.crc_errors - s.duplicates;
+    const double expected = static_cast<double>(good + s.lost);
+    const double loss = expected > 0.0 ? 100.0 * static_cast<double>(s.lost) / expected : 0.0;
+
+    std::printf("0x%03X  frames %llu  crc_err %llu  lost %llu  dup %llu  loss %.3f%%\n",
+                id,
+                static_cast<unsigned long long>(s.frames),
+                static_cast<unsigned long long>(s.crc_errors),
+                static_cast<unsigned long long>(s.lost),
+                static_cast<unsigned long long>(s.duplicates),
+                loss);
+    if (s.gaps > 0u) {
+        const double n = static_cast<double>(s.gaps);
+        const double mean = s.gap_sum / n;
+        const double var = s.gap_sq_sum / n - mean * mean;
+        std::printf("       inter-arrival ms: mean %.3f  std %.3f  min %.3f  max %.3f\n",
+                    mean * 1e3, std::sqrt(var > 0.0 ? var : 0.0) * 1e3,
+                    s.gap_min * 1e3, s.gap_max * 1e3);
+    }
+}
+
+void usage()
+{
+    std::cerr << "usage: stc_e2e_check [-n node_id] [candump.log]\n";
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    std::string input;
+    uint32_t node_id = 0x500u;
+
+    for (int i = 1; i < argc; ++i) {
+        const std::string a = argv[i];
+        if (a == "-n" && i + 1 < argc) {
+            node_id = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 0));
+        } else if (input.empty() && a[0] != '-') {
+            input = a;
+        } else {
+            usage();
+            return 2;
+        }
+    }
+
+    std::ifstream file;
+    if (!input.empty()) {
+        file.open(input);
+        if (!file) {
+            std::cerr << "stc_e2e_check: cannot open " << input << "\n";
+            return 1;
+        }
+    }
+    std::istream &in = input.empty() ? std::cin : file;
+
+    std::map<uint32_t, IdStats> stats;
+    for (uint32_t off : k_frame_offsets) {
+        stats[node_id + off] = IdStats{};
+    }
+
+    std::string line;
+    Frame f;
+    while (std::getline(in, line)) {
+        if (!parse_line(line, f)) {
+            continue;
+        }
+        auto it = stats.find(f.id);
+        if (it != stats.end()) {
+            account(it->second, f);
+        }
+    }
+
+    uint64_t frames = 0;
+    uint64_t crc_errors = 0;
+    for (const auto &kv : stats) {
+        report(kv.first, kv.second);
+        frames += kv.second.frames;
+        crc_errors += kv.second.crc_errors;
+    }
+    return (frames == 0u || crc_errors != 0u) ? 3 : 0;
+}
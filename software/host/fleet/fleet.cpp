@@ -0,0 +1,492 @@
+/* fleet.cpp
+ *
+ * Command-line front end of the host client library (stc::Client) for a
+ * fleet of signal-to-can nodes on one SocketCAN interface.
+ *
+ * Commands:
+ *   monitor            per-node sample rate, latest values and loss counters,
+ *                      printed every second (-t limits the run, else Ctrl-C)
+ *   read DID...        reads the DIDs from every node, all requests in flight
+ *                      at once (one outstanding per node)
+ *   write DID HEX      extended session, then writes the hex bytes to the DID
+ *                      on every node
+ *   bench              -c reads of DID 0x0301 (uptime) per node, back to back;
+ *                      reports requests/s and the round-trip percentiles
+ *   configure SET...   applies the settings to every node in one transaction
+ *                      per node, all nodes at once; SET is one of
+ *                        rate=HZ  baud=0..3  chN=EN,SCALE_MILLI,OFFSET_MV
+ *                        rangeN=MIN_MV,MAX_MV
+ *   update FILE        downloads the image to every node at once: one
+ *                      multicast pass, then only the blocks some node missed
+ *                      (--gap-us paces the image frames)
+ *   describe [FILE]    reads the frame layout every node describes (DID
+ *                      0x0800) and writes it as one DBC database to FILE,
+ *                      or to stdout
+ *
+ * Usage:
+ *   stc_fleet -i IFACE [-n node_id]... [-N nodes -f first_node_id -s id_stride]
+ *             [--layout auto|plain|e2e] [--p2-ms ms] [-t seconds] [-c count]
+ *             [-w cmd_window] [--gap-us us] monitor | read DID... | write DID HEX | bench |
+ *             configure SET... | update FILE | describe [FILE]
+ *
+ * Exit status: 0 all requests succeeded, 1 a request failed or the
+ * interface could not be opened, 2 usage errors.
+ */
+
+#include "../client/stc_client.h"
+#include "../client/stc_update.h"
+#include "../client/stc_describe.h"
+
+#include <algorithm>
+#include <chrono>
+#include <csignal>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+volatile std::sig_atomic_t g_stop = 0;
+
+void on_sigint(int)
+{
+    g_stop = 1;
+}
+
+struct Options {
+    std::string iface;
+    std::vector<uint16_t> node_ids;
+    uint32_t nodes = 0;
+    uint32_t first_node = 0x10;
+    uint32_t stride = 0x10;
+    stc::Layout layout = stc::Layout::Auto;
+    uint32_t p2_ms = 250;
+    double seconds = 0.0;
+    uint32_t count = 1000;
+    uint32_t window = 4;
+    uint32_t gap_us = stc::UpdateOptions().gap_us;
+    std::vector<std::string> command;
+};
+
+bool parse_hex(const std::string &s, std::vector<uint8_t> &out)
+{
+    std::string digits;
+    for (char c : s) {
+        if (c != ' ' && c != ':' && c != '.') digits += c;
+    }
+    if (digits.empty() || digits.size() % 2u != 0u) return false;
+    for (size_t i = 0; i < digits.size(); i += 2u) {
+        char *end = nullptr;
+        const std::string byte = digits.substr(i, 2u);
+        const unsigned long v = std::strtoul(byte.c_str(), &end, 16);
+        if (*end != '\0') return false;
+        out.push_back(static_cast<uint8_t>(v));
+    }
+    return true;
+}
+
+/* Parses "NAME=a,b,c" into the name and the numbers. */
+bool parse_setting(const std::string &s, std::string &name, std::vector<long> &args)
+{
+    const size_t eq = s.find('=');
+    if (eq == std::string::npos || eq == 0u) return false;
+    name = s.substr(0, eq);
+    const char *p = s.c_str() + eq + 1;
+    while (true) {
+        char *end = nullptr;
+        args.push_back(std::strtol(p, &end, 0));
+        if (end == p) return false;
+        if (*end == '\0') return true;
+        if (*end != ',') return false;
+        p = end + 1;
+    }
+}
+
+bool parse_command(const std::string &s, stc::Command &out)
+{
+    std::string name;
+    std::vector<long> a;
+    if (!parse_setting(s, name, a)) return false;
+    const bool channel = name.size() > 2u && (name.compare(0, 2, "ch") == 0 || name.compare(0, 5, "range") == 0);
+    const long ch = channel ? std::strtol(name.c_str() + (name[0] == 'c' ? 2 : 5), nullptr, 10) : 0;
+    if (ch < 0 || ch > 7) return false;
+    if (name == "rate" && a.size() == 1u) {
+        out = stc::Command::set_sample_rate(static_cast<uint16_t>(a[0]));
+    } else if (name == "baud" && a.size() == 1u) {
+        out = stc::Command::set_baud(static_cast<uint8_t>(a[0]));
+    } else if (name[0] == 'c' && channel && a.size() == 3u) {
+        out = stc::Command::set_channel(static_cast<uint8_t>(ch), a[0] != 0, static_cast<uint16_t>(a[1]),
+                                        static_cast<int16_t>(a[2]));
+    } else if (name[0] == 'r' && channel && a.size() == 2u) {
+        out = stc::Command::set_channel_range(static_cast<uint8_t>(ch), static_cast<uint16_t>(a[0]),
+                                              static_cast<uint16_t>(a[1]));
+    } else {
+        return false;
+    }
+    return true;
+}
+
+void print_reply(uint16_t node_id, uint16_t did, const stc::Reply &r)
+{
+    std::printf("0x%03X 0x%04X %s", node_id, did, stc::to_string(r.status));
+    if (r.status == stc::Reply::Status::Negative) {
+        std::printf(" nrc 0x%02X", r.nrc);
+    }
+    for (uint8_t b : r.data) {
+        std::printf(" %02X", b);
+    }
+    std::printf("\n");
+}
+
+int run_monitor(stc::Client &client, const Options &opt)
+{
+    const size_t n_nodes = client.node_count();
+    std::vector<stc::Sample> last(n_nodes);
+    std::vector<uint64_t> prev_samples(n_nodes, 0u);
+    stc::Sample batch[256];
+
+    const auto t0 = std::chrono::steady_clock::now();
+    auto next = t0 + std::chrono::seconds(1);
+    while (g_stop == 0) {
+        bool idle = true;
+        for (size_t k = 0; k < n_nodes; ++k) {
+            const size_t got = client.samples(k).pop_bulk(batch, 256u);
+            if (got != 0u) {
+                last[k] = batch[got - 1u];
+                idle = false;
+            }
+        }
+        const auto now = std::chrono::steady_clock::now();
+        if (now >= next) {
+            std::printf("%-6s %8s %-47s %8s %8s %8s %8s\n", "node", "rate/s", "latest mV ch0..7", "partial",
+                        "lost", "crc", "overrun");
+            for (size_t k = 0; k < n_nodes; ++k) {
+                const stc::NodeStats s = client.stats(k);
+                std::printf("0x%03X  %8llu", client.config(k).node_id,
+                            static_cast<unsigned long long>(s.samples - prev_samples[k]));
+                for (int ch = 0; ch < 8; ++ch) {
+                    if ((last[k].valid >> ch) & 1u) {
+                        std::printf(" %5u", last[k].mv[ch]);
+                    } else {
+                        std::printf("     -");
+                    }
+                }
+                std::printf(" %8llu %8llu %8llu %8llu\n", static_cast<unsigned long long>(s.partial),
+                            static_cast<unsigned long long>(s.lost),
+                            static_cast<unsigned long long>(s.crc_errors),
+                            static_cast<unsigned long long>(s.overruns));
+                prev_samples[k] = s.samples;
+            }
+            const stc::SocketStats ss = client.socket_stats();
+            std::printf("socket: rx %llu, kernel drops %llu\n\n", static_cast<unsigned long long>(ss.rx),
+                        static_cast<unsigned long long>(ss.rx_dropped));
+            std::fflush(stdout);
+            next += std::chrono::seconds(1);
+        }
+        if (opt.seconds > 0.0 && now - t0 >= std::chrono::duration<double>(opt.seconds)) {
+            break;
+        }
+        if (idle) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+    return 0;
+}
+
+int run_read(stc::Client &client, const std::vector<uint16_t> &dids)
+{
+    std::vector<std::future<stc::Reply>> futures;
+    for (size_t k = 0; k < client.node_count(); ++k) {
+        for (uint16_t did : dids) {
+            futures.push_back(client.read_did(k, did));
+        }
+    }
+    int status = 0;
+    size_t i = 0;
+    for (size_t k = 0; k < client.node_count(); ++k) {
+        for (uint16_t did : dids) {
+            const stc::Reply r = futures[i++].get();
+            print_reply(client.config(k).node_id, did, r);
+            if (!r.ok()) status = 1;
+        }
+    }
+    return status;
+}
+
+int run_write(stc::Client &client, uint16_t did, const std::vector<uint8_t> &value)
+{
+    std::vector<std::future<stc::Reply>> sessions;
+    std::vector<std::future<stc::Reply>> writes;
+    for (size_t k = 0; k < client.node_count(); ++k) {
+        /* Same node, same pipeline: the write goes out after the session change. */
+        sessions.push_back(client.session(k, 0x03u));
+        writes.push_back(client.write_did(k, did, value));
+    }
+    int status = 0;
+    for (size_t k = 0; k < client.node_count(); ++k) {
+        const stc::Reply s = sessions[k].get();
+        const stc::Reply r = writes[k].get();
+        print_reply(client.config(k).node_id, did, s.ok() ? r : s);
+        if (!s.ok() || !r.ok()) status = 1;
+    }
+    return status;
+}
+
+int run_bench(stc::Client &client, uint32_t count)
+{
+    std::vector<std::future<stc::Reply>> futures;
+    futures.reserve(client.node_count() * count);
+    const auto t0 = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < count; ++i) {
+        for (size_t k = 0; k < client.node_count(); ++k) {
+            futures.push_back(client.read_did(k, 0x0301u));
+        }
+    }
+    std::vector<int64_t> rtt;
+    rtt.reserve(futures.size());
+    size_t failed = 0;
+    for (auto &f : futures) {
+        const stc::Reply r = f.get();
+        if (r.ok()) {
+            rtt.push_back(r.rtt_ns);
+        } else {
+            failed++;
+        }
+    }
+    const double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    std::sort(rtt.begin(), rtt.end());
+    auto pct = [&](double p) {
+        return rtt.empty() ? 0.0 : static_cast<double>(rtt[static_cast<size_t>(p * static_cast<double>(rtt.size() - 1u))]) / 1e3;
+    };
+    std::printf("%zu requests to %zu nodes in %.3f s: %.0f requests/s, %zu failed\n", futures.size(),
+                client.node_count(), secs, static_cast<double>(futures.size()) / secs, failed);
+    std::printf("round trip: p50 %.0f us, p99 %.0f us, max %.0f us\n", pct(0.5), pct(0.99), pct(1.0));
+    return failed == 0u ? 0 : 1;
+}
+
+int run_configure(stc::Client &client, const std::vector<stc::Command> &cmds)
+{
+    std::vector<std::future<stc::Reply>> futures;
+    const auto t0 = std::chrono::steady_clock::now();
+    for (size_t k = 0; k < client.node_count(); ++k) {
+        futures.push_back(client.configure(k, cmds));
+    }
+    int status = 0;
+    for (size_t k = 0; k < client.node_count(); ++k) {
+        const stc::Reply r = futures[k].get();
+        std::printf("0x%03X %s", client.config(k).node_id, stc::to_string(r.status));
+        if (r.ok()) std::printf(" %.1f ms", static_cast<double>(r.rtt_ns) / 1e6);
+        std::printf("\n");
+        if (!r.ok()) status = 1;
+    }
+    const double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    std::printf("%zu commands to %zu nodes in %.1f ms\n", cmds.size(), client.node_count(), secs * 1e3);
+    return status;
+}
+
+int run_update(stc::Client &client, const std::vector<uint8_t> &image, uint32_t gap_us)
+{
+    static const char *const states[] = { "idle", "erasing", "receiving", "verifying", "done", "failed" };
+    std::vector<size_t> nodes;
+    for (size_t k = 0; k < client.node_count(); ++k) {
+        nodes.push_back(k);
+    }
+    stc::UpdateOptions uo;
+    uo.gap_us = gap_us;
+    const stc::UpdateResult r = stc::update(client, nodes, image, uo);
+    for (size_t k = 0; k < nodes.size(); ++k) {
+        const stc::UpdateNodeResult &n = r.nodes[k];
+        const size_t st = static_cast<size_t>(n.state);
+        std::printf("0x%03X %s", client.config(k).node_id, st < 6u ? states[st] : "?");
+        if (n.state == stc::UpdateState::Failed) std::printf(" error %u", n.error);
+        if (n.missing != 0u) std::printf(" %u blocks missing", n.missing);
+        if (n.status != stc::Reply::Status::Ok) {
+            std::printf(" (%s nrc 0x%02X)", stc::to_string(n.status), n.nrc);
+        }
+        std::printf("\n");
+    }
+    std::printf("%zu bytes to %zu nodes in %.2f s (erase %.2f s): %zu frames, %u repeat rounds\n", image.size(),
+                nodes.size(), r.total_s, r.erase_s, r.frames, r.rounds);
+    return r.ok ? 0 : 1;
+}
+
+int run_describe(stc::Client &client, const std::string &path)
+{
+    std::vector<std::future<stc::Reply>> futures;
+    for (size_t k = 0; k < client.node_count(); ++k) {
+        futures.push_back(client.read_did(k, stc::DID_LAYOUT_DESC));
+    }
+    std::vector<stc::Description> descs;
+    int status = 0;
+    for (size_t k = 0; k < client.node_count(); ++k) {
+        const stc::Reply r = futures[k].get();
+        stc::Description d;
+        if (r.ok() && stc::parse_description(r.data, d)) {
+            descs.push_back(std::move(d));
+        } else {
+            std::fprintf(stderr, "0x%03X %s nrc 0x%02X\n", client.config(k).node_id,
+                         r.ok() ? "bad description" : stc::to_string(r.status), r.nrc);
+            status = 1;
+        }
+    }
+    const std::string dbc = stc::to_dbc(descs);
+    if (path.empty()) {
+        std::fwrite(dbc.data(), 1, dbc.size(), stdout);
+        return status;
+    }
+    std::ofstream out(path, std::ios::binary);
+    if (!(out << dbc)) {
+        std::cerr << "stc_fleet: cannot write " << path << "\n";
+        return 1;
+    }
+    size_t frames = 0;
+    for (const stc::Description &d : descs) {
+        frames += d.frames.size();
+    }
+    std::printf("%zu frames of %zu nodes written to %s\n", frames, descs.size(), path.c_str());
+    return status;
+}
+
+void usage()
+{
+    std::cerr << "usage: stc_fleet -i IFACE [-n node_id]... [-N nodes -f first_node_id -s id_stride]\n"
+                 "                 [--layout auto|plain|e2e] [--p2-ms ms] [-t seconds] [-c count]\n"
+                 "                 [-w cmd_window] [--gap-us us] monitor | read DID... | write DID HEX |\n"
+                 "                 bench | update FILE | describe [FILE] |\n"
+                 "                 configure [rate=HZ] [baud=0..3] [chN=EN,SCALE_MILLI,OFFSET_MV]\n"
+                 "                           [rangeN=MIN_MV,MAX_MV]...\n";
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    Options opt;
+    for (int i = 1; i < argc; ++i) {
+        const std::string a = argv[i];
+        const bool has_value = i + 1 < argc;
+        if (!opt.command.empty() || a[0] != '-') {
+            opt.command.push_back(a);
+        } else if (has_value && (a == "-i" || a == "-n" || a == "-N" || a == "-f" || a == "-s" ||
+                                 a == "--layout" || a == "--p2-ms" || a == "-t" || a == "-c" || a == "-w" ||
+                                 a == "--gap-us")) {
+            const std::string v = argv[++i];
+            if (a == "-i") opt.iface = v;
+            if (a == "-n") opt.node_ids.push_back(static_cast<uint16_t>(std::strtoul(v.c_str(), nullptr, 0)));
+            if (a == "-N") opt.nodes = static_cast<uint32_t>(std::strtoul(v.c_str(), nullptr, 0));
+            if (a == "-f") opt.first_node = static_cast<uint32_t>(std::strtoul(v.c_str(), nullptr, 0));
+            if (a == "-s") opt.stride = static_cast<uint32_t>(std::strtoul(v.c_str(), nullptr, 0));
+            if (a == "--p2-ms") opt.p2_ms = static_cast<uint32_t>(std::strtoul(v.c_str(), nullptr, 0));
+            if (a == "-t") opt.seconds = std::strtod(v.c_str(), nullptr);
+            if (a == "-w") opt.window = static_cast<uint32_t>(std::strtoul(v.c_str(), nullptr, 0));
+            if (a == "-c") opt.count = static_cast<uint32_t>(std::strtoul(v.c_str(), nullptr, 0));
+            if (a == "--gap-us") opt.gap_us = static_cast<uint32_t>(std::strtoul(v.c_str(), nullptr, 0));
+            if (a == "--layout") {
+                if (v == "auto") opt.layout = stc::Layout::Auto;
+                else if (v == "plain") opt.layout = stc::Layout::Plain;
+                else if (v == "e2e") opt.layout = stc::Layout::E2E;
+                else {
+                    usage();
+                    return 2;
+                }
+            }
+        } else {
+            usage();
+            return 2;
+        }
+    }
+    for (uint32_t k = 0; k < opt.nodes; ++k) {
+        opt.node_ids.push_back(static_cast<uint16_t>(opt.first_node + k * opt.stride));
+    }
+    if (opt.iface.empty() || opt.node_ids.empty() || opt.command.empty()) {
+        usage();
+        return 2;
+    }
+    const std::string &cmd = opt.command[0];
+    std::vector<uint16_t> dids;
+    std::vector<uint8_t> value;
+    std::vector<stc::Command> cmds;
+    std::vector<uint8_t> image;
+    if (cmd == "update") {
+        std::ifstream in(opt.command.size() == 2u ? opt.command[1] : std::string(), std::ios::binary);
+        if (!in) {
+            usage();
+            return 2;
+        }
+        image.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+        if (image.empty()) {
+            std::cerr << "stc_fleet: empty image\n";
+            return 2;
+        }
+    } else if (cmd == "configure") {
+        for (size_t i = 1; i < opt.command.size(); ++i) {
+            stc::Command c;
+            if (!parse_command(opt.command[i], c)) {
+                std::cerr << "stc_fleet: bad setting '" << opt.command[i] << "'\n";
+                return 2;
+            }
+            cmds.push_back(c);
+        }
+        if (cmds.empty()) {
+            usage();
+            return 2;
+        }
+    } else if (cmd == "read" || cmd == "write") {
+        for (size_t i = 1; i < opt.command.size() && (cmd == "read" || i == 1u); ++i) {
+            dids.push_back(static_cast<uint16_t>(std::strtoul(opt.command[i].c_str(), nullptr, 16)));
+        }
+        if (dids.empty() || (cmd == "write" && (opt.command.size() != 3u || !parse_hex(opt.command[2], value)))) {
+            usage();
+            return 2;
+        }
+    } else if (cmd == "describe") {
+        if (opt.command.size() > 2u) {
+            usage();
+            return 2;
+        }
+    } else if (cmd != "monitor" && cmd != "bench") {
+        usage();
+        return 2;
+    }
+
+    stc::Client client;
+    std::string err;
+    if (!client.open(opt.iface, err)) {
+        std::cerr << "stc_fleet: " << err << "\n";
+        return 1;
+    }
+    for (uint16_t id : opt.node_ids) {
+        stc::NodeConfig cfg;
+        cfg.node_id = id;
+        cfg.layout = opt.layout;
+        cfg.p2_ms = opt.p2_ms;
+        cfg.cmd_window = opt.window;
+        cfg.max_queued = std::max<size_t>(cfg.max_queued, cmd == "bench" ? opt.count : dids.size() + 1u);
+        if (client.add_node(cfg, err) < 0) {
+            std::cerr << "stc_fleet: " << err << "\n";
+            return 1;
+        }
+    }
+    if (!client.start(err)) {
+        std::cerr << "stc_fleet: " << err << "\n";
+        return 1;
+    }
+    std::signal(SIGINT, on_sigint);
+
+    int status = 0;
+    if (cmd == "monitor") status = run_monitor(client, opt);
+    if (cmd == "read") status = run_read(client, dids);
+    if (cmd == "write") status = run_write(client, dids[0], value);
+    if (cmd == "bench") status = run_bench(client, opt.count);
+    if (cmd == "configure") status = run_configure(client, cmds);
+    if (cmd == "update") status = run_update(client, image, opt.gap_us);
+    if (cmd == "describe") status = run_describe(client, opt.command.size() == 2u ? opt.command[1] : std::string());
+    client.stop();
+    return status;
+}
@@ -0,0 +1,69 @@
+/* can_frame.cpp
+ *
+ * Bit stream construction for the bus model: field layout, CRC-15 and
+ * bit stuffing (a complement bit after five equal bits, stuff bits included
+ * in the count).
+ */
+
+#include "can_frame.h"
+
+namespace sim {
+
+uint16_t crc15(const std::vector<uint8_t> &bits)
+{
+    uint16_t crc = 0;
+    for (uint8_t b : bits) {
+        const bool next = ((crc >> 14) & 1u) != (b & 1u);
+        crc = static_cast<uint16_t>((crc << 1) & 0x7FFFu);
+        if (next) {
+            crc ^= 0x4599u;
+        }
+    }
+    return crc;
+}
+
+FrameBits encode_frame(const CanFrame &f)
+{
+    std::vector<uint8_t> raw;
+    raw.reserve(83);
+    auto put = [&raw](uint32_t v, int n) {
+        for (int i = n - 1; i >= 0; --i) {
+            raw.push_back(static_cast<uint8_t>((v >> i) & 1u));
+        }
+    };
+
+    const uint8_t dlc = f.dlc > 8u ? 8u : f.dlc;
+    put(0u, 1);                     /* SOF */
+    put(f.id & 0x7FFu, 11);
+    put(f.rtr ? 1u : 0u, 1);        /* RTR */
+    put(0u, 1);                     /* IDE */
+    put(0u, 1);                     /* r0 */
+    put(f.dlc & 0xFu, 4);
+    if (!f.rtr) {
+        for (uint8_t i = 0; i < dlc; ++i) {
+            put(f.data[i], 8);
+        }
+    }
+    put(crc15(raw), 15);
+
+    FrameBits out;
+    out.bits.reserve(raw.size() + raw.size() / 4u + 1u);
+    uint8_t last = 2;
+    int run = 0;
+    for (size_t i = 0; i < raw.size(); ++i) {
+        if (i == 12u) {
+            out.arb_end = static_cast<uint32_t>(out.bits.size());
+        }
+        out.bits.push_back(raw[i]);
+        run = (raw[i] == last) ? run + 1 : 1;
+        last = raw[i];
+        if (run == 5) {
+            last = static_cast<uint8_t>(!last);
+            out.bits.push_back(last);
+            run = 1;
+        }
+    }
+    return out;
+}
+
+} // namespace sim
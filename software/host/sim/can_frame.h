@@ -0,0 +1,46 @@
+/* can_frame.h
+ *
+ * Classical CAN base-format frames at bit level: the stuffed bit stream from
+ * SOF to the end of the CRC field, as it appears on the wire.
+ */
+
+#ifndef STC_SIM_CAN_FRAME_H
+#define STC_SIM_CAN_FRAME_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace sim {
+
+struct CanFrame {
+    uint16_t id = 0;        /* 11-bit identifier */
+    uint8_t dlc = 0;
+    bool rtr = false;
+    uint8_t data[8] = {};
+};
+
+/* Bits after the CRC field: CRC delimiter, ACK slot, ACK delimiter, EOF. */
+constexpr uint32_t CAN_TRAILER_BITS = 10u;
+/* Intermission between two frames. */
+constexpr uint32_t CAN_IFS_BITS = 3u;
+/* Error flag (6) plus error delimiter (8). */
+constexpr uint32_t CAN_ERROR_FRAME_BITS = 14u;
+
+struct FrameBits {
+    std::vector<uint8_t> bits;  /* 0 = dominant, SOF .. last CRC bit, stuffed */
+    uint32_t arb_end = 0;       /* index of the RTR bit (last arbitration bit) */
+
+    /* Bits from SOF to the end of EOF. */
+    uint32_t total() const { return static_cast<uint32_t>(bits.size()) + CAN_TRAILER_BITS; }
+};
+
+/* CRC-15/CAN over an unstuffed bit sequence. */
+uint16_t crc15(const std::vector<uint8_t> &bits);
+
+/* Builds the stuffed bit stream of a data or remote frame. */
+FrameBits encode_frame(const CanFrame &f);
+
+} // namespace sim
+
+#endif
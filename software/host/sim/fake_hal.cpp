@@ -0,0 +1,638 @@
+/* fake_hal.cpp
+ *
+ * The subset of the STM32F0 HAL the firmware calls, implemented against the
+ * simulated node that is running. Every call charges CPU time and may yield.
+ * Time is the node's virtual clock: HAL_GetTick counts from its boot plus
+ * cfg.tick_offset_ms, and a main loop that polls without doing anything is
+ * fast-forwarded to its next wake-up (Simulator::poll_tick). Calls that only
+ * read state (tick, mailbox and FIFO levels, error code) use hal_poll() so
+ * they do not count as activity.
+ * Peripheral state the bus needs (mailboxes, FIFOs, filters, error counters)
+ * lives in sim::Node; registers the firmware reads directly (TSR, ESR, the
+ * mailbox identifiers) are kept up to date in the swapped register blocks.
+ *
+ * The clock tree follows HAL_RCC_OscConfig / HAL_RCC_ClockConfig (HSE 16 MHz,
+ * PLL, AHB and APB dividers); HCLK scales the CPU costs and PCLK times the
+ * CAN controller, also when it changes under a running controller. The ADC
+ * runs from HSI14. Flash program and erase work on the profile and event log
+ * pages and the update staging area only, and stall the core for the
+ * datasheet times.
+ */
+
+#include "sim.h"
+
+#include <algorithm>
+#include <cstring>
+
+using sim::Node;
+using sim::Simulator;
+
+namespace {
+
+constexpr uint64_t ADC_CLK_HZ = 14000000u;
+constexpr sim::ns_t MS = 1000000u;
+constexpr sim::ns_t PLL_LOCK_NS = 200000u;
+/* Flash timings of the STM32F042 datasheet (typical). */
+constexpr sim::ns_t FLASH_PROGRAM_NS = 53000u;
+constexpr sim::ns_t FLASH_ERASE_NS = 30 * MS;
+constexpr uint32_t FLASH_DATA_BASE = 0x08007000u;     /* profiles, event log */
+constexpr uint32_t FLASH_DATA_END = 0x08008000u;
+constexpr uint32_t FLASH_STAGE_SIZE = 0x8000u;
+/* Shift of the HPRE and PPRE divider codes, as AHBPrescTable / APBPrescTable. */
+constexpr uint8_t AHB_SHIFT[16] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 2, 3, 4, 6, 7, 8, 9 };
+constexpr uint8_t APB_SHIFT[8] = { 0, 0, 0, 0, 1, 2, 3, 4 };
+
+Simulator &S() { return *Simulator::instance(); }
+Node &N() { return *S().current(); }
+
+int gpio_index(const GPIO_TypeDef *port)
+{
+    if (port == GPIOA) return 0;
+    if (port == GPIOB) return 1;
+    return 2;
+}
+
+/* Milliseconds since boot, before the tick offset. */
+uint64_t ms_since_boot(const Node &n, sim::ns_t t)
+{
+    return (t - n.boot_at) / MS;
+}
+
+uint32_t tick_of(const Node &n, sim::ns_t t)
+{
+    return static_cast<uint32_t>(ms_since_boot(n, t) + S().config().tick_offset_ms);
+}
+
+/* Bit time the controller runs at with its BTR and the node's PCLK. */
+sim::ns_t can_bit_ns(const Node &n)
+{
+    const uint32_t btr = n.hcan->Instance->BTR;
+    const uint64_t brp = (btr & CAN_BTR_BRP) + 1u;
+    const uint64_t bs1 = ((btr & CAN_BTR_TS1) >> CAN_BTR_TS1_Pos) + 1u;
+    const uint64_t bs2 = ((btr & CAN_BTR_TS2) >> CAN_BTR_TS2_Pos) + 1u;
+    return brp * (1u + bs1 + bs2) * 1000000000u / n.pclk_hz;
+}
+
+/* Profile and event log pages, or the staging area of the running node. */
+bool flash_writable(uint32_t addr)
+{
+    return (addr >= FLASH_DATA_BASE && addr < FLASH_DATA_END) || (addr - sim_update_stage_base) < FLASH_STAGE_SIZE;
+}
+
+} // namespace
+
+extern "C" {
+
+uint32_t sim_update_stage_base = 0u;
+
+/* ===== CPU hooks for cmsis_host.h ===== */
+
+uint32_t sim_cpu_get_primask(void)
+{
+    Node *n = S().current();
+    return (n != nullptr && n->primask) ? 1u : 0u;
+}
+
+void sim_cpu_set_primask(uint32_t primask)
+{
+    S().set_primask(primask != 0u);
+}
+
+/* ===== Timebase ===== */
+
+uint32_t Timebase_Module_Now_Us(void)
+{
+    const Node *n = S().current();
+    if (n == nullptr) {
+        return 0u;
+    }
+    const uint64_t us = ((n->in_isr ? n->isr_t : n->t) - n->boot_at) / 1000u;
+    return static_cast<uint32_t>(us + static_cast<uint64_t>(S().config().tick_offset_ms) * 1000u);
+}
+
+/* ===== Core ===== */
+
+HAL_StatusTypeDef HAL_Init(void)
+{
+    S().hal_enter();
+    return HAL_OK;
+}
+
+uint32_t HAL_GetTick(void)
+{
+    S().hal_poll();
+    const Node &n = N();
+    if (!n.in_isr) {
+        S().poll_tick(__builtin_return_address(0));
+    }
+    return tick_of(n, n.in_isr ? n.isr_t : n.t);
+}
+
+void HAL_Delay(uint32_t Delay)
+{
+    S().hal_enter();
+    Node &n = N();
+    uint32_t wait = Delay;
+    if (wait < HAL_MAX_DELAY) {
+        wait += 1u;     /* HAL_TICK_FREQ_DEFAULT */
+    }
+    const uint64_t start = ms_since_boot(n, n.t);
+    S().advance_to(n.boot_at + (start + wait) * MS);
+}
+
+HAL_StatusTypeDef HAL_RCC_OscConfig(RCC_OscInitTypeDef *RCC_OscInitStruct)
+{
+    if (RCC_OscInitStruct == nullptr) {
+        S().hal_enter();
+        return HAL_ERROR;
+    }
+    Node &n = N();
+    const RCC_PLLInitTypeDef &pll = RCC_OscInitStruct->PLL;
+    if (pll.PLLState == RCC_PLL_ON) {
+        /* Waits for the lock when it was off. */
+        S().hal_enter(S().config().hal_cost_ns + (n.pll_on ? 0u : PLL_LOCK_NS));
+        const uint32_t mul = ((pll.PLLMUL & RCC_CFGR_PLLMUL) >> RCC_CFGR_PLLMUL_Pos) + 2u;
+        const uint32_t div = (pll.PREDIV & RCC_CFGR2_PREDIV) + 1u;
+        const uint32_t src = (pll.PLLSource == RCC_PLLSOURCE_HSE) ? HSE_VALUE : HSI_VALUE / 2u;
+        if (n.pll_on && n.sysclk_pll && src / div * mul != n.pll_hz) {
+            return HAL_ERROR;   /* the PLL drives SYSCLK */
+        }
+        n.pll_hz = src / div * mul;
+        n.pll_on = true;
+        return HAL_OK;
+    }
+    S().hal_enter();
+    if (pll.PLLState == RCC_PLL_OFF) {
+        if (n.sysclk_pll) {
+            return HAL_ERROR;
+        }
+        n.pll_on = false;
+    }
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_RCC_ClockConfig(RCC_ClkInitTypeDef *RCC_ClkInitStruct, uint32_t FLatency)
+{
+    (void)FLatency;
+    S().hal_enter();
+    if (RCC_ClkInitStruct == nullptr) {
+        return HAL_ERROR;
+    }
+    Node &n = N();
+    const RCC_ClkInitTypeDef &c = *RCC_ClkInitStruct;
+    if ((c.ClockType & RCC_CLOCKTYPE_SYSCLK) != 0u) {
+        if (c.SYSCLKSource == RCC_SYSCLKSOURCE_PLLCLK) {
+            if (!n.pll_on) {
+                return HAL_ERROR;
+            }
+            n.sysclk_hz = n.pll_hz;
+        } else {
+            n.sysclk_hz = (c.SYSCLKSource == RCC_SYSCLKSOURCE_HSE) ? HSE_VALUE : HSI_VALUE;
+        }
+        n.sysclk_pll = (c.SYSCLKSource == RCC_SYSCLKSOURCE_PLLCLK);
+    }
+    uint32_t hclk = n.hclk_hz;
+    if ((c.ClockType & RCC_CLOCKTYPE_HCLK) != 0u) {
+        hclk = n.sysclk_hz >> AHB_SHIFT[(c.AHBCLKDivider & RCC_CFGR_HPRE) >> RCC_CFGR_HPRE_Pos];
+    }
+    uint32_t pclk = hclk / (n.hclk_hz / n.pclk_hz);   /* APB divider unchanged */
+    if ((c.ClockType & RCC_CLOCKTYPE_PCLK1) != 0u) {
+        pclk = hclk >> APB_SHIFT[(c.APB1CLKDivider & RCC_CFGR_PPRE) >> RCC_CFGR_PPRE_Pos];
+    }
+    n.hclk_hz = hclk;
+    n.pclk_hz = pclk;
+    /* A running controller follows PCLK at once: a mismatch takes it off the bus. */
+    if (n.hcan != nullptr) {
+        n.bit_ns = can_bit_ns(n);
+    }
+    return HAL_OK;
+}
+
+uint32_t HAL_RCC_GetSysClockFreq(void)
+{
+    S().hal_poll();
+    return N().sysclk_hz;
+}
+
+uint32_t HAL_RCC_GetHCLKFreq(void)
+{
+    S().hal_poll();
+    return N().hclk_hz;
+}
+
+uint32_t HAL_RCC_GetPCLK1Freq(void)
+{
+    S().hal_poll();
+    return N().pclk_hz;
+}
+
+void HAL_NVIC_SetPriority(IRQn_Type IRQn, uint32_t PreemptPriority, uint32_t SubPriority)
+{
+    (void)IRQn;
+    (void)PreemptPriority;
+    (void)SubPriority;
+    S().hal_enter();
+}
+
+void HAL_NVIC_EnableIRQ(IRQn_Type IRQn)
+{
+    (void)IRQn;
+    S().hal_enter();
+}
+
+/* ===== Flash (event log pages and update staging area only) ===== */
+
+HAL_StatusTypeDef HAL_FLASH_Unlock(void)
+{
+    S().hal_enter();
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_FLASH_Lock(void)
+{
+    S().hal_enter();
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_FLASH_Program(uint32_t TypeProgram, uint32_t Address, uint64_t Data)
+{
+    S().hal_enter();
+    if (TypeProgram != FLASH_TYPEPROGRAM_HALFWORD || (Address & 1u) != 0u ||
+        !flash_writable(Address)) {
+        return HAL_ERROR;
+    }
+    /* PGERR: only an erased half-word may be programmed (or cleared to 0). */
+    auto *p = reinterpret_cast<volatile uint16_t *>(static_cast<uintptr_t>(Address));
+    const uint16_t v = static_cast<uint16_t>(Data);
+    if (*p != 0xFFFFu && v != 0u) {
+        return HAL_ERROR;
+    }
+    S().stall(FLASH_PROGRAM_NS);
+    *p = v;
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_FLASHEx_Erase(FLASH_EraseInitTypeDef *pEraseInit, uint32_t *PageError)
+{
+    S().hal_enter();
+    *PageError = 0xFFFFFFFFu;
+    const uint32_t start = pEraseInit->PageAddress & ~(FLASH_PAGE_SIZE - 1u);
+    for (uint32_t k = 0; k < pEraseInit->NbPages; ++k) {
+        const uint32_t page = start + k * FLASH_PAGE_SIZE;
+        if (!flash_writable(page)) {
+            *PageError = page;
+            return HAL_ERROR;
+        }
+        S().stall(FLASH_ERASE_NS);
+        std::memset(reinterpret_cast<void *>(static_cast<uintptr_t>(page)), 0xFF, FLASH_PAGE_SIZE);
+    }
+    return HAL_OK;
+}
+
+/* ===== GPIO ===== */
+
+void HAL_GPIO_Init(GPIO_TypeDef *GPIOx, GPIO_InitTypeDef *GPIO_Init)
+{
+    (void)GPIOx;
+    (void)GPIO_Init;
+    S().hal_enter();
+}
+
+void HAL_GPIO_WritePin(GPIO_TypeDef *GPIOx, uint16_t GPIO_Pin, GPIO_PinState PinState)
+{
+    S().hal_enter();
+    uint32_t &odr = N().gpio_odr[gpio_index(GPIOx)];
+    odr = (PinState == GPIO_PIN_SET) ? (odr | GPIO_Pin) : (odr & ~static_cast<uint32_t>(GPIO_Pin));
+}
+
+void HAL_GPIO_TogglePin(GPIO_TypeDef *GPIOx, uint16_t GPIO_Pin)
+{
+    S().hal_enter();
+    Node &n = N();
+    n.gpio_odr[gpio_index(GPIOx)] ^= GPIO_Pin;
+    n.led_toggles++;
+}
+
+/* ===== ADC + DMA ===== */
+
+HAL_StatusTypeDef HAL_ADC_Init(ADC_HandleTypeDef *hadc)
+{
+    S().hal_enter();
+    if (hadc == nullptr) {
+        return HAL_ERROR;
+    }
+    N().hadc = hadc;
+    hadc->State = HAL_ADC_STATE_READY;
+    hadc->ErrorCode = HAL_ADC_ERROR_NONE;
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_ADC_ConfigChannel(ADC_HandleTypeDef *hadc, ADC_ChannelConfTypeDef *sConfig)
+{
+    S().hal_enter();
+    if (hadc == nullptr || sConfig == nullptr || N().adc_running) {
+        return HAL_ERROR;
+    }
+    const uint32_t bit = 1u << (sConfig->Channel & 0x1Fu);
+    if (sConfig->Rank == ADC_RANK_NONE) {
+        hadc->Instance->CHSELR &= ~bit;
+    } else {
+        hadc->Instance->CHSELR |= bit;
+        hadc->Instance->SMPR = sConfig->SamplingTime & ADC_SMPR_SMP;
+    }
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_ADCEx_Calibration_Start(ADC_HandleTypeDef *hadc)
+{
+    /* 83 ADC clock cycles */
+    S().hal_enter(S().config().hal_cost_ns + 83u * 1000000000u / ADC_CLK_HZ);
+    if (hadc == nullptr || N().adc_running) {
+        return HAL_ERROR;
+    }
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_ADC_Start_DMA(ADC_HandleTypeDef *hadc, uint32_t *pData, uint32_t Length)
+{
+    S().hal_enter();
+    Node &n = N();
+    if (hadc == nullptr || pData == nullptr || Length == 0u || n.adc_running) {
+        return HAL_ERROR;
+    }
+    /* Sampling time in half ADC cycles, plus 12.5 cycles of conversion. */
+    static const uint32_t SMP_HALF_CYCLES[8] = { 3u, 15u, 27u, 57u, 83u, 111u, 143u, 479u };
+    const uint32_t chsel = hadc->Instance->CHSELR & 0x7FFFFu;
+    const uint32_t channels = static_cast<uint32_t>(__builtin_popcount(chsel));
+    if (channels == 0u) {
+        return HAL_ERROR;
+    }
+    const uint64_t half_cycles = channels * (SMP_HALF_CYCLES[hadc->Instance->SMPR & 7u] + 25u);
+    n.hadc = hadc;
+    n.adc_chsel = chsel;
+    n.dma_buf = reinterpret_cast<uint16_t *>(pData);
+    n.dma_len = Length;
+    n.dma_idx = 0u;
+    n.scan_ns = half_cycles * 1000000000u / (2u * ADC_CLK_HZ);
+    n.next_scan = n.t + n.scan_ns;
+    n.adc_running = true;
+    hadc->State = HAL_ADC_STATE_REG_BUSY;
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_ADC_Stop_DMA(ADC_HandleTypeDef *hadc)
+{
+    S().hal_enter();
+    Node &n = N();
+    if (hadc == nullptr) {
+        return HAL_ERROR;
+    }
+    n.adc_running = false;
+    n.next_scan = sim::NS_NEVER;
+    n.dma_irq = false;
+    hadc->State = HAL_ADC_STATE_READY;
+    return HAL_OK;
+}
+
+__attribute__((weak)) void HAL_ADC_ConvCpltCallback(ADC_HandleTypeDef *hadc)
+{
+    (void)hadc;
+}
+
+/* ===== CAN ===== */
+
+HAL_StatusTypeDef HAL_CAN_Init(CAN_HandleTypeDef *hcan)
+{
+    S().hal_enter();
+    if (hcan == nullptr) {
+        return HAL_ERROR;
+    }
+    Node &n = N();
+    n.hcan = hcan;
+    n.nart = (hcan->Init.AutoRetransmission == DISABLE);
+    n.txfp = (hcan->Init.TransmitFifoPriority == ENABLE);
+    n.abom = (hcan->Init.AutoBusOff == ENABLE);
+    n.can_started = false;
+    hcan->Instance->BTR = (hcan->Init.Prescaler - 1u) | hcan->Init.TimeSeg1 | hcan->Init.TimeSeg2 |
+                          hcan->Init.SyncJumpWidth | hcan->Init.Mode;
+    n.bit_ns = can_bit_ns(n);
+    hcan->Instance->TSR = CAN_TSR_TME0 | CAN_TSR_TME1 | CAN_TSR_TME2;
+    hcan->State = HAL_CAN_STATE_READY;
+    hcan->ErrorCode = HAL_CAN_ERROR_NONE;
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_CAN_ConfigFilter(CAN_HandleTypeDef *hcan, const CAN_FilterTypeDef *sFilterConfig)
+{
+    S().hal_enter();
+    if (hcan == nullptr || sFilterConfig == nullptr || sFilterConfig->FilterBank >= 14u ||
+        (hcan->State != HAL_CAN_STATE_READY && hcan->State != HAL_CAN_STATE_LISTENING)) {
+        return HAL_ERROR;
+    }
+    const CAN_FilterTypeDef &c = *sFilterConfig;
+    sim::FilterBank &fb = N().filters[c.FilterBank];
+    fb.mode = c.FilterMode;
+    fb.scale = c.FilterScale;
+    fb.fifo = c.FilterFIFOAssignment;
+    fb.active = (c.FilterActivation == CAN_FILTER_ENABLE);
+    if (c.FilterScale == CAN_FILTERSCALE_16BIT) {
+        fb.fr1 = ((c.FilterMaskIdLow & 0xFFFFu) << 16) | (c.FilterIdLow & 0xFFFFu);
+        fb.fr2 = ((c.FilterMaskIdHigh & 0xFFFFu) << 16) | (c.FilterIdHigh & 0xFFFFu);
+    } else {
+        fb.fr1 = ((c.FilterIdHigh & 0xFFFFu) << 16) | (c.FilterIdLow & 0xFFFFu);
+        fb.fr2 = ((c.FilterMaskIdHigh & 0xFFFFu) << 16) | (c.FilterMaskIdLow & 0xFFFFu);
+    }
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_CAN_Start(CAN_HandleTypeDef *hcan)
+{
+    S().hal_enter();
+    if (hcan == nullptr || hcan->State != HAL_CAN_STATE_READY) {
+        return HAL_ERROR;
+    }
+    N().can_started = true;
+    hcan->State = HAL_CAN_STATE_LISTENING;
+    hcan->ErrorCode = HAL_CAN_ERROR_NONE;
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_CAN_Stop(CAN_HandleTypeDef *hcan)
+{
+    S().hal_enter();
+    if (hcan == nullptr || hcan->State != HAL_CAN_STATE_LISTENING) {
+        return HAL_ERROR;
+    }
+    N().can_started = false;
+    hcan->State = HAL_CAN_STATE_READY;
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_CAN_ActivateNotification(CAN_HandleTypeDef *hcan, uint32_t ActiveITs)
+{
+    S().hal_enter();
+    if (hcan == nullptr) {
+        return HAL_ERROR;
+    }
+    N().can_ier |= ActiveITs;
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_CAN_DeactivateNotification(CAN_HandleTypeDef *hcan, uint32_t InactiveITs)
+{
+    S().hal_enter();
+    if (hcan == nullptr) {
+        return HAL_ERROR;
+    }
+    N().can_ier &= ~InactiveITs;
+    return HAL_OK;
+}
+
+uint32_t HAL_CAN_GetTxMailboxesFreeLevel(const CAN_HandleTypeDef *hcan)
+{
+    S().hal_poll();
+    if (hcan == nullptr) {
+        return 0u;
+    }
+    const Node &n = N();
+    return static_cast<uint32_t>(std::count_if(std::begin(n.mb), std::end(n.mb), [](const sim::Mailbox &m) {
+        return m.state == sim::MbState::EMPTY;
+    }));
+}
+
+HAL_StatusTypeDef HAL_CAN_AddTxMessage(CAN_HandleTypeDef *hcan, const CAN_TxHeaderTypeDef *pHeader,
+                                       const uint8_t aData[], uint32_t *pTxMailbox)
+{
+    S().hal_enter();
+    if (hcan == nullptr || pHeader == nullptr || aData == nullptr || pTxMailbox == nullptr) {
+        return HAL_ERROR;
+    }
+    Node &n = N();
+    if (hcan->State != HAL_CAN_STATE_READY && hcan->State != HAL_CAN_STATE_LISTENING) {
+        hcan->ErrorCode |= HAL_CAN_ERROR_NOT_INITIALIZED;
+        return HAL_ERROR;
+    }
+    int free_mb = -1;
+    for (int i = 0; i < 3; ++i) {
+        if (n.mb[i].state == sim::MbState::EMPTY) {
+            free_mb = i;
+            break;
+        }
+    }
+    if (free_mb < 0 || pHeader->IDE != CAN_ID_STD) {
+        hcan->ErrorCode |= HAL_CAN_ERROR_PARAM;
+        return HAL_ERROR;
+    }
+
+    sim::Mailbox &m = n.mb[free_mb];
+    m.frame = sim::CanFrame{};
+    m.frame.id = static_cast<uint16_t>(pHeader->StdId & 0x7FFu);
+    m.frame.dlc = static_cast<uint8_t>(pHeader->DLC & 0xFu);
+    m.frame.rtr = (pHeader->RTR == CAN_RTR_REMOTE);
+    std::memcpy(m.frame.data, aData, std::min<uint32_t>(m.frame.dlc, 8u));
+    m.bits = sim::encode_frame(m.frame);
+    m.req = n.t;
+    m.seq = n.mb_seq++;
+    m.state = sim::MbState::PENDING;
+
+    CAN_TxMailBox_TypeDef &reg = hcan->Instance->sTxMailBox[free_mb];
+    reg.TIR = (static_cast<uint32_t>(m.frame.id) << CAN_TI0R_STID_Pos) | pHeader->RTR | CAN_TI0R_TXRQ;
+    reg.TDTR = m.frame.dlc;
+    std::memcpy(const_cast<uint32_t *>(&reg.TDLR), m.frame.data, 4);
+    std::memcpy(const_cast<uint32_t *>(&reg.TDHR), m.frame.data + 4, 4);
+    hcan->Instance->TSR &= ~(CAN_TSR_TME0 << free_mb);
+    *pTxMailbox = 1u << free_mb;
+    return HAL_OK;
+}
+
+/* A mailbox waiting for the bus (or for its next attempt) is emptied at
+ * once; one whose frame the bus has taken completes normally. */
+HAL_StatusTypeDef HAL_CAN_AbortTxRequest(CAN_HandleTypeDef *hcan, uint32_t TxMailboxes)
+{
+    S().hal_enter();
+    if (hcan == nullptr) {
+        return HAL_ERROR;
+    }
+    if (hcan->State != HAL_CAN_STATE_READY && hcan->State != HAL_CAN_STATE_LISTENING) {
+        hcan->ErrorCode |= HAL_CAN_ERROR_NOT_INITIALIZED;
+        return HAL_ERROR;
+    }
+    Node &n = N();
+    for (uint32_t m = 0; m < 3u; ++m) {
+        if ((TxMailboxes & (1u << m)) == 0u || n.mb[m].state != sim::MbState::PENDING) {
+            continue;
+        }
+        n.mb[m].state = sim::MbState::EMPTY;
+        n.mb_result[m] = sim::MB_ABORTED;
+        const uint32_t shift = 8u * m;
+        uint32_t tsr = hcan->Instance->TSR & ~((CAN_TSR_RQCP0 | CAN_TSR_TXOK0) << shift);
+        tsr |= (CAN_TSR_RQCP0 << shift) | (CAN_TSR_TME0 << m);
+        hcan->Instance->TSR = tsr;
+        hcan->Instance->sTxMailBox[m].TIR &= ~CAN_TI0R_TXRQ;
+        if (n.can_ier & CAN_IT_TX_MAILBOX_EMPTY) {
+            if (n.tx_irq == 0u) n.tx_irq_at = n.t;
+            n.tx_irq |= static_cast<uint8_t>(1u << m);
+        }
+    }
+    return HAL_OK;
+}
+
+uint32_t HAL_CAN_GetRxFifoFillLevel(const CAN_HandleTypeDef *hcan, uint32_t RxFifo)
+{
+    S().hal_poll();
+    if (hcan == nullptr) {
+        return 0u;
+    }
+    return static_cast<uint32_t>(N().fifo[RxFifo & 1u].size());
+}
+
+HAL_StatusTypeDef HAL_CAN_GetRxMessage(CAN_HandleTypeDef *hcan, uint32_t RxFifo,
+                                       CAN_RxHeaderTypeDef *pHeader, uint8_t aData[])
+{
+    S().hal_enter();
+    if (hcan == nullptr || pHeader == nullptr || aData == nullptr) {
+        return HAL_ERROR;
+    }
+    std::deque<sim::RxEntry> &q = N().fifo[RxFifo & 1u];
+    if (q.empty()) {
+        hcan->ErrorCode |= HAL_CAN_ERROR_PARAM;
+        return HAL_ERROR;
+    }
+    const sim::RxEntry e = q.front();
+    q.pop_front();
+    pHeader->StdId = e.frame.id;
+    pHeader->ExtId = 0u;
+    pHeader->IDE = CAN_ID_STD;
+    pHeader->RTR = e.frame.rtr ? CAN_RTR_REMOTE : CAN_RTR_DATA;
+    pHeader->DLC = e.frame.dlc;
+    pHeader->Timestamp = 0u;
+    pHeader->FilterMatchIndex = e.fmi;
+    std::memcpy(aData, e.frame.data, 8);
+    return HAL_OK;
+}
+
+uint32_t HAL_CAN_GetError(const CAN_HandleTypeDef *hcan)
+{
+    S().hal_poll();
+    return hcan != nullptr ? hcan->ErrorCode : 0u;
+}
+
+HAL_StatusTypeDef HAL_CAN_ResetError(CAN_HandleTypeDef *hcan)
+{
+    S().hal_enter();
+    if (hcan == nullptr) {
+        return HAL_ERROR;
+    }
+    hcan->ErrorCode = HAL_CAN_ERROR_NONE;
+    return HAL_OK;
+}
+
+__attribute__((weak)) void HAL_CAN_TxMailbox0CompleteCallback(CAN_HandleTypeDef *hcan) { (void)hcan; }
+__attribute__((weak)) void HAL_CAN_TxMailbox1CompleteCallback(CAN_HandleTypeDef *hcan) { (void)hcan; }
+__attribute__((weak)) void HAL_CAN_TxMailbox2CompleteCallback(CAN_HandleTypeDef *hcan) { (void)hcan; }
+__attribute__((weak)) void HAL_CAN_TxMailbox0AbortCallback(CAN_HandleTypeDef *hcan) { (void)hcan; }
+__attribute__((weak)) void HAL_CAN_TxMailbox1AbortCallback(CAN_HandleTypeDef *hcan) { (void)hcan; }
+__attribute__((weak)) void HAL_CAN_TxMailbox2AbortCallback(CAN_HandleTypeDef *hcan) { (void)hcan; }
+__attribute__((weak)) void HAL_CAN_ErrorCallback(CAN_HandleTypeDef *hcan) { (void)hcan; }
+
+} // extern "C"
@@ -0,0 +1,120 @@
+/* cmsis_host.h
+ *
+ * Host stand-in for cmsis_gcc.h, force-included (-include) ahead of every
+ * firmware source built for the simulator. It defines the cmsis_gcc.h include
+ * guard so the Cortex-M inline assembly never reaches the host compiler, and
+ * provides the same compiler macros and intrinsics in plain C.
+ *
+ * PRIMASK belongs to the simulated CPU of the node that is running; the
+ * simulator implements sim_cpu_get_primask() / sim_cpu_set_primask().
+ * Each node stages firmware updates at its own address, which the simulator
+ * sets in sim_update_stage_base before running the node.
+ */
+
+#ifndef CMSIS_HOST_H
+#define CMSIS_HOST_H
+
+#define __CMSIS_GCC_H   /* keep the Arm version out */
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+uint32_t sim_cpu_get_primask(void);
+void sim_cpu_set_primask(uint32_t primask);
+
+/* Update staging area of the running node (UPDATE_STAGE_BASE in the sim). */
+extern uint32_t sim_update_stage_base;
+
+#ifdef __cplusplus
+}
+#endif
+
+/* ===== Compiler specific defines (as cmsis_gcc.h) ===== */
+
+#ifndef __ASM
+#define __ASM                   __asm
+#endif
+#ifndef __INLINE
+#define __INLINE                inline
+#endif
+#ifndef __STATIC_INLINE
+#define __STATIC_INLINE         static inline
+#endif
+#ifndef __STATIC_FORCEINLINE
+#define __STATIC_FORCEINLINE    __attribute__((always_inline)) static inline
+#endif
+#ifndef __NO_RETURN
+#define __NO_RETURN             __attribute__((__noreturn__))
+#endif
+#ifndef __USED
+#define __USED                  __attribute__((used))
+#endif
+#ifndef __WEAK
+#define __WEAK                  __attribute__((weak))
+#endif
+#ifndef __PACKED
+#define __PACKED                __attribute__((packed, aligned(1)))
+#endif
+#ifndef __PACKED_STRUCT
+#define __PACKED_STRUCT         struct __attribute__((packed, aligned(1)))
+#endif
+#ifndef __PACKED_UNION
+#define __PACKED_UNION          union __attribute__((packed, aligned(1)))
+#endif
+#ifndef __ALIGNED
+#define __ALIGNED(x)            __attribute__((aligned(x)))
+#endif
+#ifndef __RESTRICT
+#define __RESTRICT              __restrict
+#endif
+
+/* ===== Core register access ===== */
+
+__STATIC_FORCEINLINE void __enable_irq(void)           { sim_cpu_set_primask(0u); }
+__STATIC_FORCEINLINE void __disable_irq(void)          { sim_cpu_set_primask(1u); }
+__STATIC_FORCEINLINE uint32_t __get_PRIMASK(void)      { return sim_cpu_get_primask(); }
+__STATIC_FORCEINLINE void __set_PRIMASK(uint32_t pm)   { sim_cpu_set_primask(pm & 1u); }
+__STATIC_FORCEINLINE uint32_t __get_CONTROL(void)      { return 0u; }
+__STATIC_FORCEINLINE void __set_CONTROL(uint32_t c)    { (void)c; }
+__STATIC_FORCEINLINE uint32_t __get_IPSR(void)         { return 0u; }
+__STATIC_FORCEINLINE uint32_t __get_APSR(void)         { return 0u; }
+__STATIC_FORCEINLINE uint32_t __get_xPSR(void)         { return 0u; }
+
+/* ===== Instructions ===== */
+
+#define __NOP()     ((void)0)
+#define __WFI()     ((void)0)
+#define __WFE()     ((void)0)
+#define __SEV()     ((void)0)
+#define __BKPT(v)   __builtin_trap()
+
+__STATIC_FORCEINLINE void __ISB(void) { __atomic_signal_fence(__ATOMIC_SEQ_CST); }
+__STATIC_FORCEINLINE void __DSB(void) { __atomic_signal_fence(__ATOMIC_SEQ_CST); }
+__STATIC_FORCEINLINE void __DMB(void) { __atomic_signal_fence(__ATOMIC_SEQ_CST); }
+
+__STATIC_FORCEINLINE uint32_t __REV(uint32_t v)   { return __builtin_bswap32(v); }
+__STATIC_FORCEINLINE uint32_t __REV16(uint32_t v)
+{
+    return ((v & 0xFF00FF00u) >> 8) | ((v & 0x00FF00FFu) << 8);
+}
+__STATIC_FORCEINLINE int16_t __REVSH(int16_t v)   { return (int16_t)__builtin_bswap16((uint16_t)v); }
+__STATIC_FORCEINLINE uint32_t __ROR(uint32_t v, uint32_t n)
+{
+    n %= 32u;
+    return (n == 0u) ? v : ((v >> n) | (v << (32u - n)));
+}
+__STATIC_FORCEINLINE uint32_t __RBIT(uint32_t v)
+{
+    uint32_t r = 0u;
+    for (int i = 0; i < 32; ++i) {
+        r = (r << 1) | (v & 1u);
+        v >>= 1;
+    }
+    return r;
+}
+#define __CLZ(v)    (uint8_t)((v) == 0u ? 32 : __builtin_clz(v))
+
+#endif /* CMSIS_HOST_H */
@@ -0,0 +1,1040 @@
+/* sim.cpp
+ *
+ * Scheduler, per-node firmware context switching and the bus model.
+ */
+
+/* Fiber switches after the first one use _setjmp/_longjmp between stacks,
+ * which skips the signal mask system calls of swapcontext; the fortified
+ * longjmp would reject the stack change. */
+#undef _FORTIFY_SOURCE
+
+#include "sim.h"
+
+#include "can_diag_module.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstring>
+#include <ctime>
+#include <sys/mman.h>
+#include <thread>
+#include <unistd.h>
+
+#ifndef MAP_FIXED_NOREPLACE
+#define MAP_FIXED_NOREPLACE 0x100000
+#endif
+
+extern "C" {
+extern char __fw_state_start[];
+extern char __fw_state_end[];
+int fw_main(void);
+}
+
+namespace sim {
+
+namespace {
+
+constexpr size_t FIBER_STACK = 256u * 1024u;
+/* Register bytes swapped per node: control, status and TX mailboxes of the
+ * bxCAN (the FIFOs and filters are modelled in Node), the whole ADC block. */
+constexpr size_t CAN_REGS = offsetof(CAN_TypeDef, sFIFOMailBox);
+constexpr size_t ADC_REGS = sizeof(ADC_TypeDef);
+/* Flash pages of the profiles and the event log, per node; the rest of flash
+ * is the host binary. */
+constexpr uintptr_t FLASH_DATA_BASE = 0x08007000u;
+constexpr size_t FLASH_DATA_SIZE = 0x1000u;
+/* Update staging areas, one per node, back to back from the end of a
+ * 32 KB part; the firmware reads its base from sim_update_stage_base. */
+constexpr uintptr_t FLASH_STAGE_BASE = 0x08008000u;
+constexpr size_t FLASH_STAGE_SIZE = 0x8000u;
+/* Bits from a bus decision to its first effect on a node: the end of an error
+ * frame raised at the SOF bit when bit errors are injected, else the end of an
+ * error frame after a bit error just past the arbitration field (bit 13). */
+constexpr uint32_t LOOKAHEAD_BITS_BER = 1u + CAN_ERROR_FRAME_BITS;
+constexpr uint32_t LOOKAHEAD_BITS = 14u + CAN_ERROR_FRAME_BITS;
+constexpr uint32_t BUS_OFF_RECOVERY_BITS = 128u * 11u;
+/* Bus time between wall clock checks of a paced run (and socket I/O of a bridge). */
+constexpr ns_t PACE_NS = 500000u;
+
+/* Peripheral pages the firmware dereferences directly. */
+struct PeriphRange {
+    uintptr_t base;
+    size_t size;
+};
+constexpr PeriphRange PERIPH_PAGES[] = {
+    { 0x40006000u, 0x1000u },   /* bxCAN */
+    { 0x40012000u, 0x1000u },   /* ADC */
+    { 0x40020000u, 0x3000u },   /* DMA1, RCC, FLASH interface */
+    { 0x48000000u, 0x2000u },   /* GPIOA..GPIOF */
+    { 0x08007000u, 0x1000u },   /* flash holding the profile and event log pages */
+    { 0x1FFFF000u, 0x1000u },   /* system memory: unique ID and flash size registers */
+};
+
+uint8_t *state_begin() { return reinterpret_cast<uint8_t *>(__fw_state_start); }
+size_t state_size() { return static_cast<size_t>(__fw_state_end - __fw_state_start); }
+uint8_t *can_block() { return reinterpret_cast<uint8_t *>(CAN); }
+uint8_t *adc_block() { return reinterpret_cast<uint8_t *>(ADC1); }
+uint8_t *flash_data_block() { return reinterpret_cast<uint8_t *>(FLASH_DATA_BASE); }
+
+void map_peripherals()
+{
+    for (const PeriphRange &r : PERIPH_PAGES) {
+        void *want = reinterpret_cast<void *>(r.base);
+        void *got = mmap(want, r.size, PROT_READ | PROT_WRITE,
+                         MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED_NOREPLACE, -1, 0);
+        if (got != want) {
+            std::fprintf(stderr, "stc_sim: cannot map peripheral page 0x%08lx\n",
+                         static_cast<unsigned long>(r.base));
+            std::exit(1);
+        }
+    }
+    /* HSI14 for the ADC reports ready as soon as it is switched on. */
+    RCC->CR2 |= RCC_CR2_HSI14RDY;
+}
+
+/* Erased staging areas for `nodes` nodes; the flash size register covers them
+ * all, so every node's area lies in its flash. */
+void map_stages(uint32_t nodes)
+{
+    const size_t bytes = static_cast<size_t>(nodes) * FLASH_STAGE_SIZE;
+    void *want = reinterpret_cast<void *>(FLASH_STAGE_BASE);
+    void *got = mmap(want, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED_NOREPLACE, -1, 0);
+    if (got != want) {
+        std::fprintf(stderr, "stc_sim: cannot map the update staging areas\n");
+        std::exit(1);
+    }
+    std::memset(got, 0xFF, bytes);
+    *reinterpret_cast<uint16_t *>(FLASHSIZE_BASE) = static_cast<uint16_t>((FLASH_STAGE_BASE - FLASH_BASE + bytes) / 1024u);
+}
+
+/* Filter element match in the bxCAN register formats. */
+bool filter_match(const FilterBank &fb, const CanFrame &f, uint32_t &elements)
+{
+    const uint32_t id = f.id & 0x7FFu;
+    if (fb.scale == CAN_FILTERSCALE_32BIT) {
+        const uint32_t v = (id << 21) | (f.rtr ? 2u : 0u);
+        if (fb.mode == CAN_FILTERMODE_IDMASK) {
+            elements = 1u;
+            return ((v ^ fb.fr1) & fb.fr2) == 0u;
+        }
+        elements = 2u;
+        return v == fb.fr1 || v == fb.fr2;
+    }
+    const uint32_t v = (id << 5) | (f.rtr ? 0x10u : 0u);
+    const uint32_t lo1 = fb.fr1 & 0xFFFFu, hi1 = fb.fr1 >> 16;
+    const uint32_t lo2 = fb.fr2 & 0xFFFFu, hi2 = fb.fr2 >> 16;
+    if (fb.mode == CAN_FILTERMODE_IDMASK) {
+        elements = 2u;
+        return ((v ^ lo1) & hi1) == 0u || ((v ^ lo2) & hi2) == 0u;
+    }
+    elements = 4u;
+    return v == lo1 || v == hi1 || v == lo2 || v == hi2;
+}
+
+} // namespace
+
+/* ===== Node ===== */
+
+uint32_t Node::esr() const
+{
+    uint32_t v = (rec & 0xFFu) << CAN_ESR_REC_Pos | (std::min<uint32_t>(tec, 255u) << CAN_ESR_TEC_Pos);
+    if (bus_off) v |= CAN_ESR_BOFF;
+    if (tec >= 128u || rec >= 128u) v |= CAN_ESR_EPVF;
+    if (tec >= 96u || rec >= 96u) v |= CAN_ESR_EWGF;
+    return v;
+}
+
+/* ===== Bus ===== */
+
+ns_t Bus::next_start(const std::vector<std::unique_ptr<Node>> &nodes)
+{
+    ns_t first = NS_NEVER;
+    each(nodes, [&](const Node &n) {
+        if (!n.can_started || n.bit_ns != bit_ns_) return;
+        for (const Mailbox &m : n.mb) {
+            if (m.state != MbState::PENDING) continue;
+            ns_t at = std::max(align(m.req), n.suspend_until);
+            if (n.bus_off) at = std::max(at, n.bus_off_until);
+            first = std::min(first, at);
+        }
+    });
+    return first == NS_NEVER ? NS_NEVER : std::max(first, idle_at_);
+}
+
+void Bus::tx_error(Node &n, ns_t err_end, bool ack_error, uint32_t lec)
+{
+    n.stats.tx_errors++;
+    /* An error-passive transmitter that only misses the ACK keeps its TEC. */
+    if (!(ack_error && n.tec >= 128u)) {
+        n.tec += 8u;
+    }
+    if (n.tec > 255u) {
+        n.bus_off = true;
+        n.stats.bus_off++;
+        n.bus_off_until = n.abom ? err_end + BUS_OFF_RECOVERY_BITS * bit_ns_ : NS_NEVER;
+        NodeEvent ev;
+        ev.t = err_end;
+        ev.kind = EvKind::ESR;
+        ev.code = n.esr() | (lec << CAN_ESR_LEC_Pos);
+        n.post(ev);
+        if (n.abom) {
+            n.tec = 0u;
+            n.rec = 0u;
+            ev.t = n.bus_off_until;
+            ev.code = 0u;
+            n.post(ev);
+        }
+        return;
+    }
+    NodeEvent ev;
+    ev.t = err_end;
+    ev.kind = EvKind::ESR;
+    ev.code = n.esr() | (lec << CAN_ESR_LEC_Pos);
+    n.post(ev);
+}
+
+void Bus::rx_error(Node &n, ns_t err_end, uint32_t lec)
+{
+    if (n.rec < 255u) n.rec++;
+    NodeEvent ev;
+    ev.t = err_end;
+    ev.kind = EvKind::ESR;
+    ev.code = n.esr() | (lec << CAN_ESR_LEC_Pos);
+    n.post(ev);
+}
+
+bool Bus::resolve(ns_t t, std::vector<std::unique_ptr<Node>> &nodes)
+{
+    struct Contender {
+        Node *node;
+        int mb;
+    };
+    std::vector<Contender> active;
+    each(nodes, [&](Node &n) {
+        if (n.bus_off && t >= n.bus_off_until) {
+            n.bus_off = false;
+        }
+        if (!n.on_bus(t, bit_ns_) || t < n.suspend_until) return;
+        int best = -1;
+        for (int i = 0; i < 3; ++i) {
+            const Mailbox &m = n.mb[i];
+            if (m.state != MbState::PENDING || m.req > t) continue;
+            if (best < 0) {
+                best = i;
+            } else if (n.txfp ? m.seq < n.mb[best].seq : m.frame.id < n.mb[best].frame.id) {
+                best = i;
+            }
+        }
+        if (best >= 0) active.push_back({ &n, best });
+    });
+    if (active.empty()) {
+        return false;
+    }
+
+    /* Wired-AND over the stuffed streams: a node sending recessive on a
+     * dominant bus loses arbitration inside the arbitration field and sees a
+     * bit error after it. */
+    std::vector<Contender> lost;
+    int64_t err_bit = -1;
+    for (uint32_t i = 0; active.size() > 1u; ++i) {
+        uint8_t bus = 1;
+        bool any = false;
+        for (const Contender &c : active) {
+            const FrameBits &fb = c.node->mb[c.mb].bits;
+            if (i < fb.bits.size()) {
+                bus &= fb.bits[i];
+                any = true;
+            }
+        }
+        if (!any) break;
+        std::vector<Contender> keep;
+        for (const Contender &c : active) {
+            const FrameBits &fb = c.node->mb[c.mb].bits;
+            const uint8_t sent = i < fb.bits.size() ? fb.bits[i] : 1u;
+            if (sent == 1u && bus == 0u) {
+                if (i <= fb.arb_end) {
+                    lost.push_back(c);
+                    c.node->stats.arb_lost++;
+                    continue;
+                }
+                err_bit = i;
+            }
+            keep.push_back(c);
+        }
+        active.swap(keep);
+        if (err_bit >= 0) break;
+    }
+
+    const FrameBits &wire = active.front().node->mb[active.front().mb].bits;
+    const uint32_t total = wire.total();
+    bool ack_error = false;
+
+    std::vector<Node *> receivers;
+    each(nodes, [&](Node &n) {
+        if (!n.on_bus(t, bit_ns_)) return;
+        const bool sender = std::any_of(active.begin(), active.end(),
+                                        [&n](const Contender &c) { return c.node == &n; });
+        if (!sender) receivers.push_back(&n);
+    });
+    if (err_bit < 0 && receivers.empty()) {
+        err_bit = static_cast<int64_t>(wire.bits.size()) + 1;   /* ACK slot stays recessive */
+        ack_error = true;
+    }
+    if (ber_ > 0.0) {
+        std::uniform_real_distribution<double> u(0.0, 1.0);
+        const double k = std::floor(std::log(1.0 - u(rng_)) / std::log1p(-ber_));
+        if (k < static_cast<double>(total) && (err_bit < 0 || k < static_cast<double>(err_bit))) {
+            err_bit = static_cast<int64_t>(k);
+            ack_error = false;
+        }
+    }
+
+    if (err_bit >= 0) {
+        const uint64_t bits = static_cast<uint64_t>(err_bit) + 1u + CAN_ERROR_FRAME_BITS;
+        const ns_t err_end = t + bits * bit_ns_;
+        idle_at_ = err_end + CAN_IFS_BITS * bit_ns_;
+        stats_.error_frames++;
+        stats_.last_error = t;
+        stats_.busy_bits += bits;
+        /* Last error code: the transmitter monitors its own bits (bit
+         * recessive/dominant error) and the ACK slot; receivers see a stuff
+         * error in the frame, a CRC error in the CRC field and a form error
+         * in the fixed-form tail. */
+        const uint64_t eb = static_cast<uint64_t>(err_bit);
+        const uint64_t crc_start = wire.bits.size() > 15u ? wire.bits.size() - 15u : 0u;
+        const uint32_t rx_lec = eb < crc_start ? 1u : (eb < wire.bits.size() ? 6u : 2u);
+        for (const Contender &c : active) {
+            Node &n = *c.node;
+            const FrameBits &fb = n.mb[c.mb].bits;
+            uint32_t lec = 2u;
+            if (ack_error) {
+                lec = 3u;
+            } else if (eb < fb.bits.size()) {
+                lec = fb.bits[eb] ? 4u : 5u;
+            }
+            tx_error(n, err_end, ack_error, lec);
+            if (n.tec >= 128u) {
+                n.suspend_until = idle_at_ + 8u * bit_ns_;   /* suspend transmission */
+            }
+            if (n.nart) {
+                n.mb[c.mb].state = MbState::ON_BUS;
+                NodeEvent ev;
+                ev.t = err_end;
+                ev.kind = EvKind::TX_FAIL;
+                ev.mailbox = static_cast<uint8_t>(c.mb);
+                ev.code = HAL_CAN_ERROR_TX_TERR0 << (4u * c.mb);
+                n.post(ev);
+            }
+        }
+        for (Node *r : receivers) {
+            rx_error(*r, err_end, rx_lec);
+        }
+        for (const Contender &c : lost) {
+            if (c.node->nart) {
+                c.node->mb[c.mb].state = MbState::ON_BUS;
+                NodeEvent ev;
+                ev.t = err_end;
+                ev.kind = EvKind::TX_FAIL;
+                ev.mailbox = static_cast<uint8_t>(c.mb);
+                ev.code = HAL_CAN_ERROR_TX_ALST0 << (4u * c.mb);
+                c.node->post(ev);
+            }
+        }
+        return true;
+    }
+
+    const ns_t end = t + static_cast<ns_t>(total) * bit_ns_;
+    idle_at_ = end + CAN_IFS_BITS * bit_ns_;
+    stats_.frames++;
+    stats_.busy_bits += total;
+    const CanFrame frame = active.front().node->mb[active.front().mb].frame;
+    auto mix = [this](uint64_t v, int bytes) {
+        for (int i = 0; i < bytes; ++i) {
+            stats_.digest = (stats_.digest ^ ((v >> (8 * i)) & 0xFFu)) * 0x100000001b3u;
+        }
+    };
+    mix(end, 8);
+    mix(frame.id | (frame.rtr ? 0x8000u : 0u) | (static_cast<uint64_t>(frame.dlc) << 16), 3);
+    for (uint8_t i = 0; i < frame.dlc && i < 8u; ++i) {
+        mix(frame.data[i], 1);
+    }
+
+    for (const Contender &c : active) {
+        Node &n = *c.node;
+        Mailbox &m = n.mb[c.mb];
+        m.state = MbState::ON_BUS;
+        n.stats.tx_ok++;
+        n.stats.last_tx = end;
+        n.stats.tx_lat_us.push_back(static_cast<uint32_t>((end - m.req) / 1000u));
+        const uint32_t before = n.esr();
+        if (n.tec > 0u) n.tec--;
+        NodeEvent ev;
+        ev.t = end;
+        ev.kind = EvKind::TX_DONE;
+        ev.mailbox = static_cast<uint8_t>(c.mb);
+        n.post(ev);
+        if (n.esr() != before) {
+            ev.kind = EvKind::ESR;
+            ev.code = n.esr();
+            n.post(ev);
+        }
+    }
+    for (Node *r : receivers) {
+        const uint32_t before = r->esr();
+        if (r->rec > 127u) {
+            r->rec = 120u;
+        } else if (r->rec > 0u) {
+            r->rec--;
+        }
+        NodeEvent ev;
+        ev.t = end - bit_ns_;   /* valid for receivers at the last-but-one EOF bit */
+        ev.kind = EvKind::RX;
+        ev.frame = frame;
+        r->post(ev);
+        if (r->esr() != before) {
+            ev.kind = EvKind::ESR;
+            ev.code = r->esr();
+            r->post(ev);
+        }
+    }
+    for (const Contender &c : lost) {
+        if (c.node->nart) {
+            c.node->mb[c.mb].state = MbState::ON_BUS;
+            NodeEvent ev;
+            ev.t = end;
+            ev.kind = EvKind::TX_FAIL;
+            ev.mailbox = static_cast<uint8_t>(c.mb);
+            ev.code = HAL_CAN_ERROR_TX_ALST0 << (4u * c.mb);
+            c.node->post(ev);
+        }
+    }
+
+    if (log_ != nullptr) {
+        std::fprintf(log_, "(%llu.%06llu) can0 %03X#", static_cast<unsigned long long>(end / 1000000000u),
+                     static_cast<unsigned long long>((end / 1000u) % 1000000u), frame.id);
+        if (frame.rtr) {
+            std::fputc('R', log_);
+        } else {
+            for (uint8_t i = 0; i < frame.dlc && i < 8u; ++i) {
+                std::fprintf(log_, "%02X", frame.data[i]);
+            }
+        }
+        std::fputc('\n', log_);
+    }
+    return true;
+}
+
+/* ===== Simulator ===== */
+
+Simulator *Simulator::s_instance = nullptr;
+volatile sig_atomic_t Simulator::s_stop = 0;
+
+Simulator::Simulator(const Config &cfg) : cfg_(cfg), bus_(1000000000u / cfg.baud, cfg.ber, cfg.seed)
+{
+    s_instance = this;
+    map_peripherals();
+    pristine_.assign(state_begin(), state_begin() + state_size());
+
+    map_stages(std::max<uint32_t>(cfg.nodes, 1u));
+
+    std::mt19937_64 rng(cfg.seed ^ 0x5bd1e995u);
+    std::uniform_real_distribution<double> stagger(0.0, cfg.stagger_ms * 1e6);
+    for (uint32_t k = 0; k < cfg.nodes; ++k) {
+        auto n = std::make_unique<Node>();
+        n->index = k;
+        n->node_id = static_cast<uint8_t>(cfg.first_node + k * cfg.stride);
+        n->boot_at = static_cast<ns_t>(stagger(rng));
+        n->t = n->boot_at;
+        n->image = pristine_;
+        n->can_regs.assign(CAN_REGS, 0u);
+        n->adc_regs.assign(ADC_REGS, 0u);
+        n->flash_data.assign(FLASH_DATA_SIZE, 0xFFu);
+        /* Wafer coordinates, lot and wafer number: distinct per node. */
+        n->uid[0] = 0x00200010u + (k % 32u) * 0x10000u + k / 32u;
+        n->uid[1] = 0x31365713u;
+        n->uid[2] = 0x20353850u + k / 1024u;
+        n->stack.assign(FIBER_STACK, 0u);
+        nodes_.push_back(std::move(n));
+    }
+
+    if (!cfg.log_path.empty()) {
+        log_ = std::fopen(cfg.log_path.c_str(), "w");
+        if (log_ == nullptr) {
+            std::fprintf(stderr, "stc_sim: cannot write %s\n", cfg.log_path.c_str());
+            std::exit(1);
+        }
+        bus_.set_log(log_);
+    }
+}
+
+Simulator::~Simulator()
+{
+    if (log_ != nullptr) {
+        std::fclose(log_);
+    }
+    munmap(reinterpret_cast<void *>(FLASH_STAGE_BASE), std::max<uint32_t>(cfg_.nodes, 1u) * FLASH_STAGE_SIZE);
+    s_instance = nullptr;
+}
+
+void Simulator::attach(SocketCanPort *port)
+{
+    port_ = port;
+    bridge_ = std::make_unique<Node>();
+    Node &b = *bridge_;
+    b.index = cfg_.nodes;
+    b.external = true;
+    b.can_started = true;
+    b.bit_ns = bus_.bit_ns();
+    b.txfp = true;          /* socket order */
+    b.abom = true;
+    bus_.set_external(&b);
+}
+
+void Simulator::bridge_service()
+{
+    Node &b = *bridge_;
+    while (!b.events.empty() && b.events.top().t <= now_) {
+        const NodeEvent ev = b.events.top();
+        b.events.pop();
+        switch (ev.kind) {
+        case EvKind::TX_DONE:
+            bridge_stats_.from_socket++;
+            b.mb[ev.mailbox].state = MbState::EMPTY;
+            break;
+        case EvKind::TX_FAIL:
+            b.mb[ev.mailbox].state = MbState::EMPTY;
+            break;
+        case EvKind::RX:
+            if (port_ != nullptr) {
+                bridge_stats_.to_socket++;
+                port_->queue(ev.frame);
+            }
+            break;
+        case EvKind::ESR:
+            break;
+        }
+    }
+    b.stats.tx_lat_us.clear();     /* not reported for the bridge */
+    for (Mailbox &m : b.mb) {
+        if (inject_.empty()) break;
+        if (m.state != MbState::EMPTY) continue;
+        m.frame = inject_.front().second;
+        m.bits = encode_frame(m.frame);
+        m.req = std::max(now_, inject_.front().first);
+        m.seq = b.mb_seq++;
+        m.state = MbState::PENDING;
+        inject_.pop_front();
+    }
+}
+
+void Simulator::pace()
+{
+    /* Hold bus time at the (scaled) wall clock; a bridge waits for socket input meanwhile. */
+    const double speed = port_ != nullptr ? 1.0 : cfg_.speed;
+    const double elapsed =
+        std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - wall_origin_).count();
+    const ns_t wall = static_cast<ns_t>(elapsed * speed);
+    if (now_ <= wall) {
+        max_lag_ns_ = std::max(max_lag_ns_, wall - now_);
+        return;
+    }
+    const ns_t ahead_ns = std::min<ns_t>(static_cast<ns_t>(static_cast<double>(now_ - wall) / speed), 1000000000u);
+    if (port_ == nullptr) {
+        std::this_thread::sleep_for(std::chrono::nanoseconds(ahead_ns));
+    } else if (ahead_ns >= 1000000u) {
+        port_->wait(static_cast<int>(ahead_ns / 1000000u));
+    }
+}
+
+void Simulator::bridge_pump()
+{
+    port_->flush();
+    pace();
+
+    rx_batch_.clear();
+    port_->receive(rx_batch_);
+    for (const TimedFrame &tf : rx_batch_) {
+        const int64_t rel = tf.rt_ns - rt_origin_ns_;
+        inject_.emplace_back(std::max(now_, rel > 0 ? static_cast<ns_t>(rel) : 0u), tf.frame);
+    }
+    bridge_service();
+}
+
+void Simulator::store(Node &n)
+{
+    std::memcpy(n.image.data(), state_begin(), state_size());
+    std::memcpy(n.can_regs.data(), can_block(), CAN_REGS);
+    std::memcpy(n.adc_regs.data(), adc_block(), ADC_REGS);
+    std::memcpy(n.flash_data.data(), flash_data_block(), FLASH_DATA_SIZE);
+}
+
+void Simulator::load(Node &n)
+{
+    if (loaded_ == &n) {
+        return;
+    }
+    if (loaded_ != nullptr) {
+        store(*loaded_);
+    }
+    std::memcpy(state_begin(), n.image.data(), state_size());
+    std::memcpy(can_block(), n.can_regs.data(), CAN_REGS);
+    std::memcpy(adc_block(), n.adc_regs.data(), ADC_REGS);
+    std::memcpy(flash_data_block(), n.flash_data.data(), FLASH_DATA_SIZE);
+    std::memcpy(reinterpret_cast<void *>(UID_BASE), n.uid, sizeof(n.uid));
+    sim_update_stage_base = static_cast<uint32_t>(FLASH_STAGE_BASE + n.index * FLASH_STAGE_SIZE);
+    loaded_ = &n;
+}
+
+void Simulator::call_in(Node &n, const std::function<void()> &f)
+{
+    load(n);
+    f();
+}
+
+void Simulator::fiber_entry()
+{
+    /* Power-on reset (the NRST pin follows the supply). */
+    RCC->CSR = RCC_CSR_PORRSTF | RCC_CSR_PINRSTF;
+    (void)fw_main();
+    /* The firmware main loop never returns; park the fiber if it does. */
+    for (;;) {
+        s_instance->cur_->t = NS_NEVER - 1u;
+        s_instance->yield();
+    }
+}
+
+void Simulator::run_node(Node &n, ns_t horizon)
+{
+    n.horizon = horizon;
+    load(n);
+    cur_ = &n;
+    running_node_.store(static_cast<int>(n.index), std::memory_order_relaxed);
+    if (_setjmp(sched_jb_) == 0) {
+        if (n.fiber_started) {
+            _longjmp(n.jb, 1);
+        }
+        n.fiber_started = true;
+        getcontext(&n.ctx);
+        n.ctx.uc_stack.ss_sp = n.stack.data();
+        n.ctx.uc_stack.ss_size = n.stack.size();
+        n.ctx.uc_link = nullptr;
+        makecontext(&n.ctx, &Simulator::fiber_entry, 0);
+        setcontext(&n.ctx);
+    }
+    cur_ = nullptr;
+    progress_.fetch_add(1u, std::memory_order_relaxed);
+}
+
+void Simulator::yield()
+{
+    if (_setjmp(cur_->jb) == 0) {
+        _longjmp(sched_jb_, 1);
+    }
+}
+
+void Simulator::run()
+{
+    const ns_t end = cfg_.seconds > 0.0 ? static_cast<ns_t>(cfg_.seconds * 1e9) : NS_NEVER;
+    const ns_t lookahead = (cfg_.ber > 0.0 ? LOOKAHEAD_BITS_BER : LOOKAHEAD_BITS) * bus_.bit_ns();
+
+    /* A node that stops calling the HAL (Error_Handler, endless loop) would
+     * hang the run; report it instead. */
+    std::thread watchdog([this]() {
+        uint64_t last = progress_.load();
+        int idle = 0;
+        while (!done_.load()) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+            const uint64_t p = progress_.load();
+            idle = (p == last) ? idle + 1 : 0;
+            last = p;
+            if (idle >= 30) {
+                std::fprintf(stderr, "stc_sim: node %d stopped calling the HAL (stuck in a loop or Error_Handler)\n",
+                             running_node_.load());
+                std::fflush(nullptr);
+                _exit(4);
+            }
+        }
+    });
+
+    timespec rt{};
+    clock_gettime(CLOCK_REALTIME, &rt);
+    rt_origin_ns_ = static_cast<int64_t>(rt.tv_sec) * 1000000000 + rt.tv_nsec;
+    wall_origin_ = std::chrono::steady_clock::now();
+    ns_t next_pace = 0;
+
+    while (now_ < end && s_stop == 0) {
+        if (bridge_ != nullptr) {
+            bridge_service();
+        }
+        if ((port_ != nullptr || cfg_.speed > 0.0) && now_ >= next_pace) {
+            if (port_ != nullptr) {
+                bridge_pump();
+            } else {
+                pace();
+            }
+            next_pace = now_ + PACE_NS;
+        }
+        const ns_t start = bus_.next_start(nodes_);
+        /* Every node has run up to now_, so all requests up to there are known. */
+        if (start <= now_ && bus_.resolve(start, nodes_)) {
+            continue;
+        }
+        /* Nobody can request a frame before the earliest node is awake again,
+         * so while all nodes sleep the slice stretches to that point. */
+        ns_t first_active = port_ != nullptr ? now_ : NS_NEVER;
+        for (const auto &n : nodes_) {
+            first_active = std::min(first_active, n->sleeping ? n->wake_at : n->t);
+        }
+        const ns_t reach = std::max(first_active, now_);
+        const ns_t horizon = std::min({ std::max(start, now_ + 1u),
+                                        reach >= NS_NEVER - lookahead ? NS_NEVER : reach + lookahead, end });
+        for (auto &n : nodes_) {
+            if (n->t < horizon) {
+                run_node(*n, horizon);
+            }
+        }
+        now_ = horizon;
+    }
+
+    if (port_ != nullptr) {
+        bridge_service();
+        port_->flush();
+    }
+    if (log_ != nullptr) {
+        std::fflush(log_);
+    }
+    done_.store(true);
+    watchdog.join();
+}
+
+/* ===== Node context ===== */
+
+void Simulator::hal_enter(ns_t cost)
+{
+    Node *n = cur_;
+    if (n == nullptr) {
+        return;
+    }
+    n->activity++;
+    charge(*n, cost);
+}
+
+void Simulator::stall(ns_t ns)
+{
+    Node *n = cur_;
+    if (n == nullptr) {
+        return;
+    }
+    n->activity++;
+    if (n->in_isr) {
+        n->isr_t += ns;
+        return;
+    }
+    n->isr_free_at = std::max(n->isr_free_at, n->t + ns);
+    n->t += ns;
+    service(*n);
+    while (n->t >= n->horizon) {
+        yield();
+        service(*n);
+    }
+}
+
+void Simulator::hal_poll()
+{
+    Node *n = cur_;
+    if (n == nullptr) {
+        return;
+    }
+    charge(*n, cfg_.hal_cost_ns);
+}
+
+void Simulator::charge(Node &n, ns_t cost)
+{
+    n.stats.hal_calls++;
+    cost = n.cpu_ns(cost);
+    if (n.in_isr) {
+        n.isr_t += cost;
+        return;
+    }
+    n.t += cost;
+    service(n);
+    while (n.t >= n.horizon) {
+        yield();
+        service(n);
+    }
+}
+
+void Simulator::poll_tick(const void *site)
+{
+    Node *n = cur_;
+    if (n == nullptr || n->in_isr || !cfg_.idle_skip) {
+        return;
+    }
+    const uint64_t ms = (n->t - n->boot_at) / 1000000u;
+    auto it = std::find_if(n->poll_sites.begin(), n->poll_sites.end(),
+                           [site](const PollSite &p) { return p.site == site; });
+    if (it == n->poll_sites.end()) {
+        n->poll_sites.push_back(PollSite{ site, ms, n->activity });
+        return;
+    }
+    if (it->ms == ms && it->activity == n->activity) {
+        n->stats.idle_skips++;
+        idle_until(n->boot_at + (ms + 1u) * 1000000u);
+    }
+    it->ms = (n->t - n->boot_at) / 1000000u;
+    it->activity = n->activity;
+}
+
+void Simulator::idle_until(ns_t t)
+{
+    Node *n = cur_;
+    const uint64_t woke = n->activity;
+    const ns_t from = n->t;
+    while (n->t < t && n->activity == woke) {
+        const ns_t ev_t = n->events.empty() ? NS_NEVER : n->events.top().t;
+        const ns_t scan_t = n->adc_running ? n->next_scan : NS_NEVER;
+        const ns_t wake = std::min({ t, ev_t, scan_t });
+        if (wake >= n->horizon) {
+            /* Tell the scheduler how long it may let this node sleep. */
+            n->t = std::max(n->t, n->horizon);
+            n->wake_at = wake;
+            n->sleeping = true;
+            yield();
+            n->sleeping = false;
+            continue;
+        }
+        n->t = std::max(n->t, wake);
+        service(*n);
+        while (n->t >= n->horizon) {
+            yield();
+            service(*n);
+        }
+    }
+    n->stats.idle_ns += n->t - from;
+}
+
+void Simulator::advance_to(ns_t t)
+{
+    Node *n = cur_;
+    if (n == nullptr || n->in_isr) {
+        return;
+    }
+    while (n->t < t) {
+        n->t = std::min(t, std::max(n->horizon, n->t + 1u));
+        service(*n);
+        while (n->t >= n->horizon) {
+            yield();
+            service(*n);
+        }
+    }
+}
+
+void Simulator::set_primask(bool masked)
+{
+    Node *n = cur_;
+    if (n == nullptr) {
+        return;
+    }
+    const bool was = n->primask;
+    n->primask = masked;
+    if (was && !masked && !n->in_isr) {
+        n->unmask_at = n->t;
+        dispatch_irqs(*n);
+    }
+}
+
+uint16_t Simulator::adc_sample(const Node &n, uint32_t channel, ns_t t) const
+{
+    if (cfg_.adc_source) {
+        return cfg_.adc_source(n.index, channel, t);
+    }
+    const double s = static_cast<double>(t) * 1e-9;
+    const double f = 0.5 + 0.25 * channel;
+    const double v = 2048.0 + 1500.0 * std::sin(2.0 * M_PI * f * s + 0.7 * n.index);
+    return static_cast<uint16_t>(std::clamp(v, 0.0, 4095.0));
+}
+
+void Simulator::adc_scan(Node &n, ns_t at)
+{
+    if (n.dma_buf == nullptr || n.dma_len == 0u) {
+        return;
+    }
+    for (uint32_t ch = 0; ch < 19u; ++ch) {
+        if ((n.adc_chsel & (1u << ch)) == 0u) continue;
+        n.dma_buf[n.dma_idx] = adc_sample(n, ch, at);
+        n.dma_idx = (n.dma_idx + 1u) % n.dma_len;
+        if (n.dma_idx == 0u && !n.dma_irq) {
+            n.dma_irq = true;
+            n.dma_irq_at = at;
+        }
+    }
+}
+
+void Simulator::apply(Node &n, const NodeEvent &ev)
+{
+    CAN_TypeDef *can = CAN;
+    n.activity++;
+    switch (ev.kind) {
+    case EvKind::TX_DONE:
+    case EvKind::TX_FAIL: {
+        const uint32_t m = ev.mailbox;
+        n.mb[m].state = MbState::EMPTY;
+        n.mb_result[m] = (ev.kind == EvKind::TX_DONE) ? 0u : ev.code;
+        const uint32_t shift = 8u * m;
+        uint32_t tsr = can->TSR & ~((CAN_TSR_RQCP0 | CAN_TSR_TXOK0 | CAN_TSR_ALST0 | CAN_TSR_TERR0) << shift);
+        tsr |= CAN_TSR_RQCP0 << shift;
+        if (ev.kind == EvKind::TX_DONE) {
+            tsr |= CAN_TSR_TXOK0 << shift;
+        } else if (ev.code & (HAL_CAN_ERROR_TX_ALST0 << (4u * m))) {
+            tsr |= CAN_TSR_ALST0 << shift;
+        } else {
+            tsr |= CAN_TSR_TERR0 << shift;
+        }
+        tsr |= CAN_TSR_TME0 << m;
+        can->TSR = tsr;
+        if (n.can_ier & CAN_IT_TX_MAILBOX_EMPTY) {
+            if (n.tx_irq == 0u) n.tx_irq_at = ev.t;
+            n.tx_irq |= static_cast<uint8_t>(1u << m);
+        }
+        break;
+    }
+    case EvKind::RX: {
+        uint32_t fmi_base[2] = { 0u, 0u };
+        for (const FilterBank &fb : n.filters) {
+            uint32_t elements = 0;
+            const bool hit = filter_match(fb, ev.frame, elements);
+            const uint32_t fifo = fb.fifo & 1u;
+            if (fb.active && hit) {
+                std::deque<RxEntry> &q = n.fifo[fifo];
+                if (q.size() >= 3u) {
+                    q.back() = RxEntry{ ev.frame, fmi_base[fifo] };  /* FIFO full: last one overwritten */
+                    n.stats.rx_overrun++;
+                } else {
+                    q.push_back(RxEntry{ ev.frame, fmi_base[fifo] });
+                }
+                n.stats.rx_ok++;
+                break;
+            }
+            fmi_base[fifo] += elements;
+        }
+        break;
+    }
+    case EvKind::ESR: {
+        /* ERRI: a new last error code, or a warning/passive/bus-off flag
+         * rising, with its interrupt enabled. */
+        const uint32_t before = can->ESR;
+        const uint32_t rising = ev.code & ~before;
+        can->ESR = ev.code;
+        const uint32_t ier = n.can_ier;
+        const bool erri = ((ier & CAN_IT_LAST_ERROR_CODE) && (ev.code & CAN_ESR_LEC) != 0u) ||
+                          ((ier & CAN_IT_ERROR_WARNING) && (rising & CAN_ESR_EWGF)) ||
+                          ((ier & CAN_IT_ERROR_PASSIVE) && (rising & CAN_ESR_EPVF)) ||
+                          ((ier & CAN_IT_BUSOFF) && (rising & CAN_ESR_BOFF));
+        if ((ier & CAN_IT_ERROR) && erri && !n.err_irq) {
+            n.err_irq = true;
+            n.err_irq_at = ev.t;
+        }
+        break;
+    }
+    }
+}
+
+void Simulator::service(Node &n)
+{
+    for (;;) {
+        const ns_t ev_t = n.events.empty() ? NS_NEVER : n.events.top().t;
+        const ns_t scan_t = n.adc_running ? n.next_scan : NS_NEVER;
+        if (scan_t <= ev_t && scan_t <= n.t) {
+            adc_scan(n, scan_t);
+            n.next_scan += n.scan_ns;
+        } else if (ev_t <= n.t) {
+            const NodeEvent ev = n.events.top();
+            n.events.pop();
+            apply(n, ev);
+        } else {
+            break;
+        }
+    }
+    dispatch_irqs(n);
+}
+
+void Simulator::run_isr(Node &n, ns_t raised, const std::function<void()> &handler)
+{
+    const ns_t start = std::max({ raised, n.isr_free_at, n.unmask_at });
+    n.in_isr = true;
+    n.activity++;
+    const ns_t cost = n.cpu_ns(cfg_.isr_cost_ns);
+    n.isr_t = start + cost / 2u;
+    handler();
+    const ns_t end = n.isr_t + cost - cost / 2u;
+    n.in_isr = false;
+    n.isr_free_at = end;
+    n.t += end - start;     /* the main context was preempted for this long */
+    n.stats.irqs++;
+}
+
+void Simulator::dispatch_irqs(Node &n)
+{
+    while (!n.primask && !n.in_isr && (n.dma_irq || n.tx_irq != 0u || n.err_irq)) {
+        /* Equal NVIC priorities: earlier request first, DMA1_Channel1 (9) before CEC_CAN (30). */
+        ns_t can_at = NS_NEVER;
+        if (n.tx_irq != 0u) can_at = n.tx_irq_at;
+        if (n.err_irq) can_at = std::min(can_at, n.err_irq_at);
+        if (n.dma_irq && n.dma_irq_at <= can_at) {
+            const ns_t raised = n.dma_irq_at;
+            n.dma_irq = false;
+            run_isr(n, raised, [&n]() { HAL_ADC_ConvCpltCallback(n.hadc); });
+        } else {
+            const ns_t raised = can_at;
+            const uint8_t pending = n.tx_irq;
+            const bool erri = n.err_irq;
+            n.tx_irq = 0u;
+            n.err_irq = false;
+            run_isr(n, raised, [&n, pending, erri]() {
+                CAN_HandleTypeDef *h = n.hcan;
+                uint32_t errorcode = HAL_CAN_ERROR_NONE;
+                for (uint32_t m = 0; m < 3u; ++m) {
+                    if ((pending & (1u << m)) == 0u) continue;
+                    h->Instance->TSR &= ~(CAN_TSR_RQCP0 << (8u * m));
+                    if (n.mb_result[m] == 0u) {
+                        if (m == 0u) HAL_CAN_TxMailbox0CompleteCallback(h);
+                        if (m == 1u) HAL_CAN_TxMailbox1CompleteCallback(h);
+                        if (m == 2u) HAL_CAN_TxMailbox2CompleteCallback(h);
+                    } else {
+                        /* CEC_CAN_IRQHandler: completed without TXOK is an abort. */
+                        CAN_Diag_Module_Tx_Aborted(n.mb_result[m] != MB_ABORTED &&
+                                                   (n.mb_result[m] & (HAL_CAN_ERROR_TX_TERR0 << (4u * m))) != 0u);
+                        if (m == 0u) HAL_CAN_TxMailbox0AbortCallback(h);
+                        if (m == 1u) HAL_CAN_TxMailbox1AbortCallback(h);
+                        if (m == 2u) HAL_CAN_TxMailbox2AbortCallback(h);
+                    }
+                }
+                /* HAL_CAN_IRQHandler error path: flags of enabled sources,
+                 * then the LEC, which it clears. */
+                if (erri) {
+                    const uint32_t esr = h->Instance->ESR;
+                    const uint32_t ier = n.can_ier;
+                    if ((ier & CAN_IT_ERROR_WARNING) && (esr & CAN_ESR_EWGF)) errorcode |= HAL_CAN_ERROR_EWG;
+                    if ((ier & CAN_IT_ERROR_PASSIVE) && (esr & CAN_ESR_EPVF)) errorcode |= HAL_CAN_ERROR_EPV;
+                    if ((ier & CAN_IT_BUSOFF) && (esr & CAN_ESR_BOFF)) errorcode |= HAL_CAN_ERROR_BOF;
+                    if ((ier & CAN_IT_LAST_ERROR_CODE) && (esr & CAN_ESR_LEC) != 0u) {
+                        static const uint32_t k_lec[8] = {
+                            0u, HAL_CAN_ERROR_STF, HAL_CAN_ERROR_FOR, HAL_CAN_ERROR_ACK,
+                            HAL_CAN_ERROR_BR, HAL_CAN_ERROR_BD, HAL_CAN_ERROR_CRC, 0u,
+                        };
+                        errorcode |= k_lec[(esr & CAN_ESR_LEC) >> CAN_ESR_LEC_Pos];
+                        h->Instance->ESR &= ~CAN_ESR_LEC;
+                    }
+                }
+                if (errorcode != HAL_CAN_ERROR_NONE) {
+                    h->ErrorCode |= errorcode;
+                    HAL_CAN_ErrorCallback(h);
+                }
+            });
+        }
+    }
+}
+
+} // namespace sim
@@ -0,0 +1,393 @@
+/* sim.h
+ *
+ * Discrete-event simulation of several signal-to-can nodes on one CAN bus.
+ *
+ * Every node runs the unmodified firmware (main loop, adc_module,
+ * process_signals, can_module and the protocol modules) in its own fiber on
+ * top of a fake HAL:
+ *  - The firmware library's writable data (.data/.bss, see fw_state.ld) and
+ *    the CAN and ADC register blocks are swapped in and out per node, so the
+ *    file-scope state of each firmware copy is private. So are the event log
+ *    pages of the flash. Each node has its own update staging area at its
+ *    own address (sim_update_stage_base), and the flash size register covers
+ *    all of them.
+ *  - Node time advances by a fixed cost per HAL call (plus a fixed cost per
+ *    interrupt), scaled from 48 MHz to the node's HCLK; a node yields to the scheduler when it reaches the current
+ *    horizon. Interrupts (DMA scan complete, CAN TX complete) are delivered
+ *    on the next HAL call once they are due and PRIMASK is clear, with their
+ *    handler time accounted at the instant they were raised.
+ *  - The bus resolves one frame at a time at bit level: wired-AND
+ *    arbitration over the stuffed bit streams, ACK, error frames from bit
+ *    errors, missing ACK or a bit error rate, TEC/REC, error passive and
+ *    bus-off with automatic recovery.
+ *
+ * All time is virtual. A node whose main loop only polls (it reaches the same
+ * HAL_GetTick call again within one millisecond with no HAL call with
+ * effects, interrupt or CAN event in between) sleeps until the next tick,
+ * interrupt or event, as with WFI; that makes idle time nearly free.
+ *
+ * Scheduling is conservative: no bus decision affects a node earlier than
+ * 28 bit times after it is taken (15 with injected bit errors: the shortest
+ * error frame), so all nodes run in lockstep slices of at most that length
+ * and the bus decides when every node has passed the decision time. Runs are
+ * deterministic for a seed.
+ *
+ * A SocketCAN port can be bridged onto the bus (attach()). The bridge is one
+ * more controller on the bus: it ACKs, forwards every frame it receives to
+ * the socket and transmits the socket's frames in arrival order with
+ * automatic retransmission. Frames enter the bus at their kernel receive
+ * time, and the simulation is paced to the wall clock while a bridge is
+ * attached. Without one, cfg.speed paces it to a multiple of real time.
+ */
+
+#ifndef STC_SIM_SIM_H
+#define STC_SIM_SIM_H
+
+#include "can_frame.h"
+#include "socketcan.h"
+#include "stm32f0xx_hal.h"
+
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <queue>
+#include <random>
+#include <setjmp.h>
+#include <string>
+#include <ucontext.h>
+#include <utility>
+#include <vector>
+
+namespace sim {
+
+using ns_t = uint64_t;
+constexpr ns_t NS_NEVER = UINT64_MAX;
+
+/* Raw 12-bit ADC value of one channel of one node at a point in time. */
+using AdcSource = std::function<uint16_t(uint32_t node, uint32_t channel, ns_t t)>;
+
+struct Config {
+    uint32_t nodes = 16;
+    uint32_t first_node = 0x00;
+    uint32_t stride = 0x10;
+    uint32_t baud = 500000;
+    int32_t sample_period_ms = -1;  /* < 0: firmware default */
+    double seconds = 10.0;
+    double ber = 0.0;               /* bit error rate on the bus */
+    uint64_t seed = 1;
+    double stagger_ms = 5.0;        /* power-on spread between nodes */
+    ns_t hal_cost_ns = 2000;        /* CPU time charged per HAL call and the code around it, at 48 MHz */
+    ns_t isr_cost_ns = 2000;        /* entry, dispatch and exit of one interrupt, at 48 MHz */
+    bool idle_skip = true;          /* fast-forward main loops that only poll */
+    uint32_t tick_offset_ms = 0;    /* HAL_GetTick at boot, e.g. close to the 2^32 wrap */
+    bool e2e = false;
+    double speed = 0.0;             /* bus time per wall clock time, 0: as fast as possible */
+    std::string log_path;           /* candump -L log of the bus, empty: none */
+    AdcSource adc_source;           /* empty: built-in sine per channel */
+};
+
+enum class EvKind : uint8_t { TX_DONE, TX_FAIL, RX, ESR };
+
+struct NodeEvent {
+    ns_t t = 0;
+    uint64_t seq = 0;
+    EvKind kind = EvKind::ESR;
+    uint8_t mailbox = 0;
+    uint32_t code = 0;              /* TX_FAIL: HAL error code, ESR: register value */
+    CanFrame frame;                 /* RX */
+
+    bool operator>(const NodeEvent &o) const { return t != o.t ? t > o.t : seq > o.seq; }
+};
+
+enum class MbState : uint8_t { EMPTY, PENDING, ON_BUS };
+
+/* Node::mb_result of a mailbox emptied by an abort request. */
+constexpr uint32_t MB_ABORTED = 0xFFFFFFFFu;
+
+struct Mailbox {
+    MbState state = MbState::EMPTY;
+    CanFrame frame;
+    FrameBits bits;
+    ns_t req = 0;                   /* transmit request time */
+    uint64_t seq = 0;               /* request order (TX FIFO priority) */
+};
+
+struct FilterBank {
+    bool active = false;
+    uint32_t mode = 0;
+    uint32_t scale = 0;
+    uint32_t fifo = 0;
+    uint32_t fr1 = 0;
+    uint32_t fr2 = 0;
+};
+
+/* A HAL_GetTick call site in the firmware, as last seen. */
+struct PollSite {
+    const void *site = nullptr;
+    uint64_t ms = 0;
+    uint64_t activity = 0;
+};
+
+struct RxEntry {
+    CanFrame frame;
+    uint32_t fmi = 0;
+};
+
+struct NodeStats {
+    uint64_t tx_ok = 0;
+    ns_t last_tx = 0;               /* end of the last frame sent */
+    uint64_t tx_errors = 0;         /* error frames while transmitting */
+    uint64_t arb_lost = 0;
+    uint64_t rx_ok = 0;
+    uint64_t rx_overrun = 0;
+    uint32_t bus_off = 0;
+    uint64_t irqs = 0;
+    uint64_t hal_calls = 0;
+    uint64_t idle_skips = 0;
+    ns_t idle_ns = 0;               /* main context time fast-forwarded */
+    std::vector<uint32_t> tx_lat_us;    /* mailbox request -> end of frame */
+};
+
+class Node {
+public:
+    uint32_t index = 0;
+    bool external = false;          /* bridge controller: no firmware, serviced by the scheduler */
+    uint8_t node_id = 0;
+    ns_t boot_at = 0;
+
+    /* CPU */
+    ns_t t = 0;                     /* main context time */
+    ns_t horizon = 0;
+    bool primask = false;
+    ns_t unmask_at = 0;
+    bool in_isr = false;
+    ns_t isr_t = 0;                 /* time inside the running handler */
+    ns_t isr_free_at = 0;
+    uint64_t activity = 0;          /* HAL calls with effects, interrupts and peripheral events */
+    bool sleeping = false;          /* parked at the horizon in an idle wait */
+    ns_t wake_at = 0;               /* while sleeping: next tick, interrupt or event */
+    std::vector<PollSite> poll_sites;
+    bool fiber_started = false;
+    ucontext_t ctx{};
+    jmp_buf jb{};
+    std::vector<uint8_t> stack;
+    std::vector<uint8_t> image;     /* firmware .data/.bss while swapped out */
+    std::vector<uint8_t> can_regs;
+    std::vector<uint8_t> adc_regs;
+    std::vector<uint8_t> flash_data;    /* profile and event log pages (FLASH_DATA_BASE) */
+    uint32_t uid[3] = {};               /* unique device ID (UID_BASE) */
+
+    /* Clock tree (HAL_RCC_OscConfig / HAL_RCC_ClockConfig); CPU costs scale with HCLK */
+    bool pll_on = true;
+    bool sysclk_pll = true;
+    uint32_t pll_hz = 48000000u;
+    uint32_t sysclk_hz = 48000000u;
+    uint32_t hclk_hz = 48000000u;
+    uint32_t pclk_hz = 48000000u;
+
+    /* CPU time of code that takes cost_48mhz at 48 MHz HCLK. */
+    ns_t cpu_ns(ns_t cost_48mhz) const { return cost_48mhz * 48000000u / hclk_hz; }
+
+    /* CAN controller */
+    CAN_HandleTypeDef *hcan = nullptr;
+    bool can_started = false;
+    bool nart = false;
+    bool txfp = false;
+    bool abom = false;
+    uint32_t can_ier = 0;
+    ns_t bit_ns = 0;
+    Mailbox mb[3];
+    uint64_t mb_seq = 0;
+    uint32_t mb_result[3] = {};     /* HAL error code of the last attempt, 0: TXOK, or MB_ABORTED */
+    std::deque<RxEntry> fifo[2];
+    FilterBank filters[14];
+    uint32_t tec = 0;
+    uint32_t rec = 0;
+    bool bus_off = false;
+    ns_t bus_off_until = 0;
+    ns_t suspend_until = 0;
+    uint8_t tx_irq = 0;             /* mailboxes with a pending RQCP interrupt */
+    ns_t tx_irq_at = 0;
+    bool err_irq = false;           /* MSR.ERRI with the error interrupt enabled */
+    ns_t err_irq_at = 0;
+
+    /* ADC + DMA */
+    ADC_HandleTypeDef *hadc = nullptr;
+    uint16_t *dma_buf = nullptr;
+    uint32_t dma_len = 0;
+    uint32_t dma_idx = 0;
+    uint32_t adc_chsel = 0;
+    bool adc_running = false;
+    ns_t scan_ns = 0;
+    ns_t next_scan = NS_NEVER;
+    bool dma_irq = false;
+    ns_t dma_irq_at = 0;
+
+    uint32_t gpio_odr[3] = {};      /* A, B, F */
+    uint32_t led_toggles = 0;
+
+    std::priority_queue<NodeEvent, std::vector<NodeEvent>, std::greater<NodeEvent>> events;
+    uint64_t ev_seq = 0;
+    NodeStats stats;
+
+    void post(NodeEvent ev)
+    {
+        ev.seq = ev_seq++;
+        events.push(ev);
+    }
+
+    uint32_t esr() const;
+    bool on_bus(ns_t at, ns_t bus_bit_ns) const
+    {
+        return can_started && bit_ns == bus_bit_ns && !(bus_off && at < bus_off_until);
+    }
+};
+
+struct BusStats {
+    uint64_t frames = 0;
+    uint64_t error_frames = 0;
+    ns_t last_error = 0;                    /* start of the last error frame */
+    uint64_t busy_bits = 0;
+    uint64_t digest = 0xcbf29ce484222325u;  /* FNV-1a over time, ID and data of every frame */
+};
+
+class Bus {
+public:
+    Bus(ns_t bit_ns, double ber, uint64_t seed) : bit_ns_(bit_ns), ber_(ber), rng_(seed) {}
+
+    ns_t bit_ns() const { return bit_ns_; }
+
+    /* Earliest time a frame can start with the requests known so far. */
+    ns_t next_start(const std::vector<std::unique_ptr<Node>> &nodes);
+
+    /* Arbitrates and transmits the frame starting at t; false if nobody could send. */
+    bool resolve(ns_t t, std::vector<std::unique_ptr<Node>> &nodes);
+
+    void set_log(FILE *f) { log_ = f; }
+    /* Adds a controller that is not one of the simulated nodes (bridge). */
+    void set_external(Node *n) { external_ = n; }
+    const BusStats &stats() const { return stats_; }
+
+private:
+    template <typename F> void each(const std::vector<std::unique_ptr<Node>> &nodes, F f)
+    {
+        for (const auto &np : nodes) f(*np);
+        if (external_ != nullptr) f(*external_);
+    }
+    ns_t align(ns_t t) const { return (t + bit_ns_ - 1u) / bit_ns_ * bit_ns_; }
+    void tx_error(Node &n, ns_t err_end, bool ack_error, uint32_t lec);
+    void rx_error(Node &n, ns_t err_end, uint32_t lec);
+
+    ns_t bit_ns_;
+    double ber_;
+    std::mt19937_64 rng_;
+    ns_t idle_at_ = 0;
+    BusStats stats_;
+    FILE *log_ = nullptr;
+    Node *external_ = nullptr;
+};
+
+struct BridgeStats {
+    uint64_t to_socket = 0;         /* bus frames forwarded */
+    uint64_t from_socket = 0;       /* socket frames sent on the bus */
+};
+
+class Simulator {
+public:
+    explicit Simulator(const Config &cfg);
+    ~Simulator();
+
+    static Simulator *instance() { return s_instance; }
+
+    /* Runs until cfg.seconds of bus time have passed (cfg.seconds == 0: until stop()). */
+    void run();
+    /* Ends run() at the next scheduling step; async-signal-safe. */
+    static void stop() { s_stop = 1; }
+
+    /* Bridges the bus to port; call before run(). A null port adds a
+     * controller that only ACKs, so a single node can transmit. */
+    void attach(SocketCanPort *port);
+    const BridgeStats &bridge_stats() const { return bridge_stats_; }
+    /* Paced runs (cfg.speed or a bridge): largest slip of bus time behind the wall clock. */
+    ns_t max_lag_ns() const { return max_lag_ns_; }
+
+    /* Runs f with the firmware state of node n swapped in (scheduler context only). */
+    void call_in(Node &n, const std::function<void()> &f);
+
+    const Config &config() const { return cfg_; }
+    const Bus &bus() const { return bus_; }
+    std::vector<std::unique_ptr<Node>> &nodes() { return nodes_; }
+    ns_t now() const { return now_; }
+
+    /* ===== Fake HAL side (node context) ===== */
+
+    Node *current() { return cur_; }
+    /* Charges CPU time to the running node, delivers due events, yields at the horizon. */
+    void hal_enter(ns_t cost);
+    void hal_enter() { hal_enter(cfg_.hal_cost_ns); }
+    /* hal_enter() for calls that only read state: not counted as activity. */
+    void hal_poll();
+    /* HAL_GetTick from site in the main context: when the node came back to
+     * site within the same millisecond without any activity, its loop is
+     * idle and it sleeps until the next tick or wake-up. */
+    void poll_tick(const void *site);
+    /* Lets the running node idle until t. */
+    void advance_to(ns_t t);
+    /* Flash program/erase: the core stalls for ns (not scaled by HCLK) and
+     * interrupts wait until it is over. */
+    void stall(ns_t ns);
+    void set_primask(bool masked);
+    uint16_t adc_sample(const Node &n, uint32_t channel, ns_t t) const;
+
+private:
+    static void fiber_entry();
+    void load(Node &n);
+    void store(Node &n);
+    void run_node(Node &n, ns_t horizon);
+    void charge(Node &n, ns_t cost);
+    void yield();
+    void service(Node &n);
+    void apply(Node &n, const NodeEvent &ev);
+    void adc_scan(Node &n, ns_t at);
+    void dispatch_irqs(Node &n);
+    void run_isr(Node &n, ns_t raised, const std::function<void()> &handler);
+    void idle_until(ns_t t);
+    void pace();
+    void bridge_service();
+    void bridge_pump();
+
+    static Simulator *s_instance;
+    static volatile sig_atomic_t s_stop;
+
+    Config cfg_;
+    Bus bus_;
+    std::vector<std::unique_ptr<Node>> nodes_;
+    std::vector<uint8_t> pristine_;
+    Node *cur_ = nullptr;
+    Node *loaded_ = nullptr;
+    jmp_buf sched_jb_{};
+    ns_t now_ = 0;
+    FILE *log_ = nullptr;
+
+    SocketCanPort *port_ = nullptr;
+    std::unique_ptr<Node> bridge_;
+    std::deque<std::pair<ns_t, CanFrame>> inject_;  /* socket frames waiting for a mailbox */
+    std::vector<TimedFrame> rx_batch_;
+    int64_t rt_origin_ns_ = 0;          /* CLOCK_REALTIME at bus time 0 */
+    BridgeStats bridge_stats_;
+    std::chrono::steady_clock::time_point wall_origin_;
+    ns_t max_lag_ns_ = 0;
+
+    std::atomic<uint64_t> progress_{0};
+    std::atomic<int> running_node_{-1};
+    std::atomic<bool> done_{false};
+};
+
+} // namespace sim
+
+#endif
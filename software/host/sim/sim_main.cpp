@@ -0,0 +1,347 @@
+/* sim_main.cpp
+ *
+ * Multi-node bus simulator for scaling tests of the signal-to-can firmware.
+ *
+ * N copies of the firmware (built from Core/Src against a fake HAL, see
+ * sim.h) boot with node IDs first_node + k * stride within the power-on
+ * stagger and run on one simulated bus for the requested bus time. At the
+ * end it reports per node: frames sent, error frames, lost arbitrations,
+ * frames dropped by the firmware (Process_Signals_Get_Tx_Drops), RX overruns,
+ * error counters, the TX latency measured on the bus (mailbox request to end
+ * of frame) and the firmware's own sample-to-bus latency (latency_module),
+ * plus bus load and error frames.
+ *
+ * With --socketcan the bus is bridged to a Linux CAN interface (vcan0 or a
+ * real adapter) and paced to the wall clock: the simulated nodes see the
+ * interface's traffic and their frames appear on it. -t 0 runs until SIGINT.
+ *
+ * --wave replays recorded ADC waveforms (CSV or binary, see waveform.h) into
+ * the nodes' ADC DMA buffers: the k-th --wave drives node k, the last one
+ * all remaining nodes. Waveform time 0 is the node's boot (HAL tick 0) and
+ * without -t the run lasts until every node has played its recording.
+ * --speed paces the run to a multiple of real time (default: as fast as
+ * possible), --listener adds an ACKing bus analyser so a single node can
+ * transmit, --golden compares the bus log with a golden candump file and
+ * --check fails a run that is not clean: error frames on the bus, a node
+ * that went bus-off, or a node that sent nothing in the last second.
+ *
+ * Time is virtual: idle main loops are fast-forwarded (--busy-loop keeps
+ * every polling pass), --tick-offset-ms starts HAL_GetTick at an offset so
+ * the 2^32 ms tick wrap (49.7 days) is reached within seconds, and the bus
+ * digest in the report is identical for runs with the same options and seed.
+ *
+ * Usage:
+ *   stc_sim [-N nodes] [-f first_node_id] [-s id_stride] [-b baud]
+ *           [-p sample_period_ms] [-t seconds] [--ber rate] [--seed n]
+ *           [--stagger-ms ms] [--hal-cost-ns ns] [--isr-cost-ns ns]
+ *           [--e2e] [-l candump.log] [--socketcan ifname]
+ *           [--wave file]... [--speed x] [--listener] [--golden candump.log]
+ *           [--busy-loop] [--tick-offset-ms ms] [--check]
+ *
+ * Exit status: 0 ok, 1/2 setup or usage errors, 3 the bus log differs from
+ * the golden file, 4 a node stopped calling the HAL (Error_Handler or an
+ * endless loop), 5 --check found the run not clean.
+ */
+
+#include "sim.h"
+#include "waveform.h"
+
+#include <algorithm>
+#include <chrono>
+#include <csignal>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <numeric>
+#include <string>
+
+extern "C" {
+#include "latency_module.h"
+#include "process_signals.h"
+
+/* main.c */
+extern uint8_t node_id;
+extern uint32_t baud_enum;
+extern uint32_t sample_period;
+}
+
+namespace {
+
+int baud_to_enum(uint32_t baud)
+{
+    switch (baud) {
+    case 125000: return 0;
+    case 250000: return 1;
+    case 500000: return 2;
+    case 1000000: return 3;
+    default: return -1;
+    }
+}
+
+uint32_t percentile(std::vector<uint32_t> v, double p)
+{
+    if (v.empty()) return 0u;
+    const size_t k = std::min(v.size() - 1u, static_cast<size_t>(p * static_cast<double>(v.size())));
+    std::nth_element(v.begin(), v.begin() + static_cast<std::ptrdiff_t>(k), v.end());
+    return v[k];
+}
+
+void on_sigint(int)
+{
+    sim::Simulator::stop();
+}
+
+void report(sim::Simulator &s, const sim::SocketCanPort *port, double wall_s)
+{
+    const sim::Config &cfg = s.config();
+    const sim::BusStats &bs = s.bus().stats();
+    const double sim_s = static_cast<double>(s.now()) * 1e-9;
+    const double bits = sim_s * cfg.baud;
+
+    std::printf("%u nodes, %u bit/s, %.3f s simulated in %.2f s (%.1fx real time)\n", cfg.nodes, cfg.baud,
+                sim_s, wall_s, wall_s > 0.0 ? sim_s / wall_s : 0.0);
+    std::printf("bus: %llu frames, %llu error frames, load %.1f %%, digest %016llx\n",
+                static_cast<unsigned long long>(bs.frames), static_cast<unsigned long long>(bs.error_frames),
+                bits > 0.0 ? 100.0 * static_cast<double>(bs.busy_bits) / bits : 0.0,
+                static_cast<unsigned long long>(bs.digest));
+    double idle_ns = 0.0;
+    for (const auto &np : s.nodes()) idle_ns += static_cast<double>(np->stats.idle_ns);
+    if (cfg.idle_skip && sim_s > 0.0) {
+        std::printf("nodes idle (fast-forwarded) %.1f %% of the time\n",
+                    100.0 * idle_ns * 1e-9 / (sim_s * static_cast<double>(cfg.nodes)));
+    }
+    std::printf("node   id  tx_ok  tx_err  arb_lost  drops  rx_ovr  TEC  REC  bus_off"
+                "  bus_lat_us mean/p99/max   fw_total_us max    irqs\n");
+
+    for (auto &np : s.nodes()) {
+        sim::Node &n = *np;
+        uint32_t drops = 0;
+        latency_hist_t total{};
+        s.call_in(n, [&]() {
+            for (uint8_t f = 0; f < PS_NUM_TX_FRAMES; ++f) {
+                drops += Process_Signals_Get_Tx_Drops(f);
+            }
+            Latency_Module_Get_Hist(LATENCY_STAGE_TOTAL, &total);
+        });
+        const std::vector<uint32_t> &lat = n.stats.tx_lat_us;
+        const double mean = lat.empty() ? 0.0
+                                        : std::accumulate(lat.begin(), lat.end(), 0.0) / static_cast<double>(lat.size());
+        const uint32_t max = lat.empty() ? 0u : *std::max_element(lat.begin(), lat.end());
+        std::printf("%4u  %3u  %5llu  %6llu  %8llu  %5u  %6llu  %3u  %3u  %7u  %8.0f/%5u/%6u   %11u  %6llu\n",
+                    n.index, n.node_id, static_cast<unsigned long long>(n.stats.tx_ok),
+                    static_cast<unsigned long long>(n.stats.tx_errors),
+                    static_cast<unsigned long long>(n.stats.arb_lost), drops,
+                    static_cast<unsigned long long>(n.stats.rx_overrun), n.tec, n.rec, n.stats.bus_off, mean,
+                    percentile(lat, 0.99), max, total.max_us, static_cast<unsigned long long>(n.stats.irqs));
+    }
+    if (port != nullptr) {
+        const sim::BridgeStats &b = s.bridge_stats();
+        const sim::PortStats &p = port->stats();
+        std::printf("bridge %s: %llu frames to the socket (%llu dropped), %llu from it (%llu ignored), "
+                    "max lag %.1f ms\n",
+                    port->name().c_str(), static_cast<unsigned long long>(b.to_socket),
+                    static_cast<unsigned long long>(p.tx_dropped), static_cast<unsigned long long>(b.from_socket),
+                    static_cast<unsigned long long>(p.rx_ignored), static_cast<double>(s.max_lag_ns()) * 1e-6);
+    } else if (cfg.speed > 0.0) {
+        std::printf("paced at %gx real time, max lag %.1f ms\n", cfg.speed,
+                    static_cast<double>(s.max_lag_ns()) * 1e-6);
+    }
+}
+
+/* No error frames after the boot window, no bus-off and every firmware node
+ * still sending in the last second of the run; prints what failed. Nodes
+ * send from boot on, so a frame before the others are up goes without ACK
+ * and nodes configured with the same address collide until the claim
+ * moves them. */
+bool run_clean(sim::Simulator &s)
+{
+    constexpr sim::ns_t boot_window = 100000000u;
+    bool ok = true;
+    const sim::BusStats &bs = s.bus().stats();
+    if (bs.error_frames != 0u && bs.last_error >= boot_window) {
+        std::cerr << "stc_sim: check: " << bs.error_frames << " error frames, the last at "
+                  << static_cast<double>(bs.last_error) * 1e-9 << " s\n";
+        ok = false;
+    }
+    for (const auto &np : s.nodes()) {
+        const sim::Node &n = *np;
+        if (n.external) {
+            continue;
+        }
+        if (n.stats.tx_ok == 0u || n.stats.last_tx + 1000000000u < s.now() || n.stats.bus_off != 0u) {
+            std::cerr << "stc_sim: check: node " << n.index << " sent " << n.stats.tx_ok << " frames (the last at "
+                      << static_cast<double>(n.stats.last_tx) * 1e-9 << " s), went bus-off " << n.stats.bus_off
+                      << " times\n";
+            ok = false;
+        }
+    }
+    return ok;
+}
+
+/* Compares two candump logs line by line; prints the first difference. */
+bool same_log(const std::string &actual, const std::string &golden)
+{
+    std::ifstream a(actual);
+    std::ifstream g(golden);
+    if (!g) {
+        std::cerr << "stc_sim: cannot read " << golden << "\n";
+        return false;
+    }
+    std::string la;
+    std::string lg;
+    for (size_t line = 1;; ++line) {
+        const bool more_a = static_cast<bool>(std::getline(a, la));
+        const bool more_g = static_cast<bool>(std::getline(g, lg));
+        if (!more_a && !more_g) {
+            return true;
+        }
+        if (!more_a || !more_g || la != lg) {
+            std::cerr << "stc_sim: bus log differs from " << golden << " at line " << line << "\n"
+                      << "  expected: " << (more_g ? lg : "<end of file>") << "\n"
+                      << "  actual:   " << (more_a ? la : "<end of file>") << "\n";
+            return false;
+        }
+    }
+}
+
+void usage()
+{
+    std::cerr << "usage: stc_sim [-N nodes] [-f first_node_id] [-s id_stride] [-b baud]\n"
+                 "               [-p sample_period_ms] [-t seconds] [--ber rate] [--seed n]\n"
+                 "               [--stagger-ms ms] [--hal-cost-ns ns] [--isr-cost-ns ns]\n"
+                 "               [--e2e] [-l candump.log] [--socketcan ifname]\n"
+                 "               [--wave file]... [--speed x] [--listener] [--golden candump.log]\n"
+                 "               [--busy-loop] [--tick-offset-ms ms] [--check]\n";
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    sim::Config cfg;
+    std::string ifname;
+    std::vector<std::unique_ptr<sim::Waveform>> waves;
+    std::string golden;
+    bool listener = false;
+    bool check = false;
+    bool have_seconds = false;
+
+    for (int i = 1; i < argc; ++i) {
+        const std::string a = argv[i];
+        const bool has_value = i + 1 < argc;
+        if (a == "--e2e") {
+            cfg.e2e = true;
+        } else if (a == "--listener") {
+            listener = true;
+        } else if (a == "--check") {
+            check = true;
+        } else if (a == "--busy-loop") {
+            cfg.idle_skip = false;
+        } else if (has_value && a == "--wave") {
+            auto w = std::make_unique<sim::Waveform>();
+            std::string err;
+            if (!w->load(argv[++i], err)) {
+                std::cerr << "stc_sim: " << err << "\n";
+                return 1;
+            }
+            waves.push_back(std::move(w));
+        } else if (has_value && (a == "-N" || a == "-f" || a == "-s" || a == "-b" || a == "-p" || a == "-t" ||
+                                 a == "-l" || a == "--ber" || a == "--seed" || a == "--stagger-ms" ||
+                                 a == "--hal-cost-ns" || a == "--isr-cost-ns" || a == "--socketcan" ||
+                                 a == "--speed" || a == "--golden" || a == "--tick-offset-ms")) {
+            const char *v = argv[++i];
+            if (a == "-N") cfg.nodes = static_cast<uint32_t>(std::strtoul(v, nullptr, 0));
+            if (a == "-f") cfg.first_node = static_cast<uint32_t>(std::strtoul(v, nullptr, 0));
+            if (a == "-s") cfg.stride = static_cast<uint32_t>(std::strtoul(v, nullptr, 0));
+            if (a == "-b") cfg.baud = static_cast<uint32_t>(std::strtoul(v, nullptr, 0));
+            if (a == "-p") cfg.sample_period_ms = static_cast<int32_t>(std::strtol(v, nullptr, 0));
+            if (a == "-t") {
+                cfg.seconds = std::strtod(v, nullptr);
+                have_seconds = true;
+            }
+            if (a == "-l") cfg.log_path = v;
+            if (a == "--ber") cfg.ber = std::strtod(v, nullptr);
+            if (a == "--seed") cfg.seed = std::strtoull(v, nullptr, 0);
+            if (a == "--stagger-ms") cfg.stagger_ms = std::strtod(v, nullptr);
+            if (a == "--hal-cost-ns") cfg.hal_cost_ns = std::strtoull(v, nullptr, 0);
+            if (a == "--isr-cost-ns") cfg.isr_cost_ns = std::strtoull(v, nullptr, 0);
+            if (a == "--socketcan") ifname = v;
+            if (a == "--speed") cfg.speed = std::strtod(v, nullptr);
+            if (a == "--golden") golden = v;
+            if (a == "--tick-offset-ms") cfg.tick_offset_ms = static_cast<uint32_t>(std::strtoul(v, nullptr, 0));
+        } else {
+            usage();
+            return 2;
+        }
+    }
+    const int benum = baud_to_enum(cfg.baud);
+    if (cfg.nodes == 0u || benum < 0 || cfg.seconds < 0.0 || cfg.hal_cost_ns == 0u || cfg.ber < 0.0 ||
+        cfg.ber >= 1.0 || cfg.speed < 0.0) {
+        usage();
+        return 2;
+    }
+    if (cfg.first_node + (cfg.nodes - 1u) * cfg.stride > 0xFFu) {
+        std::cerr << "stc_sim: node IDs must fit in 8 bits; lower -N, -f or -s\n";
+        return 1;
+    }
+
+    if (!waves.empty()) {
+        if (!have_seconds) {
+            uint64_t longest = 0;
+            for (const auto &w : waves) longest = std::max(longest, w->duration_ns());
+            cfg.seconds = static_cast<double>(longest) * 1e-9 + cfg.stagger_ms * 1e-3 + 0.1;
+        }
+        /* One cursor per node: each replays its own timeline. */
+        auto cursors = std::make_shared<std::vector<sim::Waveform::Cursor>>(cfg.nodes);
+        std::vector<const sim::Waveform *> of_node;
+        for (uint32_t k = 0; k < cfg.nodes; ++k) {
+            of_node.push_back(waves[std::min<size_t>(k, waves.size() - 1u)].get());
+        }
+        cfg.adc_source = [of_node, cursors](uint32_t node, uint32_t ch, sim::ns_t t) {
+            const sim::ns_t boot = sim::Simulator::instance()->nodes()[node]->boot_at;
+            return of_node[node]->at(ch, t > boot ? t - boot : 0u, (*cursors)[node]);
+        };
+    }
+    if (!golden.empty() && cfg.log_path.empty()) {
+        cfg.log_path = golden + ".out";
+    }
+
+    sim::Simulator s(cfg);
+    for (auto &np : s.nodes()) {
+        sim::Node &n = *np;
+        s.call_in(n, [&]() {
+            node_id = n.node_id;
+            baud_enum = static_cast<uint32_t>(benum);
+            if (cfg.sample_period_ms > 0) {
+                sample_period = static_cast<uint32_t>(cfg.sample_period_ms);
+            }
+            Process_Signals_Set_E2E(cfg.e2e);
+        });
+    }
+
+    sim::SocketCanPort port;
+    if (!ifname.empty()) {
+        std::string err;
+        if (!port.open(ifname, err)) {
+            std::cerr << "stc_sim: " << err << "\n";
+            return 1;
+        }
+        s.attach(&port);
+    } else if (listener) {
+        s.attach(nullptr);
+    }
+    std::signal(SIGINT, on_sigint);
+
+    const auto t0 = std::chrono::steady_clock::now();
+    s.run();
+    const auto t1 = std::chrono::steady_clock::now();
+    report(s, ifname.empty() ? nullptr : &port, std::chrono::duration<double>(t1 - t0).count());
+    if (!golden.empty() && !same_log(cfg.log_path, golden)) {
+        return 3;
+    }
+    if (check && !run_clean(s)) {
+        return 5;
+    }
+    return 0;
+}
@@ -0,0 +1,73 @@
+/* socketcan.h
+ *
+ * Non-blocking Linux SocketCAN port for the simulator's bus bridge.
+ * Frames are read and written in batches (recvmmsg / sendmmsg) and every
+ * received frame carries its kernel receive timestamp (SO_TIMESTAMPNS,
+ * CLOCK_REALTIME). Readiness is waited for with epoll.
+ */
+
+#ifndef STC_SIM_SOCKETCAN_H
+#define STC_SIM_SOCKETCAN_H
+
+#include "can_frame.h"
+
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <vector>
+
+namespace sim {
+
+struct TimedFrame {
+    CanFrame frame;
+    int64_t rt_ns = 0;          /* kernel receive time, CLOCK_REALTIME */
+};
+
+struct PortStats {
+    uint64_t rx = 0;
+    uint64_t tx = 0;
+    uint64_t rx_ignored = 0;    /* extended, error or FD frames */
+    uint64_t tx_dropped = 0;    /* send queue overflow */
+};
+
+class SocketCanPort {
+public:
+    SocketCanPort() = default;
+    ~SocketCanPort();
+    SocketCanPort(const SocketCanPort &) = delete;
+    SocketCanPort &operator=(const SocketCanPort &) = delete;
+
+    /* Opens a raw CAN socket bound to ifname (e.g. "vcan0"). */
+    bool open(const std::string &ifname, std::string &err);
+    /* Takes over an already open datagram socket carrying struct can_frame. */
+    bool attach(int fd, std::string &err);
+
+    /* Reads everything that is pending without blocking; returns the frame count. */
+    size_t receive(std::vector<TimedFrame> &out);
+    /* Queues a frame for the next flush(). */
+    void queue(const CanFrame &f);
+    /* Writes queued frames without blocking; keeps what the socket did not take. */
+    void flush();
+    /* Waits up to timeout_ms for input (or output space while frames are queued). */
+    void wait(int timeout_ms);
+
+    const std::string &name() const { return name_; }
+    const PortStats &stats() const { return stats_; }
+
+private:
+    bool setup(std::string &err);
+
+    static constexpr size_t BATCH = 64u;
+    static constexpr size_t MAX_QUEUED = 65536u;
+
+    int fd_ = -1;
+    int epoll_ = -1;
+    bool want_out_ = false;
+    std::string name_;
+    std::deque<CanFrame> out_;
+    PortStats stats_;
+};
+
+} // namespace sim
+
+#endif
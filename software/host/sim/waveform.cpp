@@ -0,0 +1,187 @@
+/* waveform.cpp
+ *
+ * CSV and memory-mapped binary waveform loading and zero-order-hold lookup.
+ */
+
+#include "waveform.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace sim {
+
+namespace {
+
+constexpr size_t BIN_HEADER = 16u;
+constexpr uint16_t BIN_VERSION = 1u;
+constexpr uint16_t ADC_MAX = 4095u;
+
+} // namespace
+
+Waveform::~Waveform()
+{
+    if (map_ != nullptr) {
+        munmap(map_, map_size_);
+    }
+}
+
+bool Waveform::load(const std::string &path, std::string &err)
+{
+    path_ = path;
+    const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        err = path + ": " + std::strerror(errno);
+        return false;
+    }
+    struct stat st{};
+    char magic[4] = {};
+    const bool is_bin = fstat(fd, &st) == 0 && ::read(fd, magic, 4) == 4 && std::memcmp(magic, "STCW", 4) == 0;
+    const bool ok = is_bin ? load_binary(fd, static_cast<size_t>(st.st_size), err) : load_csv(err);
+    ::close(fd);
+    if (ok && points_ == 0u) {
+        err = path + ": no samples";
+        return false;
+    }
+    return ok;
+}
+
+bool Waveform::load_binary(int fd, size_t size, std::string &err)
+{
+    if (size < BIN_HEADER) {
+        err = path_ + ": truncated header";
+        return false;
+    }
+    map_ = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (map_ == MAP_FAILED) {
+        map_ = nullptr;
+        err = path_ + ": mmap: " + std::strerror(errno);
+        return false;
+    }
+    map_size_ = size;
+    (void)madvise(map_, size, MADV_SEQUENTIAL);
+
+    const uint8_t *p = static_cast<const uint8_t *>(map_);
+    uint16_t version = 0;
+    uint16_t channels = 0;
+    double rate = 0.0;
+    std::memcpy(&version, p + 4, 2);
+    std::memcpy(&channels, p + 6, 2);
+    std::memcpy(&rate, p + 8, 8);
+    if (version != BIN_VERSION || channels == 0u || !(rate > 0.0) || !std::isfinite(rate)) {
+        err = path_ + ": unsupported header (version, channels or rate)";
+        return false;
+    }
+    channels_ = channels;
+    points_ = (size - BIN_HEADER) / (2u * channels_);
+    period_ns_ = 1e9 / rate;
+    data_ = reinterpret_cast<const uint16_t *>(p + BIN_HEADER);
+    return true;
+}
+
+bool Waveform::load_csv(std::string &err)
+{
+    std::ifstream in(path_);
+    if (!in) {
+        err = path_ + ": cannot read";
+        return false;
+    }
+    std::string line;
+    size_t line_no = 0;
+    std::vector<uint16_t> row;
+    while (std::getline(in, line)) {
+        line_no++;
+        if (!line.empty() && line.back() == '\r') line.pop_back();
+        if (line.empty()) continue;
+
+        char *p = const_cast<char *>(line.c_str());
+        char *end = nullptr;
+        const double t = std::strtod(p, &end);
+        if (end == p) {
+            if (times_.empty()) continue;       /* header */
+            err = path_ + ":" + std::to_string(line_no) + ": expected a time";
+            return false;
+        }
+        const uint64_t t_ns = static_cast<uint64_t>(std::llround(std::max(t, 0.0) * 1e9));
+        if (!times_.empty() && t_ns <= times_.back()) {
+            err = path_ + ":" + std::to_string(line_no) + ": time does not increase";
+            return false;
+        }
+        row.clear();
+        for (p = end; *p != '\0';) {
+            if (*p == ',' || *p == ';' || *p == ' ' || *p == '\t') {
+                p++;
+                continue;
+            }
+            const double v = std::strtod(p, &end);
+            if (end == p) {
+                err = path_ + ":" + std::to_string(line_no) + ": bad value";
+                return false;
+            }
+            row.push_back(static_cast<uint16_t>(std::clamp(std::lround(v), 0L, static_cast<long>(ADC_MAX))));
+            p = end;
+        }
+        if (channels_ == 0u) {
+            channels_ = static_cast<uint32_t>(row.size());
+            if (channels_ == 0u) {
+                err = path_ + ":" + std::to_string(line_no) + ": no channels";
+                return false;
+            }
+        } else if (row.size() != channels_) {
+            err = path_ + ":" + std::to_string(line_no) + ": expected " + std::to_string(channels_) + " channels";
+            return false;
+        }
+        times_.push_back(t_ns);
+        owned_.insert(owned_.end(), row.begin(), row.end());
+    }
+    points_ = times_.size();
+    data_ = owned_.data();
+    return true;
+}
+
+uint64_t Waveform::duration_ns() const
+{
+    if (points_ == 0u) return 0u;
+    if (!times_.empty()) return times_.back();
+    return static_cast<uint64_t>(static_cast<double>(points_ - 1u) * period_ns_);
+}
+
+uint16_t Waveform::at(uint32_t ch, uint64_t t_ns, Cursor &cur) const
+{
+    if (ch >= channels_ || points_ == 0u) {
+        return 0u;
+    }
+    size_t i;
+    if (times_.empty()) {
+        const double k = std::floor(static_cast<double>(t_ns) / period_ns_);
+        i = std::min(static_cast<size_t>(k), points_ - 1u);
+    } else {
+        i = std::min(cur.index, points_ - 1u);
+        if (times_[i] > t_ns) {
+            i = 0u;     /* time went back: start over */
+        }
+        /* Replay moves forward a few points at a time; search only on a jump. */
+        size_t steps = 0;
+        while (i + 1u < points_ && times_[i + 1u] <= t_ns) {
+            if (++steps > 8u) {
+                i = static_cast<size_t>(std::upper_bound(times_.begin() + static_cast<std::ptrdiff_t>(i),
+                                                         times_.end(), t_ns) - times_.begin()) - 1u;
+                break;
+            }
+            i++;
+        }
+    }
+    cur.index = i;
+    const uint16_t v = row(i)[ch];
+    return v > ADC_MAX ? ADC_MAX : v;
+}
+
+} // namespace sim
@@ -0,0 +1,73 @@
+/* waveform.h
+ *
+ * Recorded multi-channel ADC waveforms for replay into the simulated ADC.
+ *
+ * Two file formats, told apart by the first four bytes:
+ *  - CSV: one row per sample point, "time_s,ch0,ch1,..." with the time in
+ *    seconds (strictly increasing) and 12-bit ADC codes. A first line that
+ *    does not start with a number is taken as a header.
+ *  - Binary, memory-mapped: a 16-byte little-endian header
+ *        char     magic[4]   "STCW"
+ *        uint16_t version    1
+ *        uint16_t channels
+ *        double   rate_hz    sample rate
+ *    followed by uint16_t ADC codes, interleaved per sample point, up to the
+ *    end of the file.
+ *
+ * A waveform is a zero-order hold: the value at time t is the last sample
+ * point at or before t, the first one before the recording starts and the
+ * last one after it ends. Channels that are not in the file read 0.
+ */
+
+#ifndef STC_SIM_WAVEFORM_H
+#define STC_SIM_WAVEFORM_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace sim {
+
+class Waveform {
+public:
+    /* Position of the previous lookup, so sequential replay does not search. */
+    struct Cursor {
+        size_t index = 0;
+    };
+
+    Waveform() = default;
+    ~Waveform();
+    Waveform(const Waveform &) = delete;
+    Waveform &operator=(const Waveform &) = delete;
+
+    bool load(const std::string &path, std::string &err);
+
+    /* Sample of channel ch at t nanoseconds after the start of the recording. */
+    uint16_t at(uint32_t ch, uint64_t t_ns, Cursor &cur) const;
+
+    const std::string &path() const { return path_; }
+    uint32_t channels() const { return channels_; }
+    size_t points() const { return points_; }
+    /* Time of the last sample point. */
+    uint64_t duration_ns() const;
+
+private:
+    bool load_csv(std::string &err);
+    bool load_binary(int fd, size_t size, std::string &err);
+    const uint16_t *row(size_t i) const { return data_ + i * channels_; }
+
+    std::string path_;
+    uint32_t channels_ = 0;
+    size_t points_ = 0;
+    const uint16_t *data_ = nullptr;    /* points_ x channels_ codes */
+    std::vector<uint16_t> owned_;       /* CSV samples */
+    std::vector<uint64_t> times_;       /* CSV sample times; empty: fixed rate */
+    double period_ns_ = 0.0;            /* binary */
+    void *map_ = nullptr;
+    size_t map_size_ = 0;
+};
+
+} // namespace sim
+
+#endif
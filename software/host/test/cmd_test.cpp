@@ -0,0 +1,427 @@
+/* cmd_test.cpp
+ *
+ * Unit checks of the firmware's windowed command protocol (cmd_module.c).
+ *
+ * cmd_module.c is built on its own; the functions it calls in the other
+ * firmware modules are replaced below by stubs that keep a live channel
+ * configuration, count how often it is applied and record the frames
+ * handed to CAN_Module_Send_Std(). The node plan is used with node ID
+ * 0x50, so commands go to 0x55 and acks come from 0x56.
+ *
+ * Checked:
+ *  - coalesced acks: base, count, transaction state and bitmap, for
+ *    accepted and rejected commands, the hold-off and CMD_FLAG_ACK_REQ
+ *  - out-of-order frames: a sequence number overtaken by later ones still
+ *    runs once and starts a new ack
+ *  - duplicate frames: a retransmission is not run again and acks its
+ *    stored result; a GET_VALUE retransmission re-sends the value
+ *  - lost frames: the gap in the bitmap, the retransmission filling it, and
+ *    sequence numbers too old to tell, which are rejected and not run
+ *  - transactions: staged commands stay off the live configuration, COMMIT
+ *    with a missing command is rejected and leaves the transaction open,
+ *    a rejected staged command fails it, ABORT and the idle timeout drop it
+ *
+ * Usage:
+ *   stc_cmd_test
+ *
+ * Exit status: 0 all checks pass, 1 a check failed (each failure is printed).
+ */
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <initializer_list>
+#include <vector>
+
+extern "C" {
+#include "cmd_module.h"
+#include "can_module.h"
+#include "clock_module.h"
+#include "event_log_module.h"
+#include "id_plan_module.h"
+#include "process_signals.h"
+#include "profile_module.h"
+}
+
+namespace {
+
+const uint16_t k_node_id = 0x50u;
+const uint16_t k_rx_id = k_node_id + CMD_RX_ID_OFFSET;
+const uint16_t k_tx_id = k_node_id + CMD_TX_ID_OFFSET;
+
+struct Frame {
+    uint16_t id;
+    uint8_t  dlc;
+    uint8_t  data[8];
+};
+
+/* Live configuration behind the Process_Signals stubs. */
+struct Live {
+    float gain[PS_NUM_CHANNELS];
+    float offset[PS_NUM_CHANNELS];
+    float v_min[PS_NUM_CHANNELS];
+    float v_max[PS_NUM_CHANNELS];
+    bool  enabled[PS_NUM_CHANNELS];
+};
+
+std::vector<Frame> g_sent;
+Live g_live;
+uint32_t g_applied = 0u;        /* apply() calls, seen through Clock_Module_Reevaluate() */
+uint32_t g_sample_period = 10u;
+uint32_t g_tick = 1000u;
+int g_failures = 0;
+
+#define CHECK(cond)                                                                    \
+    do {                                                                               \
+        if (!(cond)) {                                                                 \
+            std::printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond);       \
+            g_failures++;                                                              \
+        }                                                                              \
+    } while (0)
+
+struct Ack {
+    uint8_t  base;
+    uint8_t  count;
+    uint8_t  txn;
+    uint32_t bits;
+};
+
+void reset()
+{
+    for (uint8_t ch = 0; ch < PS_NUM_CHANNELS; ++ch) {
+        g_live.gain[ch] = 1.0f;
+        g_live.offset[ch] = 0.0f;
+        g_live.v_min[ch] = 0.0f;
+        g_live.v_max[ch] = 3.3f;
+        g_live.enabled[ch] = true;
+    }
+    g_sample_period = 10u;
+    g_applied = 0u;
+    g_sent.clear();
+    Cmd_Module_Init(&g_sample_period);
+}
+
+/* Sends a windowed command; d holds d1..d6. */
+void windowed(uint8_t com, uint8_t seq, std::initializer_list<uint8_t> d = {}, bool ack_req = false)
+{
+    uint8_t data[8] = { static_cast<uint8_t>(CMD_FLAG_WINDOWED | (ack_req ? CMD_FLAG_ACK_REQ : 0u) | com), seq };
+    uint8_t k = 2u;
+    for (uint8_t b : d) {
+        data[k++] = b;
+    }
+    CHECK(Cmd_Module_Handle_Frame(k_rx_id, data, 8u));
+}
+
+/* SET_CHANNEL ch enabled, scale in 1/1000. */
+void set_channel(uint8_t seq, uint8_t ch, uint16_t scale, bool ack_req = false)
+{
+    windowed(CMD_SET_CHANNEL, seq, { ch, 1u, static_cast<uint8_t>(scale >> 8), static_cast<uint8_t>(scale), 0u, 0u },
+             ack_req);
+}
+
+/* Advances the tick, runs the task and returns the acks sent since the last
+ * call, including those a gap in the sequence flushed early. */
+std::vector<Ack> task(uint32_t advance_ms = 0u)
+{
+    g_tick += advance_ms;
+    Cmd_Module_Task();
+    std::vector<Ack> acks;
+    for (const Frame &f : g_sent) {
+        CHECK(f.id == k_tx_id);
+        if (f.dlc != 8u || f.data[0] != CMD_RSP_ACK) continue;
+        acks.push_back({ f.data[1], f.data[2], f.data[3],
+                         static_cast<uint32_t>(f.data[4]) << 24 | static_cast<uint32_t>(f.data[5]) << 16 |
+                         static_cast<uint32_t>(f.data[6]) << 8 | f.data[7] });
+    }
+    g_sent.clear();
+    return acks;
+}
+
+/* The single ack the task sends once the hold-off has run out. */
+Ack flush()
+{
+    const std::vector<Ack> acks = task(CMD_ACK_HOLDOFF_MS);
+    CHECK(acks.size() == 1u);
+    return acks.empty() ? Ack{ 0u, 0u, 0xFFu, 0u } : acks.front();
+}
+
+void sync(uint8_t seq)
+{
+    windowed(CMD_SYNC, seq);
+    const std::vector<Ack> acks = task();
+    CHECK(acks.size() == 1u);
+    if (acks.size() == 1u) {
+        CHECK(acks[0].base == seq && acks[0].count == 1u && acks[0].bits == 1u);
+    }
+}
+
+void test_coalesced_ack()
+{
+    reset();
+    sync(0u);
+
+    set_channel(1u, 0u, 2000u);
+    set_channel(2u, 9u, 2000u);         /* no channel 9: rejected */
+    set_channel(3u, 1u, 500u);
+    CHECK(task().empty());              /* held for more commands */
+    const Ack a = flush();
+    CHECK(a.base == 1u && a.count == 3u && a.txn == CMD_TXN_NONE);
+    CHECK(a.bits == 0x5u);
+    CHECK(g_live.gain[0] == 2.0f && g_live.gain[1] == 0.5f);
+    CHECK(g_applied == 2u);
+
+    /* An ack request flushes on the next pass. */
+    set_channel(4u, 2u, 1500u, true);
+    const std::vector<Ack> acks = task();
+    CHECK(acks.size() == 1u);
+    if (!acks.empty()) {
+        CHECK(acks[0].base == 4u && acks[0].count == 1u && acks[0].bits == 1u);
+    }
+}
+
+void test_out_of_order_and_duplicates()
+{
+    reset();
+    sync(10u);
+
+    /* 11 is lost, 12 and 13 arrive: the bitmap starts at 12. */
+    set_channel(12u, 2u, 1200u);
+    set_channel(13u, 3u, 1300u);
+    Ack a = flush();
+    CHECK(a.base == 12u && a.count == 2u && a.bits == 0x3u);
+    CHECK(g_applied == 2u);
+
+    /* The host resends 11: it runs once, in its own ack. */
+    set_channel(11u, 1u, 1100u);
+    a = flush();
+    CHECK(a.base == 11u && a.count == 1u && a.bits == 0x1u);
+    CHECK(g_applied == 3u && g_live.gain[1] == 1.1f);
+
+    /* Duplicates of 11 and 12 with other data: acked, not run again. */
+    g_live.gain[1] = 1.0f;
+    set_channel(11u, 1u, 4000u);
+    set_channel(12u, 2u, 4000u);
+    a = flush();
+    CHECK(a.base == 11u && a.count == 2u && a.bits == 0x3u);
+    CHECK(g_applied == 3u && g_live.gain[1] == 1.0f && g_live.gain[2] == 1.2f);
+
+    /* A rejected command keeps its result when retransmitted. */
+    set_channel(14u, 9u, 1000u);
+    a = flush();
+    CHECK(a.base == 14u && a.count == 1u && a.bits == 0u);
+    set_channel(14u, 1u, 1000u);
+    a = flush();
+    CHECK(a.base == 14u && a.bits == 0u);
+    CHECK(g_applied == 3u);
+
+    /* 16, 15 (late), 17: three acks, as each one breaks the run. */
+    set_channel(16u, 4u, 1600u);
+    set_channel(15u, 5u, 1500u);
+    set_channel(17u, 6u, 1700u);
+    const std::vector<Ack> acks = task(CMD_ACK_HOLDOFF_MS);
+    CHECK(acks.size() == 3u);
+    if (acks.size() == 3u) {
+        CHECK(acks[0].base == 16u && acks[1].base == 15u && acks[2].base == 17u);
+    }
+    CHECK(g_applied == 6u);
+
+    /* A GET_VALUE retransmission answers again with the value. */
+    g_sent.clear();
+    windowed(CMD_GET_VALUE, 18u, { 4u, CMD_VALUE_SCALE });
+    windowed(CMD_GET_VALUE, 18u, { 4u, CMD_VALUE_SCALE });
+    uint8_t values = 0u;
+    for (const Frame &f : g_sent) {
+        if (f.data[0] == CMD_RSP_VALUE) {
+            values++;
+            CHECK(f.data[1] == 18u && f.data[2] == 1u && f.data[3] == 4u);
+            CHECK((f.data[5] << 8 | f.data[6]) == 1600);
+        }
+    }
+    CHECK(values == 2u);
+    CHECK(task(CMD_ACK_HOLDOFF_MS).empty());   /* the value frame was the ack */
+}
+
+void test_lost_history()
+{
+    reset();
+    sync(0u);
+    for (uint8_t seq = 1u; seq <= 40u; ++seq) {
+        if (seq == 5u) continue;        /* lost */
+        set_channel(seq, static_cast<uint8_t>(seq % PS_NUM_CHANNELS), 1000u);
+    }
+    (void)task(CMD_ACK_HOLDOFF_MS);
+    const uint32_t applied = g_applied;
+
+    /* Seq 5 is now 35 behind: too old to tell, so rejected and not run. */
+    set_channel(5u, 0u, 3000u);
+    const Ack a = flush();
+    CHECK(a.base == 5u && a.count == 1u && a.bits == 0u);
+    CHECK(g_applied == applied && g_live.gain[0] != 3.0f);
+
+    /* Seq 20 is within the history: acked from it. */
+    set_channel(20u, 0u, 3000u);
+    CHECK(flush().bits == 1u);
+    CHECK(g_applied == applied);
+
+    /* Sequence numbers wrap at 256. */
+    sync(254u);
+    set_channel(255u, 0u, 2500u);
+    set_channel(0u, 1u, 2500u);
+    const Ack w = flush();
+    CHECK(w.base == 255u && w.count == 2u && w.bits == 0x3u);
+}
+
+void test_transactions()
+{
+    reset();
+    sync(0u);
+
+    windowed(CMD_BEGIN, 1u);
+    std::vector<Ack> acks = task();
+    CHECK(acks.size() == 1u);
+    if (!acks.empty()) {
+        CHECK(acks[0].txn == CMD_TXN_OPEN && acks[0].bits == 1u);
+    }
+
+    /* Two staged commands, the first lost: nothing reaches the live set. */
+    set_channel(3u, 1u, 2000u);
+    CHECK(g_applied == 0u && g_live.gain[1] == 1.0f);
+    windowed(CMD_COMMIT, 4u, { 0u, 2u });
+    acks = task();
+    CHECK(acks.size() == 1u);
+    if (acks.size() == 1u) {
+        /* 3 and 4 in one ack: 3 staged, COMMIT rejected, still open. */
+        CHECK(acks[0].base == 3u && acks[0].count == 2u && acks[0].bits == 0x1u);
+        CHECK(acks[0].txn == CMD_TXN_OPEN);
+    }
+    CHECK(g_applied == 0u);
+
+    /* The lost command comes again, a duplicate of 3 must not count twice. */
+    set_channel(2u, 0u, 3000u);
+    set_channel(3u, 1u, 2000u);
+    windowed(CMD_COMMIT, 5u, { 0u, 2u });
+    acks = task();
+    CHECK(!acks.empty());
+    if (!acks.empty()) {
+        const Ack &last = acks.back();
+        CHECK(last.base <= 5u && ((last.bits >> (5u - last.base)) & 1u) == 1u);
+        CHECK(last.txn == CMD_TXN_NONE);
+    }
+    CHECK(g_applied == 1u);
+    CHECK(g_live.gain[0] == 3.0f && g_live.gain[1] == 2.0f);
+
+    /* A rejected staged command fails the transaction; only ABORT ends it. */
+    windowed(CMD_BEGIN, 6u);
+    (void)task();
+    set_channel(7u, 9u, 1000u);
+    set_channel(8u, 2u, 5000u);
+    windowed(CMD_COMMIT, 9u, { 0u, 2u });
+    acks = task();
+    CHECK(!acks.empty());
+    if (!acks.empty()) {
+        CHECK(acks.back().txn == CMD_TXN_FAILED);
+        CHECK(((acks.back().bits >> (9u - acks.back().base)) & 1u) == 0u);
+    }
+    windowed(CMD_ABORT, 10u);
+    acks = task();
+    CHECK(acks.size() == 1u && acks[0].txn == CMD_TXN_NONE);
+    CHECK(g_applied == 1u && g_live.gain[2] == 1.0f);
+
+    /* Single-frame commands are rejected while a transaction is open. */
+    windowed(CMD_BEGIN, 11u);
+    (void)task();
+    const uint8_t legacy[] = { CMD_SET_SAMPLE_RATE, 0x00u, 0x32u };
+    g_sent.clear();
+    CHECK(Cmd_Module_Handle_Frame(k_rx_id, legacy, sizeof(legacy)));
+    CHECK(g_sent.size() == 1u && g_sent[0].dlc == 1u && g_sent[0].data[0] == 0u);
+
+    /* An idle transaction is dropped after the timeout. */
+    set_channel(12u, 3u, 5000u);
+    (void)task(CMD_ACK_HOLDOFF_MS);
+    (void)task(CMD_TXN_TIMEOUT_MS);
+    windowed(CMD_COMMIT, 13u, { 0u, 1u });
+    acks = task();
+    CHECK(acks.size() == 1u && acks[0].bits == 0u && acks[0].txn == CMD_TXN_NONE);
+    CHECK(g_applied == 1u && g_live.gain[3] == 1.0f);
+}
+
+} // namespace
+
+extern "C" {
+
+uint32_t HAL_GetTick(void) { return g_tick; }
+
+HAL_StatusTypeDef CAN_Module_Send_Std(uint16_t std_id, const uint8_t *data, uint8_t dlc, uint32_t timeout_ms)
+{
+    (void)timeout_ms;
+    Frame f{ std_id, dlc, {} };
+    std::memcpy(f.data, data, dlc);
+    g_sent.push_back(f);
+    return HAL_OK;
+}
+
+uint32_t CAN_Module_Get_Baud_Enum(void) { return 1u; }
+HAL_StatusTypeDef CAN_Module_Update_Baud(uint32_t baud_enum)
+{
+    (void)baud_enum;
+    return HAL_OK;
+}
+
+uint16_t Id_Plan_Module_Std_Id(uint16_t offset) { return static_cast<uint16_t>(k_node_id + offset); }
+
+void Process_Signals_Set_GainOffset(uint8_t ch, float gain, float offset)
+{
+    g_live.gain[ch] = gain;
+    g_live.offset[ch] = offset;
+}
+void Process_Signals_Get_GainOffset(uint8_t ch, float *gain_out, float *offset_out)
+{
+    *gain_out = g_live.gain[ch];
+    *offset_out = g_live.offset[ch];
+}
+void Process_Signals_Set_MinMax(uint8_t ch, float v_min, float v_max)
+{
+    g_live.v_min[ch] = v_min;
+    g_live.v_max[ch] = v_max;
+}
+void Process_Signals_Get_MinMax(uint8_t ch, float *v_min_out, float *v_max_out)
+{
+    *v_min_out = g_live.v_min[ch];
+    *v_max_out = g_live.v_max[ch];
+}
+void Process_Signals_Set_Enabled(uint8_t ch, bool enable) { g_live.enabled[ch] = enable; }
+bool Process_Signals_Get_Enabled(uint8_t ch) { return g_live.enabled[ch]; }
+
+void Clock_Module_Reevaluate(void) { g_applied++; }
+
+bool Event_Log_Module_Add(event_log_type_t type, uint8_t arg, uint32_t data0, uint32_t data1)
+{
+    (void)type;
+    (void)arg;
+    (void)data0;
+    (void)data1;
+    return true;
+}
+
+HAL_StatusTypeDef Profile_Module_Select(uint8_t p)
+{
+    (void)p;
+    return HAL_ERROR;
+}
+
+} // extern "C"
+
+int main()
+{
+    test_coalesced_ack();
+    test_out_of_order_and_duplicates();
+    test_lost_history();
+    test_transactions();
+
+    if (g_failures != 0) {
+        std::printf("stc_cmd_test: %d checks failed\n", g_failures);
+        return 1;
+    }
+    std::printf("stc_cmd_test: all checks passed\n");
+    return 0;
+}
@@ -0,0 +1,326 @@
+/* pdo_test.cpp
+ *
+ * Unit checks of the firmware's PDO packer (pdo_module.c) and its E2E CRC.
+ *
+ * pdo_module.c is built on its own; the functions it calls in the other
+ * firmware modules are replaced below by stubs that serve a fixed snapshot
+ * and record the frames handed to CAN_Module_Send_Std(). The node plan is
+ * used with node ID 0x50.
+ *
+ * Checked:
+ *  - the reference CRC-8 SAE J1850 against its published check value
+ *  - the plain and E2E layouts of the README, byte for byte, including the
+ *    CRC byte and the alive counter
+ *  - Motorola and Intel fields crossing bytes, and saturation at the field
+ *    width
+ *  - mappings the compiler must reject: reserved and claim IDs, the update
+ *    multicast ID, duplicate resolved IDs, overlapping fields, a misplaced
+ *    CRC byte
+ *
+ * Usage:
+ *   stc_pdo_test
+ *
+ * Exit status: 0 all checks pass, 1 a check failed (each failure is printed).
+ */
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+extern "C" {
+#include "pdo_module.h"
+#include "process_signals.h"
+#include "adc_module.h"
+#include "can_module.h"
+#include "claim_module.h"
+#include "clock_module.h"
+#include "id_plan_module.h"
+#include "latency_module.h"
+#include "timebase_module.h"
+#include "update_module.h"
+}
+
+namespace {
+
+const uint16_t k_node_id = 0x50u;
+
+struct Frame {
+    uint16_t id;
+    uint8_t  dlc;
+    uint8_t  data[8];
+};
+
+std::vector<Frame> g_sent;
+ps_snapshot_t g_snap;
+uint32_t g_tick = 0u;
+int g_failures = 0;
+
+#define CHECK(cond)                                                                    \
+    do {                                                                               \
+        if (!(cond)) {                                                                 \
+            std::printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond);       \
+            g_failures++;                                                              \
+        }                                                                              \
+    } while (0)
+
+/* Bitwise CRC-8 SAE J1850: poly 0x1D, init 0xFF, xor-out 0xFF. */
+uint8_t crc8_j1850(const uint8_t *p, size_t n)
+{
+    uint8_t crc = 0xFFu;
+    for (size_t i = 0; i < n; ++i) {
+        crc ^= p[i];
+        for (int b = 0; b < 8; ++b) {
+            crc = static_cast<uint8_t>((crc & 0x80u) ? (crc << 1) ^ 0x1Du : (crc << 1));
+        }
+    }
+    return static_cast<uint8_t>(crc ^ 0xFFu);
+}
+
+/* The E2E CRC of a frame: ID low, ID high, then every byte but the CRC's. */
+uint8_t e2e_crc(const Frame &f, uint8_t crc_byte)
+{
+    std::vector<uint8_t> in = { static_cast<uint8_t>(f.id & 0xFFu), static_cast<uint8_t>(f.id >> 8) };
+    for (uint8_t i = 0; i < f.dlc; ++i) {
+        if (i != crc_byte) in.push_back(f.data[i]);
+    }
+    return crc8_j1850(in.data(), in.size());
+}
+
+void set_snapshot()
+{
+    std::memset(&g_snap, 0, sizeof(g_snap));
+    for (uint8_t ch = 0; ch < PS_NUM_CHANNELS; ++ch) {
+        g_snap.mV[ch] = static_cast<uint16_t>(1000u * (ch + 1u) + ch);
+        g_snap.raw[ch] = static_cast<uint16_t>(0x100u * ch + 0x0ABu);
+    }
+    g_snap.oor_mask = 0xA5u;
+}
+
+pdo_frame_t frame(uint16_t id, uint8_t dlc, std::initializer_list<pdo_entry_t> entries)
+{
+    pdo_frame_t m{};
+    m.id = id;
+    m.dlc = dlc;
+    for (const pdo_entry_t &e : entries) {
+        m.entry[m.num_entries++] = e;
+    }
+    return m;
+}
+
+const Frame *sent_on(uint16_t id)
+{
+    for (const Frame &f : g_sent) {
+        if (f.id == id) return &f;
+    }
+    return nullptr;
+}
+
+void test_crc_reference()
+{
+    const uint8_t check[] = { '1', '2', '3', '4', '5', '6', '7', '8', '9' };
+    CHECK(crc8_j1850(check, sizeof(check)) == 0x4Bu);
+}
+
+void test_plain_layout()
+{
+    PDO_Module_Load_Layout(PDO_LAYOUT_PLAIN);
+    g_sent.clear();
+    CHECK(PDO_Module_Send_All(0u) == HAL_OK);
+    CHECK(g_sent.size() == 2u);
+
+    for (uint8_t f = 0; f < 2u; ++f) {
+        const Frame *fr = sent_on(static_cast<uint16_t>(k_node_id + 1u + f));
+        CHECK(fr != nullptr);
+        if (fr == nullptr) continue;
+        CHECK(fr->dlc == 8u);
+        for (uint8_t k = 0; k < 4u; ++k) {
+            const uint16_t mv = g_snap.mV[4u * f + k];
+            CHECK(fr->data[2u * k] == static_cast<uint8_t>(mv >> 8));
+            CHECK(fr->data[2u * k + 1u] == static_cast<uint8_t>(mv & 0xFFu));
+        }
+    }
+}
+
+void test_e2e_layout()
+{
+    PDO_Module_Init();
+    PDO_Module_Load_Layout(PDO_LAYOUT_E2E);
+    for (uint8_t round = 0; round < 20u; ++round) {
+        g_sent.clear();
+        CHECK(PDO_Module_Send_All(0u) == HAL_OK);
+        CHECK(g_sent.size() == 3u);
+        for (const Frame &fr : g_sent) {
+            CHECK(fr.dlc == 8u);
+            CHECK(fr.data[0] == e2e_crc(fr, 0u));
+            CHECK((fr.data[1] & 0x0Fu) == (round & 0x0Fu));
+        }
+    }
+
+    const Frame *f3 = sent_on(static_cast<uint16_t>(k_node_id + 4u));
+    CHECK(f3 != nullptr);
+    if (f3 != nullptr) {
+        CHECK(f3->data[2] == static_cast<uint8_t>(g_snap.mV[6] >> 8));
+        CHECK(f3->data[3] == static_cast<uint8_t>(g_snap.mV[6] & 0xFFu));
+        CHECK(f3->data[6] == g_snap.oor_mask);
+    }
+
+    /* A single flipped bit must change the CRC. */
+    const Frame *f1 = sent_on(static_cast<uint16_t>(k_node_id + 1u));
+    CHECK(f1 != nullptr);
+    if (f1 != nullptr) {
+        Frame bad = *f1;
+        bad.data[5] ^= 0x10u;
+        CHECK(bad.data[0] != e2e_crc(bad, 0u));
+    }
+}
+
+void test_custom_fields()
+{
+    PDO_Module_Load_Layout(PDO_LAYOUT_PLAIN);
+    /* Raw channel 1 (0x1AB) as 12-bit Intel at start bit 4: bits 4..15.
+     * Raw channel 2 (0x2AB) as 12-bit Motorola from bit 20: MSB at byte 2
+     * bit 3, low bits into byte 3. OOR mask (0xA5) into a 4-bit field
+     * saturates to 0xF. */
+    const pdo_frame_t m = frame(0x1u, 6u, {
+        { PDO_SRC_RAW, 1u, 4u, 12u, PDO_ENC_LE },
+        { PDO_SRC_RAW, 2u, 20u, 12u, PDO_ENC_BE },
+        { PDO_SRC_OOR_MASK, 0u, 40u, 4u, PDO_ENC_LE },
+        { PDO_SRC_CONST, 0x5Au, 32u, 8u, PDO_ENC_BE },
+    });
+    CHECK(PDO_Module_Set_Frame(0u, &m) == HAL_OK);
+    CHECK(PDO_Module_Get_Layout() == PDO_LAYOUT_CUSTOM);
+
+    g_sent.clear();
+    CHECK(PDO_Module_Send_All(0u) == HAL_OK);
+    const Frame *fr = sent_on(static_cast<uint16_t>(k_node_id + 1u));
+    CHECK(fr != nullptr);
+    if (fr == nullptr) return;
+    CHECK(fr->dlc == 6u);
+    CHECK(fr->data[0] == 0xB0u);        /* 0x1AB << 4, low byte */
+    CHECK(fr->data[1] == 0x1Au);
+    CHECK(fr->data[2] == 0x02u);        /* 0x2AB: bits 11..8 in byte 2 bits 3..0 */
+    CHECK(fr->data[3] == 0xABu);
+    CHECK(fr->data[4] == 0x5Au);
+    CHECK(fr->data[5] == 0x0Fu);
+}
+
+void test_rejected_mappings()
+{
+    PDO_Module_Load_Layout(PDO_LAYOUT_PLAIN);
+    const pdo_entry_t mv0 = { PDO_SRC_MV, 0u, 0u, 16u, PDO_ENC_BE };
+
+    /* Command, XCP, UDS, Bus Health and backfill offsets, relative or absolute. */
+    for (uint16_t off = 0x5u; off <= 0xCu; ++off) {
+        pdo_frame_t m = frame(off, 8u, { mv0 });
+        CHECK(PDO_Module_Set_Frame(3u, &m) == HAL_ERROR);
+        m.id = static_cast<uint16_t>(PDO_ID_ABSOLUTE | (k_node_id + off));
+        CHECK(PDO_Module_Set_Frame(3u, &m) == HAL_ERROR);
+    }
+    /* Every claim ID and the update multicast ID. */
+    for (uint16_t id = CLAIM_ID_BASE; id < CLAIM_ID_BASE + CLAIM_ID_COUNT; ++id) {
+        const pdo_frame_t m = frame(static_cast<uint16_t>(PDO_ID_ABSOLUTE | id), 8u, { mv0 });
+        CHECK(PDO_Module_Set_Frame(3u, &m) == HAL_ERROR);
+    }
+    pdo_frame_t m = frame(static_cast<uint16_t>(PDO_ID_ABSOLUTE | UPDATE_MCAST_ID), 8u, { mv0 });
+    CHECK(PDO_Module_Set_Frame(3u, &m) == HAL_ERROR);
+
+    /* Same resolved ID as frame 0 (node_id + 1), given absolute. */
+    m = frame(static_cast<uint16_t>(PDO_ID_ABSOLUTE | (k_node_id + 1u)), 8u, { mv0 });
+    CHECK(PDO_Module_Set_Frame(3u, &m) == HAL_ERROR);
+
+    /* Overlapping fields, a field past the DLC, a CRC byte off a byte
+     * boundary. */
+    m = frame(0x3u, 8u, { mv0, { PDO_SRC_MV, 1u, 8u, 16u, PDO_ENC_BE } });
+    CHECK(PDO_Module_Set_Frame(3u, &m) == HAL_ERROR);
+    m = frame(0x3u, 2u, { mv0, { PDO_SRC_MV, 1u, 16u, 16u, PDO_ENC_BE } });
+    CHECK(PDO_Module_Set_Frame(3u, &m) == HAL_ERROR);
+    m = frame(0x3u, 8u, { mv0, { PDO_SRC_CRC8, 0u, 20u, 8u, PDO_ENC_BE } });
+    CHECK(PDO_Module_Set_Frame(3u, &m) == HAL_ERROR);
+
+    /* None of them touched the table; a free offset and ID are accepted. */
+    CHECK(PDO_Module_Get_Layout() == PDO_LAYOUT_PLAIN);
+    m = frame(0x3u, 8u, { mv0 });
+    CHECK(PDO_Module_Set_Frame(3u, &m) == HAL_OK);
+    m = frame(static_cast<uint16_t>(PDO_ID_ABSOLUTE | 0x123u), 8u, { mv0 });
+    CHECK(PDO_Module_Set_Frame(2u, &m) == HAL_OK);
+}
+
+} // namespace
+
+/* ===== Stubs of the modules pdo_module.c calls ===== */
+
+extern "C" {
+
+uint32_t HAL_GetTick(void) { return g_tick; }
+
+void Process_Signals_Update(void) {}
+void Process_Signals_Get_Snapshot(ps_snapshot_t *out) { *out = g_snap; }
+bool Process_Signals_Get_Enabled(uint8_t ch) { return ch < PS_NUM_CHANNELS; }
+uint32_t Process_Signals_Get_Stats_Count(void) { return 0u; }
+void Process_Signals_Get_Stats(uint8_t ch, uint16_t *min_out, uint16_t *max_out, uint16_t *mean_out)
+{
+    if (min_out != nullptr) *min_out = g_snap.mV[ch];
+    if (max_out != nullptr) *max_out = g_snap.mV[ch];
+    if (mean_out != nullptr) *mean_out = g_snap.mV[ch];
+}
+
+uint32_t ADC_Module_Get_Scan_Count(void) { return 1u; }
+uint16_t Clock_Module_Get_Load_Permille(void) { return 0u; }
+uint32_t Timebase_Module_Now_Us(void) { return g_tick * 1000u; }
+
+uint32_t CAN_Module_Abort_Std(uint16_t std_id)
+{
+    (void)std_id;
+    return 0u;
+}
+
+HAL_StatusTypeDef CAN_Module_Send_Std(uint16_t std_id, const uint8_t *data, uint8_t dlc, uint32_t timeout_ms)
+{
+    (void)timeout_ms;
+    Frame f{ std_id, dlc, {} };
+    std::memcpy(f.data, data, dlc);
+    g_sent.push_back(f);
+    return HAL_OK;
+}
+
+bool Claim_Module_Is_Claim_Id(uint16_t std_id)
+{
+    return std_id >= CLAIM_ID_BASE && std_id < CLAIM_ID_BASE + CLAIM_ID_COUNT;
+}
+
+bool Id_Plan_Module_Is_Class_Plan(void) { return false; }
+uint16_t Id_Plan_Module_Std_Id(uint16_t offset) { return static_cast<uint16_t>(k_node_id + offset); }
+bool Id_Plan_Module_Is_Planned(uint16_t std_id)
+{
+    return std_id >= k_node_id && std_id < k_node_id + ID_PLAN_OFFSETS;
+}
+
+void Latency_Module_Mark_Queued(uint8_t frame, uint16_t std_id)
+{
+    (void)frame;
+    (void)std_id;
+}
+void Latency_Module_Mark_Accepted(uint8_t frame) { (void)frame; }
+void Latency_Module_Mark_Dropped(uint8_t frame) { (void)frame; }
+
+} // extern "C"
+
+int main()
+{
+    set_snapshot();
+    PDO_Module_Init();
+
+    test_crc_reference();
+    test_plain_layout();
+    test_e2e_layout();
+    test_custom_fields();
+    test_rejected_mappings();
+
+    if (g_failures != 0) {
+        std::printf("stc_pdo_test: %d checks failed\n", g_failures);
+        return 1;
+    }
+    std::printf("stc_pdo_test: all checks passed\n");
+    return 0;
+}
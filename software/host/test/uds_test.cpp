@@ -0,0 +1,373 @@
+/* uds_test.cpp
+ *
+ * Unit checks of the firmware's UDS DID table and ReadDataByIdentifier
+ * (uds_module.c).
+ *
+ * uds_module.c is built through uds_test_table.c, which hands out its DID
+ * table; the functions it calls in the other firmware modules are replaced
+ * below by stubs. Requests are fed through stubbed ISO-TP buffers of the
+ * firmware's sizes (ISOTP_RX_BUF_SIZE, ISOTP_TX_BUF_SIZE); the TX buffer is
+ * followed by a guard area that must stay untouched. PDO_Module_Get_Frame()
+ * serves full frames, so the layout description is as long as it gets.
+ *
+ * Checked:
+ *  - the DID table is sorted by DID, without duplicates, and every entry
+ *    is found by the binary search; no other DID answers
+ *  - every single-DID read answers with its size (at most the reserved
+ *    size for variable-length DIDs)
+ *  - multi-DID reads up to the longest request: the response is exactly
+ *    the sum of the records if the reserved sizes fit the TX buffer, NRC
+ *    0x14 (response too long) otherwise, and never writes past the buffer
+ *
+ * Usage:
+ *   stc_uds_test
+ *
+ * Exit status: 0 all checks pass, 1 a check failed (each failure is printed).
+ */
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+extern "C" {
+#include "uds_module.h"
+#include "adc_module.h"
+#include "backfill_module.h"
+#include "boot_module.h"
+#include "can_diag_module.h"
+#include "can_module.h"
+#include "claim_module.h"
+#include "clock_module.h"
+#include "cmd_module.h"
+#include "event_log_module.h"
+#include "id_plan_module.h"
+#include "irq_module.h"
+#include "isotp_module.h"
+#include "latency_module.h"
+#include "main.h"
+#include "pdo_module.h"
+#include "process_signals.h"
+#include "profile_module.h"
+#include "update_module.h"
+#include "xcp_module.h"
+
+size_t UDS_Test_Did_Table(uint16_t *did, uint16_t *size, size_t max);
+}
+
+namespace {
+
+const uint16_t k_variable = 0x8000u;       /* UDS_DID_VARIABLE */
+const uint8_t k_guard = 0xA5u;
+const size_t k_guard_size = 64u;
+
+struct Did {
+    uint16_t did;
+    uint16_t size;
+};
+
+std::vector<Did> g_table;
+uint8_t g_rx[ISOTP_RX_BUF_SIZE];
+size_t g_rx_len = 0u;
+bool g_rx_pending = false;
+uint8_t g_tx[ISOTP_TX_BUF_SIZE + k_guard_size];
+size_t g_tx_len = 0u;
+uint32_t g_tick = 0u;
+int g_failures = 0;
+
+#define CHECK(cond)                                                                    \
+    do {                                                                               \
+        if (!(cond)) {                                                                 \
+            std::printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond);       \
+            g_failures++;                                                              \
+        }                                                                              \
+    } while (0)
+
+uint16_t u16_be(const uint8_t *p) { return static_cast<uint16_t>(p[0] << 8 | p[1]); }
+
+/* Runs one request through UDS_Module_Task(); returns the response length. */
+size_t request(const std::vector<uint8_t> &req)
+{
+    std::memcpy(g_rx, req.data(), req.size());
+    g_rx_len = req.size();
+    g_rx_pending = true;
+    std::memset(g_tx, k_guard, sizeof(g_tx));
+    g_tx_len = 0u;
+    UDS_Module_Task();
+    CHECK(!g_rx_pending);
+    CHECK(std::all_of(g_tx + ISOTP_TX_BUF_SIZE, g_tx + sizeof(g_tx), [](uint8_t b) { return b == k_guard; }));
+    return g_tx_len;
+}
+
+std::vector<uint8_t> read_request(const std::vector<uint16_t> &dids)
+{
+    std::vector<uint8_t> req = { 0x22u };
+    for (uint16_t d : dids) {
+        req.push_back(static_cast<uint8_t>(d >> 8));
+        req.push_back(static_cast<uint8_t>(d & 0xFFu));
+    }
+    return req;
+}
+
+const Did *find(uint16_t did)
+{
+    for (const Did &d : g_table) {
+        if (d.did == did) return &d;
+    }
+    return nullptr;
+}
+
+void load_table()
+{
+    uint16_t did[256];
+    uint16_t size[256];
+    const size_t n = UDS_Test_Did_Table(did, size, 256u);
+    CHECK(n > 0u && n <= 256u);
+    for (size_t i = 0; i < n && i < 256u; ++i) {
+        g_table.push_back({ did[i], size[i] });
+    }
+}
+
+void test_table_sorted()
+{
+    for (size_t i = 1; i < g_table.size(); ++i) {
+        if (g_table[i - 1].did >= g_table[i].did) {
+            std::printf("DID table: 0x%04X at position %zu is not above 0x%04X\n", g_table[i].did, i,
+                        g_table[i - 1].did);
+            g_failures++;
+        }
+    }
+    for (const Did &d : g_table) {
+        CHECK((d.size & ~k_variable) != 0u);
+    }
+}
+
+/* Every DID alone, then every identifier that is not in the table. */
+void test_single_reads()
+{
+    for (const Did &d : g_table) {
+        const size_t len = request(read_request({ d.did }));
+        const uint16_t max = d.size & ~k_variable;
+        CHECK(len >= 3u && g_tx[0] == 0x62u && u16_be(&g_tx[1]) == d.did);
+        if ((d.size & k_variable) != 0u) {
+            CHECK(len >= 5u && u16_be(&g_tx[3]) <= max && len == 3u + u16_be(&g_tx[3]));
+        } else {
+            CHECK(len == 3u + max);
+        }
+    }
+    for (uint32_t did = 0u; did <= 0xFFFFu; ++did) {
+        if (find(static_cast<uint16_t>(did)) != nullptr) continue;
+        const size_t len = request(read_request({ static_cast<uint16_t>(did) }));
+        CHECK(len == 3u && g_tx[0] == 0x7Fu && g_tx[2] == 0x31u);
+    }
+}
+
+/* Checks one multi-DID read against the reserved and the actual sizes. */
+void check_multi(const std::vector<uint16_t> &dids)
+{
+    size_t reserved = 1u;
+    for (uint16_t did : dids) {
+        const Did *d = find(did);
+        reserved += (d != nullptr) ? 2u + (d->size & ~k_variable) : 0u;
+    }
+    const size_t len = request(read_request(dids));
+    if (reserved > ISOTP_TX_BUF_SIZE) {
+        CHECK(len == 3u && g_tx[0] == 0x7Fu && g_tx[2] == 0x14u);
+        return;
+    }
+    CHECK(len <= ISOTP_TX_BUF_SIZE && g_tx[0] == 0x62u);
+    /* Walk the records: each DID in request order with its own length. */
+    size_t pos = 1u;
+    for (uint16_t did : dids) {
+        const Did *d = find(did);
+        if (d == nullptr) continue;
+        CHECK(pos + 2u <= len && u16_be(&g_tx[pos]) == did);
+        const size_t size = ((d->size & k_variable) != 0u) ? u16_be(&g_tx[pos + 2u]) : d->size;
+        pos += 2u + size;
+    }
+    CHECK(pos == len);
+}
+
+void test_multi_reads()
+{
+    const size_t max_dids = (ISOTP_RX_BUF_SIZE - 1u) / 2u;
+
+    /* Largest first: fills the buffer with as few DIDs as possible. */
+    std::vector<Did> by_size = g_table;
+    std::stable_sort(by_size.begin(), by_size.end(), [](const Did &a, const Did &b) {
+        return (a.size & ~k_variable) > (b.size & ~k_variable);
+    });
+    for (size_t n = 1u; n <= max_dids; ++n) {
+        std::vector<uint16_t> dids;
+        for (size_t i = 0; i < n; ++i) {
+            dids.push_back(by_size[i % by_size.size()].did);
+        }
+        check_multi(dids);
+    }
+
+    /* Each DID repeated up to the request limit, and the whole table in
+     * request-sized runs, with an unknown DID mixed in. */
+    for (const Did &d : g_table) {
+        check_multi(std::vector<uint16_t>(max_dids, d.did));
+    }
+    for (size_t first = 0u; first < g_table.size(); first += max_dids - 1u) {
+        std::vector<uint16_t> dids = { 0xF190u };
+        for (size_t i = first; i < g_table.size() && dids.size() < max_dids; ++i) {
+            dids.push_back(g_table[i].did);
+        }
+        check_multi(dids);
+    }
+
+    /* Random sets, fixed seed. */
+    uint32_t x = 12345u;
+    for (int k = 0; k < 5000; ++k) {
+        x = x * 1664525u + 1013904223u;
+        const size_t n = 1u + (x >> 16) % max_dids;
+        std::vector<uint16_t> dids;
+        for (size_t i = 0; i < n; ++i) {
+            x = x * 1664525u + 1013904223u;
+            dids.push_back(g_table[(x >> 16) % g_table.size()].did);
+        }
+        check_multi(dids);
+    }
+
+    /* Malformed: an odd length or no DID at all. */
+    CHECK(request({ 0x22u, 0x01u }) == 3u && g_tx[2] == 0x13u);
+    CHECK(request({ 0x22u, 0x01u, 0x00u, 0x01u }) == 3u && g_tx[2] == 0x13u);
+}
+
+} // namespace
+
+extern "C" {
+
+can_debug_t g_can_dbg;
+
+uint32_t HAL_GetTick(void) { return g_tick; }
+
+const uint8_t *ISOTP_Module_Get_Rx(size_t *len)
+{
+    *len = g_rx_len;
+    return g_rx_pending ? g_rx : nullptr;
+}
+void ISOTP_Module_Release_Rx(void) { g_rx_pending = false; }
+uint8_t *ISOTP_Module_Get_Tx_Buffer(size_t *capacity)
+{
+    *capacity = ISOTP_TX_BUF_SIZE;
+    return g_tx;
+}
+HAL_StatusTypeDef ISOTP_Module_Start_Tx(size_t len)
+{
+    g_tx_len = len;
+    return HAL_OK;
+}
+
+/* Full frames: the longest layout description. */
+bool PDO_Module_Get_Frame(uint8_t f, pdo_frame_t *out)
+{
+    std::memset(out, 0, sizeof(*out));
+    out->id = static_cast<uint16_t>(1u + f);
+    out->dlc = 8u;
+    out->num_entries = PDO_MAX_ENTRIES;
+    return true;
+}
+pdo_layout_t PDO_Module_Get_Layout(void) { return PDO_LAYOUT_CUSTOM; }
+uint32_t PDO_Module_Get_Tx_Replaced(uint8_t f) { return f; }
+uint16_t PDO_Module_Resolve_Id(uint16_t id) { return id; }
+HAL_StatusTypeDef PDO_Module_Set_Frame(uint8_t f, const pdo_frame_t *frame) { return HAL_OK; }
+
+HAL_StatusTypeDef ADC_Module_Recalibrate(void) { return HAL_OK; }
+void Backfill_Module_Get_Stats(backfill_stats_t *out) { std::memset(out, 0, sizeof(*out)); }
+uint32_t Boot_Module_Get_Us(boot_phase_t phase) { return phase; }
+void CAN_Diag_Module_Get_Counters(can_diag_counters_t *out) { std::memset(out, 0, sizeof(*out)); }
+bool CAN_Diag_Module_Get_Window(uint8_t age, can_diag_window_t *out)
+{
+    std::memset(out, 0, sizeof(*out));
+    return true;
+}
+void CAN_Diag_Module_Reset(void) {}
+uint32_t CAN_Module_Get_Baud_Enum(void) { return 1u; }
+uint8_t CAN_Module_Get_Node_Id(void) { return 0x50u; }
+void Claim_Module_Get_Stats(claim_stats_t *out) { std::memset(out, 0, sizeof(*out)); }
+uint32_t Clock_Module_Get_Hclk_Hz(void) { return 48000000u; }
+uint16_t Clock_Module_Get_Load_Permille(void) { return 0u; }
+uint32_t Clock_Module_Get_Min_Pass_Us(void) { return 0u; }
+uint8_t Clock_Module_Get_Setting(void) { return 0u; }
+uint32_t Clock_Module_Get_Switch_Count(void) { return 0u; }
+void Clock_Module_Reevaluate(void) {}
+HAL_StatusTypeDef Clock_Module_Set_Setting(uint8_t setting) { return HAL_OK; }
+uint32_t Cmd_Module_Get_Sample_Period(void) { return 10u; }
+bool Event_Log_Module_Add(event_log_type_t type, uint8_t arg, uint32_t data0, uint32_t data1) { return true; }
+void Event_Log_Module_Clear(void) {}
+bool Event_Log_Module_Get_Entry(uint16_t age, event_log_entry_t *out)
+{
+    std::memset(out, 0, sizeof(*out));
+    return true;
+}
+void Event_Log_Module_Get_Stats(event_log_stats_t *out) { std::memset(out, 0, sizeof(*out)); }
+uint16_t Id_Plan_Module_Get_Base(id_class_t c) { return 0x100u; }
+uint8_t Id_Plan_Module_Get_Width(id_class_t c) { return 1u; }
+bool Id_Plan_Module_Is_Class_Plan(void) { return false; }
+void Irq_Module_Get_Stats(irq_src_t src, irq_stats_t *out) { std::memset(out, 0, sizeof(*out)); }
+void Irq_Module_Reset(void) {}
+bool Latency_Module_Get_Hist(latency_stage_t stage, latency_hist_t *out)
+{
+    std::memset(out, 0, sizeof(*out));
+    return true;
+}
+void Latency_Module_Reset(void) {}
+void Process_Signals_Get_All_Input_mV(uint16_t *out_mV) { std::memset(out_mV, 0, 2u * PS_NUM_CHANNELS); }
+void Process_Signals_Get_All_Raw(uint16_t *out_raw) { std::memset(out_raw, 0, 2u * PS_NUM_CHANNELS); }
+bool Process_Signals_Get_Enabled(uint8_t ch) { return true; }
+void Process_Signals_Get_GainOffset(uint8_t ch, float *gain_out, float *offset_out)
+{
+    *gain_out = 1.0f;
+    *offset_out = 0.0f;
+}
+void Process_Signals_Get_MinMax(uint8_t ch, float *v_min_out, float *v_max_out)
+{
+    *v_min_out = 0.0f;
+    *v_max_out = 3.3f;
+}
+uint8_t Process_Signals_Get_OutOfRange_Mask(void) { return 0u; }
+void Process_Signals_Get_Stats(uint8_t ch, uint16_t *min_out, uint16_t *max_out, uint16_t *mean_out)
+{
+    *min_out = 0u;
+    *max_out = 0u;
+    *mean_out = 0u;
+}
+uint32_t Process_Signals_Get_Stats_Count(void) { return 0u; }
+uint32_t Process_Signals_Get_Tx_Drops(uint8_t frame) { return frame; }
+void Process_Signals_Reset_Stats(void) {}
+void Process_Signals_Set_E2E(bool enable) {}
+void Process_Signals_Set_GainOffset(uint8_t ch, float gain, float offset) {}
+void Process_Signals_Set_MinMax(uint8_t ch, float v_min, float v_max) {}
+uint8_t Profile_Module_Get_Active(void) { return 0xFFu; }
+profile_save_state_t Profile_Module_Get_Save_State(void) { return static_cast<profile_save_state_t>(0); }
+uint8_t Profile_Module_Get_Valid_Mask(void) { return 0u; }
+HAL_StatusTypeDef Profile_Module_Save(uint8_t p) { return HAL_OK; }
+HAL_StatusTypeDef Profile_Module_Select(uint8_t p) { return HAL_OK; }
+void Update_Module_Abort(void) {}
+void Update_Module_Get_Missing(uint8_t *out) { std::memset(out, 0, UPDATE_BITMAP_BYTES); }
+void Update_Module_Get_Status(update_status_t *out) { std::memset(out, 0, sizeof(*out)); }
+HAL_StatusTypeDef Update_Module_Start(uint8_t tag, uint32_t size, uint32_t crc32) { return HAL_OK; }
+uint32_t XCP_Module_Get_Overrun_Count(void) { return 0u; }
+
+} // extern "C"
+
+int main()
+{
+    UDS_Module_Init();
+    load_table();
+
+    test_table_sorted();
+    test_single_reads();
+    test_multi_reads();
+
+    if (g_failures != 0) {
+        std::printf("stc_uds_test: %d checks failed\n", g_failures);
+        return 1;
+    }
+    std::printf("stc_uds_test: all checks passed (%zu DIDs)\n", g_table.size());
+    return 0;
+}
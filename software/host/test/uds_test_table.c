@@ -0,0 +1,21 @@
+/* uds_test_table.c
+ *
+ * Builds uds_module.c for stc_uds_test and gives the test a copy of its
+ * private DID table (identifier and size of every DID, in table order).
+ */
+
+#include "uds_module.c"
+
+size_t UDS_Test_Did_Table(uint16_t *did, uint16_t *size, size_t max)
+{
+    size_t n = 0u;
+    for (size_t i = 0u; i < UDS_DID_COUNT; ++i) {
+        for (uint16_t k = 0u; k < s_did_table[i].count; ++k, ++n) {
+            if (n < max) {
+                did[n] = (uint16_t)(s_did_table[i].did + k);
+                size[n] = s_did_table[i].size;
+            }
+        }
+    }
+    return n;
+}
@@ -0,0 +1,209 @@
+/* update_test.cpp
+ *
+ * End-to-end check of the multicast image download (update_module.c,
+ * stc_update.h) on the simulated bus.
+ *
+ * Each scenario runs in its own process: the simulator with N nodes, paced
+ * to the wall clock, is bridged through a socket pair to an stc_client in
+ * the same process, which downloads one image to every node with
+ * stc::update(). The image goes to 1 node and then to 16, as many as the
+ * node plan has addresses for (node_id 0x00 .. 0xF0).
+ *
+ * Checked:
+ *  - every node reaches state done (CRC-32 verified) in both scenarios
+ *  - the 16-node download takes no longer than the 1-node one, plus
+ *    TIME_SLACK of it and the erase and session requests of the extra nodes
+ *    (SETUP_PER_NODE_S each)
+ *
+ * Usage:
+ *   stc_update_test [image_bytes]
+ *
+ * Exit status: 0 all checks pass, 1 a check failed (each failure is printed).
+ */
+
+#include "sim.h"
+#include "stc_update.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+extern "C" {
+/* main.c */
+extern uint8_t node_id;
+}
+
+namespace {
+
+constexpr double TIME_SLACK = 0.25;
+constexpr double SETUP_PER_NODE_S = 0.02;
+constexpr int BOOT_TIMEOUT_MS = 5000;
+
+struct Outcome {
+    int ok = 0;
+    double total_s = 0.0;
+    double erase_s = 0.0;
+    uint32_t frames = 0;
+    uint32_t rounds = 0;
+};
+
+/* Runs one download in this process; returns false on a setup error. */
+bool scenario(uint32_t nodes, size_t image_bytes, Outcome &out)
+{
+    int sv[2];
+    if (::socketpair(AF_UNIX, SOCK_SEQPACKET, 0, sv) < 0) {
+        std::perror("socketpair");
+        return false;
+    }
+
+    sim::Config cfg;
+    cfg.nodes = nodes;
+    cfg.seconds = 0.0;
+    sim::Simulator s(cfg);
+    for (auto &np : s.nodes()) {
+        sim::Node &n = *np;
+        s.call_in(n, [&]() { node_id = n.node_id; });
+    }
+    sim::SocketCanPort port;
+    stc::Client client;
+    std::string err;
+    if (!port.attach(sv[0], err) || !client.attach(sv[1], err)) {
+        std::fprintf(stderr, "attach: %s\n", err.c_str());
+        return false;
+    }
+    s.attach(&port);
+    for (const auto &np : s.nodes()) {
+        stc::NodeConfig nc;
+        nc.node_id = np->node_id;
+        if (client.add_node(nc, err) < 0) {
+            std::fprintf(stderr, "add_node: %s\n", err.c_str());
+            return false;
+        }
+    }
+    std::thread bus([&s]() { s.run(); });
+    bool ok = client.start(err);
+    if (!ok) {
+        std::fprintf(stderr, "start: %s\n", err.c_str());
+    }
+
+    /* Every node sends data once it has booted and claimed its address. */
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(BOOT_TIMEOUT_MS);
+    for (size_t k = 0; ok && k < client.node_count(); ++k) {
+        while (client.stats(k).frames == 0u) {
+            if (std::chrono::steady_clock::now() > deadline) {
+                std::fprintf(stderr, "node 0x%03X sent nothing\n", client.config(k).node_id);
+                ok = false;
+                break;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+    }
+
+    if (ok) {
+        std::vector<uint8_t> image(image_bytes);
+        uint32_t x = 0x2545F491u;
+        for (uint8_t &b : image) {
+            x ^= x << 13;
+            x ^= x >> 17;
+            x ^= x << 5;
+            b = static_cast<uint8_t>(x);
+        }
+        std::vector<size_t> all;
+        for (size_t k = 0; k < client.node_count(); ++k) {
+            all.push_back(k);
+        }
+        const stc::UpdateResult r = stc::update(client, all, image);
+        out.ok = r.ok ? 1 : 0;
+        out.total_s = r.total_s;
+        out.erase_s = r.erase_s;
+        out.frames = static_cast<uint32_t>(r.frames);
+        out.rounds = r.rounds;
+        for (size_t k = 0; k < r.nodes.size(); ++k) {
+            if (r.nodes[k].state != stc::UpdateState::Done) {
+                std::printf("  node 0x%03X: state %u error %u, %u blocks missing (%s nrc 0x%02X)\n",
+                            client.config(k).node_id, static_cast<unsigned>(r.nodes[k].state), r.nodes[k].error,
+                            r.nodes[k].missing, stc::to_string(r.nodes[k].status), r.nodes[k].nrc);
+            }
+        }
+    }
+
+    client.stop();
+    sim::Simulator::stop();
+    bus.join();
+    return ok;
+}
+
+/* Runs scenario() in a child process: the simulator's state is global. */
+bool run(uint32_t nodes, size_t image_bytes, Outcome &out)
+{
+    int fd[2];
+    if (::pipe(fd) < 0) {
+        std::perror("pipe");
+        return false;
+    }
+    std::fflush(stdout);
+    const pid_t pid = ::fork();
+    if (pid < 0) {
+        std::perror("fork");
+        return false;
+    }
+    if (pid == 0) {
+        ::close(fd[0]);
+        Outcome o;
+        const bool set_up = scenario(nodes, image_bytes, o);
+        std::fflush(stdout);
+        if (set_up && ::write(fd[1], &o, sizeof(o)) != static_cast<ssize_t>(sizeof(o))) {
+            std::_Exit(2);
+        }
+        std::_Exit(set_up ? 0 : 2);
+    }
+    ::close(fd[1]);
+    const ssize_t got = ::read(fd[0], &out, sizeof(out));
+    ::close(fd[0]);
+    int status = 0;
+    ::waitpid(pid, &status, 0);
+    return got == static_cast<ssize_t>(sizeof(out)) && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    const size_t image_bytes = argc > 1 ? std::strtoul(argv[1], nullptr, 0) : 24000u;
+    const uint32_t sizes[2] = { 1u, 16u };
+    Outcome o[2];
+    int failures = 0;
+
+    for (int k = 0; k < 2; ++k) {
+        if (!run(sizes[k], image_bytes, o[k])) {
+            std::printf("FAIL %u nodes: simulator or client setup\n", sizes[k]);
+            return 1;
+        }
+        std::printf("%zu bytes to %2u nodes in %.2f s (erase %.2f s): %u frames, %u repeat rounds\n", image_bytes,
+                    sizes[k], o[k].total_s, o[k].erase_s, o[k].frames, o[k].rounds);
+        if (!o[k].ok) {
+            std::printf("FAIL %u nodes: not every node verified the image\n", sizes[k]);
+            ++failures;
+        }
+    }
+
+    const double limit = o[0].total_s * (1.0 + TIME_SLACK) + SETUP_PER_NODE_S * (sizes[1] - sizes[0]);
+    if (o[1].total_s > limit) {
+        std::printf("FAIL %u nodes took %.2f s, more than %.2f s\n", sizes[1], o[1].total_s, limit);
+        ++failures;
+    }
+
+    if (failures != 0) {
+        std::printf("%d check(s) failed\n", failures);
+        return 1;
+    }
+    std::printf("all checks passed\n");
+    return 0;
+}
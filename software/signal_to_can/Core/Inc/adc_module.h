@@ -12,18 +12,28 @@ extern "C" {
 #define ADC_MODULE_NUM_CHANNELS 8U
 
 /**
- * Initialize ADC1 for multi-channel continuous conversion with DMA.
- * - Enables HSI14 for ADC
+ * Start ADC1 multi-channel continuous conversion with DMA.
+ * - Waits for HSI14 only if SystemClock_Config() has not started it
  * - Calibrates ADC
- * - Configures channels 0..7
  * - Starts ADC with DMA in circular mode
  *
- * Pass a pointer to the CubeMX-created ADC handle (usually &hadc or &hadc1).
+ * Pass a pointer to the CubeMX-created ADC handle (usually &hadc or &hadc1),
+ * already initialized by MX_ADC_Init() with channels 0..7 in the sequence.
  *
  * Returns HAL_OK on success.
  */
 HAL_StatusTypeDef ADC_Module_Init(ADC_HandleTypeDef *hadc_handle);
 
+/**
+ * Count a completed DMA scan. Call from HAL_ADC_ConvCpltCallback().
+ */
+void ADC_Module_Scan_Complete(void);
+
+/**
+ * Number of DMA scans completed since start; 0 until the buffer holds data.
+ */
+uint32_t ADC_Module_Get_Scan_Count(void);
+
 /**
  * Get the latest raw ADC value for a channel index [0..7].
  * Returns 0 if index is out of range.
@@ -36,6 +46,14 @@ uint16_t ADC_Module_Get_Raw(uint8_t channel_index);
  */
 const volatile uint16_t* ADC_Module_Get_Buffer(void);
 
+/**
+ * Re-run the ADC self-calibration on the handle passed to ADC_Module_Init.
+ * Stops the DMA scan, calibrates, then restarts continuous conversion.
+ *
+ * Returns HAL_OK on success, HAL_ERROR if the module is not initialized.
+ */
+HAL_StatusTypeDef ADC_Module_Recalibrate(void);
+
 /**
  * Stop ADC + DMA (optional helper if you need to halt sampling cleanly).
  */
@@ -0,0 +1,101 @@
+/* backfill_module.h
+ *
+ * Store-and-forward of samples the bus could not take, for STM32F042.
+ * This header pairs with backfill_module.c and exposes:
+ *  - A RAM ring of timestamped, delta-compressed samples (device-input mV
+ *    of all channels), filled whenever a data frame of a sample could not
+ *    be queued (bus-off, no acknowledging node, transceiver in standby) or
+ *    was still pending when the next sample replaced it (PDO_REPLACE_PENDING)
+ *  - A paced drain once live frames get out again: the oldest samples are
+ *    replayed on node_id + 0xC, one frame per BACKFILL_DRAIN_INTERVAL_MS
+ *    and only while another TX mailbox stays free for live data
+ *
+ * Backfill frames (node_id + 0xC, three per sample):
+ *    byte 0      bits 7-6 part (0..2), bits 5-0 sample sequence
+ *    part 0      byte 1-3 sample time (uptime ms, low 24 bits), byte 4-7 ch 0, 1   DLC 8
+ *    part 1      byte 1-6 ch 2, 3, 4                                            DLC 7
+ *    part 2      byte 1-6 ch 5, 6, 7                                            DLC 7
+ * Values are mV, big-endian, as the live frames. The ID marks them as
+ * backfill: they never appear on a data frame ID.
+ *
+ * Ring record: time delta (ms, varint), a mask of the channels that
+ * changed, then per changed channel the zigzag-coded mV delta (varint).
+ * A steady signal costs 2 bytes per sample, ADC noise of a few mV about
+ * 10. When the ring is full the oldest samples are dropped.
+ *
+ * Notes:
+ *  - Samples are replayed oldest first and never reordered with each
+ *    other; live frames keep their own schedule and are not delayed.
+ *  - The drain pauses while the controller is bus-off or the last live
+ *    sample failed or replaced a pending one.
+ *  - A replaced frame whose abort came too late (it won arbitration
+ *    meanwhile) leaves its sample both live and in the backfill.
+ *  - Built only with BACKFILL_ENABLE 1. With 0, samples the bus could
+ *    not take are lost as before.
+ */
+
+#ifndef BACKFILL_MODULE_H
+#define BACKFILL_MODULE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "stm32f0xx_hal.h"
+#include <stdint.h>
+#include <stdbool.h>
+
+/* ===== Configuration (override before including if needed) ===== */
+
+/* 0: no backfill. 1 adds about 1.1 KB flash and 0.4 KB RAM, more than
+   the default STM32F042K6 image with UDS leaves. */
+#ifndef BACKFILL_ENABLE
+#define BACKFILL_ENABLE         0
+#endif
+
+/* Ring size in bytes. */
+#ifndef BACKFILL_BUF_SIZE
+#define BACKFILL_BUF_SIZE           256u
+#endif
+
+#ifndef BACKFILL_ID_OFFSET
+#define BACKFILL_ID_OFFSET          0xCu
+#endif
+
+/* Pace of the drain: one frame per interval. */
+#ifndef BACKFILL_DRAIN_INTERVAL_MS
+#define BACKFILL_DRAIN_INTERVAL_MS  2u
+#endif
+
+typedef struct {
+    uint32_t stored;            /* samples taken into the ring since reset */
+    uint32_t sent;              /* samples replayed */
+    uint32_t dropped;           /* samples pushed out of a full ring */
+    uint16_t pending;           /* samples in the ring now */
+    uint16_t bytes;             /* ring bytes in use */
+} backfill_stats_t;
+
+/* ===== Public API ===== */
+
+void Backfill_Module_Init(void);
+
+/**
+ * Report the outcome of a live send (not HAL_BUSY). On failure the current
+ * sample (Process_Signals snapshot, uptime) goes into the ring; if the send
+ * replaced a frame still pending, the previous sample does. Otherwise the
+ * drain may run.
+ */
+void Backfill_Module_Record(HAL_StatusTypeDef live_status, bool replaced);
+
+void Backfill_Module_Get_Stats(backfill_stats_t *out);
+
+/**
+ * Send the next backfill frame when it is due. Call from the main loop.
+ */
+void Backfill_Module_Task(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* BACKFILL_MODULE_H */
@@ -0,0 +1,81 @@
+/* boot_module.h
+ *
+ * Boot-phase timing for STM32F042.
+ * This header pairs with boot_module.c and exposes:
+ *  - A timestamp per boot phase, taken once when the phase completes
+ *  - A one-shot Boot Report frame on node_id + 0x3, sent after the first
+ *    data frame
+ *
+ * Boot Report frame (DLC 6, big-endian, microseconds since HAL_Init(),
+ * saturated at 65535):
+ *    byte 0-1  clock tree up (HSE + PLL)
+ *    byte 2-3  CAN started (synchronized to the bus)
+ *    byte 4-5  first data frame queued
+ * All phases are readable through UDS DID 0x0303 (UDS_ENABLE, built by
+ * default); the boot report frame carries three of them without UDS.
+ *
+ * Notes:
+ *  - Timestamps come from timebase_module, which starts at HAL_Init(); the
+ *    reset handler and C runtime start-up before main() are not included.
+ *  - Boot_Module_Mark() may be called from interrupt context.
+ *  - The Boot Report is 6 bytes so that it is never mistaken for the 8-byte
+ *    Device Status frame on the same identifier.
+ */
+
+#ifndef BOOT_MODULE_H
+#define BOOT_MODULE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "stm32f0xx_hal.h"
+#include <stdint.h>
+#include <stdbool.h>
+
+/* ===== Configuration (override before including if needed) ===== */
+
+#ifndef BOOT_REPORT_ID_OFFSET
+#define BOOT_REPORT_ID_OFFSET   0x3u
+#endif
+
+#define BOOT_REPORT_DLC         6u
+
+typedef enum {
+    BOOT_PHASE_CLOCK = 0,       /* SystemClock_Config() done */
+    BOOT_PHASE_PERIPH,          /* MX_xxx_Init() done */
+    BOOT_PHASE_ADC,             /* ADC calibrated and converting */
+    BOOT_PHASE_CAN,             /* CAN started */
+    BOOT_PHASE_MODULES,         /* protocol modules up, entering the main loop */
+    BOOT_PHASE_FIRST_SCAN,      /* first ADC scan in the DMA buffer */
+    BOOT_PHASE_FIRST_FRAME,     /* first data frame queued */
+    BOOT_NUM_PHASES
+} boot_phase_t;
+
+/* ===== Public API ===== */
+
+/**
+ * Record the completion time of a phase. Only the first call per phase counts.
+ */
+void Boot_Module_Mark(boot_phase_t phase);
+
+/**
+ * Whether a phase has completed.
+ */
+bool Boot_Module_Is_Marked(boot_phase_t phase);
+
+/**
+ * Completion time of a phase in microseconds since HAL_Init(), 0 if not reached.
+ */
+uint32_t Boot_Module_Get_Us(boot_phase_t phase);
+
+/**
+ * Send the Boot Report once the first data frame is out. Call from the main loop.
+ */
+void Boot_Module_Task(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* BOOT_MODULE_H */
@@ -0,0 +1,161 @@
+/* can_diag_module.h
+ *
+ * CAN bus error analytics for STM32F042 (bxCAN).
+ * This header pairs with can_diag_module.c and exposes:
+ *  - Error interrupt accounting: every protocol error counted by its last
+ *    error code (stuff, form, ACK, bit recessive, bit dominant, CRC), plus
+ *    entries into error warning, error passive and bus-off
+ *  - TEC/REC trends in a ring of CAN_DIAG_NUM_WINDOWS windows of
+ *    CAN_DIAG_WINDOW_MS each: error count, peak and closing TEC/REC
+ *  - A Bus Health frame on node_id + 0xB at the end of every window
+ *
+ * Bus Health frame (DLC 8):
+ *    byte 0    TEC
+ *    byte 1    REC
+ *    byte 2    bits 0-2 error warning, error passive, bus-off (now)
+ *              bit 3    error interrupts capped in the window
+ *              bits 4-6 most frequent LEC of the window (0 = no error)
+ *    byte 3    peak TEC of the window
+ *    byte 4    peak REC of the window
+ *    byte 5-6  errors in the window (big-endian, saturated)
+ *    byte 7    bus-off events since reset (saturated)
+ * Counters and windows are readable through UDS DIDs 0x0305 and 0x0306
+ * (UDS_ENABLE, built by default); Bus Health frames carry the summary
+ * without UDS.
+ *
+ * Notes:
+ *  - The interrupt side only increments counters and tracks peaks; windows
+ *    close and the frame is built in CAN_Diag_Module_Task().
+ *  - The ESR holds the code of the last error only: errors closer together
+ *    than the interrupt latency are counted once.
+ *  - After CAN_DIAG_LEC_IRQ_BUDGET errors in a window the error code
+ *    interrupt is turned off until the window closes, so a node alone on
+ *    the bus (no ACK, automatic retransmission) cannot flood the CPU with
+ *    interrupts. The window is marked capped and its count is a floor.
+ *  - The Bus Health frame never waits for a mailbox; it is skipped when
+ *    none is free.
+ */
+
+#ifndef CAN_DIAG_MODULE_H
+#define CAN_DIAG_MODULE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "stm32f0xx_hal.h"
+#include <stdint.h>
+#include <stdbool.h>
+
+/* ===== Configuration (override before including if needed) ===== */
+
+#ifndef CAN_DIAG_WINDOW_MS
+#define CAN_DIAG_WINDOW_MS      1000u
+#endif
+
+/* Windows kept (UDS DID 0x0306 is sized for 16). */
+#define CAN_DIAG_NUM_WINDOWS    16u
+
+/* 0 disables the Bus Health frame. */
+#ifndef CAN_DIAG_HEALTH_FRAME
+#define CAN_DIAG_HEALTH_FRAME   1
+#endif
+
+/* Error interrupts taken per window before the error code interrupt is
+ * turned off for the rest of it. */
+#ifndef CAN_DIAG_LEC_IRQ_BUDGET
+#define CAN_DIAG_LEC_IRQ_BUDGET 32u
+#endif
+
+#ifndef CAN_DIAG_HEALTH_ID_OFFSET
+#define CAN_DIAG_HEALTH_ID_OFFSET 0xBu
+#endif
+
+/* Last error codes (ESR.LEC). */
+typedef enum {
+    CAN_DIAG_LEC_NONE = 0,
+    CAN_DIAG_LEC_STUFF,
+    CAN_DIAG_LEC_FORM,
+    CAN_DIAG_LEC_ACK,
+    CAN_DIAG_LEC_BIT_RECESSIVE,
+    CAN_DIAG_LEC_BIT_DOMINANT,
+    CAN_DIAG_LEC_CRC,
+    CAN_DIAG_NUM_LEC
+} can_diag_lec_t;
+
+/* Error states, as in byte 2 of the Bus Health frame. */
+#define CAN_DIAG_STATE_WARNING  0x01u
+#define CAN_DIAG_STATE_PASSIVE  0x02u
+#define CAN_DIAG_STATE_BUS_OFF  0x04u
+#define CAN_DIAG_STATE_CAPPED   0x08u   /* window only: error interrupts capped */
+
+typedef struct {
+    uint32_t lec[CAN_DIAG_NUM_LEC];     /* errors per LEC, lec[0] unused */
+    uint32_t warning_entries;
+    uint32_t passive_entries;
+    uint32_t bus_off_entries;
+    uint32_t tx_failures;               /* frames aborted after a transmit error (TERR) */
+} can_diag_counters_t;
+
+typedef struct {
+    uint16_t errors;                    /* saturated */
+    uint8_t  tec_max;
+    uint8_t  rec_max;
+    uint8_t  tec_end;
+    uint8_t  rec_end;
+    uint8_t  top_lec;                   /* most frequent LEC, 0 = no error */
+    uint8_t  states;                    /* CAN_DIAG_STATE_xxx reached in the window */
+} can_diag_window_t;
+
+/* ===== Public API ===== */
+
+/**
+ * Clear counters and windows and start the first window.
+ */
+void CAN_Diag_Module_Init(void);
+
+/**
+ * Account for one error interrupt. Call from HAL_CAN_ErrorCallback().
+ *
+ * Parameters:
+ *  - error_code: HAL_CAN_GetError() of this interrupt (reset it afterwards).
+ *  - esr:        CAN->ESR read in the callback.
+ */
+void CAN_Diag_Module_Error_Isr(uint32_t error_code, uint32_t esr);
+
+/**
+ * Account for an aborted TX mailbox. Call from the CAN interrupt.
+ *
+ * Parameters:
+ *  - after_error: TERR was set, i.e. the last attempt failed with an error
+ *    rather than losing arbitration.
+ */
+void CAN_Diag_Module_Tx_Aborted(bool after_error);
+
+/**
+ * Copy the counters since Init or the last reset.
+ */
+void CAN_Diag_Module_Get_Counters(can_diag_counters_t *out);
+
+/**
+ * Copy closed window `age` (0 = the most recent). Returns false if that
+ * window has not closed yet.
+ */
+bool CAN_Diag_Module_Get_Window(uint8_t age, can_diag_window_t *out);
+
+/**
+ * Clear counters and windows (UDS routine 0x0204).
+ */
+void CAN_Diag_Module_Reset(void);
+
+/**
+ * Track TEC/REC, close due windows and send the Bus Health frame. Call
+ * from the main loop.
+ */
+void CAN_Diag_Module_Task(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* CAN_DIAG_MODULE_H */
@@ -8,11 +8,17 @@
  *  - Receive a Standard ID data frame
  *  - Store and access a CAN node ID
  *  - Update baud rate at runtime (re-init + reapply filters)
+ *  - Leave and rejoin the bus around a change of the CAN kernel clock
+ *  - Identify the frame in a TX mailbox from the TX complete callbacks
  *
  * Notes:
  *  - No application business logic is included here.
  *  - Only Standard (11-bit) identifiers are supported by this API.
  *  - GPIO pins, clocks, and NVIC setup should be handled elsewhere.
+ *  - Bit timing is computed from HAL_RCC_GetPCLK1Freq() at every (re-)init,
+ *    preferring 16 TQ per bit with a sample point near 87.5%.
+ *  - The TX mailbox empty interrupt is enabled, so the
+ *    HAL_CAN_TxMailboxNCompleteCallback hooks run once the CAN IRQ is enabled.
  */
 
 #ifndef CAN_MODULE_H
@@ -26,6 +32,7 @@ extern "C" {
 #include "stm32f0xx_hal_can.h"
 #include <stdint.h>
 #include <stddef.h>
+#include <stdbool.h>
 
 /* Optional compile-time overrides and constants. */
 
@@ -90,10 +97,80 @@ uint8_t CAN_Module_Get_Node_Id(void);
  *  - baud_enum: One of CAN_MODULE_BAUD_xxx constants.
  *
  * Returns:
- *  - HAL_OK on success, otherwise a HAL error code.
+ *  - HAL_OK on success, HAL_BUSY if the current PCLK cannot time baud_enum
+ *    exactly (nothing changed, try again at another clock), otherwise a HAL
+ *    error code.
  */
 HAL_StatusTypeDef CAN_Module_Update_Baud(uint32_t baud_enum);
 
+/**
+ * Leave the bus before the CAN kernel clock (PCLK) changes.
+ *
+ * The controller completes the frame in progress before it stops. Pending TX
+ * mailboxes and received frames are kept.
+ *
+ * Returns:
+ *  - HAL_OK on success, otherwise a HAL error code.
+ */
+HAL_StatusTypeDef CAN_Module_Suspend(void);
+
+/**
+ * Rejoin the bus after CAN_Module_Suspend().
+ *
+ * Recomputes the bit timing for the current PCLK and the stored baud,
+ * re-initializes HAL CAN and restarts CAN. Filters are kept.
+ *
+ * Returns:
+ *  - HAL_OK on success, otherwise a HAL error code. HAL_ERROR if the PCLK
+ *    cannot time the baud exactly: CAN then stays off the bus.
+ */
+HAL_StatusTypeDef CAN_Module_Resume(void);
+
+/**
+ * Whether all TX mailboxes are empty and the RX FIFO holds no frame.
+ */
+bool CAN_Module_Is_Quiet(void);
+
+/**
+ * Number of empty TX mailboxes (0..3).
+ */
+uint32_t CAN_Module_Get_Tx_Free(void);
+
+/**
+ * Request the abort of the frames on std_id still waiting in a TX mailbox
+ * (ABRQ). A frame already on the bus is not cut short. The abort completes
+ * through HAL_CAN_TxMailboxNAbortCallback.
+ *
+ * Returns:
+ *  - CAN_TX_MAILBOXn bits of the mailboxes asked to abort (0: none pending).
+ */
+uint32_t CAN_Module_Abort_Std(uint16_t std_id);
+
+/**
+ * Whether the stored baud rate can be timed exactly from a CAN kernel clock.
+ *
+ * Parameters:
+ *  - pclk_hz: Candidate PCLK frequency in Hz.
+ */
+bool CAN_Module_Supports_Clock(uint32_t pclk_hz);
+
+/**
+ * Get the bit rate of the stored baud selector in bit/s.
+ */
+uint32_t CAN_Module_Get_Bitrate(void);
+
+/**
+ * Get the bxCAN error status register (TEC, REC, last error code, error
+ * warning/passive/bus-off flags), or 0 before initialization.
+ */
+uint32_t CAN_Module_Get_Esr(void);
+
+/**
+ * Enable or disable the last error code interrupt (CAN_IT_LAST_ERROR_CODE).
+ * Safe to call from an interrupt.
+ */
+void CAN_Module_Set_Lec_Irq(bool on);
+
 /**
  * Configure hardware filters for a list of Standard IDs.
  *
@@ -141,6 +218,21 @@ HAL_StatusTypeDef CAN_Module_Send_Std(uint16_t std_id, const uint8_t *data, uint
  */
 HAL_StatusTypeDef CAN_Module_Receive_Std(uint16_t *std_id, uint8_t *data, uint8_t *dlc, uint32_t timeout_ms);
 
+/**
+ * Get the Standard ID of the frame last loaded into a TX mailbox.
+ *
+ * The mailbox keeps the identifier after transmission, so this can be used
+ * inside HAL_CAN_TxMailboxNCompleteCallback to tell which frame completed.
+ *
+ * Parameters:
+ *  - mailbox: Mailbox index 0..2.
+ *
+ * Returns:
+ *  - The 11-bit Standard ID, or 0xFFFF if the module is not initialized or
+ *    mailbox is out of range.
+ */
+uint16_t CAN_Module_Get_Tx_Mailbox_Std_Id(uint32_t mailbox);
+
 /**
  * Get the last configured baud selector value.
  *
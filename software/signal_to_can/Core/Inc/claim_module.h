@@ -0,0 +1,199 @@
+/* claim_module.h
+ *
+ * Node address claiming for STM32F042.
+ * This header pairs with claim_module.c and exposes:
+ *  - A claim at boot: the node listens on the bus for a random time, then
+ *    claims its configured node ID (the preferred address) with a claim
+ *    frame and owns it if no one objects within CLAIM_CONTEST_MS. Data goes
+ *    out on the preferred address from the start
+ *  - A fallback range for addresses found taken, searched from a point set
+ *    by the device's unique ID, at most CLAIM_MAX_ATTEMPTS addresses
+ *  - Defence of the owned address and collision detection at runtime: a
+ *    frame received on one of the node's own transmit IDs means another
+ *    node uses the address, and the claim is contested again
+ *
+ * Claim frame (CLAIM_ID_BASE + slot of the address, DLC 8):
+ *    byte 0      address (node ID) claimed
+ *    byte 1      0 claim, 1 defence of an owned address
+ *    byte 2-7    device key: 48 bits of a hash of the 96-bit UID (UID_BASE)
+ *
+ * Rules:
+ *  - While listening, a claim for the address means it is taken: the node
+ *    tries the next address. So does a frame on one of its transmit IDs
+ *    while listening on a fallback address. On the preferred address, which
+ *    the node sends on itself, such frames are left to the claims to
+ *    settle, or else two nodes booting together on one address would both
+ *    give it up.
+ *  - While contesting, a defence, or a claim with a lower key, loses.
+ *  - Tie-break: claims for one address sent at the same moment share an ID
+ *    and collide in the key bytes, which ends in an error frame for both
+ *    nodes. A node whose claim is still pending when a transmit (bit) error
+ *    is reported withdraws it (abort), listens again for CLAIM_LISTEN_MS
+ *    plus a backoff from the next key bits and claims again. The node with
+ *    the shorter backoff claims first and the other hears it while
+ *    listening. After CLAIM_MAX_RETRIES withdrawn claims the address counts
+ *    as lost.
+ *  - An owner answers every claim for its address with a defence.
+ *  - An owner hearing its own transmit IDs claims the address again (at
+ *    most once per CLAIM_RECHECK_MS) and moves if it loses.
+ *
+ * Notes:
+ *  - Claims and defences go out on one of CLAIM_ID_COUNT IDs picked by the
+ *    claimed address (address ^ address >> 4, modulo the count), which is
+ *    distinct for every address of the node plan (0x00 .. 0xF0) and of the
+ *    class plan (0 .. 31). Nodes claiming different addresses never send
+ *    the same ID with different data, which would end in bit errors with
+ *    automatic retransmission on; nodes claiming the same address resolve
+ *    it by the tie-break above.
+ *  - The claim does not delay the first data frame. A transmit bit error
+ *    before the preferred address is owned means another node may send on
+ *    the same IDs: data then waits for the claim, and pending frames are
+ *    dropped. A node that loses the preferred address drops its pending
+ *    frames and sends no data until a fallback address is owned: one
+ *    listen and contest window each (CLAIM_LISTEN_MS + up to
+ *    CLAIM_BACKOFF_MS + CLAIM_CONTEST_MS), never more than
+ *    CLAIM_MAX_ATTEMPTS of them. If all attempts lose, the node goes on
+ *    unverified on the next fallback address; runtime detection still
+ *    applies, and a search started at runtime goes on from the address
+ *    lost rather than from the start of the range.
+ *  - Every address change is recorded in the event log.
+ *  - Fallback addresses step by 0x10 in the node plan (a node owns
+ *    node_id + 0x0 .. + 0xF) and by 1 in the class plan (id_plan_module.h).
+ */
+
+#ifndef CLAIM_MODULE_H
+#define CLAIM_MODULE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "stm32f0xx_hal.h"
+#include "id_plan_module.h"
+#include <stdint.h>
+#include <stdbool.h>
+
+/* ===== Configuration (override before including if needed) ===== */
+
+/* 0: the node ID is used as configured, no claim frames. */
+#ifndef CLAIM_ENABLE
+#define CLAIM_ENABLE            1
+#endif
+
+/* Claim IDs: CLAIM_ID_BASE .. CLAIM_ID_BASE + CLAIM_ID_COUNT - 1, a power of 2. */
+#ifndef CLAIM_ID_BASE
+#define CLAIM_ID_BASE           0x7D0u
+#endif
+#ifndef CLAIM_ID_COUNT
+#define CLAIM_ID_COUNT          32u
+#endif
+
+/* Listen window before a claim; the key adds 0 .. CLAIM_BACKOFF_MS - 1. */
+#ifndef CLAIM_LISTEN_MS
+#define CLAIM_LISTEN_MS         5u
+#endif
+#ifndef CLAIM_BACKOFF_MS
+#define CLAIM_BACKOFF_MS        8u
+#endif
+
+/* Time after the claim frame in which an objection loses the address. */
+#ifndef CLAIM_CONTEST_MS
+#define CLAIM_CONTEST_MS        5u
+#endif
+
+/* Addresses tried per search, the preferred one included. */
+#ifndef CLAIM_MAX_ATTEMPTS
+#define CLAIM_MAX_ATTEMPTS      4u
+#endif
+
+/* Claims withdrawn after a transmit error before an address counts as lost. */
+#ifndef CLAIM_MAX_RETRIES
+#define CLAIM_MAX_RETRIES       3u
+#endif
+
+/* Shortest interval between two claims caused by collisions. */
+#ifndef CLAIM_RECHECK_MS
+#define CLAIM_RECHECK_MS        1000u
+#endif
+
+/* Fallback addresses: FIRST, FIRST + STEP, ... LAST. */
+#ifndef CLAIM_FALLBACK_FIRST
+#if ID_PLAN_ENABLE
+#define CLAIM_FALLBACK_FIRST    (ID_PLAN_MAX_NODES / 2u)
+#define CLAIM_FALLBACK_LAST     (ID_PLAN_MAX_NODES - 1u)
+#define CLAIM_FALLBACK_STEP     1u
+#else
+#define CLAIM_FALLBACK_FIRST    0x80u
+#define CLAIM_FALLBACK_LAST     0xF0u
+#define CLAIM_FALLBACK_STEP     0x10u
+#endif
+#endif
+
+typedef enum {
+    CLAIM_OFF = 0,              /* CLAIM_ENABLE 0 */
+    CLAIM_LISTENING,
+    CLAIM_CONTESTING,
+    CLAIM_OWNED,
+    CLAIM_UNVERIFIED            /* attempts used up, address taken anyway */
+} claim_state_t;
+
+typedef struct {
+    uint8_t  state;             /* claim_state_t */
+    uint8_t  node_id;
+    uint8_t  preferred;
+    uint8_t  attempts;          /* addresses tried in the last search */
+    uint16_t lost;              /* claims lost since reset */
+    uint16_t collisions;        /* frames received on an own transmit ID */
+    uint16_t defences;          /* defences sent */
+} claim_stats_t;
+
+/* ===== Public API ===== */
+
+/**
+ * Whether std_id is in the claim ID range.
+ */
+bool Claim_Module_Is_Claim_Id(uint16_t std_id);
+
+/**
+ * Set the preferred address as node ID and start the boot claim.
+ */
+void Claim_Module_Init(uint8_t preferred);
+
+/**
+ * Inspect a received frame for claims and collisions.
+ *
+ * Returns:
+ *  - true if the frame was a claim frame (consumed).
+ */
+bool Claim_Module_Handle_Frame(uint16_t std_id, const uint8_t *data, uint8_t dlc);
+
+/**
+ * Account for a CAN error interrupt. Call from HAL_CAN_ErrorCallback().
+ * On a transmit bit error, withdraws a pending claim (tie-break) and holds
+ * data back until the address is owned.
+ *
+ * Parameters:
+ *  - error_code: HAL_CAN_GetError() of this interrupt.
+ */
+void Claim_Module_Error_Isr(uint32_t error_code);
+
+/**
+ * Whether data frames may go out: on the preferred address from boot until
+ * its claim is lost or a transmit bit error holds them back, on any address
+ * once it is owned (or taken unverified), always with claiming disabled.
+ */
+bool Claim_Module_Can_Send(void);
+
+void Claim_Module_Get_Stats(claim_stats_t *out);
+
+/**
+ * Advance the claim: send claims and defences, close windows. Call from
+ * the main loop.
+ */
+void Claim_Module_Task(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* CLAIM_MODULE_H */
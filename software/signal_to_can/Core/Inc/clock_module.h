@@ -0,0 +1,133 @@
+/* clock_module.h
+ *
+ * Runtime clock scaling for STM32F042.
+ * This header pairs with clock_module.c and exposes:
+ *  - Performance levels of 48, 24 and 8 MHz (HCLK = PCLK)
+ *  - CPU load measurement of the main loop
+ *  - Automatic choice of the lowest level that carries the measured load,
+ *    or a fixed level set at runtime (UDS DID 0x0402)
+ *
+ * Levels:
+ *    48 MHz  HSE 16 MHz x 3 (PLL), 1 flash wait state (SystemClock_Config)
+ *    24 MHz  PLL / 2
+ *     8 MHz  HSE / 2, PLL off
+ *
+ * CPU load is measured as in an idle loop: the shortest main loop pass of a
+ * window is taken as pure polling, so load = 1 - passes * shortest / window.
+ * A lower level is chosen when, scaled by the clock ratio,
+ *  - the load stays at or below CLOCK_LOAD_TARGET_PERMILLE, and
+ *  - the shortest pass still drains the 3-frame RX FIFO in time at the
+ *    current baud rate,
+ * for CLOCK_DOWN_WINDOWS windows in a row. A window above
+ * CLOCK_LOAD_HIGH_PERMILLE, or a configuration change, returns to 48 MHz.
+ *
+ * Notes:
+ *  - A switch waits until no frame is pending in a TX mailbox or the RX FIFO,
+ *    takes CAN off the bus once the frame in progress has ended, changes the
+ *    clock tree (HAL_RCC_ClockConfig also reloads SysTick), then rejoins with
+ *    bit timing recomputed for the new PCLK. No queued frame is lost; frames
+ *    from other nodes starting during the few bit times off the bus are not
+ *    received.
+ *  - The ADC runs from HSI14 and the sample period counts milliseconds, so
+ *    neither depends on the level.
+ */
+
+#ifndef CLOCK_MODULE_H
+#define CLOCK_MODULE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "stm32f0xx_hal.h"
+#include <stdint.h>
+#include <stdbool.h>
+
+/* ===== Configuration (override before including if needed) ===== */
+
+/* Length of one load measurement window. */
+#ifndef CLOCK_LOAD_WINDOW_MS
+#define CLOCK_LOAD_WINDOW_MS        250u
+#endif
+
+/* Highest load a lower level may be expected to carry. */
+#ifndef CLOCK_LOAD_TARGET_PERMILLE
+#define CLOCK_LOAD_TARGET_PERMILLE  600u
+#endif
+
+/* Load above which the clock returns to the highest level at once. */
+#ifndef CLOCK_LOAD_HIGH_PERMILLE
+#define CLOCK_LOAD_HIGH_PERMILLE    850u
+#endif
+
+/* Consecutive windows in which a lower level must fit before switching down. */
+#ifndef CLOCK_DOWN_WINDOWS
+#define CLOCK_DOWN_WINDOWS          4u
+#endif
+
+/* Setting after reset: CLOCK_SETTING_AUTO or the MHz of a level. */
+#ifndef CLOCK_DEFAULT_SETTING
+#define CLOCK_DEFAULT_SETTING       CLOCK_SETTING_AUTO
+#endif
+
+#define CLOCK_SETTING_AUTO          0u
+
+/* ===== Public API ===== */
+
+/**
+ * Start measuring. SystemClock_Config() must have set the 48 MHz level.
+ */
+void Clock_Module_Init(void);
+
+/**
+ * Select automatic scaling (CLOCK_SETTING_AUTO) or pin a level by its HCLK
+ * in MHz (48, 24 or 8). The switch happens in Clock_Module_Task().
+ *
+ * Returns:
+ *  - HAL_OK, or HAL_ERROR for an unknown level or one the CAN baud rate
+ *    cannot be timed from.
+ */
+HAL_StatusTypeDef Clock_Module_Set_Setting(uint8_t setting);
+
+/**
+ * Current setting: CLOCK_SETTING_AUTO or the MHz of the pinned level.
+ */
+uint8_t Clock_Module_Get_Setting(void);
+
+/**
+ * Workload changed (sample rate, baud, E2E): in automatic mode, return to the
+ * highest level and measure again.
+ */
+void Clock_Module_Reevaluate(void);
+
+/**
+ * HCLK of the active level in Hz.
+ */
+uint32_t Clock_Module_Get_Hclk_Hz(void);
+
+/**
+ * CPU load of the last complete window at the active level, in permille.
+ */
+uint16_t Clock_Module_Get_Load_Permille(void);
+
+/**
+ * Shortest main loop pass of the last complete window in microseconds.
+ */
+uint32_t Clock_Module_Get_Min_Pass_Us(void);
+
+/**
+ * Number of level switches since reset.
+ */
+uint32_t Clock_Module_Get_Switch_Count(void);
+
+/**
+ * Measure the pass, close windows, choose a level and switch when CAN is
+ * quiet. Call once per main loop pass, after the other tasks.
+ */
+void Clock_Module_Task(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* CLOCK_MODULE_H */
@@ -0,0 +1,146 @@
+/* cmd_module.h
+ *
+ * Configuration command protocol on node_id + 0x5 (commands) and
+ * node_id + 0x6 (acknowledgements).
+ * This header pairs with cmd_module.c and exposes:
+ *  - The single-command protocol of the README (one 1-byte ack per command)
+ *  - A windowed protocol: sequence-numbered commands, several in flight,
+ *    acknowledged by coalesced acks that carry a bitmap of the accepted
+ *    sequence numbers
+ *  - Transactions (BEGIN / COMMIT / ABORT) that stage a whole configuration
+ *    and apply it at once between two processing cycles
+ *
+ * Windowed command frame (DLC 8):
+ *    byte 0    0x80 | CMD_FLAG_ACK_REQ (optional) | com
+ *    byte 1    seq
+ *    byte 2-7  d1..d6, as in the README command table
+ * Coalesced ack (DLC 8):
+ *    byte 0    CMD_RSP_ACK
+ *    byte 1    base seq
+ *    byte 2    count (1..32) of consecutive sequence numbers covered
+ *    byte 3    transaction state (CMD_TXN_xxx)
+ *    byte 4-7  bitmap, big-endian: bit i set = seq base+i was accepted
+ * Value reply to a windowed GET_VALUE, instead of an ack (DLC 8):
+ *    byte 0    CMD_RSP_VALUE
+ *    byte 1    seq
+ *    byte 2    1 accepted, 0 rejected
+ *    byte 3    channel, byte 4 selection, byte 5-6 value (big-endian), byte 7 0
+ *
+ * Notes:
+ *  - A repeated sequence number (a retransmission) is not executed again;
+ *    its stored result is acknowledged. Results of the last 32 sequence
+ *    numbers are kept, so at most 32 commands may be in flight.
+ *  - SYNC resets the sequence state and aborts an open transaction; BEGIN
+ *    discards an open transaction and starts a new one.
+ *  - COMMIT carries the number of commands staged since BEGIN (d1..d2) and
+ *    is rejected, leaving the transaction open, if any of them is missing.
+ *    A transaction in which a command was rejected can only be aborted.
+ *  - SELECT_PROFILE switches the whole configuration except the bit rate at
+ *    once and is rejected inside a transaction.
+ *  - Acks are held up to CMD_ACK_HOLDOFF_MS to cover more commands, unless
+ *    the command asked for one (CMD_FLAG_ACK_REQ) or changed the
+ *    transaction state.
+ */
+
+#ifndef CMD_MODULE_H
+#define CMD_MODULE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "stm32f0xx_hal.h"
+#include <stdint.h>
+#include <stdbool.h>
+
+/* ===== Configuration (override before including if needed) ===== */
+
+#ifndef CMD_RX_ID_OFFSET
+#define CMD_RX_ID_OFFSET        0x5u
+#endif
+#ifndef CMD_TX_ID_OFFSET
+#define CMD_TX_ID_OFFSET        0x6u
+#endif
+
+/* Longest an ack waits for further commands to coalesce with. */
+#ifndef CMD_ACK_HOLDOFF_MS
+#define CMD_ACK_HOLDOFF_MS      2u
+#endif
+
+/* An open transaction without commands for this long is aborted. */
+#ifndef CMD_TXN_TIMEOUT_MS
+#define CMD_TXN_TIMEOUT_MS      2000u
+#endif
+
+/* Delay between accepting SET_BAUD and switching, so its ack gets out first. */
+#ifndef CMD_BAUD_SWITCH_DELAY_MS
+#define CMD_BAUD_SWITCH_DELAY_MS 50u
+#endif
+
+/* Command codes (com). */
+#define CMD_SET_BAUD            0x01u
+#define CMD_SET_SAMPLE_RATE     0x02u
+#define CMD_SET_CHANNEL         0x03u
+#define CMD_SET_CHANNEL_RANGE   0x04u
+#define CMD_GET_VALUE           0x05u
+#define CMD_SELECT_PROFILE      0x06u   /* d1 profile (profile_module.h) */
+#define CMD_SYNC                0x10u   /* windowed only */
+#define CMD_BEGIN               0x11u   /* windowed only */
+#define CMD_COMMIT              0x12u   /* windowed only: d1..d2 staged command count */
+#define CMD_ABORT               0x13u   /* windowed only */
+
+/* Byte 0 of a windowed command. */
+#define CMD_FLAG_WINDOWED       0x80u
+#define CMD_FLAG_ACK_REQ        0x40u
+#define CMD_CODE_MASK           0x3Fu
+
+/* Byte 0 of a windowed reply. */
+#define CMD_RSP_ACK             0x80u
+#define CMD_RSP_VALUE           0x81u
+
+/* Transaction state in the ack. */
+#define CMD_TXN_NONE            0u
+#define CMD_TXN_OPEN            1u
+#define CMD_TXN_FAILED          2u      /* open, a staged command was rejected */
+
+/* GET_VALUE selections. */
+#define CMD_VALUE_SAMPLE_RATE   0u
+#define CMD_VALUE_SCALE         1u
+#define CMD_VALUE_OFFSET        2u
+#define CMD_VALUE_OOR_MIN       3u
+#define CMD_VALUE_OOR_MAX       4u
+
+/* ===== Public API ===== */
+
+/**
+ * Reset the protocol state.
+ *
+ * Parameters:
+ *  - sample_period_ms: The main loop's send period, changed by SET_SAMPLE_RATE.
+ */
+void Cmd_Module_Init(uint32_t *sample_period_ms);
+
+/**
+ * Offer a received CAN frame to the command protocol.
+ *
+ * Returns:
+ *  - true if the frame was a command (and consumed), false otherwise.
+ */
+bool Cmd_Module_Handle_Frame(uint16_t std_id, const uint8_t *data, uint8_t dlc);
+
+/**
+ * Send due acks, expire an idle transaction and apply a pending baud change.
+ * Call from the main loop.
+ */
+void Cmd_Module_Task(void);
+
+/**
+ * The main loop's send period (ms), as set by SET_SAMPLE_RATE.
+ */
+uint32_t Cmd_Module_Get_Sample_Period(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* CMD_MODULE_H */
@@ -0,0 +1,190 @@
+/* event_log_module.h
+ *
+ * Persistent event log in flash for STM32F042.
+ * This header pairs with event_log_module.c and exposes:
+ *  - A ring of two flash pages at the end of flash (section .evlog_pages
+ *    of STM32F042K6TX_FLASH.ld) holding 16-byte entries: reset cause, hard
+ *    fault PC/LR, Error_Handler caller, bus-off, out-of-range transitions
+ *    and configuration changes
+ *  - A RAM write-behind queue: Event_Log_Module_Add() never touches flash
+ *    and is safe from interrupts; the main loop programs one half-word per
+ *    pass
+ *  - A token bucket that bounds the entries reaching flash, and counters
+ *    for drops, erases per page and the longest flash stalls
+ *
+ * Entry (16 bytes, little-endian as stored):
+ *    byte 0      type (event_log_type_t), 0xFF = empty slot
+ *    byte 1      arg (per type)
+ *    byte 2-3    boot number (one more than the highest in the log)
+ *    byte 4-7    uptime in ms
+ *    byte 8-15   data[0], data[1] (per type)
+ * Each page starts with a 16-byte header (magic, page sequence, erase
+ * count), so a page holds 63 entries. When the current page is full the
+ * older page, erased beforehand, becomes the current one.
+ *
+ * Notes:
+ *  - Programming a half-word stalls the CPU (and interrupts) for about
+ *    50 us; a page erase for 20-40 ms. The running main loop never pays
+ *    for an erase: Init erases the older page while fewer than
+ *    EVENT_LOG_SPARE_SLOTS slots are left in the current one, before
+ *    acquisition starts. At runtime, erases only run for a clear (routine
+ *    0x0205) or during an update session, between CAN frames. Until then,
+ *    a full page without a blank successor leaves new entries in the RAM
+ *    queue, and they are dropped once it is full.
+ *  - Event_Log_Module_Fatal() reads the page headers itself when it runs
+ *    before Event_Log_Module_Init().
+ *  - Nothing is written during the first EVENT_LOG_HOLDOFF_MS after reset.
+ *  - The fatal paths (HardFault, Error_Handler) write synchronously and
+ *    never erase: once the current page is full, later faults are lost.
+ *  - Built only with EVENT_LOG_ENABLE 1; the log is read through UDS.
+ *    Only then are the pages claimed from the linker.
+ */
+
+#ifndef EVENT_LOG_MODULE_H
+#define EVENT_LOG_MODULE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "stm32f0xx_hal.h"
+#include <stdint.h>
+#include <stdbool.h>
+
+/* ===== Configuration (override before including if needed) ===== */
+
+/* 0: no event log, events and faults are not recorded. 1 adds about 3 KB
+   code and claims two more 1 KB pages, more than the default STM32F042K6
+   image with UDS leaves. */
+#ifndef EVENT_LOG_ENABLE
+#define EVENT_LOG_ENABLE        0
+#endif
+
+/* Log pages: the last two 1 KB pages of the 32 KB flash. */
+#ifndef EVENT_LOG_FLASH_BASE
+#define EVENT_LOG_FLASH_BASE        0x08007800u
+#endif
+#define EVENT_LOG_NUM_PAGES         2u
+#define EVENT_LOG_PAGE_SIZE         0x400u
+#define EVENT_LOG_ENTRY_SIZE        16u
+#define EVENT_LOG_ENTRIES_PER_PAGE  (EVENT_LOG_PAGE_SIZE / EVENT_LOG_ENTRY_SIZE - 1u)
+#define EVENT_LOG_MAX_ENTRIES       (EVENT_LOG_NUM_PAGES * EVENT_LOG_ENTRIES_PER_PAGE)
+
+/* Entries waiting in RAM for flash. */
+#ifndef EVENT_LOG_QUEUE_LEN
+#define EVENT_LOG_QUEUE_LEN         8u
+#endif
+
+/* Token bucket: up to EVENT_LOG_BURST entries at once, then one per
+ * EVENT_LOG_REFILL_MS. Bounds the erase rate to one page per
+ * 63 * EVENT_LOG_REFILL_MS (about 5 hours) under a sustained event storm. */
+#ifndef EVENT_LOG_BURST
+#define EVENT_LOG_BURST             16u
+#endif
+
+#ifndef EVENT_LOG_REFILL_MS
+#define EVENT_LOG_REFILL_MS         300000u
+#endif
+
+/* Tokens and half the queue kept for entries other than EVENT_LOG_OOR. */
+#ifndef EVENT_LOG_RESERVE
+#define EVENT_LOG_RESERVE           8u
+#endif
+
+/* Init erases the older page when fewer slots than this are left in the
+ * current one. */
+#ifndef EVENT_LOG_SPARE_SLOTS
+#define EVENT_LOG_SPARE_SLOTS       EVENT_LOG_BURST
+#endif
+
+/* Quiet time after reset before the first flash write. */
+#ifndef EVENT_LOG_HOLDOFF_MS
+#define EVENT_LOG_HOLDOFF_MS        1000u
+#endif
+
+typedef enum {
+    EVENT_LOG_RESET = 1,        /* arg: RCC_CSR flags >> 24, data[0]: RCC_CSR */
+    EVENT_LOG_HARD_FAULT,       /* data[0]: stacked PC, data[1]: stacked LR */
+    EVENT_LOG_ERROR_HANDLER,    /* data[0]: caller of Error_Handler() */
+    EVENT_LOG_BUS_OFF,          /* arg: REC, data[0]: CAN ESR, data[1]: bus-off entries */
+    EVENT_LOG_OOR,              /* arg: new out-of-range mask, data[0]: changed bits */
+    EVENT_LOG_CONFIG            /* arg: EVENT_LOG_SRC_xxx, data[0]: command or DID, data[1]: first value bytes */
+} event_log_type_t;
+
+#define EVENT_LOG_SRC_CMD           0u
+#define EVENT_LOG_SRC_UDS           1u
+#define EVENT_LOG_SRC_CLAIM         2u  /* data[0]: claim ID, data[1]: new node ID, old node ID, claim_state_t */
+
+typedef struct {
+    uint8_t  type;
+    uint8_t  arg;
+    uint16_t boot;
+    uint32_t time_ms;
+    uint32_t data[2];
+} event_log_entry_t;
+
+typedef struct {
+    uint32_t written;           /* entries programmed since reset */
+    uint32_t dropped_full;      /* queue full */
+    uint32_t dropped_rate;      /* token bucket empty */
+    uint32_t erases[EVENT_LOG_NUM_PAGES];   /* lifetime erases per page */
+    uint32_t max_program_us;    /* longest half-word program */
+    uint32_t max_erase_us;      /* longest page erase */
+    uint16_t stored;            /* entries in flash now */
+    uint16_t boot;
+} event_log_stats_t;
+
+/* ===== Public API ===== */
+
+/**
+ * Find the current page and the write position, take the boot number and
+ * queue the reset cause (RCC_CSR, whose flags are cleared). No flash write.
+ */
+void Event_Log_Module_Init(void);
+
+/**
+ * Queue an entry stamped with the boot number and uptime. Safe from
+ * interrupts.
+ *
+ * Returns:
+ *  - false if it was dropped (queue full or token bucket empty).
+ */
+bool Event_Log_Module_Add(event_log_type_t type, uint8_t arg, uint32_t data0, uint32_t data1);
+
+/**
+ * Flush the queue and write one more entry synchronously, without erasing.
+ * For fault handlers: disables interrupts and leaves them disabled.
+ */
+void Event_Log_Module_Fatal(event_log_type_t type, uint32_t data0, uint32_t data1);
+
+/**
+ * HardFault entry: `frame` is the stack pointer the fault was taken on, so
+ * it points at the exception stack frame (see stm32f0xx_it.c). Logs the
+ * stacked PC and LR.
+ */
+void Event_Log_Module_Hard_Fault(const uint32_t *frame);
+
+/**
+ * Copy entry `age` (0 = newest) from flash. Returns false past the oldest.
+ */
+bool Event_Log_Module_Get_Entry(uint16_t age, event_log_entry_t *out);
+
+void Event_Log_Module_Get_Stats(event_log_stats_t *out);
+
+/**
+ * Erase the log (both pages, from the main loop, UDS routine 0x0205).
+ * Queued entries are kept; erase counts persist.
+ */
+void Event_Log_Module_Clear(void);
+
+/**
+ * Perform at most one flash operation (one half-word program or one page
+ * erase). Call from the main loop.
+ */
+void Event_Log_Module_Task(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* EVENT_LOG_MODULE_H */
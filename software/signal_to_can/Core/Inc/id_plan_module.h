@@ -0,0 +1,131 @@
+/* id_plan_module.h
+ *
+ * CAN identifier plan for STM32F042.
+ * This header pairs with id_plan_module.c and exposes:
+ *  - The priority class of every node-relative identifier (node_id + 0x0
+ *    .. + 0xF): alarm, fast data, slow data, status or config
+ *  - Two plans. Node plan (ID_PLAN_ENABLE 0, the README tables): a frame
+ *    goes out on node_id + offset, so all frames of a node share one narrow
+ *    band. Class plan (ID_PLAN_ENABLE 1): every class has its own ID range
+ *    starting at a configurable base, cut into one block per node; node_id
+ *    is then the node number, 0 .. ID_PLAN_MAX_NODES - 1
+ *  - The allocation check of the class plan: the ranges of all classes,
+ *    sized for ID_PLAN_MAX_NODES nodes, must fit 11 bits, not overlap each
+ *    other and leave the update multicast and address claim IDs free
+ *
+ * Offsets and classes (block index in the class):
+ *    0x0 alarm 0     0x4 fast 2          0x8 config 3 (XCP DTO)    0xC slow 0 (backfill)
+ *    0x1 fast 0      0x5 config 0 (cmd)  0x9 config 4 (UDS req)    0xD alarm 1
+ *    0x2 fast 1      0x6 config 1 (ack)  0xA config 5 (UDS resp)   0xE fast 3
+ *    0x3 status 0    0x7 config 2 (CRO)  0xB status 1 (health)     0xF slow 1
+ * Class plan ID: base[class] + node_id * width[class] + index, with the
+ * widths alarm 2, fast 4, slow 2, status 2, config 6.
+ *
+ * Notes:
+ *  - Lower IDs win arbitration: with the default bases every alarm of
+ *    every node goes before any data frame, fast data before slow data,
+ *    status and configuration traffic.
+ *  - Mapping table frames take their class from their offset: a frame on
+ *    offset 0x0 or 0xD is an alarm.
+ *  - Offsets above 0xF are outside the plan and stay node_id + offset.
+ *  - A plan that fails the check, or a node_id past ID_PLAN_MAX_NODES,
+ *    leaves the node plan in use.
+ */
+
+#ifndef ID_PLAN_MODULE_H
+#define ID_PLAN_MODULE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "stm32f0xx_hal.h"
+#include <stdint.h>
+#include <stdbool.h>
+
+/* ===== Configuration (override before including if needed) ===== */
+
+/* 1: class plan, 0: node_id + offset. */
+#ifndef ID_PLAN_ENABLE
+#define ID_PLAN_ENABLE          0
+#endif
+
+/* Nodes the class ranges are sized for. */
+#ifndef ID_PLAN_MAX_NODES
+#define ID_PLAN_MAX_NODES       32u
+#endif
+
+/* First ID of each class range. */
+#ifndef ID_PLAN_BASE_ALARM
+#define ID_PLAN_BASE_ALARM      0x040u
+#endif
+#ifndef ID_PLAN_BASE_FAST
+#define ID_PLAN_BASE_FAST       0x080u
+#endif
+#ifndef ID_PLAN_BASE_SLOW
+#define ID_PLAN_BASE_SLOW       0x400u
+#endif
+#ifndef ID_PLAN_BASE_STATUS
+#define ID_PLAN_BASE_STATUS     0x500u
+#endif
+#ifndef ID_PLAN_BASE_CONFIG
+#define ID_PLAN_BASE_CONFIG     0x600u
+#endif
+
+typedef enum {
+    ID_CLASS_ALARM = 0,
+    ID_CLASS_FAST,
+    ID_CLASS_SLOW,
+    ID_CLASS_STATUS,
+    ID_CLASS_CONFIG,
+    ID_NUM_CLASSES
+} id_class_t;
+
+/* Node-relative offsets covered by the plan. */
+#define ID_PLAN_OFFSETS         16u
+
+/* ===== Public API ===== */
+
+/**
+ * Check the configured class plan against the node ID set in can_module
+ * and use it if it passes.
+ *
+ * Returns:
+ *  - HAL_OK, or HAL_ERROR if ID_PLAN_ENABLE is set and the plan or the
+ *    node ID fails the check (the node plan stays in use).
+ */
+HAL_StatusTypeDef Id_Plan_Module_Init(void);
+
+/**
+ * Whether the class plan is in use.
+ */
+bool Id_Plan_Module_Is_Class_Plan(void);
+
+/**
+ * The 11-bit ID of a node-relative offset for this node.
+ */
+uint16_t Id_Plan_Module_Std_Id(uint16_t offset);
+
+/**
+ * Priority class of a node-relative offset, ID_NUM_CLASSES if it is
+ * outside the plan.
+ */
+id_class_t Id_Plan_Module_Class_Of(uint16_t offset);
+
+/**
+ * Whether std_id lies in a class range of the plan in use, i.e. belongs to
+ * some node's block. Always false in the node plan.
+ */
+bool Id_Plan_Module_Is_Planned(uint16_t std_id);
+
+/**
+ * First ID and width of the class range c (per node), as configured.
+ */
+uint16_t Id_Plan_Module_Get_Base(id_class_t c);
+uint8_t  Id_Plan_Module_Get_Width(id_class_t c);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ID_PLAN_MODULE_H */
@@ -0,0 +1,93 @@
+/* irq_module.h
+ *
+ * Interrupt priority plan and ISR timing for STM32F0.
+ * This header pairs with irq_module.c and exposes:
+ *  - The NVIC priority of every interrupt source, applied in one place
+ *  - Worst-case execution time and entry latency per ISR, from SysTick->VAL
+ *
+ * Priority plan (Cortex-M0: four levels, 0 highest):
+ *  0  CEC_CAN       TX complete timestamps, error capture while ESR is fresh;
+ *                   CAN RX shares this vector. Handlers stay short.
+ *  1  DMA1_Ch1      ADC scan complete: scan timestamp, XCP DAQ sampling
+ *  2  (timers)      free for periodic timer interrupts
+ *  3  SysTick       HAL tick; timebase_module accounts for a pending tick
+ * Everything else runs in the main loop. A handler at level n delays all
+ * handlers at levels >= n, so work added to a level-0 handler shows up in
+ * the entry latency of every other one.
+ *
+ * Measurements (Irq_Module_Enter / Irq_Module_Exit around each handler):
+ *  - Execution time: entry to exit, including any preemption by a higher
+ *    level.
+ *  - Entry latency:
+ *      SysTick   exact: counter reload (the interrupt request) to entry
+ *      DMA ADC   jitter: longest minus shortest interval between scan
+ *                complete entries (the ADC scans at a fixed rate)
+ *      CAN       not measured (no hardware time of the event)
+ *
+ * Notes:
+ *  - Times come from the 24-bit SysTick counter (1 ms reload) in HCLK
+ *    cycles and are kept in ns for the clock of the moment. Execution times
+ *    and SysTick latencies above 1 ms are not resolved.
+ *  - The simulator does not build stm32f0xx_it.c and reports zeros.
+ */
+
+#ifndef IRQ_MODULE_H
+#define IRQ_MODULE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "stm32f0xx_hal.h"
+#include <stdint.h>
+
+/* ===== Priority plan ===== */
+
+#define IRQ_PRIO_CAN            0u
+#define IRQ_PRIO_DMA_ADC        1u
+#define IRQ_PRIO_TIMER          2u
+#define IRQ_PRIO_SYSTICK        3u      /* TICK_INT_PRIORITY */
+
+typedef enum {
+    IRQ_SRC_CAN = 0,
+    IRQ_SRC_DMA_ADC,
+    IRQ_SRC_SYSTICK,
+    IRQ_NUM_SOURCES
+} irq_src_t;
+
+typedef struct {
+    uint32_t count;                 /* handler runs */
+    uint32_t exec_max_ns;
+    uint32_t entry_max_ns;          /* see Measurements; 0 if not measured */
+} irq_stats_t;
+
+/* ===== Public API ===== */
+
+/**
+ * Apply the priority plan to the NVIC (SysTick keeps TICK_INT_PRIORITY from
+ * HAL_InitTick) and clear the figures. Call before the interrupt sources start.
+ */
+void Irq_Module_Init(void);
+
+/**
+ * First statement of a handler. Returns the entry time to pass to Exit.
+ */
+uint32_t Irq_Module_Enter(irq_src_t src);
+
+/**
+ * Last statement of a handler.
+ */
+void Irq_Module_Exit(irq_src_t src, uint32_t enter);
+
+/**
+ * Clear the figures (with the latency histograms, routine 0x0203).
+ */
+void Irq_Module_Reset(void);
+
+void Irq_Module_Get_Stats(irq_src_t src, irq_stats_t *out);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* IRQ_MODULE_H */
@@ -0,0 +1,118 @@
+/* isotp_module.h
+ *
+ * Minimal ISO 15765-2 (ISO-TP) transport for classic CAN, one physical
+ * connection, used by the UDS server.
+ * This header pairs with isotp_module.c and exposes:
+ *  - Reception of single-frame and segmented requests (FF/CF with flow control)
+ *  - Transmission of single-frame and segmented responses honouring BS/STmin
+ *  - A non-blocking task for consecutive frames and N_Bs/N_Cr timeouts
+ *
+ * Notes:
+ *  - Requests are received on Id_Plan_Module_Std_Id(ISOTP_RX_ID_OFFSET).
+ *  - Responses are sent on Id_Plan_Module_Std_Id(ISOTP_TX_ID_OFFSET).
+ *  - All frames are padded to 8 bytes with ISOTP_PADDING_BYTE.
+ *  - Built only with ISOTP_ENABLE 1, which UDS_ENABLE needs. With 0 the
+ *    API is kept as empty stubs.
+ */
+
+#ifndef ISOTP_MODULE_H
+#define ISOTP_MODULE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "stm32f0xx_hal.h"
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/* ===== Configuration (override before including if needed) ===== */
+
+/* 0: no ISO-TP transport (UDS_ENABLE 0). */
+#ifndef ISOTP_ENABLE
+#define ISOTP_ENABLE            1
+#endif
+
+#ifndef ISOTP_RX_ID_OFFSET
+#define ISOTP_RX_ID_OFFSET   0x9u
+#endif
+#ifndef ISOTP_TX_ID_OFFSET
+#define ISOTP_TX_ID_OFFSET   0xAu
+#endif
+
+/* Largest request / response payload in bytes (max 4095). */
+#ifndef ISOTP_RX_BUF_SIZE
+#define ISOTP_RX_BUF_SIZE    64u
+#endif
+#ifndef ISOTP_TX_BUF_SIZE
+#define ISOTP_TX_BUF_SIZE    320u
+#endif
+
+#ifndef ISOTP_PADDING_BYTE
+#define ISOTP_PADDING_BYTE   0xCCu
+#endif
+
+/* ===== Public API ===== */
+
+/**
+ * Reset both directions to idle.
+ */
+void ISOTP_Module_Init(void);
+
+/**
+ * Offer a received CAN frame to the transport.
+ *
+ * Returns:
+ *  - true if the frame was addressed to this connection (and consumed).
+ */
+bool ISOTP_Module_Handle_Frame(uint16_t std_id, const uint8_t *data, uint8_t dlc);
+
+/**
+ * Get a completely received request.
+ *
+ * Parameters:
+ *  - len: Output length of the request.
+ *
+ * Returns:
+ *  - Pointer to the request bytes, or NULL if none is pending. The buffer stays
+ *    valid (and further requests are ignored) until ISOTP_Module_Release_Rx().
+ */
+const uint8_t* ISOTP_Module_Get_Rx(size_t *len);
+
+/**
+ * Release the request returned by ISOTP_Module_Get_Rx().
+ */
+void ISOTP_Module_Release_Rx(void);
+
+/**
+ * Get the transmit buffer to build a response in place.
+ *
+ * Parameters:
+ *  - capacity: Output size of the buffer (ISOTP_TX_BUF_SIZE).
+ *
+ * Returns:
+ *  - Pointer to the buffer, or NULL while a previous response is still being sent.
+ */
+uint8_t* ISOTP_Module_Get_Tx_Buffer(size_t *capacity);
+
+/**
+ * Start sending len bytes from the transmit buffer.
+ *
+ * Returns:
+ *  - HAL_OK when the single frame or first frame was queued,
+ *    HAL_BUSY if a transfer is in progress, or a CAN error.
+ */
+HAL_StatusTypeDef ISOTP_Module_Start_Tx(size_t len);
+
+/**
+ * Send pending consecutive frames and expire timed-out transfers.
+ * Call from the main loop.
+ */
+void ISOTP_Module_Task(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ISOTP_MODULE_H */
@@ -0,0 +1,128 @@
+/* latency_module.h
+ *
+ * Sample-to-bus latency accounting for the data frames.
+ * This header pairs with latency_module.c and exposes:
+ *  - Stage marks for ADC scan complete, processing done, frame queued,
+ *    mailbox accepted and TX complete
+ *  - Per-stage log2 histograms in microseconds, kept on-device
+ *
+ * Stages (each one the time between two marks):
+ *  - PROCESS   DMA scan complete  -> processing done (sample age at conversion)
+ *  - SCHEDULE  processing done    -> frame queued (wait for the send period)
+ *  - MAILBOX   frame queued       -> mailbox accepted (wait for a free mailbox)
+ *  - BUS       mailbox accepted   -> TX complete (arbitration and transmission)
+ *  - TOTAL     DMA scan complete  -> TX complete
+ *
+ * Notes:
+ *  - Timestamps come from timebase_module; the module has no other hardware
+ *    dependency, so a host build can supply its own timebase.
+ *  - Frames are matched to TX complete interrupts by their identifier; a frame
+ *    re-queued before the previous copy completed replaces it.
+ *  - Histograms are updated in Latency_Module_Task(), never in interrupts.
+ *  - Built only with LATENCY_ENABLE 1; the histograms are read through UDS.
+ */
+
+#ifndef LATENCY_MODULE_H
+#define LATENCY_MODULE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/* ===== Configuration (override before including if needed) ===== */
+
+/* 0: no latency measurement. 1 adds about 0.7 KB flash and 0.35 KB RAM,
+   close to all the default STM32F042K6 image leaves; check the map. */
+#ifndef LATENCY_ENABLE
+#define LATENCY_ENABLE          0
+#endif
+
+/* Data frames tracked at the same time (one per mapping table frame). */
+#ifndef LATENCY_MAX_FRAMES
+#define LATENCY_MAX_FRAMES      4u
+#endif
+
+/* Bucket 0 counts 0 us, bucket b counts [2^(b-1), 2^b) us, the last bucket
+ * everything from 2^(LATENCY_NUM_BUCKETS-2) us up (16 buckets: >= 16.4 ms). */
+#define LATENCY_NUM_BUCKETS     16u
+
+typedef enum {
+    LATENCY_STAGE_PROCESS = 0,
+    LATENCY_STAGE_SCHEDULE,
+    LATENCY_STAGE_MAILBOX,
+    LATENCY_STAGE_BUS,
+    LATENCY_STAGE_TOTAL,
+    LATENCY_NUM_STAGES
+} latency_stage_t;
+
+typedef struct {
+    uint32_t count;                         /* samples recorded */
+    uint32_t max_us;                        /* largest sample */
+    uint16_t bucket[LATENCY_NUM_BUCKETS];   /* saturating counts */
+} latency_hist_t;
+
+/* ===== Public API ===== */
+
+/**
+ * Clear all histograms and in-flight frames.
+ */
+void Latency_Module_Init(void);
+
+/**
+ * Mark a completed ADC DMA scan. Interrupt context.
+ */
+void Latency_Module_Mark_Scan(void);
+
+/**
+ * Mark the end of a processing pass over the most recent scan.
+ */
+void Latency_Module_Mark_Processed(void);
+
+/**
+ * Mark data frame `frame` (0..LATENCY_MAX_FRAMES-1) as handed to the CAN driver.
+ * The frame carries the sample of the last Latency_Module_Mark_Processed().
+ */
+void Latency_Module_Mark_Queued(uint8_t frame, uint16_t std_id);
+
+/**
+ * Mark data frame `frame` as accepted into a TX mailbox (send returned HAL_OK).
+ */
+void Latency_Module_Mark_Accepted(uint8_t frame);
+
+/**
+ * Forget data frame `frame` after the send failed.
+ */
+void Latency_Module_Mark_Dropped(uint8_t frame);
+
+/**
+ * Report that the frame with identifier std_id left a TX mailbox.
+ * Call from the HAL_CAN_TxMailboxNCompleteCallback hooks (interrupt context).
+ */
+void Latency_Module_Tx_Complete(uint16_t std_id);
+
+/**
+ * Fold completed frames into the histograms. Call from the main loop.
+ */
+void Latency_Module_Task(void);
+
+/**
+ * Copy the histogram of one stage.
+ *
+ * Returns:
+ *  - false if stage is out of range or out is NULL.
+ */
+bool Latency_Module_Get_Hist(latency_stage_t stage, latency_hist_t *out);
+
+/**
+ * Clear all histograms (frames in flight are kept).
+ */
+void Latency_Module_Reset(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* LATENCY_MODULE_H */
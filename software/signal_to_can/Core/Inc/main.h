@@ -36,7 +36,16 @@ extern "C" {
 
 /* Exported types ------------------------------------------------------------*/
 /* USER CODE BEGIN ET */
-
+typedef struct {
+	volatile HAL_StatusTypeDef last_tx_status; /* return from CAN_Module_Send */
+	volatile uint32_t last_hal_error; /* HAL_CAN_GetError() */
+	volatile uint32_t last_esr; /* CAN->ESR snapshot */
+	volatile uint32_t last_tsr; /* CAN->TSR snapshot */
+	volatile uint32_t tx_ok_count; /* TX mailbox complete count */
+	volatile uint32_t tx_error_count; /* HAL error callback count */
+} can_debug_t;
+
+extern can_debug_t g_can_dbg;
 /* USER CODE END ET */
 
 /* Exported constants --------------------------------------------------------*/
@@ -0,0 +1,265 @@
+/* pdo_module.h
+ *
+ * Signal-to-frame mapping of the data frames (PDO-style).
+ * This header pairs with pdo_module.c and exposes:
+ *  - A mapping table: per TX frame an identifier, a period, a DLC and a list
+ *    of (source, bit offset, bit length, encoding) entries
+ *  - A compiler that turns the table into a flat packing program when it
+ *    changes, so the packer run per frame is a tight loop over byte writes
+ *  - Per-frame send scheduling, alive counters, CRC and drop counting
+ *  - The built-in plain and E2E layouts of the README as default tables
+ *
+ * Bit positions (frame bit k = byte k / 8):
+ *    PDO_ENC_BE  Motorola: bit_offset counts from the MSB of byte 0 and names
+ *                the field's most significant bit; the field runs towards
+ *                higher bytes (a 16-bit field at offset 0 fills bytes 0-1,
+ *                high byte first).
+ *    PDO_ENC_LE  Intel: bit_offset is the DBC start bit, i.e. the field's
+ *                least significant bit at byte k / 8, bit k % 8.
+ * Values are unsigned. Measured values (millivolts, counts, statistics,
+ * masks, constants) saturate at the field width; counters (timestamps,
+ * alive) wrap.
+ *
+ * A PDO_SRC_CRC8 entry must be 8 bits on a byte boundary. Its byte carries
+ * CRC-8 SAE J1850 over the ID low byte, the ID high byte, then all other
+ * bytes of the frame in order, computed after the rest is packed.
+ *
+ * Notes:
+ *  - A table is applied only if it compiles: every field inside the DLC, no
+ *    two fields sharing a bit, distinct resolved identifiers, and none of
+ *    them on the node's command, XCP, UDS, Bus Health or backfill IDs
+ *    (node_id + 0x5 .. + 0xC), the claim or the update multicast ID,
+ *    whether given node-relative or absolute. With the class plan (id_plan_module.h)
+ *    node-relative identifiers must be below 0x10 and absolute ones outside
+ *    every class range.
+ *  - Writing a frame through UDS DID 0x0500 + f applies the new table at
+ *    once; frames not written keep their mapping.
+ *  - Latest value wins (PDO_REPLACE_PENDING): a frame whose previous copy
+ *    still waits in a TX mailbox when it is due again aborts that copy and
+ *    takes its place, so a data frame on the bus is never more than one
+ *    period (plus the frame in progress) older than its sample. Frames
+ *    already on the bus complete; confirmed aborts are counted as
+ *    replacements.
+ */
+
+#ifndef PDO_MODULE_H
+#define PDO_MODULE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "stm32f0xx_hal.h"
+#include <stdint.h>
+#include <stdbool.h>
+
+/* ===== Configuration (override before including if needed) ===== */
+
+/* TX frames in the table. */
+#ifndef PDO_MAX_FRAMES
+#define PDO_MAX_FRAMES          4u
+#endif
+
+/* Entries per frame. */
+#ifndef PDO_MAX_ENTRIES
+#define PDO_MAX_ENTRIES         8u
+#endif
+
+/* Byte writes in the compiled program, over all frames. A field takes one
+ * per byte it touches. */
+#ifndef PDO_MAX_PUTS
+#define PDO_MAX_PUTS            48u
+#endif
+
+/* 1: abort a still-pending copy of a frame when it is sent again. */
+#ifndef PDO_REPLACE_PENDING
+#define PDO_REPLACE_PENDING     1
+#endif
+
+/* Frame identifier: node-relative offset (id_plan_module.h), or an absolute
+ * 11-bit ID. */
+#define PDO_ID_ABSOLUTE         0x8000u
+#define PDO_ID_UNUSED           0xFFFFu
+
+/* Sources. `index` selects the channel (0..7) of per-channel sources. */
+typedef enum {
+    PDO_SRC_CONST = 0,          /* index as the value */
+    PDO_SRC_MV,                 /* device-input mV of channel index */
+    PDO_SRC_RAW,                /* raw ADC counts of channel index */
+    PDO_SRC_OOR_MASK,           /* out-of-range mask, bit i = channel i */
+    PDO_SRC_ENABLED_MASK,       /* enabled channels, bit i = channel i */
+    PDO_SRC_STAT_MIN,           /* statistics window of channel index, mV */
+    PDO_SRC_STAT_MAX,
+    PDO_SRC_STAT_MEAN,
+    PDO_SRC_STAT_COUNT,         /* ADC scans in the statistics window */
+    PDO_SRC_UPTIME_MS,          /* HAL_GetTick() */
+    PDO_SRC_TIME_US,            /* timebase microseconds at packing */
+    PDO_SRC_SCAN_COUNT,         /* ADC scans since start */
+    PDO_SRC_CPU_LOAD,           /* main loop load, permille */
+    PDO_SRC_ALIVE,              /* +1 every send attempt of this frame */
+    PDO_SRC_CRC8,               /* see above */
+    PDO_NUM_SOURCES
+} pdo_source_t;
+
+#define PDO_ENC_BE              0u
+#define PDO_ENC_LE              1u
+
+typedef struct {
+    uint8_t source;             /* pdo_source_t */
+    uint8_t index;
+    uint8_t bit_offset;
+    uint8_t bit_length;         /* 1..32 */
+    uint8_t encoding;           /* PDO_ENC_xxx */
+} pdo_entry_t;
+
+typedef struct {
+    uint16_t    id;             /* offset, PDO_ID_ABSOLUTE | ID, or PDO_ID_UNUSED */
+    uint16_t    period_ms;      /* 0: the sample period (SET_SAMPLE_RATE) */
+    uint8_t     dlc;            /* 0..8 */
+    uint8_t     num_entries;
+    pdo_entry_t entry[PDO_MAX_ENTRIES];
+} pdo_frame_t;
+
+typedef enum {
+    PDO_LAYOUT_PLAIN = 0,       /* +1: ch 0..3, +2: ch 4..7 */
+    PDO_LAYOUT_E2E,             /* +1, +2, +4 with CRC and alive counter */
+    PDO_LAYOUT_CUSTOM           /* table written through PDO_Module_Set_Frame() */
+} pdo_layout_t;
+
+/* ===== Compiled program ===== */
+
+/* One value fetched from a source, followed by num_puts byte writes. */
+typedef struct {
+    uint8_t  source;
+    uint8_t  index;
+    uint8_t  num_puts;
+    uint32_t max;               /* saturation limit, UINT32_MAX for counters */
+} pdo_load_t;
+
+/* frame[byte] |= ((value >> rshift) << lshift) & mask */
+typedef struct {
+    uint8_t byte;
+    uint8_t rshift;
+    uint8_t lshift;
+    uint8_t mask;
+} pdo_put_t;
+
+typedef struct {
+    uint8_t first_load;
+    uint8_t num_loads;
+    uint8_t first_put;
+    int8_t  crc_byte;           /* -1: no CRC */
+} pdo_prog_t;
+
+#define PDO_MAX_LOADS           (PDO_MAX_FRAMES * PDO_MAX_ENTRIES)
+
+/* A mapping table with its compiled program; position independent, so a
+ * copy in flash (profile_module) runs as it is. */
+typedef struct {
+    pdo_frame_t  map[PDO_MAX_FRAMES];
+    pdo_prog_t   prog[PDO_MAX_FRAMES];
+    pdo_load_t   loads[PDO_MAX_LOADS];
+    pdo_put_t    puts[PDO_MAX_PUTS];
+    pdo_layout_t layout;
+} pdo_tables_t;
+
+/* ===== Public API ===== */
+
+/**
+ * Load the selected built-in layout (after reset the one PS_E2E_DEFAULT
+ * chooses), clear alive and drop counters and make every frame due on the
+ * first scan.
+ */
+void PDO_Module_Init(void);
+
+/**
+ * Replace the table with a built-in layout. Alive counters keep running.
+ */
+void PDO_Module_Load_Layout(pdo_layout_t layout);
+
+/**
+ * Layout the table came from: built-in, or PDO_LAYOUT_CUSTOM once a frame
+ * has been set.
+ */
+pdo_layout_t PDO_Module_Get_Layout(void);
+
+/**
+ * Replace frame f of the table, compile and apply it.
+ *
+ * Returns:
+ *  - HAL_OK, or HAL_ERROR (table unchanged) if the result does not compile.
+ */
+HAL_StatusTypeDef PDO_Module_Set_Frame(uint8_t f, const pdo_frame_t *frame);
+
+/**
+ * Copy frame f of the table. Returns false if f is out of range.
+ */
+bool PDO_Module_Get_Frame(uint8_t f, pdo_frame_t *out);
+
+/**
+ * The 11-bit identifier a table id (node offset or PDO_ID_ABSOLUTE | ID)
+ * is sent on with the current node ID.
+ */
+uint16_t PDO_Module_Resolve_Id(uint16_t id);
+
+/**
+ * Tables in use.
+ */
+const pdo_tables_t* PDO_Module_Get_Tables(void);
+
+/**
+ * Run from a compiled table set kept elsewhere (a stored profile), read only.
+ * NULL takes the tables in use over into the module's own copy; the next
+ * change of the table does that implicitly. Alive counters and due times
+ * keep running.
+ */
+void PDO_Module_Use_Tables(const pdo_tables_t *tables);
+
+/**
+ * Frames of frame f that could not be queued (TX mailbox timeout).
+ */
+uint32_t PDO_Module_Get_Tx_Drops(uint8_t f);
+
+/**
+ * Frames of frame f aborted in the mailbox and replaced by a newer copy.
+ */
+uint32_t PDO_Module_Get_Tx_Replaced(uint8_t f);
+
+/**
+ * Bit f set: the last PDO_Module_Send_If_Due() asked a pending copy of
+ * frame f to abort, i.e. the previous sample of f did not make it out.
+ */
+uint8_t PDO_Module_Get_Replaced_Mask(void);
+
+/**
+ * Count a confirmed abort of a frame on std_id. Call from the TX mailbox
+ * abort callbacks (interrupt context).
+ */
+void PDO_Module_Tx_Aborted(uint16_t std_id);
+
+/**
+ * Pack and send every mapped frame now.
+ *
+ * Returns:
+ *  - HAL_OK, or the first error; every frame is attempted.
+ */
+HAL_StatusTypeDef PDO_Module_Send_All(uint32_t timeout_ms);
+
+/**
+ * Send the frames whose period has elapsed, refreshing the signal snapshot
+ * first. Nothing is sent before the first ADC scan; then every frame is due.
+ *
+ * Parameters:
+ *  - sample_period_ms: Period of frames mapped with period_ms 0.
+ *  - timeout_ms:       Per-frame TX mailbox timeout.
+ *
+ * Returns:
+ *  - HAL_OK if frames were sent, HAL_BUSY if none was due, or the first error.
+ */
+HAL_StatusTypeDef PDO_Module_Send_If_Due(uint32_t sample_period_ms, uint32_t timeout_ms);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PDO_MODULE_H */
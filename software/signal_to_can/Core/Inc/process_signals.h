@@ -4,6 +4,7 @@
 #include <stdint.h>
 #include <stdbool.h>
 #include "stm32f0xx_hal.h"
+#include "pdo_module.h"
 
 /**
  * @file process_signals.h
@@ -11,6 +12,13 @@
  *
  * Channel indexing is 0..7 corresponding to ADC_IN0..ADC_IN7.
  * Converted values are stored in millivolts of the DEVICE INPUT (post-divider).
+ *
+ * Each update is published as a whole (ps_snapshot_t) through a sequence
+ * lock over two buffers: the writer fills the back buffer and flips, and
+ * readers copy with a retry if the writer came round to their buffer while
+ * they copied. The getters below copy from the published update, so a reader
+ * in any context (interrupt or main loop) never sees half an update and never
+ * masks interrupts.
  */
 
 /* Number of channels handled (ADC_IN0..ADC_IN7). */
@@ -32,6 +40,32 @@
 #define PS_DEFAULT_MAX_V     4.5f
 #endif
 
+/* End-to-end protection of the data frames (see Process_Signals_Set_E2E). */
+#ifndef PS_E2E_DEFAULT
+#define PS_E2E_DEFAULT       0        /* 1 = E2E layout enabled at init */
+#endif
+
+/* Data frame slots of the mapping table (see pdo_module.h): 2 used by the
+ * plain layout, 3 by the E2E layout. */
+#define PS_NUM_TX_FRAMES     PDO_MAX_FRAMES
+
+/* Calibration of one channel. */
+typedef struct {
+    float gain;     /* V_in = gain * V_pin + offset */
+    float offset;   /* volts */
+    float v_min;    /* device-input min (V) */
+    float v_max;    /* device-input max (V) */
+    bool  enabled;  /* disabled: reads 0 mV, never out of range */
+} ps_cal_t;
+
+/* One processing update, as published. */
+typedef struct {
+    uint16_t raw[PS_NUM_CHANNELS];      /* ADC counts */
+    uint16_t mV[PS_NUM_CHANNELS];       /* device input, millivolts */
+    float    v_in[PS_NUM_CHANNELS];     /* device input, volts */
+    uint8_t  oor_mask;                  /* bit i: channel i out of range */
+} ps_snapshot_t;
+
 /**
  * @brief Initialize processing state with defaults.
  *
@@ -47,17 +81,32 @@ void Process_Signals_Init(void);
  *        - Compute device input voltages (V_in = gain * V_pin + offset)
  *        - Compute device input millivolts array
  *        - Update out-of-range bitmask
+ *        - Publish the result (see Process_Signals_Get_Snapshot)
  *
- * Call this at any rate; it is non-blocking and uses the latest DMA values.
+ * Call this at any rate from the main loop; it is non-blocking and uses the
+ * latest DMA values.
  */
 void Process_Signals_Update(void);
 
+/**
+ * @brief Copy the latest published update. Safe from any context.
+ * @param out Snapshot to fill.
+ */
+void Process_Signals_Get_Snapshot(ps_snapshot_t *out);
+
 /**
  * @brief Get latest raw ADC counts for all channels.
  * @param out_raw Pointer to array of length PS_NUM_CHANNELS.
  */
 void Process_Signals_Get_All_Raw(uint16_t *out_raw);
 
+/**
+ * @brief Get the latest raw ADC count of a channel.
+ * @param ch Channel index 0..7
+ * @return Count, 0 if ch is out of range.
+ */
+uint16_t Process_Signals_Get_Raw(uint8_t ch);
+
 /**
  * @brief Get the last computed device input voltage for a channel (volts).
  * @param ch Channel index 0..7
@@ -73,10 +122,10 @@ float Process_Signals_Get_Input_V(uint8_t ch);
 uint16_t Process_Signals_Get_Input_mV(uint8_t ch);
 
 /**
- * @brief Get a pointer to the latest device-input millivolts array.
- * @return Pointer to array[PS_NUM_CHANNELS] of uint16_t mV values.
+ * @brief Get the latest device-input millivolts of all channels.
+ * @param out_mV Pointer to array of length PS_NUM_CHANNELS.
  */
-const uint16_t* Process_Signals_Get_All_Input_mV(void);
+void Process_Signals_Get_All_Input_mV(uint16_t *out_mV);
 
 /**
  * @brief Returns a bitmask of channels that are out of the configured range.
@@ -119,26 +168,119 @@ void Process_Signals_Set_Divider(uint8_t ch, float r_top_ohm, float r_bottom_ohm
 void Process_Signals_Set_GainOffset(uint8_t ch, float gain, float offset);
 
 /**
- * @brief Send two CAN frames with converted device-input millivolts.
+ * @brief Get the affine calibration for a channel.
+ * @param ch Channel 0..7
+ * @param gain_out   Output gain, optional (can be NULL)
+ * @param offset_out Output offset (V), optional
+ */
+void Process_Signals_Get_GainOffset(uint8_t ch, float *gain_out, float *offset_out);
+
+/**
+ * @brief Enable or disable a channel. A disabled channel reads 0 mV and is
+ *        never flagged out of range. All channels are enabled after Init.
+ * @param ch Channel 0..7
+ * @param enable true to enable
+ */
+void Process_Signals_Set_Enabled(uint8_t ch, bool enable);
+
+/**
+ * @brief Whether a channel is enabled (false if ch is out of range).
+ */
+bool Process_Signals_Get_Enabled(uint8_t ch);
+
+/**
+ * @brief The calibration in use, array[PS_NUM_CHANNELS]: the module's own,
+ *        or the one given to Process_Signals_Use_Cal().
+ */
+const ps_cal_t* Process_Signals_Get_Cal(void);
+
+/**
+ * @brief Run from another calibration (profile_module.h): a pointer swap,
+ *        nothing is copied. The array must stay valid while it is in use; the
+ *        first setter call copies it into the module and runs from the copy.
+ * @param cal Array[PS_NUM_CHANNELS], or NULL to take over the calibration in
+ *            use into the module's own now.
+ */
+void Process_Signals_Use_Cal(const ps_cal_t *cal);
+
+/**
+ * @brief Restart the per-channel statistics window (min/max/mean of mV).
+ */
+void Process_Signals_Reset_Stats(void);
+
+/**
+ * @brief Get the statistics of a channel over the ADC scans seen since the
+ *        last reset. Scans completing between two updates are not counted.
+ * @param ch Channel 0..7
+ * @param min_out  Output minimum (mV), optional
+ * @param max_out  Output maximum (mV), optional
+ * @param mean_out Output mean (mV), optional
+ */
+void Process_Signals_Get_Stats(uint8_t ch, uint16_t *min_out, uint16_t *max_out, uint16_t *mean_out);
+
+/**
+ * @brief Number of ADC scans accumulated in the statistics window.
+ */
+uint32_t Process_Signals_Get_Stats_Count(void);
+
+/**
+ * @brief Load the built-in plain or end-to-end protected frame layout into
+ *        the mapping table (pdo_module.h), replacing a custom mapping.
  *
- * Frame 1: StdID = CAN_Module_Get_Node_Id() + 0x1, DLC=8, mV for ch 0..3
- * Frame 2: StdID = CAN_Module_Get_Node_Id() + 0x2, DLC=8, mV for ch 4..7
+ * In E2E mode every data frame carries:
+ *   byte 0     CRC-8 (SAE J1850: poly 0x1D, init 0xFF, xor-out 0xFF) computed over
+ *              the StdID low byte, StdID high byte, then bytes 1..7
+ *   byte 1     alive counter in bits 0..3 (per frame, +1 every send attempt)
+ *   bytes 2..7 three channels, big-endian mV
+ * and the channels move to three frames:
+ *   node_id + 0x1: ch 0..2, node_id + 0x2: ch 3..5,
+ *   node_id + 0x4: ch 6..7, byte 6 = out-of-range mask, byte 7 = 0
  *
- * Each channel encoded big-endian (high byte first).
+ * @param enable true for the E2E layout, false for the plain two-frame layout.
+ */
+void Process_Signals_Set_E2E(bool enable);
+
+/**
+ * @brief Returns true if the built-in E2E layout is active.
+ */
+bool Process_Signals_Get_E2E(void);
+
+/**
+ * @brief Number of data frames dropped because no TX mailbox freed in time.
+ * @param frame Mapping table frame 0..PS_NUM_TX_FRAMES-1 (built-in layouts:
+ *              ID offset 0x1, 0x2, 0x4).
+ * @return Drop count, 0 if frame is out of range.
+ */
+uint32_t Process_Signals_Get_Tx_Drops(uint8_t frame);
+
+/**
+ * @brief Send the data frames of the mapping table now (PDO_Module_Send_All).
+ *
+ * Plain layout:
+ *   Frame 1: StdID = CAN_Module_Get_Node_Id() + 0x1, DLC=8, mV for ch 0..3
+ *   Frame 2: StdID = CAN_Module_Get_Node_Id() + 0x2, DLC=8, mV for ch 4..7
+ * E2E layout: see Process_Signals_Set_E2E(). Custom layouts: see pdo_module.h.
+ *
+ * Each channel encoded big-endian (high byte first). Every frame is attempted
+ * even if an earlier one fails; failed frames are counted as drops.
  *
  * @param timeout_ms  Per-frame TX mailbox timeout.
- * @return HAL status. If either frame fails, returns that error.
+ * @return HAL status. If any frame fails, returns the first error.
  */
 HAL_StatusTypeDef Process_Signals_Send_Can(uint32_t timeout_ms);
 
 /**
- * @brief Helper that rate-limits Process_Signals_Send_Can using HAL_GetTick().
+ * @brief Helper that rate-limits the data frames using HAL_GetTick()
+ *        (PDO_Module_Send_If_Due).
  *
- * Call frequently (e.g., in your main loop). When period_ms has elapsed since
- * the last successful send, it pushes the two frames.
+ * Call frequently (e.g., in your main loop). Each frame is sent when its
+ * mapped period, or period_ms if it has none, has elapsed since its last
+ * send. The first send after PDO_Module_Init() does not wait a period, only
+ * for the first ADC scan. A sample whose frames could not all be queued is
+ * kept for backfill (backfill_module.h).
  *
- * @param period_ms   Desired period between sends.
- * @param timeout_ms  Per-frame timeout passed to Process_Signals_Send_Can.
+ * @param period_ms   Period of frames mapped without their own.
+ * @param timeout_ms  Per-frame TX mailbox timeout.
  * @return HAL_OK if sent this call, HAL_BUSY if not due yet, or an error from CAN.
  */
 HAL_StatusTypeDef Process_Signals_Send_Can_If_Due(uint32_t period_ms, uint32_t timeout_ms);
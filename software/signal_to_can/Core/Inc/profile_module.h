@@ -0,0 +1,145 @@
+/* profile_module.h
+ *
+ * Configuration profiles in flash for STM32F042.
+ * This header pairs with profile_module.c and exposes:
+ *  - PROFILE_NUM complete configurations, one flash page each (section
+ *    .profile_pages of STM32F042K6TX_FLASH.ld): channel calibration,
+ *    sample period and the PDO mapping table together with its compiled
+ *    packing program
+ *  - Switching to a stored profile by pointer swap: processing and the PDO
+ *    packer run directly from the flash copy, nothing is copied or compiled
+ *  - Saving the configuration in use to a profile in the background
+ *
+ * Record (one page, native layout, half-word 0 programmed last):
+ *    magic, version, size, reserved       4 x u16
+ *    sample_period_ms                     u32
+ *    cal[PS_NUM_CHANNELS]                 ps_cal_t
+ *    pdo                                  pdo_tables_t
+ * A page whose magic, version or size does not match holds no profile.
+ *
+ * Notes:
+ *  - The switch is a handful of stores done from the main loop, between two
+ *    processing cycles; frames already due are packed with the new tables.
+ *  - Any later change of the configuration (commands, UDS) first copies the
+ *    tables in use into RAM and changes the copy; the profile in flash is
+ *    unaffected until it is saved again.
+ *  - The CAN bit rate and the node ID are not part of a profile.
+ *  - A save erases the page once no CAN frame is queued or unread (20-40 ms
+ *    CPU stall, as the event log), then programs PROFILE_PROGRAM_STEP
+ *    half-words per main loop pass and compares the result with the
+ *    configuration. A configuration change while saving fails the save.
+ *  - Profile 0, if valid, is selected at boot.
+ *  - Built only with PROFILE_ENABLE 1. Profiles are saved through UDS, so
+ *    this needs UDS_ENABLE as well. With 0, selecting a profile fails and
+ *    the pages are left to the image.
+ */
+
+#ifndef PROFILE_MODULE_H
+#define PROFILE_MODULE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "stm32f0xx_hal.h"
+#include "process_signals.h"
+#include "pdo_module.h"
+#include "event_log_module.h"
+#include <stdint.h>
+#include <stdbool.h>
+
+/* ===== Configuration (override before including if needed) ===== */
+
+/* 0: no profiles. 1 adds about 1.6 KB code and claims two 1 KB pages,
+   more than the default STM32F042K6 image with UDS leaves. */
+#ifndef PROFILE_ENABLE
+#define PROFILE_ENABLE          0
+#endif
+
+/* Profile pages: the last two 1 KB pages of the 32 KB flash, or the two
+   below the event log when it is built. Must match .profile_pages. */
+#ifndef PROFILE_FLASH_BASE
+#if EVENT_LOG_ENABLE
+#define PROFILE_FLASH_BASE      0x08007000u
+#else
+#define PROFILE_FLASH_BASE      0x08007800u
+#endif
+#endif
+#define PROFILE_NUM             2u
+#define PROFILE_PAGE_SIZE       0x400u
+
+/* Half-words programmed per main loop pass (about 50 us each). */
+#ifndef PROFILE_PROGRAM_STEP
+#define PROFILE_PROGRAM_STEP    8u
+#endif
+
+#define PROFILE_NONE            0xFFu
+
+typedef enum {
+    PROFILE_SAVE_IDLE = 0,
+    PROFILE_SAVE_ERASING,       /* waiting for a quiet bus, then erasing */
+    PROFILE_SAVE_PROGRAMMING,
+    PROFILE_SAVE_DONE,          /* stored and selected */
+    PROFILE_SAVE_FAILED         /* readback differs (configuration changed meanwhile) */
+} profile_save_state_t;
+
+typedef struct {
+    uint16_t     magic;
+    uint16_t     version;
+    uint16_t     size;
+    uint16_t     reserved;
+    uint32_t     sample_period_ms;
+    ps_cal_t     cal[PS_NUM_CHANNELS];
+    pdo_tables_t pdo;
+} profile_record_t;
+
+/* ===== Public API ===== */
+
+/**
+ * Select profile 0 if it is valid.
+ *
+ * Parameters:
+ *  - sample_period_ms: The main loop's send period, set by a switch.
+ */
+void Profile_Module_Init(uint32_t *sample_period_ms);
+
+/**
+ * Switch to stored profile p at once.
+ *
+ * Returns:
+ *  - HAL_OK, HAL_ERROR if p holds no profile, HAL_BUSY while saving.
+ */
+HAL_StatusTypeDef Profile_Module_Select(uint8_t p);
+
+/**
+ * Start saving the configuration in use to profile p; Profile_Module_Task()
+ * does the work and selects p when it is stored.
+ *
+ * Returns:
+ *  - HAL_OK, HAL_ERROR if p is out of range, HAL_BUSY while saving.
+ */
+HAL_StatusTypeDef Profile_Module_Save(uint8_t p);
+
+/**
+ * Stored profile equal to the configuration in use, or PROFILE_NONE.
+ */
+uint8_t Profile_Module_Get_Active(void);
+
+/**
+ * Bit p set: profile p is stored.
+ */
+uint8_t Profile_Module_Get_Valid_Mask(void);
+
+profile_save_state_t Profile_Module_Get_Save_State(void);
+
+/**
+ * Advance a save (erase, or PROFILE_PROGRAM_STEP half-words). Call from
+ * the main loop.
+ */
+void Profile_Module_Task(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PROFILE_MODULE_H */
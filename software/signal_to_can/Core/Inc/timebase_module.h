@@ -0,0 +1,35 @@
+/* timebase_module.h
+ *
+ * Microsecond timebase for STM32F042 built on the HAL millisecond tick and
+ * the SysTick down-counter.
+ * This header pairs with timebase_module.c and exposes:
+ *  - A free-running microsecond counter usable from thread and interrupt context
+ *
+ * Notes:
+ *  - The counter wraps after about 71 minutes; only use differences
+ *    ((uint32_t)(b - a)) of timestamps that are less than that apart.
+ *  - A tick that has elapsed but not yet been counted (SysTick pending because
+ *    a higher-priority interrupt is running) is accounted for.
+ */
+
+#ifndef TIMEBASE_MODULE_H
+#define TIMEBASE_MODULE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+/* ===== Public API ===== */
+
+/**
+ * Current time in microseconds since HAL_Init().
+ */
+uint32_t Timebase_Module_Now_Us(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* TIMEBASE_MODULE_H */
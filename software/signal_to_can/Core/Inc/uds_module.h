@@ -0,0 +1,119 @@
+/* uds_module.h
+ *
+ * UDS (ISO 14229) diagnostic server subset on top of isotp_module.
+ * This header pairs with uds_module.c and exposes:
+ *  - DiagnosticSessionControl (0x10) and TesterPresent (0x3E)
+ *  - ReadDataByIdentifier (0x22) with several DIDs per request
+ *  - WriteDataByIdentifier (0x2E), extended session only
+ *  - RoutineControl (0x31) for ADC calibration, signal capture, latency reset,
+ *    CAN error statistics reset, event log clear, update and profile save,
+ *    extended session only
+ *
+ * Data identifiers (all multi-byte values big-endian, floats IEEE-754):
+ *  - 0x0100+ch  R/W  gain, offset (V)                 8 bytes
+ *  - 0x0110+ch  R/W  out-of-range v_min, v_max (V)    8 bytes
+ *  - 0x0200     R    device-input mV, ch 0..7        16 bytes
+ *  - 0x0201     R    raw ADC counts, ch 0..7         16 bytes
+ *  - 0x0202     R    out-of-range mask                1 byte
+ *  - 0x0203     R/W  frame layout (0 plain, 1 E2E; reads 2 for a custom mapping)  1 byte
+ *  - 0x0210     R    ADC scan count, then min/max/mean mV per channel 52 bytes
+ *  - 0x0220+st  R    latency stage st: count u32, max us u32, 16 log2 buckets u16  40 bytes
+ *  - 0x0300     R    CAN tx_ok, tx_error, last_hal_error, last_esr, XCP overruns  20 bytes
+ *  - 0x0301     R    uptime (ms)                      4 bytes
+ *  - 0x0302     R    dropped data frames per mapping table frame 0..3 (u32 each)  16 bytes
+ *  - 0x0303     R    boot phase times, us since HAL_Init (u32 each, boot_phase_t order)  28 bytes
+ *  - 0x0304     R    HCLK MHz, clock setting, load permille, shortest pass us, level switches  8 bytes
+ *  - 0x0305     R    CAN errors: stuff, form, ACK, bit recessive, bit dominant, CRC, then
+ *                    warning, passive and bus-off entries, aborts after a TX error
+ *                    (u32 each)  40 bytes
+ *  - 0x0306     R    CAN error windows, newest first: errors u16, peak TEC, peak REC,
+ *                    TEC, REC at close, top LEC, states (zero if not closed yet)  128 bytes
+ *  - 0x0307     R    ISR timing for CAN, DMA ADC, SysTick: count, max execution ns,
+ *                    max entry latency ns (u32 each, see irq_module.h)  36 bytes
+ *  - 0x0308     R    backfill samples stored, sent, dropped (u32 each), pending,
+ *                    ring bytes in use (u16 each)  16 bytes
+ *  - 0x0309     R    replaced data frames per mapping table frame 0..3 (u32 each)  16 bytes
+ *  - 0x0400     R    node ID                          1 byte
+ *  - 0x0401     R    baud enum                        1 byte
+ *  - 0x0402     RW   clock setting: 0 auto, or 48 / 24 / 8 (MHz)  1 byte
+ *  - 0x0403     R/W  configuration profile: stored profile equal to the configuration
+ *                    in use (0xFF none); a write switches to a stored one  1 byte
+ *  - 0x0404     R    ID plan: class plan in use, max nodes, then per class (alarm, fast,
+ *                    slow, status, config) base u16 and width (id_plan_module.h)  17 bytes
+ *  - 0x0405     R    address claim: state (claim_state_t), node ID, preferred node ID,
+ *                    attempts of the last search, lost, collisions, defences (u16 each)  10 bytes
+ *  - 0x0500+f   R/W  mapping table frame f (0..3): id u16, period ms u16, DLC, entry count,
+ *                    then 8 entries of source, index, bit offset, bit length, encoding  46 bytes
+ *  - 0x0600+b   R    event log block b (0..8), entries 14*b.. newest first: type, arg,
+ *                    boot u16, time ms u32, data u32 x2 (0xFF if empty)  224 bytes
+ *  - 0x0610     R    event log written, dropped (queue full, rate), erases per page,
+ *                    max program us, max erase us (u32 each), stored, boot (u16)  32 bytes
+ *  - 0x0700     R    update state, error, tag, 0, blocks u16, missing u16, size, frames,
+ *                    stale (u32 each)  20 bytes
+ *  - 0x0701     R    update missing-block bitmap  UPDATE_BITMAP_BYTES
+ *  - 0x0800     R    layout description, variable length (at most 288 bytes):
+ *                    length u16 (whole record), format 1, node ID, layout (as 0x0203),
+ *                    enabled mask, channel count, frame count; per channel: raw-to-input
+ *                    factor (V per count), offset (V), out-of-range min, max (mV u16);
+ *                    per mapped frame: CAN ID u16 (resolved), period ms u16 (0 resolved
+ *                    to the sample period), DLC, entry count, then the entries as 0x0500+f
+ *
+ * Routines:
+ *  - 0x0201  ADC self-calibration. Start runs it, results return the status byte.
+ *  - 0x0202  Capture. Start [count u16, in ADC scans] restarts the statistics window;
+ *            results return status (0 done, 1 running, 2 idle), scan count u16 and mean mV
+ *            per channel.
+ *  - 0x0203  Latency reset. Start clears the latency histograms and the ISR timing.
+ *  - 0x0204  CAN error statistics reset. Start clears the 0x0305 counters and the windows.
+ *  - 0x0205  Event log clear. Start erases the log pages from the main loop.
+ *  - 0x0206  Update. Start tag, size u32, CRC-32 u32 enters update mode (NRC 0x22 if the
+ *            staging area is not in flash); stop leaves it; results return state, error
+ *            and missing blocks u16.
+ *  - 0x0207  Profile save. Start profile saves the configuration in use to it and switches
+ *            to it when stored; results return the save state (profile_save_state_t),
+ *            the stored-profile mask and the active profile (as 0x0403).
+ *
+ * DIDs and routines of a module built without its switch are not served
+ * (NRC 0x31, skipped in multi-DID reads): latency 0x0220+ and 0x0203,
+ * backfill 0x0308, profiles 0x0403 and 0x0207, event log 0x0600+, 0x0610
+ * and 0x0205, update 0x0700, 0x0701 and 0x0206.
+ */
+
+#ifndef UDS_MODULE_H
+#define UDS_MODULE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+/* 0: no UDS server, the largest module (about 6 KB flash with ISO-TP).
+ * 1 needs ISOTP_ENABLE 1 as well. */
+#ifndef UDS_ENABLE
+#define UDS_ENABLE 1
+#endif
+
+/* Session timeout (S3) after which the server falls back to the default session. */
+#ifndef UDS_S3_TIMEOUT_MS
+#define UDS_S3_TIMEOUT_MS 5000u
+#endif
+
+/* ===== Public API ===== */
+
+/**
+ * Reset the server to the default session.
+ */
+void UDS_Module_Init(void);
+
+/**
+ * Process a pending request from the transport and start its response.
+ * Call from the main loop after ISOTP_Module_Task().
+ */
+void UDS_Module_Task(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* UDS_MODULE_H */
@@ -0,0 +1,153 @@
+/* update_module.h
+ *
+ * Multicast firmware image download for STM32F0.
+ * This header pairs with update_module.c and exposes:
+ *  - An update session, started per node over UDS (routine 0x0206) with the
+ *    image size, CRC-32 and a session tag; the staging area is erased first
+ *  - Image frames broadcast once on UPDATE_MCAST_ID and programmed by every
+ *    node in update mode at the same time
+ *  - A missing-block bitmap per node (DID 0x0701), so the host repeats only
+ *    the blocks some node lost, and a CRC-32 check of the staged image
+ *
+ * Image frame (DLC 8, UPDATE_MCAST_ID):
+ *    byte 0-1  bits 15-13 session tag, bits 12-0 frame number n (big-endian)
+ *    byte 2-7  image bytes 6n .. 6n+5 (0xFF past the end of the image)
+ * UPDATE_BLOCK_FRAMES consecutive frames form a block. A block counts as
+ * received once all its frames arrived in a row; otherwise it stays missing
+ * and is sent again whole.
+ *
+ * Notes:
+ *  - Frames are programmed from Can_Rx_Task(): three half-words, about
+ *    150 us, per frame. The host paces the broadcast accordingly.
+ *  - The staging area must lie in the device's flash (flash size register).
+ *    The default is the upper half of a 64 KB part. The 32 KB STM32F042x6
+ *    has no room for a second image next to the application (the image
+ *    alone takes most of it), so building it with UPDATE_ENABLE needs an
+ *    explicit UPDATE_STAGE_BASE; with one that lies past its flash, every
+ *    session is refused (NRC 0x22).
+ *  - A verified image stays in the staging area. Copying it over the
+ *    application is up to a bootloader.
+ *  - Built only with UPDATE_ENABLE 1; an update is started through UDS.
+ */
+
+#ifndef UPDATE_MODULE_H
+#define UPDATE_MODULE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "stm32f0xx_hal.h"
+#include <stdint.h>
+#include <stdbool.h>
+
+/* ===== Configuration (override before including if needed) ===== */
+
+/* 0: no multicast update, image frames are ignored. */
+#ifndef UPDATE_ENABLE
+#define UPDATE_ENABLE           0
+#endif
+
+/* Shared image frame ID; low priority so node traffic wins arbitration. */
+#ifndef UPDATE_MCAST_ID
+#define UPDATE_MCAST_ID         0x7F0u
+#endif
+
+#ifndef UPDATE_STAGE_BASE
+#if UPDATE_ENABLE && defined(STM32F042x6)
+#error "no room to stage an image in the 32 KB STM32F042x6; set UPDATE_STAGE_BASE for a larger part"
+#endif
+#define UPDATE_STAGE_BASE       0x08008000u
+#endif
+
+#ifndef UPDATE_STAGE_SIZE
+#define UPDATE_STAGE_SIZE       0x8000u
+#endif
+
+/* CRC-32 bytes checked per main loop pass. */
+#ifndef UPDATE_VERIFY_CHUNK
+#define UPDATE_VERIFY_CHUNK     256u
+#endif
+
+#define UPDATE_FRAME_BYTES      6u
+#define UPDATE_BLOCK_FRAMES     8u
+#define UPDATE_BLOCK_BYTES      (UPDATE_FRAME_BYTES * UPDATE_BLOCK_FRAMES)
+#define UPDATE_MAX_BLOCKS       ((UPDATE_STAGE_SIZE + UPDATE_BLOCK_BYTES - 1u) / UPDATE_BLOCK_BYTES)
+#define UPDATE_BITMAP_BYTES     ((UPDATE_MAX_BLOCKS + 7u) / 8u)
+
+typedef enum {
+    UPDATE_IDLE = 0,
+    UPDATE_ERASING,             /* staging area being erased, frames ignored */
+    UPDATE_RECEIVING,
+    UPDATE_VERIFYING,           /* all blocks in, CRC-32 running */
+    UPDATE_DONE,                /* image staged and verified */
+    UPDATE_FAILED               /* see update_error_t */
+} update_state_t;
+
+typedef enum {
+    UPDATE_ERR_NONE = 0,
+    UPDATE_ERR_PROGRAM,         /* a half-word did not program */
+    UPDATE_ERR_CRC              /* staged image does not match the CRC-32 */
+} update_error_t;
+
+typedef struct {
+    uint8_t  state;             /* update_state_t */
+    uint8_t  error;             /* update_error_t */
+    uint8_t  tag;
+    uint16_t blocks;
+    uint16_t missing;
+    uint32_t size;
+    uint32_t frames;            /* image frames taken this session */
+    uint32_t stale;             /* frames of another tag or outside the image */
+} update_status_t;
+
+/* ===== Public API ===== */
+
+void Update_Module_Init(void);
+
+/**
+ * Start a session: erase the staging area, then accept the image frames of
+ * `tag`. A running session is abandoned.
+ *
+ * Returns:
+ *  - HAL_ERROR if the image does not fit the staging area or the staging
+ *    area is not in this device's flash, or tag > 7.
+ */
+HAL_StatusTypeDef Update_Module_Start(uint8_t tag, uint32_t size, uint32_t crc32);
+
+/**
+ * Leave update mode. The staging area keeps what was written.
+ */
+void Update_Module_Abort(void);
+
+/**
+ * True from Start until Abort (including DONE and FAILED): data frames are
+ * suspended meanwhile.
+ */
+bool Update_Module_Is_Active(void);
+
+/**
+ * Take an image frame. Returns true if the frame was on UPDATE_MCAST_ID
+ * (consumed even when not in update mode).
+ */
+bool Update_Module_Handle_Frame(uint16_t std_id, const uint8_t *data, uint8_t dlc);
+
+void Update_Module_Get_Status(update_status_t *out);
+
+/**
+ * Copy the missing-block bitmap (UPDATE_BITMAP_BYTES, bit b of byte b/8
+ * set while block b is missing).
+ */
+void Update_Module_Get_Missing(uint8_t *out);
+
+/**
+ * Erase one page of the staging area or check one chunk of the CRC-32.
+ * Call from the main loop.
+ */
+void Update_Module_Task(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* UPDATE_MODULE_H */
@@ -0,0 +1,136 @@
+/* xcp_module.h
+ *
+ * Minimal XCP-on-CAN slave for STM32F042 (measurement only).
+ * This header pairs with xcp_module.c and exposes:
+ *  - Command processing for CONNECT, DISCONNECT, GET_STATUS, SYNCH,
+ *    GET_COMM_MODE_INFO, SET_MTA, UPLOAD and SHORT_UPLOAD
+ *  - Predefined (static) and dynamically allocated DAQ lists
+ *  - Event channels that sample ODTs into a small DTO queue
+ *  - A task that drains queued DTOs straight into free TX mailboxes
+ *
+ * Notes:
+ *  - CRO (master -> slave) is received on Id_Plan_Module_Std_Id(XCP_CRO_ID_OFFSET).
+ *  - DTO (slave -> master, responses and DAQ) is sent on Id_Plan_Module_Std_Id(XCP_DTO_ID_OFFSET).
+ *  - Byte order is Intel (little-endian), address granularity is BYTE.
+ *  - All DAQ storage is statically sized below; nothing is heap allocated.
+ *  - Built only with XCP_ENABLE 1 (about 3.5 KB flash, 0.5 KB RAM). With 0
+ *    the API is kept as empty stubs and CRO frames are not consumed.
+ */
+
+#ifndef XCP_MODULE_H
+#define XCP_MODULE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/* ===== Configuration (override before including if needed) ===== */
+
+/* 0: no XCP slave. The default STM32F042K6 image, UDS included, leaves
+   about 1 KB of its 32 KB, so XCP only fits an image built with
+   UDS_ENABLE 0 (see the README build options). */
+#ifndef XCP_ENABLE
+#define XCP_ENABLE              0
+#endif
+
+/* CAN ID offsets relative to the node ID. */
+#ifndef XCP_CRO_ID_OFFSET
+#define XCP_CRO_ID_OFFSET       0x7u
+#endif
+#ifndef XCP_DTO_ID_OFFSET
+#define XCP_DTO_ID_OFFSET       0x8u
+#endif
+
+/* DAQ resources shared by predefined and dynamic lists. */
+#ifndef XCP_MAX_DAQ
+#define XCP_MAX_DAQ             4u    /* DAQ lists in total */
+#endif
+#ifndef XCP_MAX_ODT
+#define XCP_MAX_ODT             16u   /* ODTs in total (one DTO frame each) */
+#endif
+#ifndef XCP_MAX_ODT_ENTRIES
+#define XCP_MAX_ODT_ENTRIES     48u   /* ODT entries in total */
+#endif
+
+/* Number of sampled DTO frames that can wait for a TX mailbox. */
+#ifndef XCP_DTO_QUEUE_LEN
+#define XCP_DTO_QUEUE_LEN       16u
+#endif
+
+/* Event channels. */
+#define XCP_EVENT_ADC_SCAN      0u    /* ADC DMA scan complete (interrupt context) */
+#define XCP_EVENT_PROCESS       1u    /* Process_Signals_Update() finished (main loop) */
+#define XCP_MAX_EVENT_CHANNEL   2u
+
+/* One entry of a predefined DAQ list, supplied by the application at init. */
+typedef struct {
+    const void *addr;   /* start of the measured object */
+    uint8_t     size;   /* bytes, 1..7 */
+} xcp_daq_entry_t;
+
+/* Refreshes the objects the predefined list's entries point at, right before
+ * the list is sampled (e.g. copies a published snapshot). Runs with
+ * interrupts masked, in the context of the event. */
+typedef void (*xcp_daq_refresh_t)(void);
+
+/* ===== Public API ===== */
+
+/**
+ * Initialize the XCP slave and install an optional predefined DAQ list.
+ *
+ * The predefined list becomes DAQ list 0 (MIN_DAQ = 1). Its entries are packed
+ * greedily into as many ODTs as needed; it survives FREE_DAQ and is bound to
+ * the given event channel with prescaler 1 until the master changes its mode.
+ *
+ * Parameters:
+ *  - entries: Array of predefined entries, or NULL for no predefined list.
+ *  - count: Number of entries.
+ *  - event_channel: One of XCP_EVENT_xxx for the predefined list.
+ *  - refresh: Called before each sample of the predefined list, or NULL to
+ *    sample the entries in place.
+ */
+void XCP_Module_Init(const xcp_daq_entry_t *entries, size_t count, uint8_t event_channel,
+                     xcp_daq_refresh_t refresh);
+
+/**
+ * Offer a received CAN frame to the XCP slave.
+ *
+ * Parameters:
+ *  - std_id: 11-bit Standard ID of the frame.
+ *  - data: Payload bytes.
+ *  - dlc: Number of payload bytes.
+ *
+ * Returns:
+ *  - true if the frame was addressed to XCP (and consumed), false otherwise.
+ */
+bool XCP_Module_Handle_Frame(uint16_t std_id, const uint8_t *data, uint8_t dlc);
+
+/**
+ * Signal an event channel. Samples every running DAQ list bound to it whose
+ * prescaler has elapsed. Safe to call from interrupt context.
+ *
+ * Parameters:
+ *  - event_channel: One of XCP_EVENT_xxx.
+ */
+void XCP_Module_Event(uint8_t event_channel);
+
+/**
+ * Move queued DTOs into free TX mailboxes without waiting.
+ * Call from the main loop.
+ */
+void XCP_Module_Task(void);
+
+/**
+ * Get the number of DTOs dropped because the queue was full.
+ */
+uint32_t XCP_Module_Get_Overrun_Count(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* XCP_MODULE_H */
@@ -4,51 +4,49 @@
 // Static DMA target buffer (one sample per channel)
 static volatile uint16_t s_adc_raw[ADC_MODULE_NUM_CHANNELS] = {0};
 
+// Handle passed to ADC_Module_Init (needed for recalibration)
+static ADC_HandleTypeDef *s_hadc = NULL;
+
+// Completed DMA scans, counted from the DMA interrupt
+static volatile uint32_t s_scan_count = 0;
+
+// Start the circular DMA scan. Only scan complete is used, so the half-transfer
+// interrupt HAL_ADC_Start_DMA enables is turned off: half the DMA interrupts.
+static HAL_StatusTypeDef start_dma(ADC_HandleTypeDef *hadc_handle)
+{
+    if (HAL_ADC_Start_DMA(hadc_handle, (uint32_t*)s_adc_raw, ADC_MODULE_NUM_CHANNELS) != HAL_OK) {
+        return HAL_ERROR;
+    }
+    if (hadc_handle->DMA_Handle != NULL) {
+        __HAL_DMA_DISABLE_IT(hadc_handle->DMA_Handle, DMA_IT_HT);
+    }
+    return HAL_OK;
+}
+
 HAL_StatusTypeDef ADC_Module_Init(ADC_HandleTypeDef *hadc_handle)
 {
     if (hadc_handle == NULL) {
         return HAL_ERROR;
     }
+    s_hadc = hadc_handle;
 
-    // Ensure the dedicated ADC clock is on (HSI14)
-    __HAL_RCC_HSI14_ENABLE();
-    while (__HAL_RCC_GET_FLAG(RCC_FLAG_HSI14RDY) == RESET) {
-    	// wait until HSI14 is ready
-    }
+    // MX_ADC_Init() already set up continuous forward scan of ADC_IN0 .. ADC_IN7
+    // (239.5 cycles, end of sequence, circular DMA requests); re-initializing and
+    // re-adding the channels here only cost boot time. Calibrate and start.
 
-    HAL_Delay(1);
+    // The dedicated ADC clock (HSI14) is started by SystemClock_Config(); only
+    // wait for it if it is not running yet.
+    if (__HAL_RCC_GET_FLAG(RCC_FLAG_HSI14RDY) == RESET) {
+        __HAL_RCC_HSI14_ENABLE();
+        while (__HAL_RCC_GET_FLAG(RCC_FLAG_HSI14RDY) == RESET) {
+            // wait until HSI14 is ready
+        }
+    }
 
     if (HAL_ADCEx_Calibration_Start(hadc_handle) != HAL_OK) {
         return HAL_ERROR;
     }
 
-    // Continuous mode and scan-forward should be set in Init
-    hadc_handle->Init.ContinuousConvMode = ENABLE;
-    hadc_handle->Init.ScanConvMode       = ADC_SCAN_DIRECTION_FORWARD;
-    hadc_handle->Init.EOCSelection       = ADC_EOC_SEQ_CONV;
-
-    // Re-init to apply changes to the HAL state machine if needed
-    if (HAL_ADC_Init(hadc_handle) != HAL_OK) return HAL_ERROR;
-
-    // Enable DMA from ADC and set ADC to circular DMA mode
-    hadc_handle->Instance->CFGR1 |= (ADC_CFGR1_DMAEN | ADC_CFGR1_DMACFG | ADC_CFGR1_OVRMOD);
-
-    // Configure channels ADC_IN0 .. ADC_IN7 into the regular sequence.
-    // On STM32F0, "rank equals channel number"; setting Rank to ADC_RANK_CHANNEL_NUMBER
-    // adds/removes the channel from the CHSELR. SamplingTime here applies to the group.
-    hadc_handle->Instance->CHSELR = 0;
-    ADC_ChannelConfTypeDef s_config = {0};
-    s_config.Rank = ADC_RANK_CHANNEL_NUMBER;
-    s_config.SamplingTime = ADC_SAMPLETIME_239CYCLES_5;
-
-    // Add channels 0..7
-    for (uint32_t ch = 0; ch < ADC_MODULE_NUM_CHANNELS; ++ch) {
-        s_config.Channel = ADC_CHANNEL_0 + ch; // sequential enum for CH0..CH7
-        if (HAL_ADC_ConfigChannel(hadc_handle, &s_config) != HAL_OK) {
-            return HAL_ERROR;
-        }
-    }
-
     // Start ADC in DMA circular mode
     // Ensure your CubeMX DMA config for ADC is:
     // - Direction: Peripheral-to-Memory
@@ -56,13 +54,23 @@ HAL_StatusTypeDef ADC_Module_Init(ADC_HandleTypeDef *hadc_handle)
     // - Peripheral increment: Disable
     // - Memory increment: Enable
     // - Data alignment: Halfword (16-bit)
-    if (HAL_ADC_Start_DMA(hadc_handle, (uint32_t*)s_adc_raw, ADC_MODULE_NUM_CHANNELS) != HAL_OK) {
+    if (start_dma(hadc_handle) != HAL_OK) {
         return HAL_ERROR;
     }
 
     return HAL_OK;
 }
 
+void ADC_Module_Scan_Complete(void)
+{
+    s_scan_count++;
+}
+
+uint32_t ADC_Module_Get_Scan_Count(void)
+{
+    return s_scan_count;
+}
+
 uint16_t ADC_Module_Get_Raw(uint8_t channel_index)
 {
     if (channel_index >= ADC_MODULE_NUM_CHANNELS) {
@@ -76,6 +84,25 @@ const volatile uint16_t* ADC_Module_Get_Buffer(void)
     return s_adc_raw;
 }
 
+HAL_StatusTypeDef ADC_Module_Recalibrate(void)
+{
+    if (s_hadc == NULL) {
+        return HAL_ERROR;
+    }
+
+    // Calibration requires the ADC to be disabled
+    if (HAL_ADC_Stop_DMA(s_hadc) != HAL_OK) {
+        return HAL_ERROR;
+    }
+    if (HAL_ADCEx_Calibration_Start(s_hadc) != HAL_OK) {
+        return HAL_ERROR;
+    }
+    if (start_dma(s_hadc) != HAL_OK) {
+        return HAL_ERROR;
+    }
+    return HAL_OK;
+}
+
 HAL_StatusTypeDef ADC_Module_Stop(ADC_HandleTypeDef *hadc_handle)
 {
     if (hadc_handle == NULL) {
@@ -0,0 +1,267 @@
+/* backfill_module.c
+ *
+ * Backfill ring: delta-compressed samples, overflow by dropping the oldest,
+ * and the paced replay on node_id + 0xC.
+ */
+
+#include "backfill_module.h"
+#include "can_module.h"
+#include "id_plan_module.h"
+#include "process_signals.h"
+
+#include <string.h>
+
+#if BACKFILL_ENABLE
+
+/* ===== Layout ===== */
+
+#define BACKFILL_PARTS          3u
+#define BACKFILL_SEQ_MASK       0x3Fu
+
+/* dt (5) + mask (1) + a 3-byte delta per channel */
+#define BACKFILL_MAX_RECORD     (6u + 3u * PS_NUM_CHANNELS)
+
+#if PS_NUM_CHANNELS != 8u
+#error "backfill frames and the change mask are laid out for 8 channels"
+#endif
+
+#if BACKFILL_BUF_SIZE < BACKFILL_MAX_RECORD || BACKFILL_BUF_SIZE > 0xFFFFu
+#error "BACKFILL_BUF_SIZE must hold one record and fit 16 bits"
+#endif
+
+typedef struct {
+    uint32_t time_ms;
+    uint16_t mV[PS_NUM_CHANNELS];
+} backfill_sample_t;
+
+/* ===== Private state ===== */
+
+static uint8_t  s_buf[BACKFILL_BUF_SIZE];
+static uint16_t s_head = 0u;                /* next byte written */
+static uint16_t s_tail = 0u;                /* oldest record */
+static uint16_t s_used = 0u;
+
+/* Sample before the oldest record (the base its deltas apply to) and the
+ * newest sample (the base of the next record). */
+static backfill_sample_t s_base;
+static backfill_sample_t s_last;
+
+/* Sample being replayed, part by part. */
+static backfill_sample_t s_tx;
+static uint8_t  s_tx_part = BACKFILL_PARTS; /* BACKFILL_PARTS: none */
+static uint8_t  s_tx_seq = 0u;
+static uint32_t s_tx_tick = 0u;
+
+/* Sample of the last live send that queued, until it is known to be out
+ * or has been stored. */
+static backfill_sample_t s_prev;
+static bool     s_prev_valid = false;
+
+static bool     s_live_ok = true;
+static backfill_stats_t s_stats;
+
+/* ===== Helpers ===== */
+
+static void put_u16_be(uint8_t *p, uint16_t v)
+{
+    p[0] = (uint8_t)(v >> 8);
+    p[1] = (uint8_t)v;
+}
+
+static uint8_t encode_varint(uint8_t *p, uint32_t v)
+{
+    uint8_t n = 0u;
+    while (v >= 0x80u) {
+        p[n++] = (uint8_t)(v | 0x80u);
+        v >>= 7;
+    }
+    p[n++] = (uint8_t)v;
+    return n;
+}
+
+static uint8_t next_byte(void)
+{
+    const uint8_t b = s_buf[s_tail];
+    s_tail = (uint16_t)((s_tail + 1u) % BACKFILL_BUF_SIZE);
+    s_used--;
+    return b;
+}
+
+static uint32_t decode_varint(void)
+{
+    uint32_t v = 0u;
+    uint8_t shift = 0u;
+    uint8_t b;
+    do {
+        b = next_byte();
+        v |= (uint32_t)(b & 0x7Fu) << shift;
+        shift += 7u;
+    } while ((b & 0x80u) != 0u);
+    return v;
+}
+
+/* Removes the oldest record, applying it to s_base. */
+static void pop(void)
+{
+    s_base.time_ms += decode_varint();
+    const uint8_t mask = next_byte();
+    for (uint8_t ch = 0u; ch < PS_NUM_CHANNELS; ++ch) {
+        if ((mask & (1u << ch)) != 0u) {
+            const uint32_t z = decode_varint();
+            const int32_t d = (int32_t)(z >> 1) ^ -(int32_t)(z & 1u);
+            s_base.mV[ch] = (uint16_t)(s_base.mV[ch] + d);
+        }
+    }
+    s_stats.pending--;
+}
+
+static void push(const backfill_sample_t *sample)
+{
+    if (s_stats.pending == 0u) {
+        s_base = *sample;
+        s_last = *sample;
+    }
+    uint8_t rec[BACKFILL_MAX_RECORD];
+    uint8_t len = encode_varint(rec, sample->time_ms - s_last.time_ms);
+    const uint8_t mask_pos = len++;
+    uint8_t mask = 0u;
+    for (uint8_t ch = 0u; ch < PS_NUM_CHANNELS; ++ch) {
+        const int32_t d = (int32_t)sample->mV[ch] - (int32_t)s_last.mV[ch];
+        if (d != 0) {
+            mask |= (uint8_t)(1u << ch);
+            len += encode_varint(&rec[len], ((uint32_t)d << 1) ^ (uint32_t)(d >> 31));
+        }
+    }
+    rec[mask_pos] = mask;
+
+    while (BACKFILL_BUF_SIZE - s_used < len) {
+        pop();
+        s_stats.dropped++;
+    }
+    for (uint8_t k = 0u; k < len; ++k) {
+        s_buf[s_head] = rec[k];
+        s_head = (uint16_t)((s_head + 1u) % BACKFILL_BUF_SIZE);
+    }
+    s_used = (uint16_t)(s_used + len);
+    s_last = *sample;
+    s_stats.pending++;
+    s_stats.stored++;
+}
+
+static bool bus_usable(void)
+{
+    return s_live_ok && (CAN_Module_Get_Esr() & CAN_ESR_BOFF) == 0u && CAN_Module_Get_Tx_Free() >= 2u;
+}
+
+static HAL_StatusTypeDef send_part(void)
+{
+    uint8_t data[8] = {0};
+    uint8_t dlc = 7u;
+    data[0] = (uint8_t)((s_tx_part << 6) | (s_tx_seq & BACKFILL_SEQ_MASK));
+    if (s_tx_part == 0u) {
+        data[1] = (uint8_t)(s_tx.time_ms >> 16);
+        data[2] = (uint8_t)(s_tx.time_ms >> 8);
+        data[3] = (uint8_t)s_tx.time_ms;
+        put_u16_be(&data[4], s_tx.mV[0]);
+        put_u16_be(&data[6], s_tx.mV[1]);
+        dlc = 8u;
+    } else {
+        const uint8_t first = (uint8_t)(2u + 3u * (s_tx_part - 1u));
+        for (uint8_t k = 0u; k < 3u; ++k) {
+            put_u16_be(&data[1u + 2u * k], s_tx.mV[first + k]);
+        }
+    }
+    const uint16_t id = Id_Plan_Module_Std_Id(BACKFILL_ID_OFFSET);
+    return CAN_Module_Send_Std(id, data, dlc, 0u);
+}
+
+/* ===== Public API ===== */
+
+void Backfill_Module_Init(void)
+{
+    s_head = 0u;
+    s_tail = 0u;
+    s_used = 0u;
+    s_tx_part = BACKFILL_PARTS;
+    s_tx_seq = 0u;
+    s_prev_valid = false;
+    s_live_ok = true;
+    memset(&s_stats, 0, sizeof(s_stats));
+}
+
+void Backfill_Module_Record(HAL_StatusTypeDef live_status, bool replaced)
+{
+    if (replaced && s_prev_valid) {
+        push(&s_prev);
+    }
+    s_live_ok = (live_status == HAL_OK) && !replaced;
+
+    backfill_sample_t sample;
+    sample.time_ms = HAL_GetTick();
+    Process_Signals_Get_All_Input_mV(sample.mV);
+    if (live_status == HAL_OK) {
+        s_prev = sample;
+        s_prev_valid = true;
+    } else {
+        push(&sample);
+        s_prev_valid = false;
+    }
+}
+
+void Backfill_Module_Get_Stats(backfill_stats_t *out)
+{
+    if (out == NULL) {
+        return;
+    }
+    *out = s_stats;
+    out->bytes = s_used;
+}
+
+void Backfill_Module_Task(void)
+{
+    if (s_tx_part == BACKFILL_PARTS && s_stats.pending == 0u) {
+        return;
+    }
+    const uint32_t now = HAL_GetTick();
+    if ((now - s_tx_tick) < BACKFILL_DRAIN_INTERVAL_MS || !bus_usable()) {
+        return;
+    }
+    if (s_tx_part == BACKFILL_PARTS) {
+        pop();
+        s_tx = s_base;
+        s_tx_part = 0u;
+    }
+    if (send_part() != HAL_OK) {
+        return;
+    }
+    s_tx_tick = now;
+    if (++s_tx_part == BACKFILL_PARTS) {
+        s_tx_seq++;
+        s_stats.sent++;
+    }
+}
+
+#else
+
+void Backfill_Module_Init(void)
+{
+}
+
+void Backfill_Module_Record(HAL_StatusTypeDef live_status, bool replaced)
+{
+    (void)live_status;
+    (void)replaced;
+}
+
+void Backfill_Module_Get_Stats(backfill_stats_t *out)
+{
+    if (out != NULL) {
+        memset(out, 0, sizeof(*out));
+    }
+}
+
+void Backfill_Module_Task(void)
+{
+}
+
+#endif
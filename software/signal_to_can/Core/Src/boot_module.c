@@ -0,0 +1,62 @@
+/* boot_module.c
+ *
+ * Boot-phase timestamps and the one-shot Boot Report frame.
+ */
+
+#include "boot_module.h"
+#include "timebase_module.h"
+#include "can_module.h"
+#include "id_plan_module.h"
+
+/* ===== Private state ===== */
+
+/* 0 = not reached; a phase completing at exactly 0 us is stored as 1 us. */
+static volatile uint32_t s_phase_us[BOOT_NUM_PHASES];
+static bool s_report_sent = false;
+
+/* ===== Helpers ===== */
+
+static void put_u16_sat_be(uint8_t *p, uint32_t v)
+{
+    const uint16_t s = (v > 0xFFFFu) ? 0xFFFFu : (uint16_t)v;
+    p[0] = (uint8_t)(s >> 8);
+    p[1] = (uint8_t)(s & 0xFFu);
+}
+
+/* ===== Public API ===== */
+
+void Boot_Module_Mark(boot_phase_t phase)
+{
+    if ((uint32_t)phase >= BOOT_NUM_PHASES || s_phase_us[phase] != 0u) {
+        return;
+    }
+    const uint32_t now = Timebase_Module_Now_Us();
+    s_phase_us[phase] = (now != 0u) ? now : 1u;
+}
+
+bool Boot_Module_Is_Marked(boot_phase_t phase)
+{
+    return ((uint32_t)phase < BOOT_NUM_PHASES) && (s_phase_us[phase] != 0u);
+}
+
+uint32_t Boot_Module_Get_Us(boot_phase_t phase)
+{
+    return ((uint32_t)phase < BOOT_NUM_PHASES) ? s_phase_us[phase] : 0u;
+}
+
+void Boot_Module_Task(void)
+{
+    if (s_report_sent || !Boot_Module_Is_Marked(BOOT_PHASE_FIRST_FRAME)) {
+        return;
+    }
+    uint8_t frame[BOOT_REPORT_DLC];
+    put_u16_sat_be(&frame[0], s_phase_us[BOOT_PHASE_CLOCK]);
+    put_u16_sat_be(&frame[2], s_phase_us[BOOT_PHASE_CAN]);
+    put_u16_sat_be(&frame[4], s_phase_us[BOOT_PHASE_FIRST_FRAME]);
+
+    /* Never wait for a mailbox: data frames come first, retry next pass. */
+    const uint16_t id = Id_Plan_Module_Std_Id(BOOT_REPORT_ID_OFFSET);
+    if (CAN_Module_Send_Std(id, frame, BOOT_REPORT_DLC, 0u) == HAL_OK) {
+        s_report_sent = true;
+    }
+}
@@ -0,0 +1,253 @@
+/* can_diag_module.c
+ *
+ * Error interrupt accounting, TEC/REC windows and the Bus Health frame.
+ */
+
+#include "can_diag_module.h"
+#include "can_module.h"
+#include "id_plan_module.h"
+#include "event_log_module.h"
+
+#include <string.h>
+
+/* ===== Private state ===== */
+
+/* Written by the error interrupt. */
+static volatile uint32_t s_lec[CAN_DIAG_NUM_LEC];
+static volatile uint32_t s_entries[3];          /* warning, passive, bus-off */
+static volatile uint32_t s_tx_failures = 0u;
+static volatile uint8_t  s_state = 0u;          /* CAN_DIAG_STATE_xxx last seen */
+
+/* Window being measured; the interrupt adds errors and states. */
+static volatile uint16_t s_win_lec[CAN_DIAG_NUM_LEC];
+static volatile uint16_t s_win_errors = 0u;
+static volatile uint8_t  s_win_states = 0u;
+static volatile uint8_t  s_win_tec_max = 0u;
+static volatile uint8_t  s_win_rec_max = 0u;
+static uint32_t s_win_start_tick = 0u;
+
+/* Closed windows, s_head is the next slot to write. */
+static can_diag_window_t s_windows[CAN_DIAG_NUM_WINDOWS];
+static uint8_t s_head = 0u;
+static uint8_t s_closed = 0u;
+
+/* HAL error code bit of each LEC. */
+static const uint32_t s_lec_error_code[CAN_DIAG_NUM_LEC] = {
+    0u,
+    HAL_CAN_ERROR_STF,
+    HAL_CAN_ERROR_FOR,
+    HAL_CAN_ERROR_ACK,
+    HAL_CAN_ERROR_BR,
+    HAL_CAN_ERROR_BD,
+    HAL_CAN_ERROR_CRC,
+};
+
+/* ===== Helpers ===== */
+
+static uint8_t state_of(uint32_t esr)
+{
+    uint8_t state = 0u;
+    if ((esr & CAN_ESR_EWGF) != 0u) state |= CAN_DIAG_STATE_WARNING;
+    if ((esr & CAN_ESR_EPVF) != 0u) state |= CAN_DIAG_STATE_PASSIVE;
+    if ((esr & CAN_ESR_BOFF) != 0u) state |= CAN_DIAG_STATE_BUS_OFF;
+    return state;
+}
+
+static uint8_t tec_of(uint32_t esr)
+{
+    return (uint8_t)((esr & CAN_ESR_TEC) >> CAN_ESR_TEC_Pos);
+}
+
+static uint8_t rec_of(uint32_t esr)
+{
+    return (uint8_t)((esr & CAN_ESR_REC) >> CAN_ESR_REC_Pos);
+}
+
+static void track_peaks(uint32_t esr)
+{
+    const uint8_t tec = tec_of(esr);
+    const uint8_t rec = rec_of(esr);
+    if (tec > s_win_tec_max) s_win_tec_max = tec;
+    if (rec > s_win_rec_max) s_win_rec_max = rec;
+}
+
+static void close_window(uint32_t esr)
+{
+    can_diag_window_t *w = &s_windows[s_head];
+    uint16_t lec[CAN_DIAG_NUM_LEC];
+
+    /* Take the interrupt's share of the window in one piece. */
+    const uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    for (uint8_t i = 0u; i < CAN_DIAG_NUM_LEC; ++i) {
+        lec[i] = s_win_lec[i];
+        s_win_lec[i] = 0u;
+    }
+    w->states = (uint8_t)(s_win_states | state_of(esr));
+    s_win_states = 0u;
+    s_win_errors = 0u;
+    __set_PRIMASK(primask);
+
+    /* A new window gets the error code interrupt back. */
+    if ((w->states & CAN_DIAG_STATE_CAPPED) != 0u) {
+        CAN_Module_Set_Lec_Irq(true);
+    }
+
+    uint32_t errors = 0u;
+    uint8_t top = CAN_DIAG_LEC_NONE;
+    for (uint8_t i = 1u; i < CAN_DIAG_NUM_LEC; ++i) {
+        errors += lec[i];
+        if (lec[i] > lec[top]) {
+            top = i;
+        }
+    }
+    w->errors = (errors > 0xFFFFu) ? 0xFFFFu : (uint16_t)errors;
+    w->top_lec = top;
+    w->tec_max = s_win_tec_max;
+    w->rec_max = s_win_rec_max;
+    w->tec_end = tec_of(esr);
+    w->rec_end = rec_of(esr);
+
+    s_head = (uint8_t)((s_head + 1u) % CAN_DIAG_NUM_WINDOWS);
+    if (s_closed < CAN_DIAG_NUM_WINDOWS) {
+        s_closed++;
+    }
+    s_win_tec_max = w->tec_end;
+    s_win_rec_max = w->rec_end;
+}
+
+static void send_health(uint32_t esr, const can_diag_window_t *w)
+{
+    uint8_t frame[8];
+    frame[0] = tec_of(esr);
+    frame[1] = rec_of(esr);
+    frame[2] = (uint8_t)(state_of(esr) | (w->states & CAN_DIAG_STATE_CAPPED) | (uint8_t)(w->top_lec << 4));
+    frame[3] = w->tec_max;
+    frame[4] = w->rec_max;
+    frame[5] = (uint8_t)(w->errors >> 8);
+    frame[6] = (uint8_t)(w->errors & 0xFFu);
+    frame[7] = (s_entries[2] > 0xFFu) ? 0xFFu : (uint8_t)s_entries[2];
+
+    const uint16_t id = Id_Plan_Module_Std_Id(CAN_DIAG_HEALTH_ID_OFFSET);
+    (void)CAN_Module_Send_Std(id, frame, 8u, 0u);
+}
+
+/* ===== Public API ===== */
+
+void CAN_Diag_Module_Init(void)
+{
+    CAN_Diag_Module_Reset();
+}
+
+void CAN_Diag_Module_Error_Isr(uint32_t error_code, uint32_t esr)
+{
+    for (uint8_t i = 1u; i < CAN_DIAG_NUM_LEC; ++i) {
+        if ((error_code & s_lec_error_code[i]) != 0u) {
+            s_lec[i]++;
+            s_win_lec[i]++;
+            s_win_errors++;
+        }
+    }
+    /* Every failed attempt raises the interrupt, and automatic retransmission
+     * repeats a frame nobody ACKs back to back: past the budget the error
+     * code interrupt stays off until the window closes. */
+    if (s_win_errors >= CAN_DIAG_LEC_IRQ_BUDGET) {
+        CAN_Module_Set_Lec_Irq(false);
+        s_win_states |= CAN_DIAG_STATE_CAPPED;
+    }
+
+    /* HAL reports warning/passive/bus-off on every interrupt while the flag
+     * is set: count entries only. */
+    const uint8_t state = state_of(esr);
+    const uint8_t entered = (uint8_t)(state & (uint8_t)~s_state);
+    for (uint8_t b = 0u; b < 3u; ++b) {
+        if ((entered & (1u << b)) != 0u) {
+            s_entries[b]++;
+        }
+    }
+    if ((entered & CAN_DIAG_STATE_BUS_OFF) != 0u) {
+        (void)Event_Log_Module_Add(EVENT_LOG_BUS_OFF, rec_of(esr), esr, s_entries[2]);
+    }
+    s_state = state;
+    s_win_states |= state;
+    track_peaks(esr);
+}
+
+void CAN_Diag_Module_Tx_Aborted(bool after_error)
+{
+    if (after_error) {
+        s_tx_failures++;
+    }
+}
+
+void CAN_Diag_Module_Get_Counters(can_diag_counters_t *out)
+{
+    if (out == NULL) return;
+    for (uint8_t i = 0u; i < CAN_DIAG_NUM_LEC; ++i) {
+        out->lec[i] = s_lec[i];
+    }
+    out->warning_entries = s_entries[0];
+    out->passive_entries = s_entries[1];
+    out->bus_off_entries = s_entries[2];
+    out->tx_failures = s_tx_failures;
+}
+
+bool CAN_Diag_Module_Get_Window(uint8_t age, can_diag_window_t *out)
+{
+    if (out == NULL || age >= s_closed) {
+        return false;
+    }
+    const uint8_t i = (uint8_t)((s_head + CAN_DIAG_NUM_WINDOWS - 1u - age) % CAN_DIAG_NUM_WINDOWS);
+    *out = s_windows[i];
+    return true;
+}
+
+void CAN_Diag_Module_Reset(void)
+{
+    const uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    for (uint8_t i = 0u; i < CAN_DIAG_NUM_LEC; ++i) {
+        s_lec[i] = 0u;
+        s_win_lec[i] = 0u;
+    }
+    for (uint8_t b = 0u; b < 3u; ++b) {
+        s_entries[b] = 0u;
+    }
+    s_tx_failures = 0u;
+    s_win_states = 0u;
+    s_win_errors = 0u;
+    __set_PRIMASK(primask);
+    CAN_Module_Set_Lec_Irq(true);
+
+    memset(s_windows, 0, sizeof(s_windows));
+    s_head = 0u;
+    s_closed = 0u;
+    s_win_tec_max = 0u;
+    s_win_rec_max = 0u;
+    s_win_start_tick = HAL_GetTick();
+}
+
+void CAN_Diag_Module_Task(void)
+{
+    const uint32_t esr = CAN_Module_Get_Esr();
+    track_peaks(esr);
+
+    /* Rises are counted by the interrupt; forget states that have ended so
+     * the next rise counts again. */
+    const uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    s_state &= state_of(esr);
+    __set_PRIMASK(primask);
+
+    const uint32_t now = HAL_GetTick();
+    if ((now - s_win_start_tick) < CAN_DIAG_WINDOW_MS) {
+        return;
+    }
+    s_win_start_tick = ((now - s_win_start_tick) < 2u * CAN_DIAG_WINDOW_MS)
+                     ? (s_win_start_tick + CAN_DIAG_WINDOW_MS) : now;
+
+    close_window(esr);
+#if CAN_DIAG_HEALTH_FRAME
+    send_health(esr, &s_windows[(s_head + CAN_DIAG_NUM_WINDOWS - 1u) % CAN_DIAG_NUM_WINDOWS]);
+#endif
+}
@@ -15,6 +15,7 @@
 #include "stm32f0xx_hal_can.h"
 #include <stdint.h>
 #include <stddef.h>
+#include <stdbool.h>
 #include <string.h>
 
 /* ===== Module configuration ===== */
@@ -49,6 +50,12 @@ static uint32_t s_baud_enum = 2u; /* 0=125k, 1=250k, 2=500k, 3=1000k */
 static uint16_t s_filter_ids[CAN_MODULE_MAX_FILTER_IDS];
 static size_t   s_filter_id_count = 0u;
 
+/* TX complete interrupts feed the HAL_CAN_TxMailboxNCompleteCallback hooks;
+ * error interrupts feed HAL_CAN_ErrorCallback (bus error analytics). */
+#define CAN_MODULE_NOTIFICATIONS (CAN_IT_TX_MAILBOX_EMPTY | CAN_IT_ERROR_WARNING | \
+                                  CAN_IT_ERROR_PASSIVE | CAN_IT_BUSOFF | \
+                                  CAN_IT_LAST_ERROR_CODE | CAN_IT_ERROR)
+
 /* ===== Helpers ===== */
 
 /* Encodes an 11-bit Standard ID into the 16-bit filter element format.
@@ -59,37 +66,63 @@ static uint16_t encode_filter16_std_id(uint16_t std_id)
     return (uint16_t)((std_id & 0x7FFu) << 5);
 }
 
-/* Configure CAN bit timing for a 48 MHz CAN kernel clock (typical on F0 when the
- * APB runs at 48 MHz). Uses 16 TQ per bit and ~87.5% sample point.
- *  - 1 Mbps: prescaler 3
- *  - 500 kbps: prescaler 6
- *  - 250 kbps: prescaler 12
- *  - 125 kbps: prescaler 24
- *
- * If your CAN kernel clock is not 48 MHz, adjust these values accordingly.
+/* Bit rate of each baud selector; unknown selectors fall back to 125 kbps. */
+static uint32_t bitrate_of(uint32_t baud_enum)
+{
+    static const uint32_t k_bitrate[] = { 125000u, 250000u, 500000u, 1000000u };
+    return (baud_enum < 4u) ? k_bitrate[baud_enum] : k_bitrate[0];
+}
+
+/* Finds prescaler and time segments for a bit rate at a CAN kernel clock
+ * (PCLK). Prefers 16 TQ per bit, then fewer (down to 8), then more (up to
+ * 25), so 48 MHz gives the classic 16 TQ settings (prescaler 3/6/12/24).
+ * The sample point stays near 87.5%: TS2 = TQ/8 rounded, at least 1.
+ * Returns false if no exact setting exists.
  */
-static void set_bit_timing_for_baud(CAN_HandleTypeDef *hcan, uint32_t baud_enum)
+static bool compute_bit_timing(uint32_t pclk_hz, uint32_t bitrate, uint32_t *prescaler,
+                               uint32_t *ts1, uint32_t *ts2)
 {
-    /* Common time segments: 1 + 13 + 2 = 16 TQ, SJW=1 TQ */
-    hcan->Init.SyncJumpWidth = CAN_SJW_1TQ;
-    hcan->Init.TimeSeg1      = CAN_BS1_13TQ;
-    hcan->Init.TimeSeg2      = CAN_BS2_2TQ;
-
-    switch (baud_enum) {
-    default:
-    case 0: /* 125 kbps */
-        hcan->Init.Prescaler = 24u;
-        break;
-    case 1: /* 250 kbps */
-        hcan->Init.Prescaler = 12u;
-        break;
-    case 2: /* 500 kbps */
-        hcan->Init.Prescaler = 6u;
-        break;
-    case 3: /* 1 Mbps */
-        hcan->Init.Prescaler = 3u;
-        break;
+    static const uint8_t k_tq_order[] = { 16u, 15u, 14u, 13u, 12u, 11u, 10u, 9u, 8u,
+                                          17u, 18u, 19u, 20u, 21u, 22u, 23u, 24u, 25u };
+    for (size_t i = 0u; i < sizeof(k_tq_order); ++i) {
+        const uint32_t tq = k_tq_order[i];
+        if (bitrate == 0u || (pclk_hz % (bitrate * tq)) != 0u) {
+            continue;
+        }
+        const uint32_t presc = pclk_hz / (bitrate * tq);
+        uint32_t seg2 = (tq + 4u) / 8u;
+        if (seg2 < 1u) {
+            seg2 = 1u;
+        }
+        const uint32_t seg1 = tq - 1u - seg2;
+        if (presc < 1u || presc > 1024u || seg1 > 16u || seg2 > 8u) {
+            continue;
+        }
+        *prescaler = presc;
+        *ts1 = seg1;
+        *ts2 = seg2;
+        return true;
+    }
+    return false;
+}
+
+/* Configure CAN bit timing for the current CAN kernel clock (PCLK), so it
+ * follows runtime clock changes. SJW = 1 TQ.
+ * Returns HAL_ERROR, leaving the settings alone, if PCLK cannot time the
+ * bit rate exactly: a node at the wrong bit rate sends error frames and
+ * disturbs the whole bus, so it must stay off it.
+ */
+static HAL_StatusTypeDef set_bit_timing_for_baud(CAN_HandleTypeDef *hcan, uint32_t baud_enum)
+{
+    uint32_t presc, seg1, seg2;
+    if (!compute_bit_timing(HAL_RCC_GetPCLK1Freq(), bitrate_of(baud_enum), &presc, &seg1, &seg2)) {
+        return HAL_ERROR;
     }
+    hcan->Init.SyncJumpWidth = CAN_SJW_1TQ;
+    hcan->Init.TimeSeg1      = (seg1 - 1u) << CAN_BTR_TS1_Pos;
+    hcan->Init.TimeSeg2      = (seg2 - 1u) << CAN_BTR_TS2_Pos;
+    hcan->Init.Prescaler     = presc;
+    return HAL_OK;
 }
 
 /* Applies an "accept all" filter (mask=0) so all STD/EXT frames pass to FIFO0.
@@ -215,6 +248,7 @@ HAL_StatusTypeDef CAN_Module_Init(CAN_HandleTypeDef *hcan, uint32_t baud_enum)
     s_baud_enum = baud_enum;
 
     /* Base init fields. These may be overridden by CubeMX; set key ones here. */
+    const CAN_InitTypeDef cubemx = s_can->Init;
     s_can->Init.Mode = CAN_MODE_NORMAL;
     s_can->Init.TimeTriggeredMode = DISABLE;
     s_can->Init.AutoBusOff = ENABLE;
@@ -223,9 +257,15 @@ HAL_StatusTypeDef CAN_Module_Init(CAN_HandleTypeDef *hcan, uint32_t baud_enum)
     s_can->Init.ReceiveFifoLocked = DISABLE;
     s_can->Init.TransmitFifoPriority = ENABLE;
 
-    set_bit_timing_for_baud(s_can, baud_enum);
+    if (set_bit_timing_for_baud(s_can, baud_enum) != HAL_OK) {
+        return HAL_ERROR;
+    }
 
-    if (HAL_CAN_Init(s_can) != HAL_OK) {
+    /* MX_CAN_Init() already left the controller in initialization mode with
+     * these settings unless the baud rate differs: skip the second init. */
+    const bool same = (s_can->State == HAL_CAN_STATE_READY) &&
+                      (memcmp(&cubemx, &s_can->Init, sizeof(cubemx)) == 0);
+    if (!same && HAL_CAN_Init(s_can) != HAL_OK) {
         return HAL_ERROR;
     }
 
@@ -238,6 +278,10 @@ HAL_StatusTypeDef CAN_Module_Init(CAN_HandleTypeDef *hcan, uint32_t baud_enum)
         return HAL_ERROR;
     }
 
+    if (HAL_CAN_ActivateNotification(s_can, CAN_MODULE_NOTIFICATIONS) != HAL_OK) {
+        return HAL_ERROR;
+    }
+
     return HAL_OK;
 }
 
@@ -253,38 +297,70 @@ uint8_t CAN_Module_Get_Node_Id(void)
     return s_node_id;
 }
 
-/* Updates the CAN baud rate at runtime.
- * This function stops CAN, re-initializes timing, reapplies filters, and restarts CAN.
+/* Leaves the bus: the controller finishes the frame in progress, then enters
+ * initialization mode. Pending mailboxes and the RX FIFO are kept.
  */
-HAL_StatusTypeDef CAN_Module_Update_Baud(uint32_t baud_enum)
+HAL_StatusTypeDef CAN_Module_Suspend(void)
 {
     if (s_can == NULL) {
         return HAL_ERROR;
     }
+    return HAL_CAN_Stop(s_can);
+}
 
-    if (HAL_CAN_Stop(s_can) != HAL_OK) {
+/* Recomputes the bit timing for the current PCLK and stored baud, re-initializes
+ * and rejoins the bus. Filter banks are not touched by initialization mode.
+ * Stays off the bus if PCLK cannot time the baud.
+ */
+HAL_StatusTypeDef CAN_Module_Resume(void)
+{
+    if (s_can == NULL) {
         return HAL_ERROR;
     }
 
-    s_baud_enum = baud_enum;
-    set_bit_timing_for_baud(s_can, baud_enum);
+    if (set_bit_timing_for_baud(s_can, s_baud_enum) != HAL_OK) {
+        return HAL_ERROR;
+    }
 
     if (HAL_CAN_Init(s_can) != HAL_OK) {
         return HAL_ERROR;
     }
 
-    /* Re-apply stored filters (or accept-all if none). */
-    if (reapply_id_list_filters() != HAL_OK) {
+    if (HAL_CAN_Start(s_can) != HAL_OK) {
         return HAL_ERROR;
     }
 
-    if (HAL_CAN_Start(s_can) != HAL_OK) {
+    if (HAL_CAN_ActivateNotification(s_can, CAN_MODULE_NOTIFICATIONS) != HAL_OK) {
         return HAL_ERROR;
     }
 
     return HAL_OK;
 }
 
+/* Updates the CAN baud rate at runtime.
+ * This function stops CAN, re-initializes timing, reapplies filters, and restarts CAN.
+ */
+HAL_StatusTypeDef CAN_Module_Update_Baud(uint32_t baud_enum)
+{
+    uint32_t presc, seg1, seg2;
+    if (!compute_bit_timing(HAL_RCC_GetPCLK1Freq(), bitrate_of(baud_enum), &presc, &seg1, &seg2)) {
+        return HAL_BUSY;    /* not at this clock: keep the old baud on the bus */
+    }
+
+    if (CAN_Module_Suspend() != HAL_OK) {
+        return HAL_ERROR;
+    }
+
+    s_baud_enum = baud_enum;
+
+    /* Re-apply stored filters (or accept-all if none). */
+    if (reapply_id_list_filters() != HAL_OK) {
+        return HAL_ERROR;
+    }
+
+    return CAN_Module_Resume();
+}
+
 /* Programs hardware filters to receive the provided list of Standard IDs.
  * The list is copied into module storage and will be re-applied after baud changes.
  * If id_count is zero, an accept-all filter is applied.
@@ -337,6 +413,15 @@ HAL_StatusTypeDef CAN_Module_Send_Std(uint16_t std_id, const uint8_t *data, uint
     return HAL_CAN_AddTxMessage(s_can, &tx_header, (uint8_t *)data, &mailbox);
 }
 
+/* Reads the identifier register of a TX mailbox; it is left intact after transmission. */
+uint16_t CAN_Module_Get_Tx_Mailbox_Std_Id(uint32_t mailbox)
+{
+    if (s_can == NULL || mailbox > 2u) {
+        return 0xFFFFu;
+    }
+    return (uint16_t)((s_can->Instance->sTxMailBox[mailbox].TIR & CAN_TI0R_STID) >> CAN_TI0R_STID_Pos);
+}
+
 /* Receives a Standard ID data frame from FIFO0 with a simple timeout poll.
  * On success, fills std_id, dlc, and copies payload to data (assumes data has space for 8 bytes).
  * Returns HAL_OK on success, HAL_TIMEOUT if no frame arrived in time.
@@ -377,6 +462,81 @@ HAL_StatusTypeDef CAN_Module_Receive_Std(uint16_t *std_id, uint8_t *data, uint8_
     return HAL_OK;
 }
 
+/* True if no frame is waiting to be sent or to be read. */
+bool CAN_Module_Is_Quiet(void)
+{
+    if (s_can == NULL) {
+        return true;
+    }
+    return HAL_CAN_GetTxMailboxesFreeLevel(s_can) == 3u &&
+           HAL_CAN_GetRxFifoFillLevel(s_can, CAN_MODULE_RX_FIFO) == 0u;
+}
+
+uint32_t CAN_Module_Get_Tx_Free(void)
+{
+    return (s_can != NULL) ? HAL_CAN_GetTxMailboxesFreeLevel(s_can) : 0u;
+}
+
+/* Requests the abort of every mailbox still holding a frame on std_id.
+ * A mailbox waiting for the bus is emptied at once; one on the bus finishes
+ * (or is emptied when the attempt fails). */
+uint32_t CAN_Module_Abort_Std(uint16_t std_id)
+{
+    if (s_can == NULL) {
+        return 0u;
+    }
+    const uint32_t tsr = s_can->Instance->TSR;
+    uint32_t mailboxes = 0u;
+    for (uint32_t m = 0u; m < 3u; ++m) {
+        if ((tsr & (CAN_TSR_TME0 << m)) == 0u && CAN_Module_Get_Tx_Mailbox_Std_Id(m) == (std_id & 0x7FFu)) {
+            mailboxes |= CAN_TX_MAILBOX0 << m;
+        }
+    }
+    if (mailboxes != 0u && HAL_CAN_AbortTxRequest(s_can, mailboxes) != HAL_OK) {
+        return 0u;
+    }
+    return mailboxes;
+}
+
+/* True if the stored baud rate can be timed exactly from this kernel clock. */
+bool CAN_Module_Supports_Clock(uint32_t pclk_hz)
+{
+    uint32_t presc, seg1, seg2;
+    return compute_bit_timing(pclk_hz, bitrate_of(s_baud_enum), &presc, &seg1, &seg2);
+}
+
+/* Returns the bit rate of the stored baud selector. */
+uint32_t CAN_Module_Get_Bitrate(void)
+{
+    return bitrate_of(s_baud_enum);
+}
+
+/* Returns the error status register (TEC, REC, LEC, error state flags). */
+uint32_t CAN_Module_Get_Esr(void)
+{
+    if (s_can == NULL) {
+        return 0u;
+    }
+    return s_can->Instance->ESR;
+}
+
+/* Turns the last error code interrupt on or off. Warning, passive and
+ * bus-off interrupts are not affected. */
+void CAN_Module_Set_Lec_Irq(bool on)
+{
+    if (s_can == NULL) {
+        return;
+    }
+    const uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    if (on) {
+        (void)HAL_CAN_ActivateNotification(s_can, CAN_IT_LAST_ERROR_CODE);
+    } else {
+        (void)HAL_CAN_DeactivateNotification(s_can, CAN_IT_LAST_ERROR_CODE);
+    }
+    __set_PRIMASK(primask);
+}
+
 /* Optional utility: returns the last configured baud enum. */
 uint32_t CAN_Module_Get_Baud_Enum(void)
 {
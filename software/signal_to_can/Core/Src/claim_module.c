@@ -0,0 +1,341 @@
+/* claim_module.c
+ *
+ * Address claim at boot, fallback search, defence and runtime collision
+ * detection.
+ */
+
+#include "claim_module.h"
+#include "can_module.h"
+#include "cmd_module.h"
+#include "event_log_module.h"
+#include "isotp_module.h"
+#include "xcp_module.h"
+
+#include <string.h>
+
+#define CLAIM_KIND_CLAIM        0u
+#define CLAIM_KIND_DEFENCE      1u
+#define CLAIM_KEY_MASK          0xFFFFFFFFFFFFull
+
+#define CLAIM_FALLBACK_COUNT    ((CLAIM_FALLBACK_LAST - CLAIM_FALLBACK_FIRST) / CLAIM_FALLBACK_STEP + 1u)
+
+#if CLAIM_FALLBACK_LAST < CLAIM_FALLBACK_FIRST || CLAIM_FALLBACK_LAST > 0xFFu
+#error "CLAIM_FALLBACK_FIRST .. CLAIM_FALLBACK_LAST must be node IDs"
+#endif
+
+#if ID_PLAN_ENABLE && CLAIM_FALLBACK_LAST >= ID_PLAN_MAX_NODES
+#error "fallback addresses must be node numbers of the class plan"
+#endif
+
+#if (CLAIM_ID_COUNT & (CLAIM_ID_COUNT - 1u)) != 0u || CLAIM_ID_BASE + CLAIM_ID_COUNT > 0x800u
+#error "CLAIM_ID_COUNT must be a power of 2 and the claim IDs must fit 11 bits"
+#endif
+
+#if CLAIM_MAX_ATTEMPTS == 0u || CLAIM_BACKOFF_MS == 0u
+#error "CLAIM_MAX_ATTEMPTS and CLAIM_BACKOFF_MS must not be 0"
+#endif
+
+/* Key bits used per backoff, and backoffs drawn per address. */
+#define CLAIM_BACKOFF_BITS      3u
+#define CLAIM_BACKOFF_DRAWS     (CLAIM_MAX_RETRIES + 1u)
+
+/* ===== Private state ===== */
+
+static claim_state_t s_state = CLAIM_OFF;
+static bool     s_settled = true;
+static volatile bool s_sending = true;      /* data may go out on the address in use */
+static uint64_t s_key = 0u;
+static uint8_t  s_preferred = 0u;
+static uint8_t  s_from = 0u;                /* address before the search or contest */
+static uint8_t  s_attempt = 0u;             /* candidate index, counts on across searches */
+static uint8_t  s_search = 0u;              /* addresses tried in this search */
+static uint8_t  s_retry = 0u;               /* claims withdrawn on this address */
+static volatile bool s_withdrawn = false;   /* set by the error interrupt */
+static uint32_t s_t0 = 0u;                  /* window start */
+static uint32_t s_wait = 0u;                /* listen window length */
+static uint32_t s_recheck_tick = 0u;
+static bool     s_defence_pending = false;
+static bool     s_heard_claim = false;      /* a claim for the address in this contest */
+static claim_stats_t s_stats;
+
+/* ===== Helpers ===== */
+
+/* FNV-1a over the unique device ID, folded to 48 bits. */
+static uint64_t device_key(void)
+{
+    const uint8_t *uid = (const uint8_t *)UID_BASE;
+    uint64_t h = 0xCBF29CE484222325ull;
+    for (uint8_t k = 0u; k < 12u; ++k) {
+        h ^= uid[k];
+        h *= 0x100000001B3ull;
+    }
+    return (h ^ (h >> 48)) & CLAIM_KEY_MASK;
+}
+
+/* Claim ID of an address: the slot is distinct for all addresses of both
+ * plans, so only claims for the same address share an ID. */
+static uint16_t claim_id(uint8_t address)
+{
+    return (uint16_t)(CLAIM_ID_BASE + ((address ^ (address >> 4)) & (CLAIM_ID_COUNT - 1u)));
+}
+
+static uint8_t candidate(uint8_t attempt)
+{
+    if (attempt == 0u) {
+        return s_preferred;
+    }
+    const uint32_t k = (uint32_t)((s_key + attempt - 1u) % CLAIM_FALLBACK_COUNT);
+    return (uint8_t)(CLAIM_FALLBACK_FIRST + k * CLAIM_FALLBACK_STEP);
+}
+
+/* Backoff of the next listen window: key bits not used before on this
+ * address, so two nodes whose claims collided draw apart. */
+static uint32_t backoff(void)
+{
+    const uint32_t draw = (uint32_t)s_attempt * CLAIM_BACKOFF_DRAWS + s_retry;
+    return (uint32_t)((s_key >> ((CLAIM_BACKOFF_BITS * draw) % 46u)) % CLAIM_BACKOFF_MS);
+}
+
+/* Whether std_id is one this node transmits on (every offset of the plan
+ * but the request IDs). */
+static bool is_own_tx_id(uint16_t std_id)
+{
+    for (uint16_t off = 0u; off < ID_PLAN_OFFSETS; ++off) {
+        if (off == CMD_RX_ID_OFFSET || off == XCP_CRO_ID_OFFSET || off == ISOTP_RX_ID_OFFSET) {
+            continue;
+        }
+        if (Id_Plan_Module_Std_Id(off) == std_id) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static HAL_StatusTypeDef send_claim(uint8_t kind)
+{
+    uint8_t data[8];
+    data[0] = CAN_Module_Get_Node_Id();
+    data[1] = kind;
+    for (uint8_t k = 0u; k < 6u; ++k) {
+        data[2u + k] = (uint8_t)(s_key >> (40u - 8u * k));
+    }
+    return CAN_Module_Send_Std(claim_id(data[0]), data, 8u, 0u);
+}
+
+/* Drops the data frames still waiting to go out on the address in use. */
+static void abort_own(void)
+{
+    for (uint16_t off = 0u; off < ID_PLAN_OFFSETS; ++off) {
+        (void)CAN_Module_Abort_Std(Id_Plan_Module_Std_Id(off));
+    }
+}
+
+static void listen(void)
+{
+    s_wait = CLAIM_LISTEN_MS + backoff();
+    s_t0 = HAL_GetTick();
+    s_state = CLAIM_LISTENING;
+}
+
+/* Listen on the address of attempt s_attempt. */
+static void listen_on(void)
+{
+    CAN_Module_Set_Node_Id(candidate(s_attempt));
+    s_retry = 0u;
+    s_stats.attempts = (uint8_t)(s_search + 1u);
+    listen();
+}
+
+static void contest(void)
+{
+    s_t0 = HAL_GetTick();
+    s_heard_claim = false;
+    s_withdrawn = false;
+    s_state = CLAIM_CONTESTING;
+}
+
+static void settle(claim_state_t state)
+{
+    s_state = state;
+    s_settled = true;
+    s_sending = true;
+    const uint8_t node = CAN_Module_Get_Node_Id();
+    if (node != s_from || state == CLAIM_UNVERIFIED) {
+        (void)Event_Log_Module_Add(EVENT_LOG_CONFIG, EVENT_LOG_SRC_CLAIM, claim_id(node),
+                                   ((uint32_t)node << 24) | ((uint32_t)s_from << 16) | ((uint32_t)state << 8));
+    }
+}
+
+/* The address in use is taken by someone else. */
+static void lose(void)
+{
+    s_stats.lost++;
+    s_settled = false;
+    s_sending = false;
+    (void)CAN_Module_Abort_Std(claim_id(CAN_Module_Get_Node_Id()));
+    abort_own();
+    ++s_attempt;
+    if (++s_search < CLAIM_MAX_ATTEMPTS) {
+        listen_on();
+        return;
+    }
+    /* Search exhausted: go on, unverified, on the next address. */
+    CAN_Module_Set_Node_Id(candidate(s_attempt));
+    settle(CLAIM_UNVERIFIED);
+}
+
+/* ===== Public API ===== */
+
+void Claim_Module_Init(uint8_t preferred)
+{
+    memset(&s_stats, 0, sizeof(s_stats));
+    s_preferred = preferred;
+    s_from = preferred;
+    s_defence_pending = false;
+    s_sending = true;
+    s_recheck_tick = HAL_GetTick();
+    CAN_Module_Set_Node_Id(preferred);
+#if CLAIM_ENABLE
+    s_key = device_key();
+    s_attempt = 0u;
+    s_search = 0u;
+    s_settled = false;
+    listen_on();
+#else
+    s_state = CLAIM_OFF;
+    s_settled = true;
+#endif
+}
+
+bool Claim_Module_Handle_Frame(uint16_t std_id, const uint8_t *data, uint8_t dlc)
+{
+    if (s_state == CLAIM_OFF) {
+        return false;
+    }
+    if (!Claim_Module_Is_Claim_Id(std_id)) {
+        if (!is_own_tx_id(std_id)) {
+            return false;
+        }
+        s_stats.collisions++;
+        if (!s_settled) {
+            if (!s_sending) {
+                lose();     /* fallback address in use by a node that did not claim it */
+            }
+        } else if (s_state != CLAIM_CONTESTING && (HAL_GetTick() - s_recheck_tick) >= CLAIM_RECHECK_MS) {
+            /* Claim the address again: an owner that claims defends it, a
+             * node contesting it as well loses or wins on the key. */
+            s_recheck_tick = HAL_GetTick();
+            if (send_claim(CLAIM_KIND_CLAIM) == HAL_OK) {
+                s_search = 0u;  /* a loss moves on to the next candidate, not back to the first */
+                s_from = CAN_Module_Get_Node_Id();
+                contest();
+            }
+        }
+        return false;
+    }
+
+    if (data == NULL || dlc < 8u || data[0] != CAN_Module_Get_Node_Id()) {
+        return true;
+    }
+    uint64_t key = 0u;
+    for (uint8_t k = 0u; k < 6u; ++k) {
+        key = (key << 8) | data[2u + k];
+    }
+    switch (s_state) {
+    case CLAIM_LISTENING:
+        lose();
+        break;
+    case CLAIM_CONTESTING:
+        s_heard_claim = true;
+        if (data[1] == CLAIM_KIND_DEFENCE || key <= s_key) {
+            lose();
+        }
+        break;
+    default:
+        s_defence_pending = true;
+        break;
+    }
+    return true;
+}
+
+bool Claim_Module_Is_Claim_Id(uint16_t std_id)
+{
+    return std_id >= CLAIM_ID_BASE && std_id < CLAIM_ID_BASE + CLAIM_ID_COUNT;
+}
+
+void Claim_Module_Error_Isr(uint32_t error_code)
+{
+    /* Only a transmitter sees bit errors: another node may send the same ID
+     * with other data. A pending claim may have been the frame on the bus,
+     * so it is withdrawn; data on an unclaimed address waits for the claim. */
+    if ((error_code & (HAL_CAN_ERROR_BR | HAL_CAN_ERROR_BD)) == 0u) {
+        return;
+    }
+    if (s_state == CLAIM_CONTESTING && !s_withdrawn &&
+            CAN_Module_Abort_Std(claim_id(CAN_Module_Get_Node_Id())) != 0u) {
+        s_withdrawn = true;
+    }
+    if (!s_settled && s_sending) {
+        s_sending = false;
+        abort_own();
+    }
+}
+
+bool Claim_Module_Can_Send(void)
+{
+    return s_sending;
+}
+
+void Claim_Module_Get_Stats(claim_stats_t *out)
+{
+    if (out == NULL) {
+        return;
+    }
+    *out = s_stats;
+    out->state = (uint8_t)s_state;
+    out->node_id = CAN_Module_Get_Node_Id();
+    out->preferred = s_preferred;
+}
+
+void Claim_Module_Task(void)
+{
+    const uint32_t now = HAL_GetTick();
+    switch (s_state) {
+    case CLAIM_LISTENING:
+        if ((now - s_t0) >= s_wait && send_claim(CLAIM_KIND_CLAIM) == HAL_OK) {
+            contest();
+        }
+        break;
+
+    case CLAIM_CONTESTING:
+        if (s_withdrawn) {
+            /* Tie-break: claim again after a fresh backoff. */
+            if (++s_retry > CLAIM_MAX_RETRIES) {
+                lose();
+            } else {
+                listen();
+            }
+            break;
+        }
+        if ((now - s_t0) < CLAIM_CONTEST_MS) {
+            break;
+        }
+        if (s_settled && !s_heard_claim) {
+            lose();     /* collision contest without an answer: the other node does not claim */
+        } else {
+            settle(CLAIM_OWNED);
+        }
+        break;
+
+    case CLAIM_OWNED:
+    case CLAIM_UNVERIFIED:
+        if (s_defence_pending && send_claim(CLAIM_KIND_DEFENCE) == HAL_OK) {
+            s_defence_pending = false;
+            s_stats.defences++;
+        }
+        break;
+
+    default:
+        break;
+    }
+}
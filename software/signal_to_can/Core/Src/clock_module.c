@@ -0,0 +1,266 @@
+/* clock_module.c
+ *
+ * Performance levels, main loop load measurement and level switching.
+ */
+
+#include "clock_module.h"
+#include "can_module.h"
+#include "timebase_module.h"
+
+/* ===== Levels ===== */
+
+typedef struct {
+    uint8_t  mhz;               /* HCLK = PCLK */
+    uint32_t sysclk_source;     /* RCC_SYSCLKSOURCE_xxx */
+    uint32_t ahb_div;           /* RCC_SYSCLK_DIVx */
+    uint32_t flash_latency;
+} clock_level_t;
+
+/* Fastest first; index 0 is what SystemClock_Config() sets up. */
+static const clock_level_t s_levels[] = {
+    { 48u, RCC_SYSCLKSOURCE_PLLCLK, RCC_SYSCLK_DIV1, FLASH_LATENCY_1 },
+    { 24u, RCC_SYSCLKSOURCE_PLLCLK, RCC_SYSCLK_DIV2, FLASH_LATENCY_0 },
+    {  8u, RCC_SYSCLKSOURCE_HSE,    RCC_SYSCLK_DIV2, FLASH_LATENCY_0 },
+};
+
+#define CLOCK_NUM_LEVELS ((uint8_t)(sizeof(s_levels) / sizeof(s_levels[0])))
+
+/* The main loop must come round before the RX FIFO fills with back-to-back
+ * frames of the shortest kind (DLC 0, including intermission). */
+#define CLOCK_RX_FIFO_DEPTH     3u
+#define CLOCK_MIN_FRAME_BITS    47u
+
+/* ===== Private state ===== */
+
+static uint8_t  s_setting = CLOCK_DEFAULT_SETTING;
+static uint8_t  s_level = 0u;           /* active level */
+static uint8_t  s_target = 0u;          /* level to switch to once CAN is quiet */
+static bool     s_pll_on = true;
+static uint8_t  s_down_votes = 0u;
+static uint32_t s_switches = 0u;
+
+/* Window being measured */
+static uint32_t s_win_start_us = 0u;
+static uint32_t s_pass_start_us = 0u;
+static uint32_t s_passes = 0u;
+static uint32_t s_min_pass_us = UINT32_MAX;
+
+/* Last complete window */
+static uint16_t s_load_permille = 0u;
+static uint32_t s_last_min_pass_us = 0u;
+
+/* ===== Helpers ===== */
+
+static int level_of_mhz(uint8_t mhz)
+{
+    for (uint8_t i = 0u; i < CLOCK_NUM_LEVELS; ++i) {
+        if (s_levels[i].mhz == mhz) {
+            return (int)i;
+        }
+    }
+    return -1;
+}
+
+static void restart_window(uint32_t now)
+{
+    s_win_start_us = now;
+    s_pass_start_us = now;
+    s_passes = 0u;
+    s_min_pass_us = UINT32_MAX;
+}
+
+static HAL_StatusTypeDef set_pll(bool on)
+{
+    RCC_OscInitTypeDef osc = {0};
+    osc.OscillatorType = RCC_OSCILLATORTYPE_NONE;
+    osc.PLL.PLLState = on ? RCC_PLL_ON : RCC_PLL_OFF;
+    osc.PLL.PLLSource = RCC_PLLSOURCE_HSE;
+    osc.PLL.PLLMUL = RCC_PLL_MUL3;
+    osc.PLL.PREDIV = RCC_PREDIV_DIV1;
+    const HAL_StatusTypeDef st = HAL_RCC_OscConfig(&osc);
+    if (st == HAL_OK) {
+        s_pll_on = on;
+    }
+    return st;
+}
+
+/* Whether level i carries the last window's load, scaled from the active level. */
+static bool level_fits(uint8_t i)
+{
+    const uint32_t from = s_levels[s_level].mhz;
+    const uint32_t to = s_levels[i].mhz;
+    if (!CAN_Module_Supports_Clock(to * 1000000u)) {
+        return false;
+    }
+    const uint32_t load = (uint32_t)s_load_permille * from / to;
+    const uint32_t pass_us = s_last_min_pass_us * from / to;
+    const uint32_t deadline_us = CLOCK_RX_FIFO_DEPTH * CLOCK_MIN_FRAME_BITS * 1000000u /
+                                 CAN_Module_Get_Bitrate();
+    return load <= CLOCK_LOAD_TARGET_PERMILLE && pass_us <= deadline_us;
+}
+
+static void choose_level(void)
+{
+    const uint32_t deadline_us = CLOCK_RX_FIFO_DEPTH * CLOCK_MIN_FRAME_BITS * 1000000u /
+                                 CAN_Module_Get_Bitrate();
+    if (s_level != 0u &&
+        (s_load_permille > CLOCK_LOAD_HIGH_PERMILLE || s_last_min_pass_us > deadline_us)) {
+        s_target = 0u;
+        s_down_votes = 0u;
+        return;
+    }
+
+    for (uint8_t i = (uint8_t)(CLOCK_NUM_LEVELS - 1u); i > s_level; --i) {
+        if (level_fits(i)) {
+            if (++s_down_votes >= CLOCK_DOWN_WINDOWS) {
+                s_target = i;
+                s_down_votes = 0u;
+            }
+            return;
+        }
+    }
+    s_down_votes = 0u;
+}
+
+static void switch_level(void)
+{
+    const clock_level_t *to = &s_levels[s_target];
+
+    /* Never leave CAN at a clock that cannot time the bit rate. */
+    if (!CAN_Module_Supports_Clock((uint32_t)to->mhz * 1000000u)) {
+        s_target = s_level;
+        return;
+    }
+
+    /* The PLL locks while the core still runs from HSE, CAN on the bus. */
+    if (to->sysclk_source == RCC_SYSCLKSOURCE_PLLCLK && !s_pll_on) {
+        if (set_pll(true) != HAL_OK) {
+            s_target = s_level;
+            return;
+        }
+    }
+
+    /* Switch between frames: nothing queued, nothing unread. */
+    if (!CAN_Module_Is_Quiet()) {
+        return;
+    }
+    if (CAN_Module_Suspend() != HAL_OK) {
+        s_target = s_level;
+        return;
+    }
+
+    RCC_ClkInitTypeDef clk = {0};
+    clk.ClockType = RCC_CLOCKTYPE_HCLK | RCC_CLOCKTYPE_SYSCLK | RCC_CLOCKTYPE_PCLK1;
+    clk.SYSCLKSource = to->sysclk_source;
+    clk.AHBCLKDivider = to->ahb_div;
+    clk.APB1CLKDivider = RCC_HCLK_DIV1;
+    if (HAL_RCC_ClockConfig(&clk, to->flash_latency) == HAL_OK) {
+        s_level = s_target;
+        s_switches++;
+    } else {
+        s_target = s_level;
+    }
+
+    /* Bit timing follows the new PCLK. */
+    (void)CAN_Module_Resume();
+
+    if (s_levels[s_level].sysclk_source != RCC_SYSCLKSOURCE_PLLCLK && s_pll_on) {
+        (void)set_pll(false);
+    }
+
+    s_down_votes = 0u;
+    restart_window(Timebase_Module_Now_Us());
+}
+
+/* ===== Public API ===== */
+
+void Clock_Module_Init(void)
+{
+    s_level = 0u;
+    s_target = 0u;
+    s_pll_on = true;
+    s_down_votes = 0u;
+    s_switches = 0u;
+    s_load_permille = 0u;
+    s_last_min_pass_us = 0u;
+    restart_window(Timebase_Module_Now_Us());
+    (void)Clock_Module_Set_Setting(CLOCK_DEFAULT_SETTING);
+}
+
+HAL_StatusTypeDef Clock_Module_Set_Setting(uint8_t setting)
+{
+    if (setting == CLOCK_SETTING_AUTO) {
+        s_setting = CLOCK_SETTING_AUTO;
+        s_down_votes = 0u;
+        return HAL_OK;
+    }
+    const int i = level_of_mhz(setting);
+    if (i < 0 || !CAN_Module_Supports_Clock((uint32_t)setting * 1000000u)) {
+        return HAL_ERROR;
+    }
+    s_setting = setting;
+    s_target = (uint8_t)i;
+    return HAL_OK;
+}
+
+uint8_t Clock_Module_Get_Setting(void)
+{
+    return s_setting;
+}
+
+void Clock_Module_Reevaluate(void)
+{
+    if (s_setting == CLOCK_SETTING_AUTO) {
+        s_target = 0u;
+        s_down_votes = 0u;
+    }
+}
+
+uint32_t Clock_Module_Get_Hclk_Hz(void)
+{
+    return (uint32_t)s_levels[s_level].mhz * 1000000u;
+}
+
+uint16_t Clock_Module_Get_Load_Permille(void)
+{
+    return s_load_permille;
+}
+
+uint32_t Clock_Module_Get_Min_Pass_Us(void)
+{
+    return s_last_min_pass_us;
+}
+
+uint32_t Clock_Module_Get_Switch_Count(void)
+{
+    return s_switches;
+}
+
+void Clock_Module_Task(void)
+{
+    const uint32_t now = Timebase_Module_Now_Us();
+    const uint32_t pass_us = now - s_pass_start_us;
+    s_pass_start_us = now;
+    s_passes++;
+    if (pass_us < s_min_pass_us) {
+        s_min_pass_us = pass_us;
+    }
+
+    if (s_target != s_level) {
+        switch_level();
+        return;
+    }
+
+    const uint32_t win_us = now - s_win_start_us;
+    if (win_us < CLOCK_LOAD_WINDOW_MS * 1000u) {
+        return;
+    }
+    const uint64_t idle_us = (uint64_t)s_passes * s_min_pass_us;
+    s_load_permille = (idle_us >= win_us) ? 0u : (uint16_t)((win_us - idle_us) * 1000u / win_us);
+    s_last_min_pass_us = s_min_pass_us;
+    restart_window(now);
+
+    if (s_setting == CLOCK_SETTING_AUTO) {
+        choose_level();
+    }
+}
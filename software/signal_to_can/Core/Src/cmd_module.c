@@ -0,0 +1,462 @@
+/* cmd_module.c
+ *
+ * Configuration command protocol for STM32F042.
+ * This module provides:
+ *  - The README single-command protocol with a 1-byte ack
+ *  - Sequence-numbered commands with duplicate suppression over the last
+ *    32 sequence numbers and coalesced bitmap acks
+ *  - Staged transactions applied in one step on COMMIT
+ *
+ * Every command works on a staging copy of the configuration. Outside a
+ * transaction the copy is refreshed from the live settings, changed and
+ * applied at once; inside one it accumulates until COMMIT or ABORT. Commands
+ * run from Can_Rx_Task() in the main loop, so an applied set is never seen
+ * half-way by Process_Signals_Update().
+ *
+ * Parameter scaling: scale_factor is the gain in 1/1000, offset the offset
+ * in signed mV, oor_min / oor_max and sample_rate as in the README.
+ */
+
+#include "cmd_module.h"
+#include "can_module.h"
+#include "id_plan_module.h"
+#include "process_signals.h"
+#include "clock_module.h"
+#include "event_log_module.h"
+#include "profile_module.h"
+#include <string.h>
+#include <math.h>
+
+/* ===== Private configuration ===== */
+
+#ifndef CMD_RESP_TIMEOUT_MS
+#define CMD_RESP_TIMEOUT_MS     2u
+#endif
+
+/* Sequence numbers whose results are remembered (bits of s_seen / s_ok). */
+#define SEQ_HISTORY             32u
+
+#define SAMPLE_RATE_MAX_HZ      1000u
+#define BAUD_ENUM_MAX           3u
+
+/* ===== Private types and state ===== */
+
+typedef struct {
+    float    gain[PS_NUM_CHANNELS];
+    float    offset[PS_NUM_CHANNELS];       /* V */
+    float    v_min[PS_NUM_CHANNELS];        /* V */
+    float    v_max[PS_NUM_CHANNELS];        /* V */
+    bool     enabled[PS_NUM_CHANNELS];
+    uint32_t sample_period_ms;
+    uint32_t baud_enum;
+} cmd_config_t;
+
+static uint32_t    *s_sample_period = NULL;
+static cmd_config_t s_stage;
+
+/* Transaction */
+static uint8_t  s_txn = CMD_TXN_NONE;
+static uint16_t s_txn_count = 0u;       /* commands staged since BEGIN */
+static uint32_t s_txn_tick = 0u;
+
+/* Sequence window: bit i of s_seen / s_ok is seq s_seq_hi - i */
+static bool     s_seq_valid = false;
+static uint8_t  s_seq_hi = 0u;
+static uint32_t s_seen = 0u;
+static uint32_t s_ok = 0u;
+
+/* Coalesced ack being collected */
+static uint8_t  s_ack_base = 0u;
+static uint8_t  s_ack_count = 0u;
+static uint32_t s_ack_bits = 0u;
+static uint32_t s_ack_tick = 0u;
+static bool     s_ack_now = false;
+
+/* Deferred baud rate change */
+static bool     s_baud_pending = false;
+static uint32_t s_baud_next = 0u;
+static uint32_t s_baud_tick = 0u;
+
+/* ===== Helpers ===== */
+
+static uint16_t get_u16_be(const uint8_t *p)
+{
+    return (uint16_t)(((uint16_t)p[0] << 8) | p[1]);
+}
+
+static void put_u16_be(uint8_t *p, uint16_t v)
+{
+    p[0] = (uint8_t)(v >> 8);
+    p[1] = (uint8_t)(v & 0xFFu);
+}
+
+static void put_u32_be(uint8_t *p, uint32_t v)
+{
+    p[0] = (uint8_t)(v >> 24);
+    p[1] = (uint8_t)(v >> 16);
+    p[2] = (uint8_t)(v >> 8);
+    p[3] = (uint8_t)(v & 0xFFu);
+}
+
+/* Volts to a u16 in thousandths, rounded and saturated. */
+static uint16_t to_milli_u16(float v)
+{
+    const float m = v * 1000.0f;
+    if (!(m > 0.0f)) return 0u;
+    if (m >= 65535.0f) return 65535u;
+    return (uint16_t)(m + 0.5f);
+}
+
+static void send_reply(const uint8_t *data, uint8_t len)
+{
+    const uint16_t id = Id_Plan_Module_Std_Id(CMD_TX_ID_OFFSET);
+    (void)CAN_Module_Send_Std(id, data, len, CMD_RESP_TIMEOUT_MS);
+}
+
+static void load_live(cmd_config_t *cfg)
+{
+    for (uint8_t ch = 0u; ch < PS_NUM_CHANNELS; ++ch) {
+        Process_Signals_Get_GainOffset(ch, &cfg->gain[ch], &cfg->offset[ch]);
+        Process_Signals_Get_MinMax(ch, &cfg->v_min[ch], &cfg->v_max[ch]);
+        cfg->enabled[ch] = Process_Signals_Get_Enabled(ch);
+    }
+    cfg->sample_period_ms = *s_sample_period;
+    cfg->baud_enum = s_baud_pending ? s_baud_next : CAN_Module_Get_Baud_Enum();
+}
+
+static void apply(const cmd_config_t *cfg)
+{
+    for (uint8_t ch = 0u; ch < PS_NUM_CHANNELS; ++ch) {
+        Process_Signals_Set_GainOffset(ch, cfg->gain[ch], cfg->offset[ch]);
+        Process_Signals_Set_MinMax(ch, cfg->v_min[ch], cfg->v_max[ch]);
+        Process_Signals_Set_Enabled(ch, cfg->enabled[ch]);
+    }
+    *s_sample_period = cfg->sample_period_ms;
+    if (cfg->baud_enum != CAN_Module_Get_Baud_Enum()) {
+        s_baud_pending = true;
+        s_baud_next = cfg->baud_enum;
+        s_baud_tick = HAL_GetTick();
+    } else {
+        s_baud_pending = false;
+    }
+    Clock_Module_Reevaluate();
+}
+
+/* Changes the staging copy; returns false if the parameters are invalid. */
+static bool stage_set(uint8_t com, const uint8_t *d)
+{
+    const uint8_t ch = d[0];
+    switch (com) {
+    case CMD_SET_BAUD:
+        if (d[0] > BAUD_ENUM_MAX) {
+            return false;
+        }
+        s_stage.baud_enum = d[0];
+        return true;
+
+    case CMD_SET_SAMPLE_RATE: {
+        const uint16_t rate = get_u16_be(&d[0]);
+        if (rate == 0u || rate > SAMPLE_RATE_MAX_HZ) {
+            return false;
+        }
+        s_stage.sample_period_ms = (1000u + rate / 2u) / rate;
+        return true;
+    }
+
+    case CMD_SET_CHANNEL: {
+        const uint16_t scale = get_u16_be(&d[2]);
+        if (ch >= PS_NUM_CHANNELS || d[1] > 1u || scale == 0u) {
+            return false;
+        }
+        s_stage.enabled[ch] = (d[1] != 0u);
+        s_stage.gain[ch] = (float)scale / 1000.0f;
+        s_stage.offset[ch] = (float)(int16_t)get_u16_be(&d[4]) / 1000.0f;
+        return true;
+    }
+
+    case CMD_SET_CHANNEL_RANGE: {
+        const uint16_t mv_min = get_u16_be(&d[1]);
+        const uint16_t mv_max = get_u16_be(&d[3]);
+        if (ch >= PS_NUM_CHANNELS || mv_min >= mv_max) {
+            return false;
+        }
+        s_stage.v_min[ch] = (float)mv_min / 1000.0f;
+        s_stage.v_max[ch] = (float)mv_max / 1000.0f;
+        return true;
+    }
+
+    default:
+        return false;
+    }
+}
+
+/* Reads a value from the staging copy; returns false if the selection is invalid. */
+static bool stage_get(uint8_t ch, uint8_t sel, uint16_t *value)
+{
+    if (ch >= PS_NUM_CHANNELS && sel != CMD_VALUE_SAMPLE_RATE) {
+        return false;
+    }
+    switch (sel) {
+    case CMD_VALUE_SAMPLE_RATE:
+        *value = (uint16_t)((s_stage.sample_period_ms != 0u) ? 1000u / s_stage.sample_period_ms : 0u);
+        return true;
+    case CMD_VALUE_SCALE:
+        *value = to_milli_u16(s_stage.gain[ch]);
+        return true;
+    case CMD_VALUE_OFFSET: {
+        const float m = s_stage.offset[ch] * 1000.0f;
+        const float c = (m < -32768.0f) ? -32768.0f : (m > 32767.0f) ? 32767.0f : m;
+        *value = (uint16_t)(int16_t)lroundf(c);
+        return true;
+    }
+    case CMD_VALUE_OOR_MIN:
+        *value = to_milli_u16(s_stage.v_min[ch]);
+        return true;
+    case CMD_VALUE_OOR_MAX:
+        *value = to_milli_u16(s_stage.v_max[ch]);
+        return true;
+    default:
+        return false;
+    }
+}
+
+/* Switches to a stored profile; not inside a transaction, whose staging
+ * copy it would bypass. */
+static bool select_profile(uint8_t p)
+{
+    if (s_txn != CMD_TXN_NONE || Profile_Module_Select(p) != HAL_OK) {
+        return false;
+    }
+    (void)Event_Log_Module_Add(EVENT_LOG_CONFIG, EVENT_LOG_SRC_CMD, CMD_SELECT_PROFILE, (uint32_t)p << 24);
+    return true;
+}
+
+/* Runs a configuration command outside or inside a transaction. */
+static bool run_config(uint8_t com, const uint8_t *d, uint16_t *value)
+{
+    if (com == CMD_SELECT_PROFILE) {
+        return select_profile(d[0]);
+    }
+    if (s_txn == CMD_TXN_NONE) {
+        load_live(&s_stage);
+    }
+    if (com == CMD_GET_VALUE) {
+        return stage_get(d[0], d[1], value);
+    }
+    const bool ok = stage_set(com, d);
+    if (s_txn != CMD_TXN_NONE) {
+        s_txn_count++;
+        if (!ok) {
+            s_txn = CMD_TXN_FAILED;
+        }
+    } else if (ok) {
+        apply(&s_stage);
+        (void)Event_Log_Module_Add(EVENT_LOG_CONFIG, EVENT_LOG_SRC_CMD, com,
+                                   (uint32_t)d[0] << 24 | (uint32_t)d[1] << 16 |
+                                   (uint32_t)d[2] << 8 | d[3]);
+    }
+    return ok;
+}
+
+/* Executes one windowed command; GET_VALUE answers with a value frame. */
+static bool run_windowed(uint8_t com, uint8_t seq, const uint8_t *d)
+{
+    if (s_txn != CMD_TXN_NONE) {
+        s_txn_tick = HAL_GetTick();
+    }
+    switch (com) {
+    case CMD_BEGIN:
+        /* Discards a transaction left open by a tester that went away. */
+        load_live(&s_stage);
+        s_txn = CMD_TXN_OPEN;
+        s_txn_count = 0u;
+        s_txn_tick = HAL_GetTick();
+        return true;
+
+    case CMD_COMMIT:
+        if (s_txn != CMD_TXN_OPEN || get_u16_be(&d[0]) != s_txn_count) {
+            return false;
+        }
+        apply(&s_stage);
+        s_txn = CMD_TXN_NONE;
+        (void)Event_Log_Module_Add(EVENT_LOG_CONFIG, EVENT_LOG_SRC_CMD, CMD_COMMIT, s_txn_count);
+        return true;
+
+    case CMD_ABORT:
+        s_txn = CMD_TXN_NONE;
+        return true;
+
+    case CMD_GET_VALUE: {
+        uint16_t value = 0u;
+        const bool ok = run_config(com, d, &value);
+        uint8_t rsp[8] = { CMD_RSP_VALUE, seq, ok ? 1u : 0u, d[0], d[1], 0u, 0u, 0u };
+        put_u16_be(&rsp[5], value);
+        send_reply(rsp, 8u);
+        return ok;
+    }
+
+    default:
+        return run_config(com, d, NULL);
+    }
+}
+
+static void flush_ack(void)
+{
+    if (s_ack_count == 0u) {
+        return;
+    }
+    uint8_t rsp[8] = { CMD_RSP_ACK, s_ack_base, s_ack_count, s_txn, 0u, 0u, 0u, 0u };
+    put_u32_be(&rsp[4], s_ack_bits);
+    send_reply(rsp, 8u);
+    s_ack_count = 0u;
+    s_ack_bits = 0u;
+    s_ack_now = false;
+}
+
+/* Adds a result to the ack being collected; a gap in the sequence starts a new one. */
+static void record_ack(uint8_t seq, bool ok)
+{
+    if (s_ack_count != 0u && (seq != (uint8_t)(s_ack_base + s_ack_count) || s_ack_count >= SEQ_HISTORY)) {
+        flush_ack();
+    }
+    if (s_ack_count == 0u) {
+        s_ack_base = seq;
+        s_ack_tick = HAL_GetTick();
+    }
+    if (ok) {
+        s_ack_bits |= (1uL << s_ack_count);
+    }
+    s_ack_count++;
+}
+
+static void handle_windowed(const uint8_t *data)
+{
+    const uint8_t com = data[0] & CMD_CODE_MASK;
+    const uint8_t seq = data[1];
+    const uint8_t *d = &data[2];
+    bool ok;
+
+    if (com == CMD_SYNC) {
+        flush_ack();                    /* older sequence numbers */
+        s_txn = CMD_TXN_NONE;
+        s_seq_valid = true;
+        s_seq_hi = seq;
+        s_seen = 1u;
+        s_ok = 1u;
+        record_ack(seq, true);
+        s_ack_now = true;
+        return;
+    }
+    if (!s_seq_valid) {
+        s_seq_valid = true;
+        s_seq_hi = (uint8_t)(seq - 1u);
+        s_seen = 0u;
+        s_ok = 0u;
+    }
+
+    const uint8_t ahead = (uint8_t)(seq - s_seq_hi);
+    if (ahead != 0u && ahead < 0x80u) {
+        /* New sequence number: slide the window. */
+        s_seen = (ahead >= SEQ_HISTORY) ? 0u : (s_seen << ahead);
+        s_ok = (ahead >= SEQ_HISTORY) ? 0u : (s_ok << ahead);
+        s_seq_hi = seq;
+        ok = run_windowed(com, seq, d);
+        s_seen |= 1u;
+        s_ok |= ok ? 1u : 0u;
+    } else {
+        const uint8_t back = (uint8_t)(s_seq_hi - seq);
+        const uint32_t bit = (back < SEQ_HISTORY) ? (1uL << back) : 0u;
+        if (bit == 0u) {
+            ok = false;                 /* too old to tell: never run twice */
+        } else if ((s_seen & bit) != 0u) {
+            /* Retransmission: report the stored result, re-send a value. */
+            ok = (s_ok & bit) != 0u;
+            if (com == CMD_GET_VALUE) {
+                (void)run_windowed(com, seq, d);
+            }
+        } else {
+            /* Overtaken by later commands (e.g. lost once and resent). */
+            ok = run_windowed(com, seq, d);
+            s_seen |= bit;
+            s_ok |= ok ? bit : 0u;
+        }
+    }
+
+    if (com == CMD_GET_VALUE) {
+        return;                         /* the value frame is its ack */
+    }
+    record_ack(seq, ok);
+    if ((data[0] & CMD_FLAG_ACK_REQ) != 0u || com == CMD_BEGIN || com == CMD_COMMIT || com == CMD_ABORT) {
+        s_ack_now = true;
+    }
+}
+
+static void handle_legacy(const uint8_t *data, uint8_t dlc)
+{
+    uint8_t d[7] = {0};
+    memcpy(d, &data[1], (size_t)(dlc - 1u));
+
+    /* Single commands would bypass an open transaction's staging. */
+    const uint8_t com = data[0];
+    const bool known = (com >= CMD_SET_BAUD && com <= CMD_SELECT_PROFILE);
+    uint16_t value = 0u;
+    const bool ok = known && s_txn == CMD_TXN_NONE && run_config(com, d, &value);
+
+    uint8_t rsp[3] = { ok ? 1u : 0u, 0u, 0u };
+    if (com == CMD_GET_VALUE) {
+        put_u16_be(&rsp[1], value);
+        send_reply(rsp, 3u);
+    } else {
+        send_reply(rsp, 1u);
+    }
+}
+
+/* ===== Public API ===== */
+
+void Cmd_Module_Init(uint32_t *sample_period_ms)
+{
+    s_sample_period = sample_period_ms;
+    s_txn = CMD_TXN_NONE;
+    s_seq_valid = false;
+    s_ack_count = 0u;
+    s_ack_bits = 0u;
+    s_ack_now = false;
+    s_baud_pending = false;
+}
+
+bool Cmd_Module_Handle_Frame(uint16_t std_id, const uint8_t *data, uint8_t dlc)
+{
+    if (std_id != Id_Plan_Module_Std_Id(CMD_RX_ID_OFFSET)) {
+        return false;
+    }
+    if (data == NULL || dlc == 0u || s_sample_period == NULL) {
+        return true;
+    }
+    if ((data[0] & CMD_FLAG_WINDOWED) == 0u) {
+        handle_legacy(data, (dlc > 8u) ? 8u : dlc);
+    } else if (dlc >= 8u) {
+        handle_windowed(data);
+    }
+    return true;
+}
+
+void Cmd_Module_Task(void)
+{
+    const uint32_t now = HAL_GetTick();
+
+    if (s_ack_count != 0u && (s_ack_now || (now - s_ack_tick) >= CMD_ACK_HOLDOFF_MS)) {
+        flush_ack();
+    }
+    if (s_txn != CMD_TXN_NONE && (now - s_txn_tick) >= CMD_TXN_TIMEOUT_MS) {
+        s_txn = CMD_TXN_NONE;
+    }
+    if (s_baud_pending && (now - s_baud_tick) >= CMD_BAUD_SWITCH_DELAY_MS) {
+        /* HAL_BUSY: the clock is not back at a level that times the baud yet. */
+        s_baud_pending = (CAN_Module_Update_Baud(s_baud_next) == HAL_BUSY);
+    }
+}
+
+uint32_t Cmd_Module_Get_Sample_Period(void)
+{
+    return (s_sample_period != NULL) ? *s_sample_period : 0u;
+}
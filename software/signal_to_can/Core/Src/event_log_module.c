@@ -0,0 +1,517 @@
+/* event_log_module.c
+ *
+ * Flash event log: page ring, RAM write-behind queue and fault paths.
+ */
+
+#include "event_log_module.h"
+#include "can_module.h"
+#include "timebase_module.h"
+#include "update_module.h"
+
+#include <string.h>
+
+#if EVENT_LOG_PAGE_SIZE != FLASH_PAGE_SIZE
+#error "event log pages must be flash pages"
+#endif
+
+#if EVENT_LOG_ENABLE
+
+/* ===== Layout ===== */
+
+#define EVENT_LOG_MAGIC         0x4C45u     /* "EL" */
+#define EVENT_LOG_VERSION       1u
+#define EVENT_LOG_SLOTS         (EVENT_LOG_PAGE_SIZE / EVENT_LOG_ENTRY_SIZE)   /* slot 0: header */
+#define EVENT_LOG_HALFWORDS     (EVENT_LOG_ENTRY_SIZE / 2u)
+#define EVENT_LOG_NO_PAGE       0xFFu
+
+typedef struct {
+    uint16_t magic;
+    uint16_t version;
+    uint32_t seq;
+    uint32_t erases;
+    uint32_t reserved;
+} event_log_header_t;
+
+/* ===== Private state ===== */
+
+static uint8_t  s_cur = EVENT_LOG_NO_PAGE;  /* page being written */
+static uint8_t  s_open = 0u;                /* page to open when s_cur is none */
+static uint8_t  s_slot = 1u;                /* next slot in s_cur */
+static bool     s_valid[EVENT_LOG_NUM_PAGES];
+static uint32_t s_seq[EVENT_LOG_NUM_PAGES];
+static uint32_t s_erases[EVENT_LOG_NUM_PAGES];
+static uint8_t  s_erase_pending = 0u;       /* bit p: erase page p */
+static bool     s_erase_now = false;        /* pending erase asked for by a clear */
+static bool     s_scanned = false;          /* pages read, by Init or a fatal path before it */
+static uint16_t s_boot = 0u;
+static uint32_t s_init_tick = 0u;
+
+/* Write-behind queue, filled from any context. */
+static event_log_entry_t s_queue[EVENT_LOG_QUEUE_LEN];
+static volatile uint8_t  s_q_head = 0u;
+static volatile uint8_t  s_q_count = 0u;
+static uint8_t  s_tokens = EVENT_LOG_BURST;
+static uint32_t s_refill_tick = 0u;
+
+/* Entry or header being programmed, half-word 0 (type or magic) last. */
+static uint16_t s_stage[EVENT_LOG_HALFWORDS];
+static uint32_t s_stage_addr = 0u;
+static uint8_t  s_stage_pos = EVENT_LOG_HALFWORDS;
+
+static event_log_stats_t s_stats;
+
+/* Claims the log pages: the linker script places .evlog_pages at
+   EVENT_LOG_FLASH_BASE (NOLOAD), so only images with the log lose them. */
+static const uint8_t s_pages[EVENT_LOG_NUM_PAGES * EVENT_LOG_PAGE_SIZE]
+    __attribute__((section(".evlog_pages"), used));
+
+/* ===== Helpers ===== */
+
+static uint32_t page_addr(uint8_t p)
+{
+    return EVENT_LOG_FLASH_BASE + (uint32_t)p * EVENT_LOG_PAGE_SIZE;
+}
+
+static uint32_t slot_addr(uint8_t p, uint8_t slot)
+{
+    return page_addr(p) + (uint32_t)slot * EVENT_LOG_ENTRY_SIZE;
+}
+
+static bool slot_blank(uint32_t addr)
+{
+    const volatile uint32_t *w = (const volatile uint32_t *)(uintptr_t)addr;
+    return (w[0] & w[1] & w[2] & w[3]) == 0xFFFFFFFFu;
+}
+
+static bool page_blank(uint8_t p)
+{
+    for (uint8_t s = 0u; s < EVENT_LOG_SLOTS; ++s) {
+        if (!slot_blank(slot_addr(p, s))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/* Entry at a slot; false if the slot is empty or was torn by a reset. */
+static bool read_entry(uint8_t p, uint8_t slot, event_log_entry_t *out)
+{
+    memcpy(out, (const void *)(uintptr_t)slot_addr(p, slot), sizeof(*out));
+    return out->type != 0xFFu;
+}
+
+static void program(uint32_t addr, uint16_t value)
+{
+    if (value == 0xFFFFu) {
+        return;     /* already the erased value */
+    }
+    const uint32_t t0 = Timebase_Module_Now_Us();
+    (void)HAL_FLASH_Unlock();
+    (void)HAL_FLASH_Program(FLASH_TYPEPROGRAM_HALFWORD, addr, value);
+    (void)HAL_FLASH_Lock();
+    const uint32_t us = Timebase_Module_Now_Us() - t0;
+    if (us > s_stats.max_program_us) {
+        s_stats.max_program_us = us;
+    }
+}
+
+static void erase(uint8_t p)
+{
+    FLASH_EraseInitTypeDef init = {0};
+    uint32_t page_error = 0u;
+    init.TypeErase = FLASH_TYPEERASE_PAGES;
+    init.PageAddress = page_addr(p);
+    init.NbPages = 1u;
+
+    const uint32_t t0 = Timebase_Module_Now_Us();
+    (void)HAL_FLASH_Unlock();
+    (void)HAL_FLASHEx_Erase(&init, &page_error);
+    (void)HAL_FLASH_Lock();
+    const uint32_t us = Timebase_Module_Now_Us() - t0;
+    if (us > s_stats.max_erase_us) {
+        s_stats.max_erase_us = us;
+    }
+    s_erases[p]++;
+    s_valid[p] = false;
+}
+
+static void stage(uint32_t addr, const void *src)
+{
+    memcpy(s_stage, src, EVENT_LOG_ENTRY_SIZE);
+    s_stage_addr = addr;
+    s_stage_pos = 0u;
+}
+
+/* Programs the next half-word of the stage: 1..7, then 0. */
+static void program_step(void)
+{
+    const uint8_t i = (uint8_t)((s_stage_pos + 1u) % EVENT_LOG_HALFWORDS);
+    program(s_stage_addr + 2u * i, s_stage[i]);
+    s_stage_pos++;
+}
+
+static bool stage_busy(void)
+{
+    return s_stage_pos < EVENT_LOG_HALFWORDS;
+}
+
+/* Stages the header of blank page p and makes it current. */
+static void open_page(uint8_t p)
+{
+    const uint8_t other = (uint8_t)(p ^ 1u);
+    event_log_header_t h;
+    h.magic = EVENT_LOG_MAGIC;
+    h.version = EVENT_LOG_VERSION;
+    h.seq = s_valid[other] ? s_seq[other] + 1u : s_seq[p] + 1u;
+    h.erases = s_erases[p];
+    h.reserved = 0xFFFFFFFFu;
+    stage(slot_addr(p, 0u), &h);
+    s_cur = p;
+    s_slot = 1u;
+    s_valid[p] = true;
+    s_seq[p] = h.seq;
+}
+
+static bool queue_pop(event_log_entry_t *out)
+{
+    bool ok = false;
+    const uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    if (s_q_count > 0u) {
+        *out = s_queue[s_q_head];
+        s_q_head = (uint8_t)((s_q_head + 1u) % EVENT_LOG_QUEUE_LEN);
+        s_q_count--;
+        ok = true;
+    }
+    __set_PRIMASK(primask);
+    return ok;
+}
+
+/* Stages the next queued entry if the current page has room. */
+static bool stage_next_entry(void)
+{
+    event_log_entry_t e;
+    if (s_cur == EVENT_LOG_NO_PAGE || s_slot >= EVENT_LOG_SLOTS || !queue_pop(&e)) {
+        return false;
+    }
+    stage(slot_addr(s_cur, s_slot), &e);
+    s_slot++;
+    s_stats.written++;
+    return true;
+}
+
+static void fill(event_log_entry_t *e, event_log_type_t type, uint8_t arg,
+                 uint32_t data0, uint32_t data1)
+{
+    e->type = (uint8_t)type;
+    e->arg = arg;
+    e->boot = s_boot;
+    e->time_ms = HAL_GetTick();
+    e->data[0] = data0;
+    e->data[1] = data1;
+}
+
+/* Reads the page headers: current page, its next slot, the page to open
+ * next and the boot number. Only reads flash. */
+static void scan(void)
+{
+    s_cur = EVENT_LOG_NO_PAGE;
+    uint16_t boot = 0u;
+    for (uint8_t p = 0u; p < EVENT_LOG_NUM_PAGES; ++p) {
+        event_log_header_t h;
+        memcpy(&h, (const void *)(uintptr_t)page_addr(p), sizeof(h));
+        s_valid[p] = (h.magic == EVENT_LOG_MAGIC && h.version == EVENT_LOG_VERSION);
+        s_seq[p] = s_valid[p] ? h.seq : 0u;
+        s_erases[p] = s_valid[p] ? h.erases : 0u;
+        if (!s_valid[p]) {
+            continue;
+        }
+        for (uint8_t s = 1u; s < EVENT_LOG_SLOTS; ++s) {
+            event_log_entry_t e;
+            if (read_entry(p, s, &e) && e.boot > boot) {
+                boot = e.boot;
+            }
+        }
+        if (s_cur == EVENT_LOG_NO_PAGE || (int32_t)(h.seq - s_seq[s_cur]) > 0) {
+            s_cur = p;
+        }
+    }
+
+    if (s_cur != EVENT_LOG_NO_PAGE) {
+        /* Next slot after the last one touched, torn entries included. */
+        s_slot = 1u;
+        for (uint8_t s = (uint8_t)(EVENT_LOG_SLOTS - 1u); s >= 1u; --s) {
+            if (!slot_blank(slot_addr(s_cur, s))) {
+                s_slot = (uint8_t)(s + 1u);
+                break;
+            }
+        }
+        s_open = (uint8_t)(s_cur ^ 1u);
+    } else {
+        s_open = 0u;
+    }
+    s_boot = (uint16_t)(boot + 1u);
+    s_scanned = true;
+}
+
+/* ===== Public API ===== */
+
+void Event_Log_Module_Init(void)
+{
+    memset(&s_stats, 0, sizeof(s_stats));
+    s_erase_pending = 0u;
+    s_erase_now = false;
+    s_stage_pos = EVENT_LOG_HALFWORDS;
+    s_q_head = 0u;
+    s_q_count = 0u;
+    scan();
+
+    /* An erase stalls the CPU for 20-40 ms, which the running main loop
+     * must not see: a current page close to full gets its blank successor
+     * now, before acquisition starts. Without a current page the one to
+     * open must be blank too. */
+    if ((s_cur == EVENT_LOG_NO_PAGE || (EVENT_LOG_SLOTS - s_slot) < EVENT_LOG_SPARE_SLOTS) &&
+        !page_blank(s_open)) {
+        erase(s_open);
+    }
+
+    s_init_tick = HAL_GetTick();
+    s_refill_tick = s_init_tick;
+    s_tokens = EVENT_LOG_BURST;
+
+    const uint32_t csr = RCC->CSR;
+    __HAL_RCC_CLEAR_RESET_FLAGS();
+    (void)Event_Log_Module_Add(EVENT_LOG_RESET, (uint8_t)(csr >> 24), csr, 0u);
+}
+
+bool Event_Log_Module_Add(event_log_type_t type, uint8_t arg, uint32_t data0, uint32_t data1)
+{
+    bool ok = false;
+    const uint32_t now = HAL_GetTick();
+    const uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    while ((now - s_refill_tick) >= EVENT_LOG_REFILL_MS) {
+        s_refill_tick += EVENT_LOG_REFILL_MS;
+        if (s_tokens < EVENT_LOG_BURST) {
+            s_tokens++;
+        }
+    }
+    /* Out-of-range transitions may not take the reserve, so a flapping
+     * input cannot crowd out faults and configuration changes. */
+    const bool low = (type == EVENT_LOG_OOR);
+    if (s_tokens <= (low ? EVENT_LOG_RESERVE : 0u)) {
+        s_stats.dropped_rate++;
+    } else if (s_q_count >= (low ? EVENT_LOG_QUEUE_LEN / 2u : EVENT_LOG_QUEUE_LEN)) {
+        s_stats.dropped_full++;
+    } else {
+        const uint8_t tail = (uint8_t)((s_q_head + s_q_count) % EVENT_LOG_QUEUE_LEN);
+        fill(&s_queue[tail], type, arg, data0, data1);
+        s_q_count++;
+        s_tokens--;
+        ok = true;
+    }
+    __set_PRIMASK(primask);
+    return ok;
+}
+
+void Event_Log_Module_Fatal(event_log_type_t type, uint32_t data0, uint32_t data1)
+{
+    __disable_irq();
+
+    /* Before Init the page state is unknown: a header with a stale
+     * sequence would lose to the older page. */
+    if (!s_scanned) {
+        scan();
+    }
+    if (s_cur == EVENT_LOG_NO_PAGE && !stage_busy()) {
+        if (!page_blank(s_open)) {
+            return;     /* never erase from here */
+        }
+        open_page(s_open);
+    }
+    for (;;) {
+        while (stage_busy()) {
+            program_step();
+        }
+        if (!stage_next_entry()) {
+            break;
+        }
+    }
+    if (s_cur == EVENT_LOG_NO_PAGE || s_slot >= EVENT_LOG_SLOTS) {
+        return;
+    }
+    event_log_entry_t e;
+    fill(&e, type, 0u, data0, data1);
+    stage(slot_addr(s_cur, s_slot), &e);
+    s_slot++;
+    while (stage_busy()) {
+        program_step();
+    }
+}
+
+void Event_Log_Module_Hard_Fault(const uint32_t *frame)
+{
+    /* The frame is r0-r3, r12, LR, PC, xPSR. */
+    Event_Log_Module_Fatal(EVENT_LOG_HARD_FAULT, frame[6], frame[5]);
+}
+
+bool Event_Log_Module_Get_Entry(uint16_t age, event_log_entry_t *out)
+{
+    if (out == NULL) {
+        return false;
+    }
+    /* Between pages the newest one is the page before s_open. */
+    const uint8_t newest = (s_cur != EVENT_LOG_NO_PAGE) ? s_cur : (uint8_t)(s_open ^ 1u);
+    const uint8_t order[EVENT_LOG_NUM_PAGES] = { newest, (uint8_t)(newest ^ 1u) };
+    for (uint8_t k = 0u; k < EVENT_LOG_NUM_PAGES; ++k) {
+        const uint8_t p = order[k];
+        if (!s_valid[p]) {
+            continue;
+        }
+        const uint8_t top = (p == s_cur) ? s_slot : EVENT_LOG_SLOTS;
+        for (uint8_t s = (uint8_t)(top - 1u); s >= 1u; --s) {
+            if (read_entry(p, s, out)) {
+                if (age == 0u) {
+                    return true;
+                }
+                age--;
+            }
+        }
+    }
+    return false;
+}
+
+void Event_Log_Module_Get_Stats(event_log_stats_t *out)
+{
+    if (out == NULL) return;
+    *out = s_stats;
+    for (uint8_t p = 0u; p < EVENT_LOG_NUM_PAGES; ++p) {
+        out->erases[p] = s_erases[p];
+    }
+    uint16_t stored = 0u;
+    for (uint8_t p = 0u; p < EVENT_LOG_NUM_PAGES; ++p) {
+        if (!s_valid[p]) {
+            continue;
+        }
+        const uint8_t top = (p == s_cur) ? s_slot : EVENT_LOG_SLOTS;
+        for (uint8_t s = 1u; s < top; ++s) {
+            event_log_entry_t e;
+            if (read_entry(p, s, &e)) {
+                stored++;
+            }
+        }
+    }
+    out->stored = stored;
+    out->boot = s_boot;
+}
+
+void Event_Log_Module_Clear(void)
+{
+    s_erase_pending = (uint8_t)((1u << EVENT_LOG_NUM_PAGES) - 1u);
+    s_erase_now = true;
+}
+
+void Event_Log_Module_Task(void)
+{
+    if ((HAL_GetTick() - s_init_tick) < EVENT_LOG_HOLDOFF_MS) {
+        return;
+    }
+    if (stage_busy()) {
+        program_step();
+        return;
+    }
+
+    /* Erase stalls the CPU for tens of ms, acquisition included: only when
+     * a clear asks for it or an update session has stopped the data
+     * frames, and between frames. A full page otherwise waits, and new
+     * entries stay queued (or are dropped) until then or the next boot. */
+    if (s_erase_pending != 0u) {
+        if (!(s_erase_now || Update_Module_Is_Active()) || !CAN_Module_Is_Quiet()) {
+            return;
+        }
+        const uint8_t p = (s_erase_pending & 1u) ? 0u : 1u;
+        s_erase_pending &= (uint8_t)~(1u << p);
+        if (p == s_cur) {
+            s_cur = EVENT_LOG_NO_PAGE;
+            s_open = p;
+        }
+        if (!page_blank(p)) {
+            erase(p);
+        }
+        s_valid[p] = false;
+        if (s_erase_pending == 0u) {
+            s_erase_now = false;
+        }
+        return;
+    }
+
+    if (s_q_count == 0u) {
+        return;
+    }
+    if (s_cur != EVENT_LOG_NO_PAGE && s_slot >= EVENT_LOG_SLOTS) {
+        s_open = (uint8_t)(s_cur ^ 1u);
+        s_cur = EVENT_LOG_NO_PAGE;
+    }
+    if (s_cur == EVENT_LOG_NO_PAGE) {
+        if (!page_blank(s_open)) {
+            s_erase_pending |= (uint8_t)(1u << s_open);
+            return;
+        }
+        open_page(s_open);
+        return;
+    }
+    if (stage_next_entry()) {
+        program_step();
+    }
+}
+
+#else
+
+void Event_Log_Module_Init(void)
+{
+}
+
+bool Event_Log_Module_Add(event_log_type_t type, uint8_t arg, uint32_t data0, uint32_t data1)
+{
+    (void)type;
+    (void)arg;
+    (void)data0;
+    (void)data1;
+    return false;
+}
+
+void Event_Log_Module_Fatal(event_log_type_t type, uint32_t data0, uint32_t data1)
+{
+    (void)type;
+    (void)data0;
+    (void)data1;
+}
+
+void Event_Log_Module_Hard_Fault(const uint32_t *frame)
+{
+    (void)frame;
+}
+
+bool Event_Log_Module_Get_Entry(uint16_t age, event_log_entry_t *out)
+{
+    (void)age;
+    (void)out;
+    return false;
+}
+
+void Event_Log_Module_Get_Stats(event_log_stats_t *out)
+{
+    if (out != NULL) {
+        memset(out, 0, sizeof(*out));
+    }
+}
+
+void Event_Log_Module_Clear(void)
+{
+}
+
+void Event_Log_Module_Task(void)
+{
+}
+
+#endif
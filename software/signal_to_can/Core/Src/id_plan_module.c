@@ -0,0 +1,122 @@
+/* id_plan_module.c
+ *
+ * Offset-to-class table, the class range check and ID resolution.
+ */
+
+#include "id_plan_module.h"
+#include "can_module.h"
+#include "update_module.h"
+#include "claim_module.h"
+
+#if UPDATE_MCAST_ID >= CLAIM_ID_BASE && UPDATE_MCAST_ID < CLAIM_ID_BASE + CLAIM_ID_COUNT
+#error "UPDATE_MCAST_ID must be outside the claim IDs"
+#endif
+
+/* ===== Plan ===== */
+
+typedef struct {
+    uint8_t cls;                /* id_class_t */
+    uint8_t index;              /* in the node's block of the class */
+} id_slot_t;
+
+static const id_slot_t s_slots[ID_PLAN_OFFSETS] = {
+    { ID_CLASS_ALARM, 0u },  { ID_CLASS_FAST, 0u },   { ID_CLASS_FAST, 1u },   { ID_CLASS_STATUS, 0u },
+    { ID_CLASS_FAST, 2u },   { ID_CLASS_CONFIG, 0u }, { ID_CLASS_CONFIG, 1u }, { ID_CLASS_CONFIG, 2u },
+    { ID_CLASS_CONFIG, 3u }, { ID_CLASS_CONFIG, 4u }, { ID_CLASS_CONFIG, 5u }, { ID_CLASS_STATUS, 1u },
+    { ID_CLASS_SLOW, 0u },   { ID_CLASS_ALARM, 1u },  { ID_CLASS_FAST, 3u },   { ID_CLASS_SLOW, 1u },
+};
+
+static const uint8_t s_width[ID_NUM_CLASSES] = { 2u, 4u, 2u, 2u, 6u };
+
+static const uint16_t s_base[ID_NUM_CLASSES] = {
+    ID_PLAN_BASE_ALARM, ID_PLAN_BASE_FAST, ID_PLAN_BASE_SLOW, ID_PLAN_BASE_STATUS, ID_PLAN_BASE_CONFIG,
+};
+
+/* ===== Private state ===== */
+
+static bool s_class_plan = false;
+
+/* ===== Helpers ===== */
+
+static uint32_t range_end(id_class_t c)
+{
+    return (uint32_t)s_base[c] + ID_PLAN_MAX_NODES * (uint32_t)s_width[c];
+}
+
+#if ID_PLAN_ENABLE
+/* Ranges of all nodes inside 11 bits, apart from each other and from the
+ * update multicast and claim IDs. */
+static bool plan_fits(void)
+{
+    for (uint8_t c = 0u; c < ID_NUM_CLASSES; ++c) {
+        if (range_end((id_class_t)c) > 0x800u ||
+            (UPDATE_MCAST_ID >= s_base[c] && UPDATE_MCAST_ID < range_end((id_class_t)c)) ||
+            (s_base[c] < CLAIM_ID_BASE + CLAIM_ID_COUNT && CLAIM_ID_BASE < range_end((id_class_t)c))) {
+            return false;
+        }
+        for (uint8_t d = (uint8_t)(c + 1u); d < ID_NUM_CLASSES; ++d) {
+            if (s_base[c] < range_end((id_class_t)d) && s_base[d] < range_end((id_class_t)c)) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+#endif
+
+/* ===== Public API ===== */
+
+HAL_StatusTypeDef Id_Plan_Module_Init(void)
+{
+    s_class_plan = false;
+#if ID_PLAN_ENABLE
+    if (!plan_fits() || CAN_Module_Get_Node_Id() >= ID_PLAN_MAX_NODES) {
+        return HAL_ERROR;
+    }
+    s_class_plan = true;
+#endif
+    return HAL_OK;
+}
+
+bool Id_Plan_Module_Is_Class_Plan(void)
+{
+    return s_class_plan;
+}
+
+uint16_t Id_Plan_Module_Std_Id(uint16_t offset)
+{
+    const uint8_t node = CAN_Module_Get_Node_Id();
+    if (!s_class_plan || offset >= ID_PLAN_OFFSETS) {
+        return (uint16_t)((node + offset) & 0x7FFu);
+    }
+    const id_slot_t slot = s_slots[offset];
+    return (uint16_t)(s_base[slot.cls] + node * s_width[slot.cls] + slot.index);
+}
+
+id_class_t Id_Plan_Module_Class_Of(uint16_t offset)
+{
+    return (offset < ID_PLAN_OFFSETS) ? (id_class_t)s_slots[offset].cls : ID_NUM_CLASSES;
+}
+
+bool Id_Plan_Module_Is_Planned(uint16_t std_id)
+{
+    if (!s_class_plan) {
+        return false;
+    }
+    for (uint8_t c = 0u; c < ID_NUM_CLASSES; ++c) {
+        if (std_id >= s_base[c] && std_id < range_end((id_class_t)c)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+uint16_t Id_Plan_Module_Get_Base(id_class_t c)
+{
+    return (c < ID_NUM_CLASSES) ? s_base[c] : 0u;
+}
+
+uint8_t Id_Plan_Module_Get_Width(id_class_t c)
+{
+    return (c < ID_NUM_CLASSES) ? s_width[c] : 0u;
+}
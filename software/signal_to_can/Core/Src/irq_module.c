@@ -0,0 +1,145 @@
+/* irq_module.c
+ *
+ * Interrupt priority plan and ISR timing from SysTick->VAL.
+ */
+
+#include "irq_module.h"
+
+#include <stdbool.h>
+#include <string.h>
+
+#if IRQ_PRIO_CAN >= IRQ_PRIO_DMA_ADC || IRQ_PRIO_TIMER <= IRQ_PRIO_DMA_ADC || IRQ_PRIO_SYSTICK <= IRQ_PRIO_TIMER
+#error "the priority plan must stay in the documented order"
+#endif
+
+/* ===== Private state ===== */
+
+static volatile irq_stats_t s_stats[IRQ_NUM_SOURCES];
+
+/* Cycle to ns conversion for the HCLK of the moment: ns = cycles * q4 / 16. */
+static uint32_t s_hclk = 0u;
+static uint32_t s_ns_q4 = 0u;
+static uint32_t s_ns_cycles_max = 0u;   /* largest cycle count that converts */
+
+/* Scan complete intervals; an interval spanning a clock change or a
+ * preempted SysTick handler (tick count in flux) is not taken. */
+static volatile bool s_tick_active = false;
+static bool s_scan_valid = false;
+static uint32_t s_scan_last = 0u;
+static uint32_t s_scan_min_ns = 0u;
+static uint32_t s_scan_max_ns = 0u;
+
+/* ===== Helpers ===== */
+
+static uint32_t to_ns(uint32_t cycles)
+{
+    const uint32_t hclk = HAL_RCC_GetHCLKFreq();
+    if (hclk != s_hclk) {
+        s_ns_q4 = 16000u / (hclk / 1000000u);
+        s_ns_cycles_max = UINT32_MAX / s_ns_q4;
+        s_hclk = hclk;
+        s_scan_valid = false;
+    }
+    return (cycles <= s_ns_cycles_max) ? ((cycles * s_ns_q4) >> 4) : UINT32_MAX;
+}
+
+static void raise(volatile uint32_t *max, uint32_t v)
+{
+    if (v > *max) {
+        *max = v;
+    }
+}
+
+/* Cycle time (wrapping) from the tick and SysTick->VAL, as timebase_module
+ * but without the division. Only for handlers above SysTick priority. */
+static uint32_t now_cycles(uint32_t load)
+{
+    uint32_t ms = HAL_GetTick();
+    const uint32_t val_before = SysTick->VAL;
+    const bool pending = (SCB->ICSR & SCB_ICSR_PENDSTSET_Msk) != 0u;
+    const uint32_t val_after = SysTick->VAL;
+    uint32_t val = val_before;
+    if (pending) {
+        ms++;
+        val = val_after;
+    }
+    return ms * (load + 1u) + (load - val);
+}
+
+static void scan_entry(uint32_t load, uint32_t cycles_since_entry)
+{
+    const uint32_t entry = now_cycles(load) - cycles_since_entry;
+    if (s_scan_valid && !s_tick_active) {
+        const uint32_t ns = to_ns(entry - s_scan_last);
+        if (s_scan_min_ns == 0u || ns < s_scan_min_ns) {
+            s_scan_min_ns = ns;
+        }
+        if (ns > s_scan_max_ns) {
+            s_scan_max_ns = ns;
+        }
+        s_stats[IRQ_SRC_DMA_ADC].entry_max_ns = s_scan_max_ns - s_scan_min_ns;
+    }
+    s_scan_last = entry;
+    s_scan_valid = !s_tick_active;
+}
+
+/* ===== Public API ===== */
+
+void Irq_Module_Init(void)
+{
+    HAL_NVIC_SetPriority(CEC_CAN_IRQn, IRQ_PRIO_CAN, 0u);
+    HAL_NVIC_SetPriority(DMA1_Channel1_IRQn, IRQ_PRIO_DMA_ADC, 0u);
+    Irq_Module_Reset();
+}
+
+uint32_t Irq_Module_Enter(irq_src_t src)
+{
+    const uint32_t val = SysTick->VAL;
+    if (src == IRQ_SRC_SYSTICK) {
+        s_tick_active = true;
+    }
+    return val;
+}
+
+void Irq_Module_Exit(irq_src_t src, uint32_t enter)
+{
+    const uint32_t load = SysTick->LOAD;
+    const uint32_t now = SysTick->VAL;
+    /* The counter runs down and reloads from 0 to LOAD. */
+    const uint32_t cycles = (enter >= now) ? (enter - now) : (enter + load + 1u - now);
+    volatile irq_stats_t *st = &s_stats[src];
+
+    st->count++;
+    raise(&st->exec_max_ns, to_ns(cycles));
+    if (src == IRQ_SRC_SYSTICK) {
+        /* Requested at the reload, LOAD - VAL cycles before entry. */
+        raise(&st->entry_max_ns, to_ns(load - enter));
+        s_tick_active = false;
+    } else if (src == IRQ_SRC_DMA_ADC) {
+        scan_entry(load, cycles);
+    }
+}
+
+void Irq_Module_Reset(void)
+{
+    const uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    memset((void *)s_stats, 0, sizeof(s_stats));
+    s_scan_valid = false;
+    s_scan_min_ns = 0u;
+    s_scan_max_ns = 0u;
+    __set_PRIMASK(primask);
+}
+
+void Irq_Module_Get_Stats(irq_src_t src, irq_stats_t *out)
+{
+    if (out == NULL || src >= IRQ_NUM_SOURCES) {
+        return;
+    }
+    const uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    out->count = s_stats[src].count;
+    out->exec_max_ns = s_stats[src].exec_max_ns;
+    out->entry_max_ns = s_stats[src].entry_max_ns;
+    __set_PRIMASK(primask);
+}
@@ -0,0 +1,383 @@
+/* isotp_module.c
+ *
+ * Minimal ISO 15765-2 transport for STM32F042 (bxCAN + STM32 HAL).
+ * This module provides:
+ *  - Single frame (SF), first frame (FF), consecutive frame (CF) and
+ *    flow control (FC) handling for one physical connection
+ *  - Receive side always grants the whole message (BS = 0, STmin = 0)
+ *  - Transmit side follows the tester's BS/STmin and never blocks
+ */
+
+#include "isotp_module.h"
+#include "can_module.h"
+#include "id_plan_module.h"
+#include <string.h>
+
+#if ISOTP_ENABLE
+
+/* ===== Module configuration ===== */
+
+/* N_Bs: wait for flow control, N_Cr: wait for the next consecutive frame. */
+#ifndef ISOTP_N_BS_MS
+#define ISOTP_N_BS_MS        1000u
+#endif
+#ifndef ISOTP_N_CR_MS
+#define ISOTP_N_CR_MS        1000u
+#endif
+
+/* Mailbox wait for SF/FF/FC frames (CFs are sent without waiting). */
+#ifndef ISOTP_TX_TIMEOUT_MS
+#define ISOTP_TX_TIMEOUT_MS  5u
+#endif
+
+/* Protocol control information (upper nibble of byte 0). */
+#define PCI_SF   0x0u
+#define PCI_FF   0x1u
+#define PCI_CF   0x2u
+#define PCI_FC   0x3u
+
+#define FC_CTS   0x0u
+#define FC_WAIT  0x1u
+#define FC_OVFLW 0x2u
+
+typedef enum {
+    RX_IDLE = 0,
+    RX_RECEIVING,
+    RX_COMPLETE
+} isotp_rx_state_t;
+
+typedef enum {
+    TX_IDLE = 0,
+    TX_WAIT_FC,
+    TX_SENDING
+} isotp_tx_state_t;
+
+/* ===== Private state ===== */
+
+static uint8_t          s_rx_buf[ISOTP_RX_BUF_SIZE];
+static size_t           s_rx_len = 0u;
+static size_t           s_rx_pos = 0u;
+static uint8_t          s_rx_sn = 0u;
+static uint32_t         s_rx_deadline = 0u;
+static isotp_rx_state_t s_rx_state = RX_IDLE;
+
+static uint8_t          s_tx_buf[ISOTP_TX_BUF_SIZE];
+static size_t           s_tx_len = 0u;
+static size_t           s_tx_pos = 0u;
+static uint8_t          s_tx_sn = 0u;
+static uint8_t          s_tx_bs = 0u;        /* block size granted by the tester */
+static uint8_t          s_tx_bs_left = 0u;
+static uint8_t          s_tx_stmin_ms = 0u;
+static uint32_t         s_tx_last_cf = 0u;
+static uint32_t         s_tx_deadline = 0u;
+static isotp_tx_state_t s_tx_state = TX_IDLE;
+
+/* ===== Helpers ===== */
+
+static uint16_t tx_id(void)
+{
+    return Id_Plan_Module_Std_Id(ISOTP_TX_ID_OFFSET);
+}
+
+/* Sends one padded frame. */
+static HAL_StatusTypeDef send_frame(const uint8_t *bytes, uint8_t len, uint32_t timeout_ms)
+{
+    uint8_t frame[8];
+    memset(frame, ISOTP_PADDING_BYTE, sizeof(frame));
+    memcpy(frame, bytes, len);
+    return CAN_Module_Send_Std(tx_id(), frame, 8u, timeout_ms);
+}
+
+static void send_flow_control(uint8_t status)
+{
+    const uint8_t fc[3] = { (uint8_t)((PCI_FC << 4) | status), 0u, 0u };
+    (void)send_frame(fc, 3u, ISOTP_TX_TIMEOUT_MS);
+}
+
+/* STmin 0x00..0x7F is in ms; 0xF1..0xF9 (100..900 us) rounds up to 1 ms;
+ * reserved values are treated as the maximum as the standard requires.
+ */
+static uint8_t decode_stmin(uint8_t raw)
+{
+    if (raw <= 0x7Fu) {
+        return raw;
+    }
+    if (raw >= 0xF1u && raw <= 0xF9u) {
+        return 1u;
+    }
+    return 0x7Fu;
+}
+
+/* Returns true if deadline has passed (wrap-safe). */
+static bool expired(uint32_t now, uint32_t deadline)
+{
+    return (int32_t)(now - deadline) >= 0;
+}
+
+static void handle_rx_single(const uint8_t *data, uint8_t dlc)
+{
+    const uint8_t len = data[0] & 0x0Fu;
+    if (len == 0u || len > 7u || len > (uint8_t)(dlc - 1u) || len > ISOTP_RX_BUF_SIZE) {
+        return;
+    }
+    memcpy(s_rx_buf, &data[1], len);
+    s_rx_len = len;
+    s_rx_state = RX_COMPLETE;
+}
+
+static void handle_rx_first(const uint8_t *data, uint8_t dlc)
+{
+    const size_t len = ((size_t)(data[0] & 0x0Fu) << 8) | data[1];
+    if (dlc < 8u || len < 8u) {
+        return;
+    }
+    if (len > ISOTP_RX_BUF_SIZE) {
+        send_flow_control(FC_OVFLW);
+        s_rx_state = RX_IDLE;
+        return;
+    }
+    memcpy(s_rx_buf, &data[2], 6u);
+    s_rx_len = len;
+    s_rx_pos = 6u;
+    s_rx_sn = 1u;
+    s_rx_state = RX_RECEIVING;
+    s_rx_deadline = HAL_GetTick() + ISOTP_N_CR_MS;
+    send_flow_control(FC_CTS);
+}
+
+static void handle_rx_consecutive(const uint8_t *data, uint8_t dlc)
+{
+    if (s_rx_state != RX_RECEIVING) {
+        return;
+    }
+    if ((data[0] & 0x0Fu) != s_rx_sn) {
+        s_rx_state = RX_IDLE;   /* wrong sequence number aborts the reception */
+        return;
+    }
+    size_t chunk = s_rx_len - s_rx_pos;
+    if (chunk > 7u) {
+        chunk = 7u;
+    }
+    if (chunk > (size_t)(dlc - 1u)) {
+        s_rx_state = RX_IDLE;
+        return;
+    }
+    memcpy(&s_rx_buf[s_rx_pos], &data[1], chunk);
+    s_rx_pos += chunk;
+    s_rx_sn = (uint8_t)((s_rx_sn + 1u) & 0x0Fu);
+    s_rx_deadline = HAL_GetTick() + ISOTP_N_CR_MS;
+    if (s_rx_pos >= s_rx_len) {
+        s_rx_state = RX_COMPLETE;
+    }
+}
+
+static void handle_flow_control(const uint8_t *data, uint8_t dlc)
+{
+    if (s_tx_state != TX_WAIT_FC || dlc < 3u) {
+        return;
+    }
+    switch (data[0] & 0x0Fu) {
+    case FC_CTS:
+        s_tx_bs = data[1];
+        s_tx_bs_left = data[1];
+        s_tx_stmin_ms = decode_stmin(data[2]);
+        s_tx_last_cf = HAL_GetTick() - s_tx_stmin_ms;  /* first CF may go immediately */
+        s_tx_state = TX_SENDING;
+        break;
+    case FC_WAIT:
+        s_tx_deadline = HAL_GetTick() + ISOTP_N_BS_MS;
+        break;
+    default:
+        s_tx_state = TX_IDLE;   /* overflow or invalid: abort */
+        break;
+    }
+}
+
+/* ===== Public API ===== */
+
+void ISOTP_Module_Init(void)
+{
+    s_rx_state = RX_IDLE;
+    s_tx_state = TX_IDLE;
+    s_rx_len = 0u;
+    s_tx_len = 0u;
+}
+
+bool ISOTP_Module_Handle_Frame(uint16_t std_id, const uint8_t *data, uint8_t dlc)
+{
+    if (std_id != Id_Plan_Module_Std_Id(ISOTP_RX_ID_OFFSET)) {
+        return false;
+    }
+    if (data == NULL || dlc < 2u) {
+        return true;
+    }
+
+    switch (data[0] >> 4) {
+    case PCI_SF:
+        /* A new request is only accepted once the previous one is released. */
+        if (s_rx_state != RX_COMPLETE) {
+            handle_rx_single(data, dlc);
+        }
+        break;
+    case PCI_FF:
+        if (s_rx_state != RX_COMPLETE) {
+            handle_rx_first(data, dlc);
+        }
+        break;
+    case PCI_CF:
+        handle_rx_consecutive(data, dlc);
+        break;
+    case PCI_FC:
+        handle_flow_control(data, dlc);
+        break;
+    default:
+        break;
+    }
+    return true;
+}
+
+const uint8_t* ISOTP_Module_Get_Rx(size_t *len)
+{
+    if (s_rx_state != RX_COMPLETE || len == NULL) {
+        return NULL;
+    }
+    *len = s_rx_len;
+    return s_rx_buf;
+}
+
+void ISOTP_Module_Release_Rx(void)
+{
+    if (s_rx_state == RX_COMPLETE) {
+        s_rx_state = RX_IDLE;
+    }
+}
+
+uint8_t* ISOTP_Module_Get_Tx_Buffer(size_t *capacity)
+{
+    if (s_tx_state != TX_IDLE) {
+        return NULL;
+    }
+    if (capacity != NULL) {
+        *capacity = ISOTP_TX_BUF_SIZE;
+    }
+    return s_tx_buf;
+}
+
+HAL_StatusTypeDef ISOTP_Module_Start_Tx(size_t len)
+{
+    if (s_tx_state != TX_IDLE) {
+        return HAL_BUSY;
+    }
+    if (len == 0u || len > ISOTP_TX_BUF_SIZE) {
+        return HAL_ERROR;
+    }
+
+    uint8_t frame[8];
+    if (len <= 7u) {
+        frame[0] = (uint8_t)((PCI_SF << 4) | len);
+        memcpy(&frame[1], s_tx_buf, len);
+        return send_frame(frame, (uint8_t)(len + 1u), ISOTP_TX_TIMEOUT_MS);
+    }
+
+    frame[0] = (uint8_t)((PCI_FF << 4) | ((len >> 8) & 0x0Fu));
+    frame[1] = (uint8_t)(len & 0xFFu);
+    memcpy(&frame[2], s_tx_buf, 6u);
+    HAL_StatusTypeDef st = send_frame(frame, 8u, ISOTP_TX_TIMEOUT_MS);
+    if (st != HAL_OK) {
+        return st;
+    }
+
+    s_tx_len = len;
+    s_tx_pos = 6u;
+    s_tx_sn = 1u;
+    s_tx_deadline = HAL_GetTick() + ISOTP_N_BS_MS;
+    s_tx_state = TX_WAIT_FC;
+    return HAL_OK;
+}
+
+void ISOTP_Module_Task(void)
+{
+    const uint32_t now = HAL_GetTick();
+
+    if (s_rx_state == RX_RECEIVING && expired(now, s_rx_deadline)) {
+        s_rx_state = RX_IDLE;
+    }
+
+    if (s_tx_state == TX_WAIT_FC && expired(now, s_tx_deadline)) {
+        s_tx_state = TX_IDLE;
+    }
+
+    while (s_tx_state == TX_SENDING) {
+        if ((uint32_t)(HAL_GetTick() - s_tx_last_cf) < s_tx_stmin_ms) {
+            break;
+        }
+
+        uint8_t frame[8];
+        size_t chunk = s_tx_len - s_tx_pos;
+        if (chunk > 7u) {
+            chunk = 7u;
+        }
+        frame[0] = (uint8_t)((PCI_CF << 4) | s_tx_sn);
+        memcpy(&frame[1], &s_tx_buf[s_tx_pos], chunk);
+        if (send_frame(frame, (uint8_t)(chunk + 1u), 0u) != HAL_OK) {
+            break;  /* no free mailbox, retry next loop */
+        }
+
+        s_tx_pos += chunk;
+        s_tx_sn = (uint8_t)((s_tx_sn + 1u) & 0x0Fu);
+        s_tx_last_cf = HAL_GetTick();
+
+        if (s_tx_pos >= s_tx_len) {
+            s_tx_state = TX_IDLE;
+        } else if (s_tx_bs != 0u && --s_tx_bs_left == 0u) {
+            s_tx_deadline = HAL_GetTick() + ISOTP_N_BS_MS;
+            s_tx_state = TX_WAIT_FC;
+        }
+    }
+}
+
+#else
+
+void ISOTP_Module_Init(void)
+{
+}
+
+bool ISOTP_Module_Handle_Frame(uint16_t std_id, const uint8_t *data, uint8_t dlc)
+{
+    (void)std_id;
+    (void)data;
+    (void)dlc;
+    return false;
+}
+
+const uint8_t* ISOTP_Module_Get_Rx(size_t *len)
+{
+    if (len != NULL) {
+        *len = 0u;
+    }
+    return NULL;
+}
+
+void ISOTP_Module_Release_Rx(void)
+{
+}
+
+uint8_t* ISOTP_Module_Get_Tx_Buffer(size_t *capacity)
+{
+    if (capacity != NULL) {
+        *capacity = 0u;
+    }
+    return NULL;
+}
+
+HAL_StatusTypeDef ISOTP_Module_Start_Tx(size_t len)
+{
+    (void)len;
+    return HAL_ERROR;
+}
+
+void ISOTP_Module_Task(void)
+{
+}
+
+#endif
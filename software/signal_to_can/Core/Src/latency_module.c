@@ -0,0 +1,213 @@
+/* latency_module.c
+ *
+ * Sample-to-bus latency accounting.
+ * This module provides:
+ *  - One in-flight record per data frame, filled by the marks along the path
+ *  - TX complete timestamps taken in interrupt context, matched by identifier
+ *  - Log2 microsecond histograms per stage, updated from the main loop
+ */
+
+#include "latency_module.h"
+#include "timebase_module.h"
+#include <string.h>
+
+typedef enum {
+    FRAME_IDLE = 0,
+    FRAME_IN_FLIGHT,    /* queued, waiting for TX complete */
+    FRAME_DONE          /* TX complete seen, waiting for Latency_Module_Task() */
+} latency_frame_state_t;
+
+typedef struct {
+    uint16_t std_id;
+    uint32_t scan_us;
+    uint32_t processed_us;
+    uint32_t queued_us;
+    uint32_t accepted_us;
+    uint32_t done_us;
+    volatile uint8_t state;
+} latency_frame_t;
+
+#if LATENCY_ENABLE
+
+/* ===== Private state ===== */
+
+static volatile uint32_t s_last_scan_us = 0u;   /* written by the DMA interrupt */
+static uint32_t s_sample_scan_us = 0u;          /* scan used by the last processing pass */
+static uint32_t s_sample_processed_us = 0u;
+
+static latency_frame_t s_frames[LATENCY_MAX_FRAMES];
+static latency_hist_t  s_hist[LATENCY_NUM_STAGES];
+
+/* ===== Helpers ===== */
+
+static uint8_t bucket_of(uint32_t us)
+{
+    uint8_t b = 0u;
+    while (us != 0u && b < (LATENCY_NUM_BUCKETS - 1u)) {
+        us >>= 1;
+        b++;
+    }
+    return b;
+}
+
+/* Interval from a to b; negative intervals (marks raced each other) count as 0. */
+static uint32_t interval(uint32_t a, uint32_t b)
+{
+    const int32_t d = (int32_t)(b - a);
+    return (d > 0) ? (uint32_t)d : 0u;
+}
+
+static void record(latency_stage_t stage, uint32_t us)
+{
+    latency_hist_t *h = &s_hist[stage];
+    h->count++;
+    if (us > h->max_us) {
+        h->max_us = us;
+    }
+    uint16_t *bin = &h->bucket[bucket_of(us)];
+    if (*bin != 0xFFFFu) {
+        (*bin)++;
+    }
+}
+
+/* ===== Public API ===== */
+
+void Latency_Module_Init(void)
+{
+    memset(s_frames, 0, sizeof(s_frames));
+    Latency_Module_Reset();
+    s_last_scan_us = Timebase_Module_Now_Us();
+    s_sample_scan_us = s_last_scan_us;
+    s_sample_processed_us = s_last_scan_us;
+}
+
+void Latency_Module_Mark_Scan(void)
+{
+    s_last_scan_us = Timebase_Module_Now_Us();
+}
+
+void Latency_Module_Mark_Processed(void)
+{
+    s_sample_scan_us = s_last_scan_us;
+    s_sample_processed_us = Timebase_Module_Now_Us();
+}
+
+void Latency_Module_Mark_Queued(uint8_t frame, uint16_t std_id)
+{
+    if (frame >= LATENCY_MAX_FRAMES) return;
+    latency_frame_t *f = &s_frames[frame];
+
+    f->state = FRAME_IDLE;   /* keep the interrupt off the record while it is rewritten */
+    f->std_id = std_id;
+    f->scan_us = s_sample_scan_us;
+    f->processed_us = s_sample_processed_us;
+    f->queued_us = Timebase_Module_Now_Us();
+    f->accepted_us = f->queued_us;
+    f->state = FRAME_IN_FLIGHT;
+}
+
+void Latency_Module_Mark_Accepted(uint8_t frame)
+{
+    if (frame >= LATENCY_MAX_FRAMES) return;
+    s_frames[frame].accepted_us = Timebase_Module_Now_Us();
+}
+
+void Latency_Module_Mark_Dropped(uint8_t frame)
+{
+    if (frame >= LATENCY_MAX_FRAMES) return;
+    s_frames[frame].state = FRAME_IDLE;
+}
+
+void Latency_Module_Tx_Complete(uint16_t std_id)
+{
+    for (uint8_t i = 0u; i < LATENCY_MAX_FRAMES; ++i) {
+        latency_frame_t *f = &s_frames[i];
+        if (f->state == FRAME_IN_FLIGHT && f->std_id == std_id) {
+            f->done_us = Timebase_Module_Now_Us();
+            f->state = FRAME_DONE;
+            return;
+        }
+    }
+}
+
+void Latency_Module_Task(void)
+{
+    for (uint8_t i = 0u; i < LATENCY_MAX_FRAMES; ++i) {
+        latency_frame_t *f = &s_frames[i];
+        if (f->state != FRAME_DONE) {
+            continue;
+        }
+        record(LATENCY_STAGE_PROCESS,  interval(f->scan_us, f->processed_us));
+        record(LATENCY_STAGE_SCHEDULE, interval(f->processed_us, f->queued_us));
+        record(LATENCY_STAGE_MAILBOX,  interval(f->queued_us, f->accepted_us));
+        record(LATENCY_STAGE_BUS,      interval(f->accepted_us, f->done_us));
+        record(LATENCY_STAGE_TOTAL,    interval(f->scan_us, f->done_us));
+        f->state = FRAME_IDLE;
+    }
+}
+
+bool Latency_Module_Get_Hist(latency_stage_t stage, latency_hist_t *out)
+{
+    if (out == NULL || (unsigned)stage >= (unsigned)LATENCY_NUM_STAGES) {
+        return false;
+    }
+    *out = s_hist[stage];
+    return true;
+}
+
+void Latency_Module_Reset(void)
+{
+    memset(s_hist, 0, sizeof(s_hist));
+}
+
+#else
+
+void Latency_Module_Init(void)
+{
+}
+
+void Latency_Module_Mark_Scan(void)
+{
+}
+
+void Latency_Module_Mark_Processed(void)
+{
+}
+
+void Latency_Module_Mark_Queued(uint8_t frame, uint16_t std_id)
+{
+    (void)frame;
+    (void)std_id;
+}
+
+void Latency_Module_Mark_Accepted(uint8_t frame)
+{
+    (void)frame;
+}
+
+void Latency_Module_Mark_Dropped(uint8_t frame)
+{
+    (void)frame;
+}
+
+void Latency_Module_Tx_Complete(uint16_t std_id)
+{
+    (void)std_id;
+}
+
+void Latency_Module_Task(void)
+{
+}
+
+bool Latency_Module_Get_Hist(latency_stage_t stage, latency_hist_t *out)
+{
+    (void)stage;
+    (void)out;
+    return false;
+}
+
+void Latency_Module_Reset(void)
+{
+}
+
+#endif
@@ -25,22 +25,29 @@
 #include <string.h>
 #include <math.h>
 #include "can_module.h"
+#include "can_diag_module.h"
+#include "event_log_module.h"
 #include "adc_module.h"
 #include "process_signals.h"
+#include "pdo_module.h"
+#include "id_plan_module.h"
+#include "claim_module.h"
+#include "xcp_module.h"
+#include "isotp_module.h"
+#include "uds_module.h"
+#include "cmd_module.h"
+#include "latency_module.h"
+#include "boot_module.h"
+#include "clock_module.h"
+#include "update_module.h"
+#include "irq_module.h"
+#include "profile_module.h"
+#include "backfill_module.h"
 /* USER CODE END Includes */
 
 /* Private typedef -----------------------------------------------------------*/
 /* USER CODE BEGIN PTD */
-typedef struct {
-	volatile HAL_StatusTypeDef last_tx_status; /* return from CAN_Module_Send */
-	volatile uint32_t last_hal_error; /* HAL_CAN_GetError() */
-	volatile uint32_t last_esr; /* CAN->ESR snapshot */
-	volatile uint32_t last_tsr; /* CAN->TSR snapshot */
-	volatile uint32_t tx_ok_count; /* TX mailbox complete count */
-	volatile uint32_t tx_error_count; /* HAL error callback count */
-} can_debug_t;
-
-extern can_debug_t g_can_dbg;
+
 /* USER CODE END PTD */
 
 /* Private define ------------------------------------------------------------*/
@@ -76,12 +83,16 @@ static uint32_t heartbeat_tick = 0;
 
 // CAN bus
 uint32_t baud_enum = 2; // 2 -> 500 kbps
+uint8_t node_id = 0; // base of the node's CAN identifiers
 
 // Logic
 uint32_t sample_period = 20; // sample at 50 Hz
 uint32_t timeout_period = 10;
 
 
+// Published millivolts as sampled by XCP DAQ list 0
+static uint16_t xcp_daq0_mV[PS_NUM_CHANNELS];
+
 // Test
 can_debug_t g_can_dbg = { 0 };
 static uint32_t last_tick = 0;
@@ -98,6 +109,8 @@ static void MX_ADC_Init(void);
 
 void Heartbeat_Task(void);
 static void Test_Can_Task(uint16_t value);
+static void Can_Rx_Task(void);
+static void Xcp_Daq0_Refresh(void);
 
 /* USER CODE END PFP */
 
@@ -130,7 +143,7 @@ int main(void)
   SystemClock_Config();
 
   /* USER CODE BEGIN SysInit */
-
+  Boot_Module_Mark(BOOT_PHASE_CLOCK);
   /* USER CODE END SysInit */
 
   /* Initialize all configured peripherals */
@@ -139,24 +152,62 @@ int main(void)
   MX_CAN_Init();
   MX_ADC_Init();
   /* USER CODE BEGIN 2 */
+	Boot_Module_Mark(BOOT_PHASE_PERIPH);
+
+	// Interrupt priorities per the plan in irq_module.h before any source starts
+	Irq_Module_Init();
+
+	// Event log first: it takes the reset cause before anything can log
+	Event_Log_Module_Init();
 
 	// Set Standby Pin on CAN transceiver low (normal mode) before initializing
 	HAL_GPIO_WritePin(GPIOB, CAN_STANDBY_Pin, GPIO_PIN_RESET);
 
-	if (CAN_Module_Init(&hcan, baud_enum) != HAL_OK) {
+	// Start the bare-bones ADC module first: the first scan converts while
+	// CAN waits for bus synchronization
+	if (ADC_Module_Init(&hadc) != HAL_OK) {
 		// TODO
-		Error_Handler();
 	}
+	Boot_Module_Mark(BOOT_PHASE_ADC);
 
-	// Start the bare-bones ADC module
-	if (ADC_Module_Init(&hadc) != HAL_OK) {
+	// Error analytics first: error interrupts start with the controller
+	CAN_Diag_Module_Init();
+	if (CAN_Module_Init(&hcan, baud_enum) != HAL_OK) {
 		// TODO
+		Error_Handler();
 	}
+	// node_id is the preferred address; the claim may move the node off it
+	Claim_Module_Init(node_id);
+	// Class ID plan if configured; one that fails its check keeps node_id + offset
+	(void)Id_Plan_Module_Init();
+	Boot_Module_Mark(BOOT_PHASE_CAN);
 
+	Latency_Module_Init();
 	Process_Signals_Init();
+	PDO_Module_Init();
+	Backfill_Module_Init();
+
+	// XCP predefined DAQ list 0: device-input millivolts, sampled after each update
+	// from a copy of the published snapshot, whichever event the master binds it to
+	const xcp_daq_entry_t xcp_daq0[] = {
+		{ &xcp_daq0_mV[0], 6u },
+		{ &xcp_daq0_mV[3], 6u },
+		{ &xcp_daq0_mV[6], 4u },
+	};
+	XCP_Module_Init(xcp_daq0, sizeof(xcp_daq0) / sizeof(xcp_daq0[0]), XCP_EVENT_PROCESS, Xcp_Daq0_Refresh);
+
+	ISOTP_Module_Init();
+	UDS_Module_Init();
+	Cmd_Module_Init(&sample_period);
+	// Stored profile 0, if any, replaces the built-in configuration
+	Profile_Module_Init(&sample_period);
+	Update_Module_Init();
+
+	Clock_Module_Init();
 
 	last_tick = HAL_GetTick();
 	heartbeat_tick = last_tick;
+	Boot_Module_Mark(BOOT_PHASE_MODULES);
   /* USER CODE END 2 */
 
   /* Infinite loop */
@@ -167,8 +218,29 @@ int main(void)
 
     /* USER CODE BEGIN 3 */
 	  Heartbeat_Task();
+	  Can_Rx_Task();
 	  Process_Signals_Update();
-	  Process_Signals_Send_Can_If_Due(sample_period, timeout_period);
+	  XCP_Module_Event(XCP_EVENT_PROCESS);
+	  Claim_Module_Task();
+	  // Data frames pause after a lost address claim until the next address is
+	  // owned, and while an image download has the bus
+	  if (!Update_Module_Is_Active() && Claim_Module_Can_Send()) {
+		  if (Process_Signals_Send_Can_If_Due(sample_period, timeout_period) == HAL_OK) {
+			  Boot_Module_Mark(BOOT_PHASE_FIRST_FRAME);
+		  }
+		  Backfill_Module_Task();
+	  }
+	  Latency_Module_Task();
+	  XCP_Module_Task();
+	  ISOTP_Module_Task();
+	  UDS_Module_Task();
+	  Cmd_Module_Task();
+	  Boot_Module_Task();
+	  Clock_Module_Task();
+	  CAN_Diag_Module_Task();
+	  Event_Log_Module_Task();
+	  Update_Module_Task();
+	  Profile_Module_Task();
   }
   /* USER CODE END 3 */
 }
@@ -237,7 +309,7 @@ static void MX_ADC_Init(void)
   hadc.Init.Resolution = ADC_RESOLUTION_12B;
   hadc.Init.DataAlign = ADC_DATAALIGN_RIGHT;
   hadc.Init.ScanConvMode = ADC_SCAN_DIRECTION_FORWARD;
-  hadc.Init.EOCSelection = ADC_EOC_SINGLE_CONV;
+  hadc.Init.EOCSelection = ADC_EOC_SEQ_CONV;
   hadc.Init.LowPowerAutoWait = DISABLE;
   hadc.Init.LowPowerAutoPowerOff = DISABLE;
   hadc.Init.ContinuousConvMode = ENABLE;
@@ -255,7 +327,7 @@ static void MX_ADC_Init(void)
   */
   sConfig.Channel = ADC_CHANNEL_0;
   sConfig.Rank = ADC_RANK_CHANNEL_NUMBER;
-  sConfig.SamplingTime = ADC_SAMPLETIME_1CYCLE_5;
+  sConfig.SamplingTime = ADC_SAMPLETIME_239CYCLES_5;
   if (HAL_ADC_ConfigChannel(&hadc, &sConfig) != HAL_OK)
   {
     Error_Handler();
@@ -344,11 +416,11 @@ static void MX_CAN_Init(void)
   hcan.Init.TimeSeg1 = CAN_BS1_13TQ;
   hcan.Init.TimeSeg2 = CAN_BS2_2TQ;
   hcan.Init.TimeTriggeredMode = DISABLE;
-  hcan.Init.AutoBusOff = DISABLE;
-  hcan.Init.AutoWakeUp = DISABLE;
-  hcan.Init.AutoRetransmission = DISABLE;
+  hcan.Init.AutoBusOff = ENABLE;
+  hcan.Init.AutoWakeUp = ENABLE;
+  hcan.Init.AutoRetransmission = ENABLE;
   hcan.Init.ReceiveFifoLocked = DISABLE;
-  hcan.Init.TransmitFifoPriority = DISABLE;
+  hcan.Init.TransmitFifoPriority = ENABLE;
   if (HAL_CAN_Init(&hcan) != HAL_OK)
   {
     Error_Handler();
@@ -370,7 +442,7 @@ static void MX_DMA_Init(void)
 
   /* DMA interrupt init */
   /* DMA1_Channel1_IRQn interrupt configuration */
-  HAL_NVIC_SetPriority(DMA1_Channel1_IRQn, 0, 0);
+  HAL_NVIC_SetPriority(DMA1_Channel1_IRQn, 1, 0);
   HAL_NVIC_EnableIRQ(DMA1_Channel1_IRQn);
 
 }
@@ -420,6 +492,15 @@ void Heartbeat_Task(void) {
 	}
 }
 
+/**
+ * @brief XCP DAQ list 0 refresh: copy the published millivolts. The seqlock
+ *        read retries if an update is published meanwhile, so the list never
+ *        mixes two updates, also when sampled from the ADC interrupt.
+ */
+static void Xcp_Daq0_Refresh(void) {
+	Process_Signals_Get_All_Input_mV(xcp_daq0_mV);
+}
+
 /**
  * @brief Periodically send a simple CAN test message and flash LED on success.
  *        Note: Updated to use CAN_Module_Send_Std() from can_module.c.
@@ -451,20 +532,74 @@ static void Test_Can_Task(uint16_t value) {
 	}
 }
 
+/**
+ * @brief Drain the RX FIFO without blocking and hand each frame to the
+ *        protocol handlers.
+ */
+static void Can_Rx_Task(void) {
+	uint16_t id;
+	uint8_t data[8];
+	uint8_t dlc;
+
+	while (CAN_Module_Receive_Std(&id, data, &dlc, 0u) == HAL_OK) {
+		if (Claim_Module_Handle_Frame(id, data, dlc)) {
+			continue;
+		}
+		if (Update_Module_Handle_Frame(id, data, dlc)) {
+			continue;
+		}
+		if (XCP_Module_Handle_Frame(id, data, dlc)) {
+			continue;
+		}
+		if (Cmd_Module_Handle_Frame(id, data, dlc)) {
+			continue;
+		}
+		(void) ISOTP_Module_Handle_Frame(id, data, dlc);
+	}
+}
+
+/* Called from the DMA interrupt each time a full ADC scan has been written */
+void HAL_ADC_ConvCpltCallback(ADC_HandleTypeDef *h) {
+	(void) h;
+	ADC_Module_Scan_Complete();
+	Boot_Module_Mark(BOOT_PHASE_FIRST_SCAN);
+	Latency_Module_Mark_Scan();
+	XCP_Module_Event(XCP_EVENT_ADC_SCAN);
+}
+
 /* Called when a mailbox actually finishes transmitting */
 void HAL_CAN_TxMailbox0CompleteCallback(CAN_HandleTypeDef *h) {
 	(void) h;
 	g_can_dbg.tx_ok_count++;
+	Latency_Module_Tx_Complete(CAN_Module_Get_Tx_Mailbox_Std_Id(0u));
 }
 
 void HAL_CAN_TxMailbox1CompleteCallback(CAN_HandleTypeDef *h) {
 	(void) h;
 	g_can_dbg.tx_ok_count++;
+	Latency_Module_Tx_Complete(CAN_Module_Get_Tx_Mailbox_Std_Id(1u));
 }
 
 void HAL_CAN_TxMailbox2CompleteCallback(CAN_HandleTypeDef *h) {
 	(void) h;
 	g_can_dbg.tx_ok_count++;
+	Latency_Module_Tx_Complete(CAN_Module_Get_Tx_Mailbox_Std_Id(2u));
+}
+
+/* Called when a mailbox was aborted: a data frame replaced by a newer copy */
+void HAL_CAN_TxMailbox0AbortCallback(CAN_HandleTypeDef *h) {
+	(void) h;
+	PDO_Module_Tx_Aborted(CAN_Module_Get_Tx_Mailbox_Std_Id(0u));
+}
+
+void HAL_CAN_TxMailbox1AbortCallback(CAN_HandleTypeDef *h) {
+	(void) h;
+	PDO_Module_Tx_Aborted(CAN_Module_Get_Tx_Mailbox_Std_Id(1u));
+}
+
+void HAL_CAN_TxMailbox2AbortCallback(CAN_HandleTypeDef *h) {
+	(void) h;
+	PDO_Module_Tx_Aborted(CAN_Module_Get_Tx_Mailbox_Std_Id(2u));
 }
 
 /* Called on any CAN error (ACK error, bus-off, etc.) */
@@ -473,6 +608,9 @@ void HAL_CAN_ErrorCallback(CAN_HandleTypeDef *h) {
 	g_can_dbg.last_esr = h->Instance->ESR; /* includes TEC/REC/LEC */
 	g_can_dbg.last_tsr = h->Instance->TSR;
 	g_can_dbg.tx_error_count++;
+	CAN_Diag_Module_Error_Isr(g_can_dbg.last_hal_error, g_can_dbg.last_esr);
+	Claim_Module_Error_Isr(g_can_dbg.last_hal_error);
+	HAL_CAN_ResetError(h);
 }
 
 /* USER CODE END 4 */
@@ -485,6 +623,7 @@ void Error_Handler(void)
 {
   /* USER CODE BEGIN Error_Handler_Debug */
 	/* User can add his own implementation to report the HAL error return state */
+	Event_Log_Module_Fatal(EVENT_LOG_ERROR_HANDLER, (uint32_t)(uintptr_t)__builtin_return_address(0), 0u);
 	__disable_irq();
 	while (1) {
 	}
@@ -0,0 +1,499 @@
+/* pdo_module.c
+ *
+ * Mapping table, table compiler, packer and send scheduling of the data frames.
+ */
+
+#include "pdo_module.h"
+#include "process_signals.h"
+#include "adc_module.h"
+#include "can_module.h"
+#include "clock_module.h"
+#include "id_plan_module.h"
+#include "claim_module.h"
+#include "latency_module.h"
+#include "timebase_module.h"
+#include "update_module.h"
+
+#include <string.h>
+
+/* Node-relative identifiers owned by the command, XCP, UDS, Bus Health and
+ * backfill frames. */
+#define PDO_RESERVED_OFFSET_MIN 0x5u
+#define PDO_RESERVED_OFFSET_MAX 0xCu
+
+/* ===== Built-in layouts ===== */
+
+#define MV_BE(ch, off)  { PDO_SRC_MV, (ch), (off), 16u, PDO_ENC_BE }
+#define E2E_HEADER      { PDO_SRC_CRC8, 0u, 0u, 8u, PDO_ENC_BE }, \
+                        { PDO_SRC_ALIVE, 0u, 12u, 4u, PDO_ENC_BE }
+#define UNUSED_FRAME    { PDO_ID_UNUSED, 0u, 0u, 0u, { { 0u } } }
+
+static const pdo_frame_t s_layout_plain[PDO_MAX_FRAMES] = {
+    { 0x1u, 0u, 8u, 4u, { MV_BE(0u, 0u), MV_BE(1u, 16u), MV_BE(2u, 32u), MV_BE(3u, 48u) } },
+    { 0x2u, 0u, 8u, 4u, { MV_BE(4u, 0u), MV_BE(5u, 16u), MV_BE(6u, 32u), MV_BE(7u, 48u) } },
+    UNUSED_FRAME,
+    UNUSED_FRAME,
+};
+
+static const pdo_frame_t s_layout_e2e[PDO_MAX_FRAMES] = {
+    { 0x1u, 0u, 8u, 5u, { E2E_HEADER, MV_BE(0u, 16u), MV_BE(1u, 32u), MV_BE(2u, 48u) } },
+    { 0x2u, 0u, 8u, 5u, { E2E_HEADER, MV_BE(3u, 16u), MV_BE(4u, 32u), MV_BE(5u, 48u) } },
+    { 0x4u, 0u, 8u, 5u, { E2E_HEADER, MV_BE(6u, 16u), MV_BE(7u, 32u),
+                          { PDO_SRC_OOR_MASK, 0u, 48u, 8u, PDO_ENC_BE } } },
+    UNUSED_FRAME,
+};
+
+/* ===== Private state ===== */
+
+static pdo_tables_t s_tables = { .layout = (PS_E2E_DEFAULT != 0) ? PDO_LAYOUT_E2E : PDO_LAYOUT_PLAIN };
+
+/* Tables in use: s_tables, or a stored profile's (read only) until the
+ * table is changed. */
+static const pdo_tables_t *s_run = &s_tables;
+
+static uint8_t      s_alive[PDO_MAX_FRAMES];
+static uint32_t     s_tx_drops[PDO_MAX_FRAMES];
+static volatile uint32_t s_tx_replaced[PDO_MAX_FRAMES];
+static uint8_t      s_replaced_mask = 0u;
+static uint32_t     s_last_send_tick[PDO_MAX_FRAMES];
+static bool         s_sent_once = false;
+
+/* CRC-8 SAE J1850 lookup table (polynomial 0x1D). */
+static const uint8_t s_crc8_table[256] = {
+    0x00u, 0x1Du, 0x3Au, 0x27u, 0x74u, 0x69u, 0x4Eu, 0x53u,
+    0xE8u, 0xF5u, 0xD2u, 0xCFu, 0x9Cu, 0x81u, 0xA6u, 0xBBu,
+    0xCDu, 0xD0u, 0xF7u, 0xEAu, 0xB9u, 0xA4u, 0x83u, 0x9Eu,
+    0x25u, 0x38u, 0x1Fu, 0x02u, 0x51u, 0x4Cu, 0x6Bu, 0x76u,
+    0x87u, 0x9Au, 0xBDu, 0xA0u, 0xF3u, 0xEEu, 0xC9u, 0xD4u,
+    0x6Fu, 0x72u, 0x55u, 0x48u, 0x1Bu, 0x06u, 0x21u, 0x3Cu,
+    0x4Au, 0x57u, 0x70u, 0x6Du, 0x3Eu, 0x23u, 0x04u, 0x19u,
+    0xA2u, 0xBFu, 0x98u, 0x85u, 0xD6u, 0xCBu, 0xECu, 0xF1u,
+    0x13u, 0x0Eu, 0x29u, 0x34u, 0x67u, 0x7Au, 0x5Du, 0x40u,
+    0xFBu, 0xE6u, 0xC1u, 0xDCu, 0x8Fu, 0x92u, 0xB5u, 0xA8u,
+    0xDEu, 0xC3u, 0xE4u, 0xF9u, 0xAAu, 0xB7u, 0x90u, 0x8Du,
+    0x36u, 0x2Bu, 0x0Cu, 0x11u, 0x42u, 0x5Fu, 0x78u, 0x65u,
+    0x94u, 0x89u, 0xAEu, 0xB3u, 0xE0u, 0xFDu, 0xDAu, 0xC7u,
+    0x7Cu, 0x61u, 0x46u, 0x5Bu, 0x08u, 0x15u, 0x32u, 0x2Fu,
+    0x59u, 0x44u, 0x63u, 0x7Eu, 0x2Du, 0x30u, 0x17u, 0x0Au,
+    0xB1u, 0xACu, 0x8Bu, 0x96u, 0xC5u, 0xD8u, 0xFFu, 0xE2u,
+    0x26u, 0x3Bu, 0x1Cu, 0x01u, 0x52u, 0x4Fu, 0x68u, 0x75u,
+    0xCEu, 0xD3u, 0xF4u, 0xE9u, 0xBAu, 0xA7u, 0x80u, 0x9Du,
+    0xEBu, 0xF6u, 0xD1u, 0xCCu, 0x9Fu, 0x82u, 0xA5u, 0xB8u,
+    0x03u, 0x1Eu, 0x39u, 0x24u, 0x77u, 0x6Au, 0x4Du, 0x50u,
+    0xA1u, 0xBCu, 0x9Bu, 0x86u, 0xD5u, 0xC8u, 0xEFu, 0xF2u,
+    0x49u, 0x54u, 0x73u, 0x6Eu, 0x3Du, 0x20u, 0x07u, 0x1Au,
+    0x6Cu, 0x71u, 0x56u, 0x4Bu, 0x18u, 0x05u, 0x22u, 0x3Fu,
+    0x84u, 0x99u, 0xBEu, 0xA3u, 0xF0u, 0xEDu, 0xCAu, 0xD7u,
+    0x35u, 0x28u, 0x0Fu, 0x12u, 0x41u, 0x5Cu, 0x7Bu, 0x66u,
+    0xDDu, 0xC0u, 0xE7u, 0xFAu, 0xA9u, 0xB4u, 0x93u, 0x8Eu,
+    0xF8u, 0xE5u, 0xC2u, 0xDFu, 0x8Cu, 0x91u, 0xB6u, 0xABu,
+    0x10u, 0x0Du, 0x2Au, 0x37u, 0x64u, 0x79u, 0x5Eu, 0x43u,
+    0xB2u, 0xAFu, 0x88u, 0x95u, 0xC6u, 0xDBu, 0xFCu, 0xE1u,
+    0x5Au, 0x47u, 0x60u, 0x7Du, 0x2Eu, 0x33u, 0x14u, 0x09u,
+    0x7Fu, 0x62u, 0x45u, 0x58u, 0x0Bu, 0x16u, 0x31u, 0x2Cu,
+    0x97u, 0x8Au, 0xADu, 0xB0u, 0xE3u, 0xFEu, 0xD9u, 0xC4u,
+};
+
+/* ===== Helpers ===== */
+
+static bool is_per_channel(uint8_t source)
+{
+    return source == PDO_SRC_MV || source == PDO_SRC_RAW ||
+           source == PDO_SRC_STAT_MIN || source == PDO_SRC_STAT_MAX ||
+           source == PDO_SRC_STAT_MEAN;
+}
+
+static bool is_counter(uint8_t source)
+{
+    return source == PDO_SRC_STAT_COUNT || source == PDO_SRC_UPTIME_MS ||
+           source == PDO_SRC_TIME_US || source == PDO_SRC_SCAN_COUNT ||
+           source == PDO_SRC_ALIVE;
+}
+
+/* Frame bit (byte k / 8, bit k % 8) that holds value bit i of entry e. */
+static uint8_t frame_bit(const pdo_entry_t *e, uint8_t i)
+{
+    if (e->encoding == PDO_ENC_LE) {
+        return (uint8_t)(e->bit_offset + i);
+    }
+    const uint8_t q = (uint8_t)(e->bit_offset + e->bit_length - 1u - i);  /* MSB-first position */
+    return (uint8_t)((q & ~7u) | (7u - (q & 7u)));
+}
+
+static uint16_t resolve_id(uint16_t id)
+{
+    if ((id & PDO_ID_ABSOLUTE) != 0u) {
+        return (uint16_t)(id & 0x7FFu);
+    }
+    return Id_Plan_Module_Std_Id(id);
+}
+
+/* IDs a mapping must not send on: the update multicast and claim IDs, and
+ * this node's command, XCP, UDS, Bus Health and backfill IDs. */
+static bool is_reserved(uint16_t std_id)
+{
+    if (std_id == UPDATE_MCAST_ID || Claim_Module_Is_Claim_Id(std_id)) {
+        return true;
+    }
+    for (uint16_t off = PDO_RESERVED_OFFSET_MIN; off <= PDO_RESERVED_OFFSET_MAX; ++off) {
+        if (Id_Plan_Module_Std_Id(off) == std_id) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool id_is_valid(uint16_t id)
+{
+    if ((id & PDO_ID_ABSOLUTE) != 0u) {
+        if ((id & (uint16_t)~(PDO_ID_ABSOLUTE | 0x7FFu)) != 0u || Id_Plan_Module_Is_Planned(id & 0x7FFu)) {
+            return false;
+        }
+    } else if (id > 0x7FFu || (Id_Plan_Module_Is_Class_Plan() && id >= ID_PLAN_OFFSETS)) {
+        return false;
+    }
+    return !is_reserved(resolve_id(id));
+}
+
+/* Checks the table with frame `repl` replaced by `frame` (NULL: no
+ * replacement) and, if commit is set, writes its program. Checking first
+ * means a rejected table never touches the running program. */
+static bool compile(uint8_t repl, const pdo_frame_t *frame, bool commit)
+{
+    uint8_t n_loads = 0u;
+    uint8_t n_puts = 0u;
+
+    for (uint8_t f = 0u; f < PDO_MAX_FRAMES; ++f) {
+        const pdo_frame_t *m = (f == repl && frame != NULL) ? frame : &s_tables.map[f];
+        pdo_prog_t prog = { n_loads, 0u, n_puts, -1 };
+
+        if (m->id != PDO_ID_UNUSED) {
+            if (!id_is_valid(m->id) || m->dlc > 8u || m->num_entries > PDO_MAX_ENTRIES) {
+                return false;
+            }
+            for (uint8_t g = 0u; g < f; ++g) {
+                const pdo_frame_t *o = (g == repl && frame != NULL) ? frame : &s_tables.map[g];
+                if (o->id != PDO_ID_UNUSED && resolve_id(o->id) == resolve_id(m->id)) {
+                    return false;
+                }
+            }
+
+            uint64_t used = 0u;
+            for (uint8_t k = 0u; k < m->num_entries; ++k) {
+                const pdo_entry_t *e = &m->entry[k];
+                if (e->source >= PDO_NUM_SOURCES || e->encoding > PDO_ENC_LE ||
+                    e->bit_length == 0u || e->bit_length > 32u ||
+                    (uint16_t)e->bit_offset + e->bit_length > 8u * m->dlc ||
+                    (is_per_channel(e->source) && e->index >= PS_NUM_CHANNELS)) {
+                    return false;
+                }
+                for (uint8_t i = 0u; i < e->bit_length; ++i) {
+                    const uint64_t bit = (uint64_t)1u << frame_bit(e, i);
+                    if ((used & bit) != 0u) {
+                        return false;
+                    }
+                    used |= bit;
+                }
+
+                if (e->source == PDO_SRC_CRC8) {
+                    if (e->bit_length != 8u || (e->bit_offset & 7u) != 0u || prog.crc_byte >= 0) {
+                        return false;
+                    }
+                    prog.crc_byte = (int8_t)(e->bit_offset / 8u);
+                    continue;
+                }
+
+                /* One byte write per run of value bits that land in the same byte. */
+                pdo_load_t load = { e->source, e->index, 0u, UINT32_MAX };
+                if (!is_counter(e->source) && e->bit_length < 32u) {
+                    load.max = (1u << e->bit_length) - 1u;
+                }
+                uint8_t i = 0u;
+                while (i < e->bit_length) {
+                    const uint8_t b0 = frame_bit(e, i);
+                    uint8_t n = 1u;
+                    while ((uint8_t)(i + n) < e->bit_length &&
+                           frame_bit(e, (uint8_t)(i + n)) == (uint8_t)(b0 + n) &&
+                           ((b0 + n) & 7u) != 0u) {
+                        n++;
+                    }
+                    if (n_puts >= PDO_MAX_PUTS) {
+                        return false;
+                    }
+                    if (commit) {
+                        pdo_put_t *p = &s_tables.puts[n_puts];
+                        p->byte = (uint8_t)(b0 / 8u);
+                        p->rshift = i;
+                        p->lshift = (uint8_t)(b0 & 7u);
+                        p->mask = (uint8_t)(((1u << n) - 1u) << p->lshift);
+                    }
+                    n_puts++;
+                    load.num_puts++;
+                    i = (uint8_t)(i + n);
+                }
+                if (commit) {
+                    s_tables.loads[n_loads] = load;
+                }
+                n_loads++;
+                prog.num_loads++;
+            }
+        }
+        if (commit) {
+            s_tables.prog[f] = prog;
+        }
+    }
+    return true;
+}
+
+static uint8_t enabled_mask(void)
+{
+    uint8_t mask = 0u;
+    for (uint8_t i = 0u; i < PS_NUM_CHANNELS; ++i) {
+        if (Process_Signals_Get_Enabled(i)) {
+            mask |= (uint8_t)(1u << i);
+        }
+    }
+    return mask;
+}
+
+static uint32_t fetch(uint8_t source, uint8_t index, uint8_t f, const ps_snapshot_t *snap)
+{
+    uint16_t v = 0u;
+    switch (source) {
+    case PDO_SRC_CONST:        return index;
+    case PDO_SRC_MV:           return snap->mV[index];
+    case PDO_SRC_RAW:          return snap->raw[index];
+    case PDO_SRC_OOR_MASK:     return snap->oor_mask;
+    case PDO_SRC_ENABLED_MASK: return enabled_mask();
+    case PDO_SRC_STAT_MIN:     Process_Signals_Get_Stats(index, &v, NULL, NULL); return v;
+    case PDO_SRC_STAT_MAX:     Process_Signals_Get_Stats(index, NULL, &v, NULL); return v;
+    case PDO_SRC_STAT_MEAN:    Process_Signals_Get_Stats(index, NULL, NULL, &v); return v;
+    case PDO_SRC_STAT_COUNT:   return Process_Signals_Get_Stats_Count();
+    case PDO_SRC_UPTIME_MS:    return HAL_GetTick();
+    case PDO_SRC_TIME_US:      return Timebase_Module_Now_Us();
+    case PDO_SRC_SCAN_COUNT:   return ADC_Module_Get_Scan_Count();
+    case PDO_SRC_CPU_LOAD:     return Clock_Module_Get_Load_Permille();
+    case PDO_SRC_ALIVE:        return s_alive[f];
+    default:                   return 0u;
+    }
+}
+
+/* CRC-8 SAE J1850 over the 11-bit ID (low byte first) and every payload byte but the CRC's. */
+static uint8_t e2e_crc8(uint16_t std_id, const uint8_t *data, uint8_t dlc, uint8_t crc_byte)
+{
+    uint8_t crc = 0xFFu;
+    crc = s_crc8_table[crc ^ (uint8_t)(std_id & 0xFFu)];
+    crc = s_crc8_table[crc ^ (uint8_t)(std_id >> 8)];
+    for (uint8_t i = 0u; i < dlc; ++i) {
+        if (i != crc_byte) {
+            crc = s_crc8_table[crc ^ data[i]];
+        }
+    }
+    return (uint8_t)(crc ^ 0xFFu);
+}
+
+/* Runs the program of frame f into data[8]. The signals all come from one
+ * published processing update. */
+static void pack(uint8_t f, uint16_t std_id, uint8_t *data)
+{
+    const pdo_prog_t *prog = &s_run->prog[f];
+    const pdo_load_t *load = &s_run->loads[prog->first_load];
+    const pdo_load_t *end = load + prog->num_loads;
+    const pdo_put_t *put = &s_run->puts[prog->first_put];
+    ps_snapshot_t snap;
+
+    Process_Signals_Get_Snapshot(&snap);
+    memset(data, 0, 8u);
+    for (; load < end; ++load) {
+        uint32_t v = fetch(load->source, load->index, f, &snap);
+        if (v > load->max) {
+            v = load->max;
+        }
+        for (uint8_t k = load->num_puts; k != 0u; --k, ++put) {
+            data[put->byte] |= (uint8_t)(((v >> put->rshift) << put->lshift) & put->mask);
+        }
+    }
+    if (prog->crc_byte >= 0) {
+        data[prog->crc_byte] = e2e_crc8(std_id, data, s_run->map[f].dlc, (uint8_t)prog->crc_byte);
+    }
+}
+
+/* Packs and sends frame f, in place of a copy still pending. Counts drops. */
+static HAL_StatusTypeDef send_frame(uint8_t f, uint32_t timeout_ms)
+{
+    const uint16_t id = resolve_id(s_run->map[f].id);
+    uint8_t data[8];
+    pack(f, id, data);
+    s_alive[f]++;
+
+#if PDO_REPLACE_PENDING
+    if (CAN_Module_Abort_Std(id) != 0u) {
+        s_replaced_mask |= (uint8_t)(1u << f);
+    }
+#endif
+    Latency_Module_Mark_Queued(f, id);
+    const HAL_StatusTypeDef st = CAN_Module_Send_Std(id, data, s_run->map[f].dlc, timeout_ms);
+    if (st != HAL_OK) {
+        Latency_Module_Mark_Dropped(f);
+        s_tx_drops[f]++;
+    } else {
+        Latency_Module_Mark_Accepted(f);
+    }
+    return st;
+}
+
+/* ===== Public API ===== */
+
+void PDO_Module_Init(void)
+{
+    for (uint8_t f = 0u; f < PDO_MAX_FRAMES; ++f) {
+        s_alive[f] = 0u;
+        s_tx_drops[f] = 0u;
+        s_tx_replaced[f] = 0u;
+        s_last_send_tick[f] = HAL_GetTick();
+    }
+    s_sent_once = false;
+    s_replaced_mask = 0u;
+    PDO_Module_Load_Layout((s_run->layout == PDO_LAYOUT_E2E) ? PDO_LAYOUT_E2E : PDO_LAYOUT_PLAIN);
+}
+
+void PDO_Module_Load_Layout(pdo_layout_t layout)
+{
+    if (layout == PDO_LAYOUT_CUSTOM) {
+        return;
+    }
+    memcpy(s_tables.map, (layout == PDO_LAYOUT_E2E) ? s_layout_e2e : s_layout_plain, sizeof(s_tables.map));
+    (void)compile(PDO_MAX_FRAMES, NULL, true);
+    s_tables.layout = layout;
+    s_run = &s_tables;
+}
+
+pdo_layout_t PDO_Module_Get_Layout(void)
+{
+    return s_run->layout;
+}
+
+HAL_StatusTypeDef PDO_Module_Set_Frame(uint8_t f, const pdo_frame_t *frame)
+{
+    if (f >= PDO_MAX_FRAMES || frame == NULL) {
+        return HAL_ERROR;
+    }
+    PDO_Module_Use_Tables(NULL);
+    if (!compile(f, frame, false)) {
+        return HAL_ERROR;
+    }
+    s_tables.map[f] = *frame;
+    (void)compile(PDO_MAX_FRAMES, NULL, true);
+    s_tables.layout = PDO_LAYOUT_CUSTOM;
+    return HAL_OK;
+}
+
+bool PDO_Module_Get_Frame(uint8_t f, pdo_frame_t *out)
+{
+    if (f >= PDO_MAX_FRAMES || out == NULL) {
+        return false;
+    }
+    *out = s_run->map[f];
+    return true;
+}
+
+uint16_t PDO_Module_Resolve_Id(uint16_t id)
+{
+    return resolve_id(id);
+}
+
+const pdo_tables_t* PDO_Module_Get_Tables(void)
+{
+    return s_run;
+}
+
+void PDO_Module_Use_Tables(const pdo_tables_t *tables)
+{
+    if (tables != NULL) {
+        s_run = tables;
+    } else if (s_run != &s_tables) {
+        memcpy(&s_tables, s_run, sizeof(s_tables));
+        s_run = &s_tables;
+    }
+}
+
+uint32_t PDO_Module_Get_Tx_Drops(uint8_t f)
+{
+    return (f < PDO_MAX_FRAMES) ? s_tx_drops[f] : 0u;
+}
+
+uint32_t PDO_Module_Get_Tx_Replaced(uint8_t f)
+{
+    return (f < PDO_MAX_FRAMES) ? s_tx_replaced[f] : 0u;
+}
+
+uint8_t PDO_Module_Get_Replaced_Mask(void)
+{
+    return s_replaced_mask;
+}
+
+void PDO_Module_Tx_Aborted(uint16_t std_id)
+{
+    for (uint8_t f = 0u; f < PDO_MAX_FRAMES; ++f) {
+        if (s_run->map[f].id != PDO_ID_UNUSED && resolve_id(s_run->map[f].id) == std_id) {
+            s_tx_replaced[f]++;
+            return;
+        }
+    }
+}
+
+HAL_StatusTypeDef PDO_Module_Send_All(uint32_t timeout_ms)
+{
+    HAL_StatusTypeDef first_err = HAL_OK;
+    for (uint8_t f = 0u; f < PDO_MAX_FRAMES; ++f) {
+        if (s_run->map[f].id == PDO_ID_UNUSED) {
+            continue;
+        }
+        const HAL_StatusTypeDef st = send_frame(f, timeout_ms);
+        if (first_err == HAL_OK) first_err = st;
+    }
+    return first_err;
+}
+
+HAL_StatusTypeDef PDO_Module_Send_If_Due(uint32_t sample_period_ms, uint32_t timeout_ms)
+{
+    const uint32_t now = HAL_GetTick();
+    bool first = false;
+    if (!s_sent_once) {
+        /* First frames after boot: due as soon as the DMA buffer holds a scan. */
+        if (ADC_Module_Get_Scan_Count() == 0u) {
+            return HAL_BUSY;
+        }
+        first = true;
+    }
+
+    uint32_t due = 0u;
+    for (uint8_t f = 0u; f < PDO_MAX_FRAMES; ++f) {
+        if (s_run->map[f].id == PDO_ID_UNUSED) {
+            continue;
+        }
+        const uint32_t period = (s_run->map[f].period_ms != 0u) ? s_run->map[f].period_ms : sample_period_ms;
+        if (first || (now - s_last_send_tick[f]) >= period) {
+            due |= 1u << f;
+        }
+    }
+    if (due == 0u) {
+        return HAL_BUSY;
+    }
+    s_sent_once = true;
+
+    /* Update snapshot right before sending to minimize staleness. */
+    Process_Signals_Update();
+    s_replaced_mask = 0u;
+
+    HAL_StatusTypeDef first_err = HAL_OK;
+    for (uint8_t f = 0u; f < PDO_MAX_FRAMES; ++f) {
+        if ((due & (1u << f)) == 0u) {
+            continue;
+        }
+        s_last_send_tick[f] = now;
+        const HAL_StatusTypeDef st = send_frame(f, timeout_ms);
+        if (first_err == HAL_OK) first_err = st;
+    }
+    return first_err;
+}
@@ -1,20 +1,32 @@
 #include "process_signals.h"
 #include "adc_module.h"   /* DMA-backed readings */   /* uses ADC_Module_Get_Buffer() */
-#include "can_module.h"   /* CAN send + node id */    /* uses CAN_Module_Send_Std() */
+#include "latency_module.h"
+#include "pdo_module.h"     /* data frame mapping and sending */
+#include "event_log_module.h"
+#include "backfill_module.h"  /* samples the bus did not take */
 
 #include <string.h>
 #include <math.h>
 
 /* ---------- Internal state ---------- */
 
+static ps_cal_t s_cal[PS_NUM_CHANNELS];
+
+/* Calibration in use: s_cal, or a stored profile's (read only) until a
+ * setter takes it over. */
+static const ps_cal_t *s_cal_run = s_cal;
+
 typedef struct {
-    float gain;     /* V_in = gain * V_pin + offset */
-    float offset;   /* volts */
-    float v_min;    /* device-input min (V) */
-    float v_max;    /* device-input max (V) */
-} ps_cal_t;
+    uint16_t min_mV;
+    uint16_t max_mV;
+    uint64_t sum_mV;
+} ps_stats_t;
 
-static ps_cal_t s_cal[PS_NUM_CHANNELS];
+/* The window counts ADC scans: an update adds to it only if a new scan
+ * completed since the last one it added. */
+static ps_stats_t s_stats[PS_NUM_CHANNELS];
+static uint32_t   s_stats_count = 0u;
+static uint32_t   s_stats_scan = 0u;
 
 static uint16_t s_raw[PS_NUM_CHANNELS];       /* snapshot of ADC counts */
 static float    s_v_pin[PS_NUM_CHANNELS];     /* volts at MCU pin */
@@ -22,7 +34,11 @@ static float    s_v_in[PS_NUM_CHANNELS];      /* volts at device input */
 static uint16_t s_v_in_mV[PS_NUM_CHANNELS];   /* device input in millivolts */
 static uint8_t  s_oor_mask = 0u;
 
-static uint32_t s_last_send_tick = 0u;
+/* Published updates. s_pub_seq is odd while the writer fills buffer
+ * ((seq >> 1) + 1) & 1; the latest complete update is always in buffer
+ * (seq >> 1) & 1, which the writer only touches again two updates later. */
+static ps_snapshot_t     s_pub[2];
+static volatile uint32_t s_pub_seq = 0u;
 
 /* ---------- Helpers ---------- */
 
@@ -43,11 +59,44 @@ static inline uint16_t volts_to_mV_u16(float v)
     return (uint16_t)(mv + 0.5f);
 }
 
-/* Big-endian write of u16 into a byte buffer. */
-static inline void put_u16_be(uint8_t *buf, uint16_t v)
+/* Copy the working arrays into the back buffer and flip. */
+static void publish(void)
 {
-    buf[0] = (uint8_t)((v >> 8) & 0xFFu);
-    buf[1] = (uint8_t)(v & 0xFFu);
+    const uint32_t seq = s_pub_seq + 1u;
+    ps_snapshot_t *back = &s_pub[((seq >> 1) + 1u) & 1u];
+
+    s_pub_seq = seq;
+    __DMB();
+    memcpy(back->raw, s_raw, sizeof(back->raw));
+    memcpy(back->mV, s_v_in_mV, sizeof(back->mV));
+    memcpy(back->v_in, s_v_in, sizeof(back->v_in));
+    back->oor_mask = s_oor_mask;
+    __DMB();
+    s_pub_seq = seq + 1u;
+}
+
+/* Latest complete update; the copy taken from it is good if read_ok(seq). */
+static const ps_snapshot_t *read_begin(uint32_t *seq)
+{
+    *seq = s_pub_seq;
+    __DMB();
+    return &s_pub[(*seq >> 1) & 1u];
+}
+
+static bool read_ok(uint32_t seq)
+{
+    __DMB();
+    /* The buffer is written again from sequence (seq & ~1) + 3 on. */
+    return (uint32_t)(s_pub_seq - (seq & ~1u)) < 3u;
+}
+
+/* Makes s_cal the calibration in use, starting from the one in use. */
+static void own_cal(void)
+{
+    if (s_cal_run != s_cal) {
+        memcpy(s_cal, s_cal_run, sizeof(s_cal));
+        s_cal_run = s_cal;
+    }
 }
 
 /* ---------- Public API ---------- */
@@ -59,13 +108,17 @@ void Process_Signals_Init(void)
         s_cal[i].offset = 0.0f;
         s_cal[i].v_min  = PS_DEFAULT_MIN_V; /* device-input domain */
         s_cal[i].v_max  = PS_DEFAULT_MAX_V;
+        s_cal[i].enabled = true;
         s_raw[i]        = 0u;
         s_v_pin[i]      = 0.0f;
         s_v_in[i]       = 0.0f;
         s_v_in_mV[i]    = 0u;
     }
+    s_cal_run = s_cal;
     s_oor_mask = 0u;
-    s_last_send_tick = HAL_GetTick();
+    memset(s_pub, 0, sizeof(s_pub));
+    s_pub_seq = 0u;
+    Process_Signals_Reset_Stats();
 }
 
 void Process_Signals_Update(void)
@@ -80,52 +133,113 @@ void Process_Signals_Update(void)
     uint8_t mask = 0u;
     for (uint8_t i = 0; i < PS_NUM_CHANNELS; ++i) {
         const float vpin = adc_raw_to_vpin(s_raw[i]);
-        const float vin  = s_cal[i].gain * vpin + s_cal[i].offset;
+        const ps_cal_t *cal = &s_cal_run[i];
+        const float vin  = cal->enabled ? (cal->gain * vpin + cal->offset) : 0.0f;
 
         s_v_pin[i]   = vpin;
         s_v_in[i]    = vin;
         s_v_in_mV[i] = volts_to_mV_u16(vin);
 
-        if (vin < s_cal[i].v_min || vin > s_cal[i].v_max) {
+        if (cal->enabled && (vin < cal->v_min || vin > cal->v_max)) {
             mask |= (uint8_t)(1u << i);
         }
     }
+    if (mask != s_oor_mask) {
+        (void)Event_Log_Module_Add(EVENT_LOG_OOR, mask, (uint32_t)(mask ^ s_oor_mask), 0u);
+    }
     s_oor_mask = mask;
+
+    /* Accumulate statistics for the current window, once per ADC scan. */
+    const uint32_t scan = ADC_Module_Get_Scan_Count();
+    if (scan != s_stats_scan && s_stats_count != UINT32_MAX) {
+        s_stats_scan = scan;
+        for (uint8_t i = 0; i < PS_NUM_CHANNELS; ++i) {
+            const uint16_t mv = s_v_in_mV[i];
+            if (mv < s_stats[i].min_mV) s_stats[i].min_mV = mv;
+            if (mv > s_stats[i].max_mV) s_stats[i].max_mV = mv;
+            s_stats[i].sum_mV += mv;
+        }
+        s_stats_count++;
+    }
+
+    publish();
+    Latency_Module_Mark_Processed();
+}
+
+void Process_Signals_Get_Snapshot(ps_snapshot_t *out)
+{
+    if (!out) return;
+    uint32_t seq;
+    do {
+        *out = *read_begin(&seq);
+    } while (!read_ok(seq));
 }
 
 void Process_Signals_Get_All_Raw(uint16_t *out_raw)
 {
     if (!out_raw) return;
-    for (uint8_t i = 0; i < PS_NUM_CHANNELS; ++i) {
-        out_raw[i] = s_raw[i];
-    }
+    uint32_t seq;
+    do {
+        memcpy(out_raw, read_begin(&seq)->raw, sizeof(s_raw));
+    } while (!read_ok(seq));
+}
+
+uint16_t Process_Signals_Get_Raw(uint8_t ch)
+{
+    if (ch >= PS_NUM_CHANNELS) return 0u;
+    uint32_t seq;
+    uint16_t v;
+    do {
+        v = read_begin(&seq)->raw[ch];
+    } while (!read_ok(seq));
+    return v;
 }
 
 float Process_Signals_Get_Input_V(uint8_t ch)
 {
     if (ch >= PS_NUM_CHANNELS) return 0.0f;
-    return s_v_in[ch];
+    uint32_t seq;
+    float v;
+    do {
+        v = read_begin(&seq)->v_in[ch];
+    } while (!read_ok(seq));
+    return v;
 }
 
 uint16_t Process_Signals_Get_Input_mV(uint8_t ch)
 {
     if (ch >= PS_NUM_CHANNELS) return 0u;
-    return s_v_in_mV[ch];
+    uint32_t seq;
+    uint16_t v;
+    do {
+        v = read_begin(&seq)->mV[ch];
+    } while (!read_ok(seq));
+    return v;
 }
 
-const uint16_t* Process_Signals_Get_All_Input_mV(void)
+void Process_Signals_Get_All_Input_mV(uint16_t *out_mV)
 {
-    return s_v_in_mV;
+    if (!out_mV) return;
+    uint32_t seq;
+    do {
+        memcpy(out_mV, read_begin(&seq)->mV, sizeof(s_v_in_mV));
+    } while (!read_ok(seq));
 }
 
 uint8_t Process_Signals_Get_OutOfRange_Mask(void)
 {
-    return s_oor_mask;
+    uint32_t seq;
+    uint8_t v;
+    do {
+        v = read_begin(&seq)->oor_mask;
+    } while (!read_ok(seq));
+    return v;
 }
 
 void Process_Signals_Set_MinMax(uint8_t ch, float v_min, float v_max)
 {
     if (ch >= PS_NUM_CHANNELS) return;
+    own_cal();
     s_cal[ch].v_min = v_min;
     s_cal[ch].v_max = v_max;
 }
@@ -133,8 +247,8 @@ void Process_Signals_Set_MinMax(uint8_t ch, float v_min, float v_max)
 void Process_Signals_Get_MinMax(uint8_t ch, float *v_min_out, float *v_max_out)
 {
     if (ch >= PS_NUM_CHANNELS) return;
-    if (v_min_out) *v_min_out = s_cal[ch].v_min;
-    if (v_max_out) *v_max_out = s_cal[ch].v_max;
+    if (v_min_out) *v_min_out = s_cal_run[ch].v_min;
+    if (v_max_out) *v_max_out = s_cal_run[ch].v_max;
 }
 
 void Process_Signals_Set_Divider(uint8_t ch, float r_top_ohm, float r_bottom_ohm)
@@ -143,6 +257,7 @@ void Process_Signals_Set_Divider(uint8_t ch, float r_top_ohm, float r_bottom_ohm
     if (r_bottom_ohm <= 0.0f) return;
     /* V_in = V_pin * (Rtop + Rbottom)/Rbottom */
     const float gain = (r_top_ohm + r_bottom_ohm) / r_bottom_ohm;
+    own_cal();
     s_cal[ch].gain   = gain;
     s_cal[ch].offset = 0.0f;
 }
@@ -150,49 +265,95 @@ void Process_Signals_Set_Divider(uint8_t ch, float r_top_ohm, float r_bottom_ohm
 void Process_Signals_Set_GainOffset(uint8_t ch, float gain, float offset)
 {
     if (ch >= PS_NUM_CHANNELS) return;
+    own_cal();
     s_cal[ch].gain   = gain;
     s_cal[ch].offset = offset;
 }
 
-HAL_StatusTypeDef Process_Signals_Send_Can(uint32_t timeout_ms)
+void Process_Signals_Get_GainOffset(uint8_t ch, float *gain_out, float *offset_out)
 {
-    /* Ensure latest conversions are used. */
-    /* Caller may have called Update() already; we do not force it. */
+    if (ch >= PS_NUM_CHANNELS) return;
+    if (gain_out)   *gain_out   = s_cal_run[ch].gain;
+    if (offset_out) *offset_out = s_cal_run[ch].offset;
+}
+
+void Process_Signals_Set_Enabled(uint8_t ch, bool enable)
+{
+    if (ch >= PS_NUM_CHANNELS) return;
+    own_cal();
+    s_cal[ch].enabled = enable;
+}
 
-    uint8_t frame[8];
+bool Process_Signals_Get_Enabled(uint8_t ch)
+{
+    return (ch < PS_NUM_CHANNELS) ? s_cal_run[ch].enabled : false;
+}
 
-    /* Frame 1: channels 0..3 */
-    put_u16_be(&frame[0], s_v_in_mV[0]);
-    put_u16_be(&frame[2], s_v_in_mV[1]);
-    put_u16_be(&frame[4], s_v_in_mV[2]);
-    put_u16_be(&frame[6], s_v_in_mV[3]);
+const ps_cal_t* Process_Signals_Get_Cal(void)
+{
+    return s_cal_run;
+}
 
-    uint16_t id1 = (uint16_t)(CAN_Module_Get_Node_Id() + 0x1u);
-    HAL_StatusTypeDef st = CAN_Module_Send_Std(id1, frame, 8u, timeout_ms);
-    if (st != HAL_OK) {
-        return st;
+void Process_Signals_Use_Cal(const ps_cal_t *cal)
+{
+    if (cal == NULL) {
+        own_cal();
+    } else {
+        s_cal_run = cal;
     }
+}
 
-    /* Frame 2: channels 4..7 */
-    put_u16_be(&frame[0], s_v_in_mV[4]);
-    put_u16_be(&frame[2], s_v_in_mV[5]);
-    put_u16_be(&frame[4], s_v_in_mV[6]);
-    put_u16_be(&frame[6], s_v_in_mV[7]);
+void Process_Signals_Reset_Stats(void)
+{
+    for (uint8_t i = 0; i < PS_NUM_CHANNELS; ++i) {
+        s_stats[i].min_mV = 0xFFFFu;
+        s_stats[i].max_mV = 0u;
+        s_stats[i].sum_mV = 0u;
+    }
+    s_stats_count = 0u;
+    s_stats_scan = ADC_Module_Get_Scan_Count();
+}
 
-    uint16_t id2 = (uint16_t)(CAN_Module_Get_Node_Id() + 0x2u);
-    st = CAN_Module_Send_Std(id2, frame, 8u, timeout_ms);
-    return st;
+void Process_Signals_Get_Stats(uint8_t ch, uint16_t *min_out, uint16_t *max_out, uint16_t *mean_out)
+{
+    if (ch >= PS_NUM_CHANNELS) return;
+    const uint32_t n = s_stats_count;
+    if (min_out)  *min_out  = (n > 0u) ? s_stats[ch].min_mV : 0u;
+    if (max_out)  *max_out  = s_stats[ch].max_mV;
+    if (mean_out) *mean_out = (n > 0u) ? (uint16_t)(s_stats[ch].sum_mV / n) : 0u;
+}
+
+uint32_t Process_Signals_Get_Stats_Count(void)
+{
+    return s_stats_count;
+}
+
+void Process_Signals_Set_E2E(bool enable)
+{
+    PDO_Module_Load_Layout(enable ? PDO_LAYOUT_E2E : PDO_LAYOUT_PLAIN);
+}
+
+bool Process_Signals_Get_E2E(void)
+{
+    return PDO_Module_Get_Layout() == PDO_LAYOUT_E2E;
+}
+
+uint32_t Process_Signals_Get_Tx_Drops(uint8_t frame)
+{
+    return PDO_Module_Get_Tx_Drops(frame);
+}
+
+HAL_StatusTypeDef Process_Signals_Send_Can(uint32_t timeout_ms)
+{
+    /* Caller may have called Update() already; we do not force it. */
+    return PDO_Module_Send_All(timeout_ms);
 }
 
 HAL_StatusTypeDef Process_Signals_Send_Can_If_Due(uint32_t period_ms, uint32_t timeout_ms)
 {
-    const uint32_t now = HAL_GetTick();
-    if ((now - s_last_send_tick) < period_ms) {
-        return HAL_BUSY;
+    const HAL_StatusTypeDef st = PDO_Module_Send_If_Due(period_ms, timeout_ms);
+    if (st != HAL_BUSY) {
+        Backfill_Module_Record(st, PDO_Module_Get_Replaced_Mask() != 0u);
     }
-    s_last_send_tick = now;
-
-    /* Update snapshot right before sending to minimize staleness. */
-    Process_Signals_Update();
-    return Process_Signals_Send_Can(timeout_ms);
+    return st;
 }
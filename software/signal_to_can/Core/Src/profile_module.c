@@ -0,0 +1,265 @@
+/* profile_module.c
+ *
+ * Configuration profiles: flash records, pointer-swap switching and the
+ * background save.
+ */
+
+#include "profile_module.h"
+#include "can_module.h"
+#include "clock_module.h"
+
+#include <stddef.h>
+#include <string.h>
+
+#if PROFILE_PAGE_SIZE != FLASH_PAGE_SIZE
+#error "profiles must be flash pages"
+#endif
+
+_Static_assert(sizeof(profile_record_t) <= PROFILE_PAGE_SIZE, "a profile must fit its page");
+
+#if PROFILE_ENABLE
+
+/* ===== Layout ===== */
+
+#define PROFILE_MAGIC           0x4650u     /* "PF" */
+#define PROFILE_VERSION         1u
+#define PROFILE_HALFWORDS       ((sizeof(profile_record_t) + 1u) / 2u)
+
+#define PROFILE_CAL_START       offsetof(profile_record_t, cal)
+#define PROFILE_CAL_END         (PROFILE_CAL_START + sizeof(((profile_record_t *)0)->cal))
+#define PROFILE_PDO_START       offsetof(profile_record_t, pdo)
+
+/* Leading fields of profile_record_t. */
+typedef struct {
+    uint16_t magic;
+    uint16_t version;
+    uint16_t size;
+    uint16_t reserved;
+    uint32_t sample_period_ms;
+} profile_head_t;
+
+/* ===== Private state ===== */
+
+static uint32_t *s_sample_period = NULL;
+
+/* Save in progress: header fields from here, the rest from the tables in use. */
+static profile_save_state_t s_save = PROFILE_SAVE_IDLE;
+static uint8_t  s_save_p = 0u;
+static uint16_t s_save_pos = 0u;            /* next half-word, 0 (magic) last */
+static profile_head_t s_head;
+
+/* Claims the profile pages: the linker script places .profile_pages at
+   PROFILE_FLASH_BASE (NOLOAD), so only images with profiles lose them. */
+static const uint8_t s_pages[PROFILE_NUM * PROFILE_PAGE_SIZE]
+    __attribute__((section(".profile_pages"), used));
+
+/* ===== Helpers ===== */
+
+static const profile_record_t* record(uint8_t p)
+{
+    return (const profile_record_t *)(uintptr_t)(PROFILE_FLASH_BASE + (uint32_t)p * PROFILE_PAGE_SIZE);
+}
+
+static bool valid(uint8_t p)
+{
+    const profile_record_t *r = record(p);
+    return r->magic == PROFILE_MAGIC && r->version == PROFILE_VERSION && r->size == sizeof(profile_record_t);
+}
+
+/* Byte of the record being saved at offset off. */
+static uint8_t src_byte(size_t off)
+{
+    if (off < sizeof(s_head)) {
+        return ((const uint8_t *)&s_head)[off];
+    }
+    if (off >= PROFILE_CAL_START && off < PROFILE_CAL_END) {
+        return ((const uint8_t *)Process_Signals_Get_Cal())[off - PROFILE_CAL_START];
+    }
+    if (off < PROFILE_PDO_START || off - PROFILE_PDO_START >= sizeof(pdo_tables_t)) {
+        return 0xFFu;   /* padding */
+    }
+    return ((const uint8_t *)PDO_Module_Get_Tables())[off - PROFILE_PDO_START];
+}
+
+static void program(uint32_t addr, uint16_t value)
+{
+    if (value == 0xFFFFu) {
+        return;     /* already the erased value */
+    }
+    (void)HAL_FLASH_Unlock();
+    (void)HAL_FLASH_Program(FLASH_TYPEPROGRAM_HALFWORD, addr, value);
+    (void)HAL_FLASH_Lock();
+}
+
+static void erase(uint8_t p)
+{
+    FLASH_EraseInitTypeDef init = {0};
+    uint32_t page_error = 0u;
+    init.TypeErase = FLASH_TYPEERASE_PAGES;
+    init.PageAddress = (uint32_t)(uintptr_t)record(p);
+    init.NbPages = 1u;
+
+    (void)HAL_FLASH_Unlock();
+    (void)HAL_FLASHEx_Erase(&init, &page_error);
+    (void)HAL_FLASH_Lock();
+}
+
+static void program_halfword(uint16_t n)
+{
+    const size_t off = (size_t)n * 2u;
+    const uint16_t lo = src_byte(off);
+    const uint16_t hi = (off + 1u < sizeof(profile_record_t)) ? src_byte(off + 1u) : 0xFFu;
+    program((uint32_t)(uintptr_t)record(s_save_p) + off, (uint16_t)(lo | (hi << 8)));
+}
+
+/* True if stored profile p is the configuration in use. */
+static bool matches(uint8_t p)
+{
+    const profile_record_t *r = record(p);
+    return valid(p) && s_sample_period != NULL && r->sample_period_ms == *s_sample_period &&
+           memcmp(r->cal, Process_Signals_Get_Cal(), sizeof(r->cal)) == 0 &&
+           memcmp(&r->pdo, PDO_Module_Get_Tables(), sizeof(r->pdo)) == 0;
+}
+
+/* ===== Public API ===== */
+
+void Profile_Module_Init(uint32_t *sample_period_ms)
+{
+    s_sample_period = sample_period_ms;
+    s_save = PROFILE_SAVE_IDLE;
+    (void)Profile_Module_Select(0u);
+}
+
+HAL_StatusTypeDef Profile_Module_Select(uint8_t p)
+{
+    if (s_save == PROFILE_SAVE_ERASING || s_save == PROFILE_SAVE_PROGRAMMING) {
+        return HAL_BUSY;
+    }
+    if (p >= PROFILE_NUM || !valid(p) || s_sample_period == NULL) {
+        return HAL_ERROR;
+    }
+    const profile_record_t *r = record(p);
+    Process_Signals_Use_Cal(r->cal);
+    PDO_Module_Use_Tables(&r->pdo);
+    *s_sample_period = r->sample_period_ms;
+    Clock_Module_Reevaluate();
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef Profile_Module_Save(uint8_t p)
+{
+    if (s_save == PROFILE_SAVE_ERASING || s_save == PROFILE_SAVE_PROGRAMMING) {
+        return HAL_BUSY;
+    }
+    if (p >= PROFILE_NUM || s_sample_period == NULL) {
+        return HAL_ERROR;
+    }
+    /* The page may be the one running: take the configuration into RAM. */
+    Process_Signals_Use_Cal(NULL);
+    PDO_Module_Use_Tables(NULL);
+
+    s_head.magic = PROFILE_MAGIC;
+    s_head.version = PROFILE_VERSION;
+    s_head.size = (uint16_t)sizeof(profile_record_t);
+    s_head.reserved = 0xFFFFu;
+    s_head.sample_period_ms = *s_sample_period;
+    s_save_p = p;
+    s_save_pos = 1u;
+    s_save = PROFILE_SAVE_ERASING;
+    return HAL_OK;
+}
+
+uint8_t Profile_Module_Get_Active(void)
+{
+    for (uint8_t p = 0u; p < PROFILE_NUM; ++p) {
+        if (matches(p)) {
+            return p;
+        }
+    }
+    return PROFILE_NONE;
+}
+
+uint8_t Profile_Module_Get_Valid_Mask(void)
+{
+    uint8_t mask = 0u;
+    for (uint8_t p = 0u; p < PROFILE_NUM; ++p) {
+        if (valid(p)) {
+            mask |= (uint8_t)(1u << p);
+        }
+    }
+    return mask;
+}
+
+profile_save_state_t Profile_Module_Get_Save_State(void)
+{
+    return s_save;
+}
+
+void Profile_Module_Task(void)
+{
+    switch (s_save) {
+    case PROFILE_SAVE_ERASING:
+        if (CAN_Module_Is_Quiet()) {
+            erase(s_save_p);
+            s_save = PROFILE_SAVE_PROGRAMMING;
+        }
+        break;
+
+    case PROFILE_SAVE_PROGRAMMING:
+        for (uint8_t k = 0u; k < PROFILE_PROGRAM_STEP && s_save_pos < PROFILE_HALFWORDS; ++k) {
+            program_halfword(s_save_pos++);
+        }
+        if (s_save_pos < PROFILE_HALFWORDS) {
+            break;
+        }
+        program_halfword(0u);
+        s_save = matches(s_save_p) ? PROFILE_SAVE_DONE : PROFILE_SAVE_FAILED;
+        if (s_save == PROFILE_SAVE_DONE) {
+            (void)Profile_Module_Select(s_save_p);
+        }
+        break;
+
+    default:
+        break;
+    }
+}
+
+#else
+
+void Profile_Module_Init(uint32_t *sample_period_ms)
+{
+    (void)sample_period_ms;
+}
+
+HAL_StatusTypeDef Profile_Module_Select(uint8_t p)
+{
+    (void)p;
+    return HAL_ERROR;
+}
+
+HAL_StatusTypeDef Profile_Module_Save(uint8_t p)
+{
+    (void)p;
+    return HAL_ERROR;
+}
+
+uint8_t Profile_Module_Get_Active(void)
+{
+    return PROFILE_NONE;
+}
+
+uint8_t Profile_Module_Get_Valid_Mask(void)
+{
+    return 0u;
+}
+
+profile_save_state_t Profile_Module_Get_Save_State(void)
+{
+    return PROFILE_SAVE_IDLE;
+}
+
+void Profile_Module_Task(void)
+{
+}
+
+#endif
@@ -22,6 +22,9 @@
 #include "stm32f0xx_it.h"
 /* Private includes ----------------------------------------------------------*/
 /* USER CODE BEGIN Includes */
+#include "event_log_module.h"
+#include "irq_module.h"
+#include "can_diag_module.h"
 /* USER CODE END Includes */
 
 /* Private typedef -----------------------------------------------------------*/
@@ -46,7 +49,8 @@
 
 /* Private function prototypes -----------------------------------------------*/
 /* USER CODE BEGIN PFP */
-
+/* No prologue: the asm below must see the exception's LR and stack. */
+void HardFault_Handler(void) __attribute__((naked));
 /* USER CODE END PFP */
 
 /* Private user code ---------------------------------------------------------*/
@@ -56,7 +60,9 @@
 
 /* External variables --------------------------------------------------------*/
 extern DMA_HandleTypeDef hdma_adc;
+extern CAN_HandleTypeDef hcan;
 /* USER CODE BEGIN EV */
+extern ADC_HandleTypeDef hadc;
 
 /* USER CODE END EV */
 
@@ -84,7 +90,20 @@ void NMI_Handler(void)
 void HardFault_Handler(void)
 {
   /* USER CODE BEGIN HardFault_IRQn 0 */
-
+  /* Naked: EXC_RETURN bit 2 selects the stack the fault was taken on, and
+   * that stack pointer is the exception frame itself. */
+  __asm volatile (
+    "movs r0, #4          \n"
+    "mov  r1, lr          \n"
+    "tst  r0, r1          \n"
+    "beq  1f              \n"
+    "mrs  r0, psp         \n"
+    "b    2f              \n"
+    "1:                   \n"
+    "mrs  r0, msp         \n"
+    "2:                   \n"
+    "bl   Event_Log_Module_Hard_Fault \n"
+    "b    .               \n");
   /* USER CODE END HardFault_IRQn 0 */
   while (1)
   {
@@ -125,11 +144,11 @@ void PendSV_Handler(void)
 void SysTick_Handler(void)
 {
   /* USER CODE BEGIN SysTick_IRQn 0 */
-
+  const uint32_t enter = Irq_Module_Enter(IRQ_SRC_SYSTICK);
   /* USER CODE END SysTick_IRQn 0 */
   HAL_IncTick();
   /* USER CODE BEGIN SysTick_IRQn 1 */
-
+  Irq_Module_Exit(IRQ_SRC_SYSTICK, enter);
   /* USER CODE END SysTick_IRQn 1 */
 }
 
@@ -146,14 +165,79 @@ void SysTick_Handler(void)
 void DMA1_Channel1_IRQHandler(void)
 {
   /* USER CODE BEGIN DMA1_Channel1_IRQn 0 */
-
+  /* Scan complete straight from the flags (ADC_Module_Init turns the
+   * half-transfer interrupt off); a transfer error takes the HAL path. */
+  const uint32_t enter = Irq_Module_Enter(IRQ_SRC_DMA_ADC);
+  const uint32_t flags = DMA1->ISR & (DMA_ISR_GIF1 | DMA_ISR_TCIF1 | DMA_ISR_HTIF1 | DMA_ISR_TEIF1);
+  if ((flags & DMA_ISR_TEIF1) == 0u) {
+    DMA1->IFCR = flags;
+    if ((flags & DMA_ISR_TCIF1) != 0u) {
+      HAL_ADC_ConvCpltCallback(&hadc);
+    }
+    Irq_Module_Exit(IRQ_SRC_DMA_ADC, enter);
+    return;
+  }
   /* USER CODE END DMA1_Channel1_IRQn 0 */
   HAL_DMA_IRQHandler(&hdma_adc);
   /* USER CODE BEGIN DMA1_Channel1_IRQn 1 */
-
+  Irq_Module_Exit(IRQ_SRC_DMA_ADC, enter);
   /* USER CODE END DMA1_Channel1_IRQn 1 */
 }
 
+/**
+  * @brief This function handles HDMI-CEC and CAN global interrupts / HDMI-CEC wake-up interrupt through EXTI line 27.
+  */
+void CEC_CAN_IRQHandler(void)
+{
+  /* USER CODE BEGIN CEC_CAN_IRQn 0 */
+  /* Completed mailboxes are always taken here, so they are classified the
+   * same with or without an error interrupt. With automatic retransmission
+   * a mailbox completes without TXOK only when it was aborted (a replaced
+   * data frame), whatever ALST or TERR say about the attempt before; HAL
+   * would report those as transmit errors. Only the error interrupt (ERRI)
+   * goes through HAL_CAN_IRQHandler. */
+  const uint32_t enter = Irq_Module_Enter(IRQ_SRC_CAN);
+  const uint32_t tsr = hcan.Instance->TSR;
+  const uint32_t done = tsr & (CAN_TSR_RQCP0 | CAN_TSR_RQCP1 | CAN_TSR_RQCP2);
+  const uint32_t txok = tsr & (CAN_TSR_TXOK0 | CAN_TSR_TXOK1 | CAN_TSR_TXOK2);
+  if (done != 0u) {
+    hcan.Instance->TSR = done;    /* rc_w1: clears RQCP, TXOK, ALST and TERR */
+    if ((done & CAN_TSR_RQCP0) != 0u) {
+      if ((txok & CAN_TSR_TXOK0) != 0u) {
+        HAL_CAN_TxMailbox0CompleteCallback(&hcan);
+      } else {
+        CAN_Diag_Module_Tx_Aborted((tsr & CAN_TSR_TERR0) != 0u);
+        HAL_CAN_TxMailbox0AbortCallback(&hcan);
+      }
+    }
+    if ((done & CAN_TSR_RQCP1) != 0u) {
+      if ((txok & CAN_TSR_TXOK1) != 0u) {
+        HAL_CAN_TxMailbox1CompleteCallback(&hcan);
+      } else {
+        CAN_Diag_Module_Tx_Aborted((tsr & CAN_TSR_TERR1) != 0u);
+        HAL_CAN_TxMailbox1AbortCallback(&hcan);
+      }
+    }
+    if ((done & CAN_TSR_RQCP2) != 0u) {
+      if ((txok & CAN_TSR_TXOK2) != 0u) {
+        HAL_CAN_TxMailbox2CompleteCallback(&hcan);
+      } else {
+        CAN_Diag_Module_Tx_Aborted((tsr & CAN_TSR_TERR2) != 0u);
+        HAL_CAN_TxMailbox2AbortCallback(&hcan);
+      }
+    }
+  }
+  if ((hcan.Instance->MSR & CAN_MSR_ERRI) == 0u) {
+    Irq_Module_Exit(IRQ_SRC_CAN, enter);
+    return;
+  }
+  /* USER CODE END CEC_CAN_IRQn 0 */
+  HAL_CAN_IRQHandler(&hcan);
+  /* USER CODE BEGIN CEC_CAN_IRQn 1 */
+  Irq_Module_Exit(IRQ_SRC_CAN, enter);
+  /* USER CODE END CEC_CAN_IRQn 1 */
+}
+
 /* USER CODE BEGIN 1 */
 
 /* USER CODE END 1 */
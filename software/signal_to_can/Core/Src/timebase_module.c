@@ -0,0 +1,34 @@
+/* timebase_module.c
+ *
+ * Microsecond timebase from HAL_GetTick() and SysTick->VAL (1 ms reload).
+ */
+
+#include "timebase_module.h"
+#include "stm32f0xx_hal.h"
+#include <stdbool.h>
+
+uint32_t Timebase_Module_Now_Us(void)
+{
+    uint32_t tick;
+    uint32_t ms;
+    uint32_t val;
+
+    do {
+        tick = HAL_GetTick();
+        const uint32_t val_before = SysTick->VAL;
+        const bool pending = (SCB->ICSR & SCB_ICSR_PENDSTSET_Msk) != 0u;
+        const uint32_t val_after = SysTick->VAL;
+        if (pending) {
+            /* Reloaded before the ICSR read but not counted yet: val_after is
+             * from the new period. */
+            ms = tick + 1u;
+            val = val_after;
+        } else {
+            ms = tick;
+            val = val_before;
+        }
+    } while (tick != HAL_GetTick());   /* SysTick ran in between: sample again */
+
+    const uint32_t load = SysTick->LOAD + 1u;
+    return ms * 1000u + ((load - 1u - val) * 1000u) / load;
+}
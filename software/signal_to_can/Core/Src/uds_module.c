@@ -0,0 +1,1133 @@
+/* uds_module.c
+ *
+ * UDS diagnostic server subset for STM32F042.
+ * This module provides:
+ *  - Table-driven ReadDataByIdentifier / WriteDataByIdentifier. The DID table
+ *    is kept sorted so lookups are a binary search.
+ *  - RoutineControl for ADC calibration, signal capture, latency reset,
+ *    CAN error statistics reset, event log clear, multicast update and
+ *    profile save
+ *  - Default/extended sessions with S3 timeout
+ *
+ * Requests and responses travel over isotp_module; see uds_module.h for the
+ * identifier map.
+ */
+
+#include "uds_module.h"
+#include "isotp_module.h"
+#include "process_signals.h"
+#include "adc_module.h"
+#include "can_module.h"
+#include "xcp_module.h"
+#include "latency_module.h"
+#include "boot_module.h"
+#include "clock_module.h"
+#include "pdo_module.h"
+#include "can_diag_module.h"
+#include "event_log_module.h"
+#include "update_module.h"
+#include "irq_module.h"
+#include "cmd_module.h"
+#include "profile_module.h"
+#include "backfill_module.h"
+#include "id_plan_module.h"
+#include "claim_module.h"
+#include "main.h"
+#include <stdbool.h>
+#include <string.h>
+#include <math.h>
+
+#if LATENCY_NUM_BUCKETS != 16u
+#error "latency DIDs 0x0220..0x0224 are sized for 16 histogram buckets"
+#endif
+
+#if CAN_DIAG_NUM_WINDOWS != 16u
+#error "CAN error window DID 0x0306 is sized for 16 windows"
+#endif
+
+#if EVENT_LOG_MAX_ENTRIES != 126u
+#error "event log DIDs 0x0600..0x0608 are sized for 126 entries"
+#endif
+
+#if UPDATE_BITMAP_BYTES > 0x7FFFu
+#error "update bitmap DID 0x0701 must fit a DID size"
+#endif
+
+#if PDO_MAX_FRAMES != 4u
+#error "mapping DIDs 0x0500..0x0503 expect 4 table frames"
+#endif
+
+/* Event log entries per DID 0x0600 + b, and the number of such DIDs. */
+#define UDS_EVENT_LOG_BLOCK      14u
+#define UDS_EVENT_LOG_BLOCKS     9u
+
+/* Mapping table frame DID: header, then PDO_MAX_ENTRIES entries of 5 bytes. */
+#define UDS_PDO_FRAME_SIZE       (6u + 5u * PDO_MAX_ENTRIES)
+
+/* Layout description DID 0x0800: header, channel records, then the used
+ * frames with their entries (see uds_module.h). */
+#define UDS_DESC_FORMAT          1u
+#define UDS_DESC_HEADER_SIZE     8u
+#define UDS_DESC_CHANNEL_SIZE    12u
+#define UDS_DESC_MAX_SIZE        (UDS_DESC_HEADER_SIZE + UDS_DESC_CHANNEL_SIZE * PS_NUM_CHANNELS + \
+                                  PDO_MAX_FRAMES * 6u + PDO_MAX_FRAMES * PDO_MAX_ENTRIES * 5u)
+
+#if (3u + UDS_DESC_MAX_SIZE) > ISOTP_TX_BUF_SIZE
+#error "layout description DID 0x0800 must fit the ISO-TP TX buffer"
+#endif
+
+#if UDS_ENABLE && !ISOTP_ENABLE
+#error "UDS_ENABLE needs ISOTP_ENABLE"
+#endif
+
+#if UDS_ENABLE
+
+/* ===== Protocol constants ===== */
+
+#define SID_SESSION_CONTROL      0x10u
+#define SID_READ_DID             0x22u
+#define SID_WRITE_DID            0x2Eu
+#define SID_ROUTINE_CONTROL      0x31u
+#define SID_TESTER_PRESENT       0x3Eu
+
+#define POSITIVE_OFFSET          0x40u
+#define NEGATIVE_RESPONSE        0x7Fu
+#define SUPPRESS_POS_RSP         0x80u
+
+#define NRC_SERVICE_NOT_SUPPORTED        0x11u
+#define NRC_SUBFUNCTION_NOT_SUPPORTED    0x12u
+#define NRC_INCORRECT_LENGTH             0x13u
+#define NRC_RESPONSE_TOO_LONG            0x14u
+#define NRC_CONDITIONS_NOT_CORRECT       0x22u
+#define NRC_REQUEST_SEQUENCE_ERROR       0x24u
+#define NRC_REQUEST_OUT_OF_RANGE         0x31u
+#define NRC_NOT_SUPPORTED_IN_SESSION     0x7Fu
+
+#define SESSION_DEFAULT          0x01u
+#define SESSION_EXTENDED         0x03u
+
+#define ROUTINE_START            0x01u
+#define ROUTINE_STOP             0x02u
+#define ROUTINE_RESULTS          0x03u
+
+/* Reads write exactly `size` bytes; writes get exactly `size` bytes and return an NRC (0 = ok).
+ * A read-only DID with UDS_DID_VARIABLE in its size writes at most the size
+ * that remains, starting with the record length (u16, itself included). */
+typedef void    (*uds_did_read_fn)(uint16_t did, uint8_t *out);
+typedef uint8_t (*uds_did_write_fn)(uint16_t did, const uint8_t *in);
+
+#define UDS_DID_VARIABLE         0x8000u
+
+/* One entry serves `count` consecutive DIDs of the same size; the handlers
+ * tell them apart by the low nibble of the DID. */
+typedef struct {
+    uint16_t         did;     /* first DID */
+    uint16_t         size;
+    uint8_t          count;
+    uds_did_read_fn  read;
+    uds_did_write_fn write;   /* NULL = read only */
+} uds_did_t;
+
+/* Returns an NRC (0 = ok) and the number of result bytes written to out. */
+typedef uint8_t (*uds_routine_fn)(uint8_t sub, const uint8_t *params, size_t param_len,
+                                  uint8_t *out, size_t *out_len);
+
+typedef struct {
+    uint16_t       rid;
+    uds_routine_fn run;
+} uds_routine_t;
+
+/* ===== Private state ===== */
+
+static uint8_t  s_session = SESSION_DEFAULT;
+static uint32_t s_last_request_tick = 0u;
+
+static uint8_t  s_adc_cal_status = 0xFFu;     /* 0xFF = never run, 0 = ok, 1 = failed */
+static bool     s_capture_active = false;
+static uint16_t s_capture_target = 0u;
+
+/* ===== Helpers ===== */
+
+static void put_u16_be(uint8_t *p, uint16_t v)
+{
+    p[0] = (uint8_t)(v >> 8);
+    p[1] = (uint8_t)(v & 0xFFu);
+}
+
+static void put_u32_be(uint8_t *p, uint32_t v)
+{
+    p[0] = (uint8_t)(v >> 24);
+    p[1] = (uint8_t)(v >> 16);
+    p[2] = (uint8_t)(v >> 8);
+    p[3] = (uint8_t)(v & 0xFFu);
+}
+
+static uint16_t get_u16_be(const uint8_t *p)
+{
+    return (uint16_t)(((uint16_t)p[0] << 8) | p[1]);
+}
+
+static uint32_t get_u32_be(const uint8_t *p)
+{
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+static void put_f32_be(uint8_t *p, float f)
+{
+    uint32_t v;
+    memcpy(&v, &f, sizeof(v));
+    put_u32_be(p, v);
+}
+
+static float get_f32_be(const uint8_t *p)
+{
+    const uint32_t v = get_u32_be(p);
+    float f;
+    memcpy(&f, &v, sizeof(f));
+    return f;
+}
+
+/* ===== DID handlers ===== */
+
+static void rd_gain_offset(uint16_t did, uint8_t *out)
+{
+    float gain = 0.0f, offset = 0.0f;
+    Process_Signals_Get_GainOffset((uint8_t)(did & 0x0Fu), &gain, &offset);
+    put_f32_be(&out[0], gain);
+    put_f32_be(&out[4], offset);
+}
+
+static uint8_t wr_gain_offset(uint16_t did, const uint8_t *in)
+{
+    const float gain = get_f32_be(&in[0]);
+    const float offset = get_f32_be(&in[4]);
+    if (!isfinite(gain) || !isfinite(offset)) {
+        return NRC_REQUEST_OUT_OF_RANGE;
+    }
+    Process_Signals_Set_GainOffset((uint8_t)(did & 0x0Fu), gain, offset);
+    return 0u;
+}
+
+static void rd_min_max(uint16_t did, uint8_t *out)
+{
+    float v_min = 0.0f, v_max = 0.0f;
+    Process_Signals_Get_MinMax((uint8_t)(did & 0x0Fu), &v_min, &v_max);
+    put_f32_be(&out[0], v_min);
+    put_f32_be(&out[4], v_max);
+}
+
+static uint8_t wr_min_max(uint16_t did, const uint8_t *in)
+{
+    const float v_min = get_f32_be(&in[0]);
+    const float v_max = get_f32_be(&in[4]);
+    if (!isfinite(v_min) || !isfinite(v_max) || v_min >= v_max) {
+        return NRC_REQUEST_OUT_OF_RANGE;
+    }
+    Process_Signals_Set_MinMax((uint8_t)(did & 0x0Fu), v_min, v_max);
+    return 0u;
+}
+
+static void rd_input_mV(uint16_t did, uint8_t *out)
+{
+    (void)did;
+    uint16_t mv[PS_NUM_CHANNELS];
+    Process_Signals_Get_All_Input_mV(mv);
+    for (uint8_t i = 0; i < PS_NUM_CHANNELS; ++i) {
+        put_u16_be(&out[2u * i], mv[i]);
+    }
+}
+
+static void rd_raw(uint16_t did, uint8_t *out)
+{
+    (void)did;
+    uint16_t raw[PS_NUM_CHANNELS];
+    Process_Signals_Get_All_Raw(raw);
+    for (uint8_t i = 0; i < PS_NUM_CHANNELS; ++i) {
+        put_u16_be(&out[2u * i], raw[i]);
+    }
+}
+
+static void rd_oor_mask(uint16_t did, uint8_t *out)
+{
+    (void)did;
+    out[0] = Process_Signals_Get_OutOfRange_Mask();
+}
+
+static void rd_e2e(uint16_t did, uint8_t *out)
+{
+    (void)did;
+    out[0] = (uint8_t)PDO_Module_Get_Layout();
+}
+
+static uint8_t wr_e2e(uint16_t did, const uint8_t *in)
+{
+    (void)did;
+    if (in[0] > 1u) {
+        return NRC_REQUEST_OUT_OF_RANGE;
+    }
+    Process_Signals_Set_E2E(in[0] != 0u);
+    Clock_Module_Reevaluate();
+    return 0u;
+}
+
+static void rd_tx_drops(uint16_t did, uint8_t *out)
+{
+    (void)did;
+    for (uint8_t f = 0u; f < PS_NUM_TX_FRAMES; ++f) {
+        put_u32_be(&out[4u * f], Process_Signals_Get_Tx_Drops(f));
+    }
+}
+
+/* Frame header (id, period, dlc, entry count) and entries of 5 bytes, as
+ * DIDs 0x0500.. and 0x0800 carry them; returns the bytes written. */
+static uint16_t put_pdo_frame(uint8_t *out, const pdo_frame_t *m, uint16_t id, uint16_t period_ms)
+{
+    put_u16_be(&out[0], id);
+    put_u16_be(&out[2], period_ms);
+    out[4] = m->dlc;
+    out[5] = m->num_entries;
+    uint8_t *e = &out[6];
+    for (uint8_t k = 0u; k < m->num_entries; ++k, e += 5) {
+        e[0] = m->entry[k].source;
+        e[1] = m->entry[k].index;
+        e[2] = m->entry[k].bit_offset;
+        e[3] = m->entry[k].bit_length;
+        e[4] = m->entry[k].encoding;
+    }
+    return (uint16_t)(e - out);
+}
+
+static void rd_pdo_frame(uint16_t did, uint8_t *out)
+{
+    pdo_frame_t m;
+    memset(out, 0, UDS_PDO_FRAME_SIZE);
+    if (!PDO_Module_Get_Frame((uint8_t)(did & 0x0Fu), &m)) {
+        return;
+    }
+    (void)put_pdo_frame(out, &m, m.id, m.period_ms);
+}
+
+static uint8_t wr_pdo_frame(uint16_t did, const uint8_t *in)
+{
+    pdo_frame_t m;
+    memset(&m, 0, sizeof(m));
+    m.id = get_u16_be(&in[0]);
+    m.period_ms = get_u16_be(&in[2]);
+    m.dlc = in[4];
+    m.num_entries = in[5];
+    if (m.num_entries > PDO_MAX_ENTRIES) {
+        return NRC_REQUEST_OUT_OF_RANGE;
+    }
+    for (uint8_t k = 0u; k < m.num_entries; ++k) {
+        const uint8_t *e = &in[6u + 5u * k];
+        m.entry[k].source = e[0];
+        m.entry[k].index = e[1];
+        m.entry[k].bit_offset = e[2];
+        m.entry[k].bit_length = e[3];
+        m.entry[k].encoding = e[4];
+    }
+    if (PDO_Module_Set_Frame((uint8_t)(did & 0x0Fu), &m) != HAL_OK) {
+        return NRC_REQUEST_OUT_OF_RANGE;
+    }
+    Clock_Module_Reevaluate();
+    return 0u;
+}
+
+static void rd_stats(uint16_t did, uint8_t *out)
+{
+    (void)did;
+    put_u32_be(&out[0], Process_Signals_Get_Stats_Count());
+    for (uint8_t i = 0; i < PS_NUM_CHANNELS; ++i) {
+        uint16_t mn, mx, mean;
+        Process_Signals_Get_Stats(i, &mn, &mx, &mean);
+        put_u16_be(&out[4u + 6u * i], mn);
+        put_u16_be(&out[6u + 6u * i], mx);
+        put_u16_be(&out[8u + 6u * i], mean);
+    }
+}
+
+static void rd_can_counters(uint16_t did, uint8_t *out)
+{
+    (void)did;
+    put_u32_be(&out[0], g_can_dbg.tx_ok_count);
+    put_u32_be(&out[4], g_can_dbg.tx_error_count);
+    put_u32_be(&out[8], g_can_dbg.last_hal_error);
+    put_u32_be(&out[12], g_can_dbg.last_esr);
+    put_u32_be(&out[16], XCP_Module_Get_Overrun_Count());
+}
+
+static void rd_can_errors(uint16_t did, uint8_t *out)
+{
+    (void)did;
+    can_diag_counters_t c;
+    CAN_Diag_Module_Get_Counters(&c);
+    for (uint8_t i = 1u; i < CAN_DIAG_NUM_LEC; ++i) {
+        put_u32_be(&out[4u * (i - 1u)], c.lec[i]);
+    }
+    put_u32_be(&out[24], c.warning_entries);
+    put_u32_be(&out[28], c.passive_entries);
+    put_u32_be(&out[32], c.bus_off_entries);
+    put_u32_be(&out[36], c.tx_failures);
+}
+
+static void rd_can_windows(uint16_t did, uint8_t *out)
+{
+    (void)did;
+    for (uint8_t age = 0u; age < CAN_DIAG_NUM_WINDOWS; ++age) {
+        uint8_t *o = &out[8u * age];
+        can_diag_window_t w;
+        if (!CAN_Diag_Module_Get_Window(age, &w)) {
+            memset(o, 0, 8u);
+            continue;
+        }
+        put_u16_be(&o[0], w.errors);
+        o[2] = w.tec_max;
+        o[3] = w.rec_max;
+        o[4] = w.tec_end;
+        o[5] = w.rec_end;
+        o[6] = w.top_lec;
+        o[7] = w.states;
+    }
+}
+
+static void rd_irq(uint16_t did, uint8_t *out)
+{
+    (void)did;
+    for (uint8_t src = 0u; src < IRQ_NUM_SOURCES; ++src) {
+        irq_stats_t st;
+        Irq_Module_Get_Stats((irq_src_t)src, &st);
+        put_u32_be(&out[12u * src], st.count);
+        put_u32_be(&out[12u * src + 4u], st.exec_max_ns);
+        put_u32_be(&out[12u * src + 8u], st.entry_max_ns);
+    }
+}
+
+#if BACKFILL_ENABLE
+static void rd_backfill(uint16_t did, uint8_t *out)
+{
+    (void)did;
+    backfill_stats_t st;
+    Backfill_Module_Get_Stats(&st);
+    put_u32_be(&out[0], st.stored);
+    put_u32_be(&out[4], st.sent);
+    put_u32_be(&out[8], st.dropped);
+    put_u16_be(&out[12], st.pending);
+    put_u16_be(&out[14], st.bytes);
+}
+#endif
+
+static void rd_tx_replaced(uint16_t did, uint8_t *out)
+{
+    (void)did;
+    for (uint8_t f = 0u; f < PS_NUM_TX_FRAMES; ++f) {
+        put_u32_be(&out[4u * f], PDO_Module_Get_Tx_Replaced(f));
+    }
+}
+
+#if EVENT_LOG_ENABLE
+static void rd_event_log(uint16_t did, uint8_t *out)
+{
+    const uint16_t first = (uint16_t)((did & 0x0Fu) * UDS_EVENT_LOG_BLOCK);
+    for (uint8_t i = 0u; i < UDS_EVENT_LOG_BLOCK; ++i) {
+        uint8_t *o = &out[EVENT_LOG_ENTRY_SIZE * i];
+        event_log_entry_t e;
+        if (!Event_Log_Module_Get_Entry((uint16_t)(first + i), &e)) {
+            memset(o, 0xFF, EVENT_LOG_ENTRY_SIZE);
+            continue;
+        }
+        o[0] = e.type;
+        o[1] = e.arg;
+        put_u16_be(&o[2], e.boot);
+        put_u32_be(&o[4], e.time_ms);
+        put_u32_be(&o[8], e.data[0]);
+        put_u32_be(&o[12], e.data[1]);
+    }
+}
+#endif
+
+#if UPDATE_ENABLE
+static void rd_update_status(uint16_t did, uint8_t *out)
+{
+    (void)did;
+    update_status_t st;
+    Update_Module_Get_Status(&st);
+    out[0] = st.state;
+    out[1] = st.error;
+    out[2] = st.tag;
+    out[3] = 0u;
+    put_u16_be(&out[4], st.blocks);
+    put_u16_be(&out[6], st.missing);
+    put_u32_be(&out[8], st.size);
+    put_u32_be(&out[12], st.frames);
+    put_u32_be(&out[16], st.stale);
+}
+
+static void rd_update_missing(uint16_t did, uint8_t *out)
+{
+    (void)did;
+    Update_Module_Get_Missing(out);
+}
+#endif
+
+/* Volts to millivolts, rounded and saturated to a u16. */
+static uint16_t to_mV_u16(float v)
+{
+    const float m = v * 1000.0f;
+    if (!(m > 0.0f)) {
+        return 0u;
+    }
+    return (m >= 65535.0f) ? 65535u : (uint16_t)(m + 0.5f);
+}
+
+static void rd_layout_desc(uint16_t did, uint8_t *out)
+{
+    (void)did;
+    uint8_t enabled = 0u;
+    uint16_t pos = UDS_DESC_HEADER_SIZE;
+
+    for (uint8_t ch = 0u; ch < PS_NUM_CHANNELS; ++ch) {
+        float gain = 0.0f, offset = 0.0f, v_min = 0.0f, v_max = 0.0f;
+        Process_Signals_Get_GainOffset(ch, &gain, &offset);
+        Process_Signals_Get_MinMax(ch, &v_min, &v_max);
+        if (Process_Signals_Get_Enabled(ch)) {
+            enabled |= (uint8_t)(1u << ch);
+        }
+        /* Raw counts to device-input volts, as Process_Signals_Update. */
+        put_f32_be(&out[pos + 0u], gain * (PS_ADC_VREF_V / PS_ADC_FULL_SCALE));
+        put_f32_be(&out[pos + 4u], offset);
+        put_u16_be(&out[pos + 8u], to_mV_u16(v_min));
+        put_u16_be(&out[pos + 10u], to_mV_u16(v_max));
+        pos += UDS_DESC_CHANNEL_SIZE;
+    }
+
+    uint8_t frames = 0u;
+    for (uint8_t f = 0u; f < PDO_MAX_FRAMES; ++f) {
+        pdo_frame_t m;
+        if (!PDO_Module_Get_Frame(f, &m) || m.id == PDO_ID_UNUSED) {
+            continue;
+        }
+        pos += put_pdo_frame(&out[pos], &m, PDO_Module_Resolve_Id(m.id),
+                             (m.period_ms != 0u) ? m.period_ms : (uint16_t)Cmd_Module_Get_Sample_Period());
+        frames++;
+    }
+
+    put_u16_be(&out[0], pos);
+    out[2] = UDS_DESC_FORMAT;
+    out[3] = CAN_Module_Get_Node_Id();
+    out[4] = (uint8_t)PDO_Module_Get_Layout();
+    out[5] = enabled;
+    out[6] = PS_NUM_CHANNELS;
+    out[7] = frames;
+}
+
+#if EVENT_LOG_ENABLE
+static void rd_event_log_stats(uint16_t did, uint8_t *out)
+{
+    (void)did;
+    event_log_stats_t st;
+    Event_Log_Module_Get_Stats(&st);
+    put_u32_be(&out[0], st.written);
+    put_u32_be(&out[4], st.dropped_full);
+    put_u32_be(&out[8], st.dropped_rate);
+    put_u32_be(&out[12], st.erases[0]);
+    put_u32_be(&out[16], st.erases[1]);
+    put_u32_be(&out[20], st.max_program_us);
+    put_u32_be(&out[24], st.max_erase_us);
+    put_u16_be(&out[28], st.stored);
+    put_u16_be(&out[30], st.boot);
+}
+#endif
+
+#if LATENCY_ENABLE
+static void rd_latency(uint16_t did, uint8_t *out)
+{
+    latency_hist_t h;
+    if (!Latency_Module_Get_Hist((latency_stage_t)(did & 0x0Fu), &h)) {
+        memset(out, 0, 8u + 2u * LATENCY_NUM_BUCKETS);
+        return;
+    }
+    put_u32_be(&out[0], h.count);
+    put_u32_be(&out[4], h.max_us);
+    for (uint8_t b = 0u; b < LATENCY_NUM_BUCKETS; ++b) {
+        put_u16_be(&out[8u + 2u * b], h.bucket[b]);
+    }
+}
+#endif
+
+static void rd_uptime(uint16_t did, uint8_t *out)
+{
+    (void)did;
+    put_u32_be(out, HAL_GetTick());
+}
+
+static void rd_boot(uint16_t did, uint8_t *out)
+{
+    (void)did;
+    for (uint8_t p = 0u; p < BOOT_NUM_PHASES; ++p) {
+        put_u32_be(&out[4u * p], Boot_Module_Get_Us((boot_phase_t)p));
+    }
+}
+
+static void rd_clock(uint16_t did, uint8_t *out)
+{
+    (void)did;
+    out[0] = (uint8_t)(Clock_Module_Get_Hclk_Hz() / 1000000u);
+    out[1] = Clock_Module_Get_Setting();
+    put_u16_be(&out[2], Clock_Module_Get_Load_Permille());
+    const uint32_t pass_us = Clock_Module_Get_Min_Pass_Us();
+    put_u16_be(&out[4], (uint16_t)(pass_us > 0xFFFFu ? 0xFFFFu : pass_us));
+    const uint32_t switches = Clock_Module_Get_Switch_Count();
+    put_u16_be(&out[6], (uint16_t)(switches > 0xFFFFu ? 0xFFFFu : switches));
+}
+
+static void rd_clock_setting(uint16_t did, uint8_t *out)
+{
+    (void)did;
+    out[0] = Clock_Module_Get_Setting();
+}
+
+static uint8_t wr_clock_setting(uint16_t did, const uint8_t *in)
+{
+    (void)did;
+    return (Clock_Module_Set_Setting(in[0]) == HAL_OK) ? 0u : NRC_REQUEST_OUT_OF_RANGE;
+}
+
+static void rd_node_id(uint16_t did, uint8_t *out)
+{
+    (void)did;
+    out[0] = CAN_Module_Get_Node_Id();
+}
+
+static void rd_baud(uint16_t did, uint8_t *out)
+{
+    (void)did;
+    out[0] = (uint8_t)CAN_Module_Get_Baud_Enum();
+}
+
+static void rd_id_plan(uint16_t did, uint8_t *out)
+{
+    (void)did;
+    out[0] = Id_Plan_Module_Is_Class_Plan() ? 1u : 0u;
+    out[1] = (uint8_t)ID_PLAN_MAX_NODES;
+    for (uint8_t c = 0u; c < ID_NUM_CLASSES; ++c) {
+        put_u16_be(&out[2u + 3u * c], Id_Plan_Module_Get_Base((id_class_t)c));
+        out[4u + 3u * c] = Id_Plan_Module_Get_Width((id_class_t)c);
+    }
+}
+
+static void rd_claim(uint16_t did, uint8_t *out)
+{
+    (void)did;
+    claim_stats_t st;
+    Claim_Module_Get_Stats(&st);
+    out[0] = st.state;
+    out[1] = st.node_id;
+    out[2] = st.preferred;
+    out[3] = st.attempts;
+    put_u16_be(&out[4], st.lost);
+    put_u16_be(&out[6], st.collisions);
+    put_u16_be(&out[8], st.defences);
+}
+
+#if PROFILE_ENABLE
+static void rd_profile(uint16_t did, uint8_t *out)
+{
+    (void)did;
+    out[0] = Profile_Module_Get_Active();
+}
+
+static uint8_t wr_profile(uint16_t did, const uint8_t *in)
+{
+    (void)did;
+    switch (Profile_Module_Select(in[0])) {
+    case HAL_OK:
+        return 0u;
+    case HAL_BUSY:
+        return NRC_CONDITIONS_NOT_CORRECT;
+    default:
+        return NRC_REQUEST_OUT_OF_RANGE;
+    }
+}
+#endif
+
+/* Must stay sorted by DID: lookups are a binary search. DIDs of modules
+ * built without their switch are left out, as are their routines. */
+static const uds_did_t s_did_table[] = {
+    { 0x0100u,  8u, PS_NUM_CHANNELS, rd_gain_offset, wr_gain_offset },
+    { 0x0110u,  8u, PS_NUM_CHANNELS, rd_min_max,     wr_min_max },
+    { 0x0200u, 16u, 1u, rd_input_mV,     NULL },
+    { 0x0201u, 16u, 1u, rd_raw,          NULL },
+    { 0x0202u,  1u, 1u, rd_oor_mask,     NULL },
+    { 0x0203u,  1u, 1u, rd_e2e,          wr_e2e },
+    { 0x0210u, 52u, 1u, rd_stats,        NULL },
+#if LATENCY_ENABLE
+    { 0x0220u, 40u, LATENCY_NUM_STAGES, rd_latency, NULL },
+#endif
+    { 0x0300u, 20u, 1u, rd_can_counters, NULL },
+    { 0x0301u,  4u, 1u, rd_uptime,       NULL },
+    { 0x0302u, 4u * PS_NUM_TX_FRAMES, 1u, rd_tx_drops, NULL },
+    { 0x0303u, 28u, 1u, rd_boot,         NULL },
+    { 0x0304u,  8u, 1u, rd_clock,        NULL },
+    { 0x0305u, 40u, 1u, rd_can_errors,   NULL },
+    { 0x0306u, 8u * CAN_DIAG_NUM_WINDOWS, 1u, rd_can_windows, NULL },
+    { 0x0307u, 12u * IRQ_NUM_SOURCES, 1u, rd_irq, NULL },
+#if BACKFILL_ENABLE
+    { 0x0308u, 16u, 1u, rd_backfill,     NULL },
+#endif
+    { 0x0309u, 4u * PS_NUM_TX_FRAMES, 1u, rd_tx_replaced, NULL },
+    { 0x0400u,  1u, 1u, rd_node_id,      NULL },
+    { 0x0401u,  1u, 1u, rd_baud,         NULL },
+    { 0x0402u,  1u, 1u, rd_clock_setting, wr_clock_setting },
+#if PROFILE_ENABLE
+    { 0x0403u,  1u, 1u, rd_profile,      wr_profile },
+#endif
+    { 0x0404u, 2u + 3u * ID_NUM_CLASSES, 1u, rd_id_plan, NULL },
+    { 0x0405u, 10u, 1u, rd_claim,        NULL },
+    { 0x0500u, UDS_PDO_FRAME_SIZE, PDO_MAX_FRAMES, rd_pdo_frame, wr_pdo_frame },
+#if EVENT_LOG_ENABLE
+    { 0x0600u, UDS_EVENT_LOG_BLOCK * EVENT_LOG_ENTRY_SIZE, UDS_EVENT_LOG_BLOCKS, rd_event_log, NULL },
+    { 0x0610u, 32u, 1u, rd_event_log_stats, NULL },
+#endif
+#if UPDATE_ENABLE
+    { 0x0700u, 20u, 1u, rd_update_status, NULL },
+    { 0x0701u, UPDATE_BITMAP_BYTES, 1u, rd_update_missing, NULL },
+#endif
+    { 0x0800u, UDS_DID_VARIABLE | UDS_DESC_MAX_SIZE, 1u, rd_layout_desc, NULL },
+};
+
+#define UDS_DID_COUNT (sizeof(s_did_table) / sizeof(s_did_table[0]))
+
+static const uds_did_t* find_did(uint16_t did)
+{
+    size_t lo = 0u;
+    size_t hi = UDS_DID_COUNT;
+    while (lo < hi) {
+        const size_t mid = lo + (hi - lo) / 2u;
+        const uds_did_t *e = &s_did_table[mid];
+        if (did < e->did) {
+            hi = mid;
+        } else if (did - e->did >= e->count) {
+            lo = mid + 1u;
+        } else {
+            return e;
+        }
+    }
+    return NULL;
+}
+
+/* ===== Routine handlers ===== */
+
+static uint8_t rc_adc_calibration(uint8_t sub, const uint8_t *params, size_t param_len,
+                                  uint8_t *out, size_t *out_len)
+{
+    (void)params;
+    (void)param_len;
+    switch (sub) {
+    case ROUTINE_START:
+        s_adc_cal_status = (ADC_Module_Recalibrate() == HAL_OK) ? 0u : 1u;
+        break;
+    case ROUTINE_RESULTS:
+        break;
+    default:
+        return NRC_SUBFUNCTION_NOT_SUPPORTED;
+    }
+    out[0] = s_adc_cal_status;
+    *out_len = 1u;
+    return 0u;
+}
+
+static uint8_t rc_capture(uint8_t sub, const uint8_t *params, size_t param_len,
+                          uint8_t *out, size_t *out_len)
+{
+    switch (sub) {
+    case ROUTINE_START:
+        if (param_len != 0u && param_len != 2u) {
+            return NRC_INCORRECT_LENGTH;
+        }
+        s_capture_target = (param_len == 2u) ? get_u16_be(params) : 100u;
+        if (s_capture_target == 0u) {
+            return NRC_REQUEST_OUT_OF_RANGE;
+        }
+        Process_Signals_Reset_Stats();
+        s_capture_active = true;
+        *out_len = 0u;
+        return 0u;
+
+    case ROUTINE_STOP:
+        if (!s_capture_active) {
+            return NRC_REQUEST_SEQUENCE_ERROR;
+        }
+        s_capture_active = false;
+        *out_len = 0u;
+        return 0u;
+
+    case ROUTINE_RESULTS: {
+        const uint32_t count = Process_Signals_Get_Stats_Count();
+        uint8_t status = 2u;
+        if (s_capture_active) {
+            status = (count >= s_capture_target) ? 0u : 1u;
+        }
+        out[0] = status;
+        put_u16_be(&out[1], (count > 0xFFFFu) ? 0xFFFFu : (uint16_t)count);
+        for (uint8_t i = 0; i < PS_NUM_CHANNELS; ++i) {
+            uint16_t mean = 0u;
+            Process_Signals_Get_Stats(i, NULL, NULL, &mean);
+            put_u16_be(&out[3u + 2u * i], mean);
+        }
+        *out_len = 3u + 2u * PS_NUM_CHANNELS;
+        return 0u;
+    }
+
+    default:
+        return NRC_SUBFUNCTION_NOT_SUPPORTED;
+    }
+}
+
+#if LATENCY_ENABLE
+static uint8_t rc_latency_reset(uint8_t sub, const uint8_t *params, size_t param_len,
+                                uint8_t *out, size_t *out_len)
+{
+    (void)params;
+    (void)param_len;
+    (void)out;
+    if (sub != ROUTINE_START) {
+        return NRC_SUBFUNCTION_NOT_SUPPORTED;
+    }
+    Latency_Module_Reset();
+    Irq_Module_Reset();
+    *out_len = 0u;
+    return 0u;
+}
+#endif
+
+static uint8_t rc_can_errors_reset(uint8_t sub, const uint8_t *params, size_t param_len,
+                                   uint8_t *out, size_t *out_len)
+{
+    (void)params;
+    (void)param_len;
+    (void)out;
+    if (sub != ROUTINE_START) {
+        return NRC_SUBFUNCTION_NOT_SUPPORTED;
+    }
+    CAN_Diag_Module_Reset();
+    *out_len = 0u;
+    return 0u;
+}
+
+#if EVENT_LOG_ENABLE
+static uint8_t rc_event_log_clear(uint8_t sub, const uint8_t *params, size_t param_len,
+                                  uint8_t *out, size_t *out_len)
+{
+    (void)params;
+    (void)param_len;
+    (void)out;
+    if (sub != ROUTINE_START) {
+        return NRC_SUBFUNCTION_NOT_SUPPORTED;
+    }
+    Event_Log_Module_Clear();
+    *out_len = 0u;
+    return 0u;
+}
+#endif
+
+#if UPDATE_ENABLE
+static uint8_t rc_update(uint8_t sub, const uint8_t *params, size_t param_len,
+                         uint8_t *out, size_t *out_len)
+{
+    switch (sub) {
+    case ROUTINE_START:
+        if (param_len != 9u) {
+            return NRC_INCORRECT_LENGTH;
+        }
+        if (Update_Module_Start(params[0], get_u32_be(&params[1]), get_u32_be(&params[5])) != HAL_OK) {
+            return NRC_CONDITIONS_NOT_CORRECT;
+        }
+        Clock_Module_Reevaluate();
+        *out_len = 0u;
+        return 0u;
+
+    case ROUTINE_STOP:
+        Update_Module_Abort();
+        *out_len = 0u;
+        return 0u;
+
+    case ROUTINE_RESULTS: {
+        update_status_t st;
+        Update_Module_Get_Status(&st);
+        out[0] = st.state;
+        out[1] = st.error;
+        put_u16_be(&out[2], st.missing);
+        *out_len = 4u;
+        return 0u;
+    }
+
+    default:
+        return NRC_SUBFUNCTION_NOT_SUPPORTED;
+    }
+}
+#endif
+
+#if PROFILE_ENABLE
+static uint8_t rc_profile_save(uint8_t sub, const uint8_t *params, size_t param_len,
+                               uint8_t *out, size_t *out_len)
+{
+    switch (sub) {
+    case ROUTINE_START:
+        if (param_len != 1u) {
+            return NRC_INCORRECT_LENGTH;
+        }
+        if (params[0] >= PROFILE_NUM) {
+            return NRC_REQUEST_OUT_OF_RANGE;
+        }
+        if (Profile_Module_Save(params[0]) != HAL_OK) {
+            return NRC_CONDITIONS_NOT_CORRECT;
+        }
+        *out_len = 0u;
+        return 0u;
+
+    case ROUTINE_RESULTS:
+        out[0] = (uint8_t)Profile_Module_Get_Save_State();
+        out[1] = Profile_Module_Get_Valid_Mask();
+        out[2] = Profile_Module_Get_Active();
+        *out_len = 3u;
+        return 0u;
+
+    default:
+        return NRC_SUBFUNCTION_NOT_SUPPORTED;
+    }
+}
+#endif
+
+static const uds_routine_t s_routine_table[] = {
+    { 0x0201u, rc_adc_calibration },
+    { 0x0202u, rc_capture },
+#if LATENCY_ENABLE
+    { 0x0203u, rc_latency_reset },
+#endif
+    { 0x0204u, rc_can_errors_reset },
+#if EVENT_LOG_ENABLE
+    { 0x0205u, rc_event_log_clear },
+#endif
+#if UPDATE_ENABLE
+    { 0x0206u, rc_update },
+#endif
+#if PROFILE_ENABLE
+    { 0x0207u, rc_profile_save },
+#endif
+};
+
+/* ===== Service handlers (each returns the response length, 0 for none) ===== */
+
+static size_t negative(uint8_t *rsp, uint8_t sid, uint8_t nrc)
+{
+    rsp[0] = NEGATIVE_RESPONSE;
+    rsp[1] = sid;
+    rsp[2] = nrc;
+    return 3u;
+}
+
+static size_t svc_session_control(const uint8_t *req, size_t len, uint8_t *rsp)
+{
+    if (len != 2u) {
+        return negative(rsp, req[0], NRC_INCORRECT_LENGTH);
+    }
+    const uint8_t sub = req[1] & (uint8_t)~SUPPRESS_POS_RSP;
+    if (sub != SESSION_DEFAULT && sub != SESSION_EXTENDED) {
+        return negative(rsp, req[0], NRC_SUBFUNCTION_NOT_SUPPORTED);
+    }
+    s_session = sub;
+    if (req[1] & SUPPRESS_POS_RSP) {
+        return 0u;
+    }
+    rsp[0] = SID_SESSION_CONTROL + POSITIVE_OFFSET;
+    rsp[1] = sub;
+    put_u16_be(&rsp[2], 50u);                           /* P2 server max (ms) */
+    put_u16_be(&rsp[4], (uint16_t)(UDS_S3_TIMEOUT_MS / 10u)); /* P2* (10 ms units) */
+    return 6u;
+}
+
+static size_t svc_tester_present(const uint8_t *req, size_t len, uint8_t *rsp)
+{
+    if (len != 2u) {
+        return negative(rsp, req[0], NRC_INCORRECT_LENGTH);
+    }
+    if ((req[1] & (uint8_t)~SUPPRESS_POS_RSP) != 0u) {
+        return negative(rsp, req[0], NRC_SUBFUNCTION_NOT_SUPPORTED);
+    }
+    if (req[1] & SUPPRESS_POS_RSP) {
+        return 0u;
+    }
+    rsp[0] = SID_TESTER_PRESENT + POSITIVE_OFFSET;
+    rsp[1] = 0u;
+    return 2u;
+}
+
+static size_t svc_read_did(const uint8_t *req, size_t len, uint8_t *rsp, size_t cap)
+{
+    if (len < 3u || ((len - 1u) % 2u) != 0u) {
+        return negative(rsp, req[0], NRC_INCORRECT_LENGTH);
+    }
+
+    size_t pos = 0u;
+    rsp[pos++] = SID_READ_DID + POSITIVE_OFFSET;
+    bool any = false;
+
+    for (size_t i = 1u; i < len; i += 2u) {
+        const uint16_t did = get_u16_be(&req[i]);
+        const uds_did_t *entry = find_did(did);
+        if (entry == NULL) {
+            continue;   /* unsupported DIDs are skipped in multi-DID reads */
+        }
+        const size_t max = entry->size & (uint16_t)~UDS_DID_VARIABLE;
+        if (pos + 2u + max > cap) {
+            return negative(rsp, req[0], NRC_RESPONSE_TOO_LONG);
+        }
+        put_u16_be(&rsp[pos], did);
+        entry->read(did, &rsp[pos + 2u]);
+        pos += 2u + (((entry->size & UDS_DID_VARIABLE) != 0u) ? get_u16_be(&rsp[pos + 2u]) : max);
+        any = true;
+    }
+
+    if (!any) {
+        return negative(rsp, req[0], NRC_REQUEST_OUT_OF_RANGE);
+    }
+    return pos;
+}
+
+static size_t svc_write_did(const uint8_t *req, size_t len, uint8_t *rsp)
+{
+    if (s_session != SESSION_EXTENDED) {
+        return negative(rsp, req[0], NRC_NOT_SUPPORTED_IN_SESSION);
+    }
+    if (len < 4u) {
+        return negative(rsp, req[0], NRC_INCORRECT_LENGTH);
+    }
+    const uint16_t did = get_u16_be(&req[1]);
+    const uds_did_t *entry = find_did(did);
+    if (entry == NULL || entry->write == NULL) {
+        return negative(rsp, req[0], NRC_REQUEST_OUT_OF_RANGE);
+    }
+    if (len != 3u + entry->size) {
+        return negative(rsp, req[0], NRC_INCORRECT_LENGTH);
+    }
+    const uint8_t nrc = entry->write(did, &req[3]);
+    if (nrc != 0u) {
+        return negative(rsp, req[0], nrc);
+    }
+    uint8_t head[4] = { 0u, 0u, 0u, 0u };
+    memcpy(head, &req[3], (entry->size < 4u) ? entry->size : 4u);
+    (void)Event_Log_Module_Add(EVENT_LOG_CONFIG, EVENT_LOG_SRC_UDS, did,
+                               (uint32_t)head[0] << 24 | (uint32_t)head[1] << 16 |
+                               (uint32_t)head[2] << 8 | head[3]);
+    rsp[0] = SID_WRITE_DID + POSITIVE_OFFSET;
+    put_u16_be(&rsp[1], did);
+    return 3u;
+}
+
+static size_t svc_routine_control(const uint8_t *req, size_t len, uint8_t *rsp)
+{
+    if (s_session != SESSION_EXTENDED) {
+        return negative(rsp, req[0], NRC_NOT_SUPPORTED_IN_SESSION);
+    }
+    if (len < 4u) {
+        return negative(rsp, req[0], NRC_INCORRECT_LENGTH);
+    }
+    const uint8_t sub = req[1] & (uint8_t)~SUPPRESS_POS_RSP;
+    const uint16_t rid = get_u16_be(&req[2]);
+
+    const uds_routine_t *routine = NULL;
+    for (size_t i = 0u; i < sizeof(s_routine_table) / sizeof(s_routine_table[0]); ++i) {
+        if (s_routine_table[i].rid == rid) {
+            routine = &s_routine_table[i];
+            break;
+        }
+    }
+    if (routine == NULL) {
+        return negative(rsp, req[0], NRC_REQUEST_OUT_OF_RANGE);
+    }
+
+    size_t out_len = 0u;
+    const uint8_t nrc = routine->run(sub, &req[4], len - 4u, &rsp[4], &out_len);
+    if (nrc != 0u) {
+        return negative(rsp, req[0], nrc);
+    }
+    if (req[1] & SUPPRESS_POS_RSP) {
+        return 0u;
+    }
+    rsp[0] = SID_ROUTINE_CONTROL + POSITIVE_OFFSET;
+    rsp[1] = sub;
+    put_u16_be(&rsp[2], rid);
+    return 4u + out_len;
+}
+
+/* ===== Public API ===== */
+
+void UDS_Module_Init(void)
+{
+    s_session = SESSION_DEFAULT;
+    s_last_request_tick = HAL_GetTick();
+    s_capture_active = false;
+}
+
+void UDS_Module_Task(void)
+{
+    const uint32_t now = HAL_GetTick();
+    if (s_session != SESSION_DEFAULT && (now - s_last_request_tick) >= UDS_S3_TIMEOUT_MS) {
+        s_session = SESSION_DEFAULT;
+    }
+
+    size_t len = 0u;
+    const uint8_t *req = ISOTP_Module_Get_Rx(&len);
+    if (req == NULL) {
+        return;
+    }
+
+    /* Leave the request pending until the previous response has gone out. */
+    size_t cap = 0u;
+    uint8_t *rsp = ISOTP_Module_Get_Tx_Buffer(&cap);
+    if (rsp == NULL) {
+        return;
+    }
+
+    s_last_request_tick = now;
+
+    size_t rsp_len;
+    switch (req[0]) {
+    case SID_SESSION_CONTROL:
+        rsp_len = svc_session_control(req, len, rsp);
+        break;
+    case SID_TESTER_PRESENT:
+        rsp_len = svc_tester_present(req, len, rsp);
+        break;
+    case SID_READ_DID:
+        rsp_len = svc_read_did(req, len, rsp, cap);
+        break;
+    case SID_WRITE_DID:
+        rsp_len = svc_write_did(req, len, rsp);
+        break;
+    case SID_ROUTINE_CONTROL:
+        rsp_len = svc_routine_control(req, len, rsp);
+        break;
+    default:
+        rsp_len = negative(rsp, req[0], NRC_SERVICE_NOT_SUPPORTED);
+        break;
+    }
+
+    ISOTP_Module_Release_Rx();
+
+    if (rsp_len > 0u) {
+        (void)ISOTP_Module_Start_Tx(rsp_len);
+    }
+}
+
+#else
+
+void UDS_Module_Init(void)
+{
+}
+
+void UDS_Module_Task(void)
+{
+}
+
+#endif
@@ -0,0 +1,313 @@
+/* update_module.c
+ *
+ * Multicast image download: staging area erase, frame programming,
+ * missing-block bitmap and CRC-32 check.
+ */
+
+#include "update_module.h"
+#include "can_module.h"
+
+#include <string.h>
+
+#if (UPDATE_STAGE_BASE % FLASH_PAGE_SIZE) != 0u || (UPDATE_STAGE_SIZE % FLASH_PAGE_SIZE) != 0u
+#error "the staging area must be whole flash pages"
+#endif
+
+#if (UPDATE_MAX_BLOCKS * UPDATE_BLOCK_FRAMES) > 0x2000u
+#error "frame numbers are 13 bits"
+#endif
+
+#define UPDATE_NO_BLOCK         0xFFFFu
+#define UPDATE_TAG_MAX          7u
+
+#if UPDATE_ENABLE
+
+/* ===== Private state ===== */
+
+static update_status_t s_st;
+static uint32_t s_crc_expected = 0u;
+static uint16_t s_frames_total = 0u;
+static uint8_t  s_missing[UPDATE_BITMAP_BYTES];
+
+/* Block being received and its frames seen so far. */
+static uint16_t s_cur_block = UPDATE_NO_BLOCK;
+static uint8_t  s_cur_mask = 0u;
+
+static uint16_t s_erase_page = 0u;
+static uint16_t s_erase_pages = 0u;
+static uint32_t s_verify_pos = 0u;
+static uint32_t s_crc = 0u;
+
+/* ===== Helpers ===== */
+
+static bool stage_in_flash(void)
+{
+    const uint32_t flash_end = FLASH_BASE + (uint32_t)(*(const volatile uint16_t *)FLASHSIZE_BASE) * 1024u;
+    return (UPDATE_STAGE_BASE + UPDATE_STAGE_SIZE) <= flash_end;
+}
+
+static bool page_blank(uint32_t addr)
+{
+    const volatile uint32_t *w = (const volatile uint32_t *)(uintptr_t)addr;
+    for (uint32_t i = 0u; i < FLASH_PAGE_SIZE / 4u; ++i) {
+        if (w[i] != 0xFFFFFFFFu) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void fail(update_error_t err)
+{
+    s_st.state = UPDATE_FAILED;
+    s_st.error = (uint8_t)err;
+}
+
+/* Frames of block b: UPDATE_BLOCK_FRAMES, fewer for the last block. */
+static uint8_t block_frames(uint16_t b)
+{
+    const uint32_t left = (uint32_t)s_frames_total - (uint32_t)b * UPDATE_BLOCK_FRAMES;
+    return (left < UPDATE_BLOCK_FRAMES) ? (uint8_t)left : (uint8_t)UPDATE_BLOCK_FRAMES;
+}
+
+static bool block_missing(uint16_t b)
+{
+    return (s_missing[b >> 3] & (uint8_t)(1u << (b & 7u))) != 0u;
+}
+
+static void block_received(uint16_t b)
+{
+    s_missing[b >> 3] &= (uint8_t)~(1u << (b & 7u));
+    s_st.missing--;
+    if (s_st.missing == 0u) {
+        s_st.state = UPDATE_VERIFYING;
+        s_verify_pos = 0u;
+        s_crc = 0xFFFFFFFFu;
+    }
+}
+
+/* Programs the frame's half-words inside the image. A half-word already
+ * holding the value (block sent again) is left alone. */
+static bool program_frame(uint16_t n, const uint8_t *bytes)
+{
+    const uint32_t offset = (uint32_t)n * UPDATE_FRAME_BYTES;
+    bool ok = true;
+    (void)HAL_FLASH_Unlock();
+    for (uint32_t k = 0u; k < UPDATE_FRAME_BYTES && (offset + k) < s_st.size; k += 2u) {
+        const uint32_t addr = UPDATE_STAGE_BASE + offset + k;
+        const uint16_t value = (uint16_t)(bytes[k] | ((uint16_t)bytes[k + 1u] << 8));
+        const uint16_t cur = *(const volatile uint16_t *)(uintptr_t)addr;
+        if (cur == value) {
+            continue;
+        }
+        if (cur != 0xFFFFu ||
+            HAL_FLASH_Program(FLASH_TYPEPROGRAM_HALFWORD, addr, value) != HAL_OK ||
+            *(const volatile uint16_t *)(uintptr_t)addr != value) {
+            ok = false;
+            break;
+        }
+    }
+    (void)HAL_FLASH_Lock();
+    return ok;
+}
+
+static uint32_t crc32_update(uint32_t crc, const uint8_t *p, uint32_t len)
+{
+    while (len-- > 0u) {
+        crc ^= *p++;
+        for (uint8_t b = 0u; b < 8u; ++b) {
+            crc = (crc >> 1) ^ (0xEDB88320u & (0u - (crc & 1u)));
+        }
+    }
+    return crc;
+}
+
+/* ===== Public API ===== */
+
+void Update_Module_Init(void)
+{
+    memset(&s_st, 0, sizeof(s_st));
+    s_st.state = UPDATE_IDLE;
+}
+
+HAL_StatusTypeDef Update_Module_Start(uint8_t tag, uint32_t size, uint32_t crc32)
+{
+    if (tag > UPDATE_TAG_MAX || size == 0u || size > UPDATE_STAGE_SIZE || !stage_in_flash()) {
+        return HAL_ERROR;
+    }
+    memset(&s_st, 0, sizeof(s_st));
+    s_st.state = UPDATE_ERASING;
+    s_st.tag = tag;
+    s_st.size = size;
+    s_crc_expected = crc32;
+    s_frames_total = (uint16_t)((size + UPDATE_FRAME_BYTES - 1u) / UPDATE_FRAME_BYTES);
+    s_st.blocks = (uint16_t)((s_frames_total + UPDATE_BLOCK_FRAMES - 1u) / UPDATE_BLOCK_FRAMES);
+    s_st.missing = s_st.blocks;
+
+    memset(s_missing, 0, sizeof(s_missing));
+    for (uint16_t b = 0u; b < s_st.blocks; ++b) {
+        s_missing[b >> 3] |= (uint8_t)(1u << (b & 7u));
+    }
+    s_cur_block = UPDATE_NO_BLOCK;
+    s_cur_mask = 0u;
+    s_erase_page = 0u;
+    s_erase_pages = (uint16_t)((size + FLASH_PAGE_SIZE - 1u) / FLASH_PAGE_SIZE);
+    return HAL_OK;
+}
+
+void Update_Module_Abort(void)
+{
+    s_st.state = UPDATE_IDLE;
+}
+
+bool Update_Module_Is_Active(void)
+{
+    return s_st.state != UPDATE_IDLE;
+}
+
+bool Update_Module_Handle_Frame(uint16_t std_id, const uint8_t *data, uint8_t dlc)
+{
+    if (std_id != UPDATE_MCAST_ID) {
+        return false;
+    }
+    if (s_st.state != UPDATE_RECEIVING) {
+        return true;
+    }
+    const uint16_t word = (uint16_t)(((uint16_t)data[0] << 8) | data[1]);
+    const uint16_t n = (uint16_t)(word & 0x1FFFu);
+    if (dlc != 8u || (word >> 13) != s_st.tag || n >= s_frames_total) {
+        s_st.stale++;
+        return true;
+    }
+    s_st.frames++;
+
+    const uint16_t b = (uint16_t)(n / UPDATE_BLOCK_FRAMES);
+    if (!block_missing(b)) {
+        return true;
+    }
+    if (b != s_cur_block) {
+        /* A block left unfinished stays missing and comes again whole. */
+        s_cur_block = b;
+        s_cur_mask = 0u;
+    }
+    if (!program_frame(n, &data[2])) {
+        fail(UPDATE_ERR_PROGRAM);
+        return true;
+    }
+    s_cur_mask |= (uint8_t)(1u << (n % UPDATE_BLOCK_FRAMES));
+    if (s_cur_mask == (uint8_t)((1u << block_frames(b)) - 1u)) {
+        s_cur_block = UPDATE_NO_BLOCK;
+        block_received(b);
+    }
+    return true;
+}
+
+void Update_Module_Get_Status(update_status_t *out)
+{
+    if (out != NULL) {
+        *out = s_st;
+    }
+}
+
+void Update_Module_Get_Missing(uint8_t *out)
+{
+    if (out != NULL) {
+        memcpy(out, s_missing, sizeof(s_missing));
+    }
+}
+
+void Update_Module_Task(void)
+{
+    if (s_st.state == UPDATE_ERASING) {
+        if (s_erase_page >= s_erase_pages) {
+            s_st.state = UPDATE_RECEIVING;
+            return;
+        }
+        const uint32_t addr = UPDATE_STAGE_BASE + (uint32_t)s_erase_page * FLASH_PAGE_SIZE;
+        if (!page_blank(addr)) {
+            /* The erase stalls the core: wait for a moment without traffic to lose. */
+            if (!CAN_Module_Is_Quiet()) {
+                return;
+            }
+            FLASH_EraseInitTypeDef init = {0};
+            uint32_t page_error = 0u;
+            init.TypeErase = FLASH_TYPEERASE_PAGES;
+            init.PageAddress = addr;
+            init.NbPages = 1u;
+            (void)HAL_FLASH_Unlock();
+            const HAL_StatusTypeDef st = HAL_FLASHEx_Erase(&init, &page_error);
+            (void)HAL_FLASH_Lock();
+            if (st != HAL_OK) {
+                fail(UPDATE_ERR_PROGRAM);
+                return;
+            }
+        }
+        s_erase_page++;
+        return;
+    }
+
+    if (s_st.state == UPDATE_VERIFYING) {
+        uint32_t len = s_st.size - s_verify_pos;
+        if (len > UPDATE_VERIFY_CHUNK) {
+            len = UPDATE_VERIFY_CHUNK;
+        }
+        s_crc = crc32_update(s_crc, (const uint8_t *)(uintptr_t)(UPDATE_STAGE_BASE + s_verify_pos), len);
+        s_verify_pos += len;
+        if (s_verify_pos >= s_st.size) {
+            if ((s_crc ^ 0xFFFFFFFFu) == s_crc_expected) {
+                s_st.state = UPDATE_DONE;
+            } else {
+                fail(UPDATE_ERR_CRC);
+            }
+        }
+    }
+}
+
+#else
+
+void Update_Module_Init(void)
+{
+}
+
+HAL_StatusTypeDef Update_Module_Start(uint8_t tag, uint32_t size, uint32_t crc32)
+{
+    (void)tag;
+    (void)size;
+    (void)crc32;
+    return HAL_ERROR;
+}
+
+void Update_Module_Abort(void)
+{
+}
+
+bool Update_Module_Is_Active(void)
+{
+    return false;
+}
+
+bool Update_Module_Handle_Frame(uint16_t std_id, const uint8_t *data, uint8_t dlc)
+{
+    (void)std_id;
+    (void)data;
+    (void)dlc;
+    return false;
+}
+
+void Update_Module_Get_Status(update_status_t *out)
+{
+    if (out != NULL) {
+        memset(out, 0, sizeof(*out));
+    }
+}
+
+void Update_Module_Get_Missing(uint8_t *out)
+{
+    (void)out;
+}
+
+void Update_Module_Task(void)
+{
+}
+
+#endif
@@ -0,0 +1,864 @@
+/* xcp_module.c
+ *
+ * Minimal XCP-on-CAN slave for STM32F042.
+ * This module provides:
+ *  - Standard commands: CONNECT, DISCONNECT, GET_STATUS, SYNCH,
+ *    GET_COMM_MODE_INFO, SET_MTA, UPLOAD, SHORT_UPLOAD
+ *  - DAQ commands: CLEAR_DAQ_LIST, SET_DAQ_PTR, WRITE_DAQ, SET/GET_DAQ_LIST_MODE,
+ *    START_STOP_DAQ_LIST, START_STOP_SYNCH, GET_DAQ_PROCESSOR_INFO,
+ *    GET_DAQ_RESOLUTION_INFO, GET_DAQ_EVENT_INFO, FREE_DAQ, ALLOC_DAQ,
+ *    ALLOC_ODT, ALLOC_ODT_ENTRY
+ *  - One optional predefined DAQ list (list 0) plus dynamic lists from a fixed pool
+ *
+ * DAQ lists are sampled when their event channel fires. Sampling copies every
+ * ODT of the list into the DTO queue with interrupts masked, so a list is always
+ * consistent; XCP_Module_Task() then hands queued DTOs to free TX mailboxes.
+ */
+
+#include "xcp_module.h"
+#include "can_module.h"
+#include "id_plan_module.h"
+#include "stm32f0xx_hal.h"
+#include <string.h>
+
+#if XCP_ENABLE
+
+/* ===== Module configuration ===== */
+
+/* Timeout for command responses waiting on a TX mailbox. */
+#ifndef XCP_RESP_TIMEOUT_MS
+#define XCP_RESP_TIMEOUT_MS 2u
+#endif
+
+/* Readable memory windows for UPLOAD/SHORT_UPLOAD/WRITE_DAQ. Anything outside
+ * these would fault on the Cortex-M0, so such requests are rejected.
+ */
+#ifndef XCP_RAM_START
+#define XCP_RAM_START     0x20000000u
+#define XCP_RAM_SIZE      (6u * 1024u)
+#endif
+#ifndef XCP_FLASH_START
+#define XCP_FLASH_START   0x08000000u
+#define XCP_FLASH_SIZE    (32u * 1024u)
+#endif
+#ifndef XCP_SYSMEM_START
+#define XCP_SYSMEM_START  0x1FFFC400u  /* system memory, UID and option bytes */
+#define XCP_SYSMEM_SIZE   0x3C10u
+#endif
+
+/* Converts an XCP address to a readable pointer. */
+#ifndef XCP_ADDR_TO_PTR
+#define XCP_ADDR_TO_PTR(a) ((const uint8_t *)(uintptr_t)(a))
+#endif
+
+/* Largest payload of one DTO after the PID byte. */
+#define XCP_MAX_CTO        8u
+#define XCP_MAX_DTO        8u
+#define XCP_ODT_MAX_BYTES  (XCP_MAX_DTO - 1u)
+
+/* Packet identifiers and command codes (ASAM XCP 1.x). */
+#define XCP_PID_RES        0xFFu
+#define XCP_PID_ERR        0xFEu
+
+#define CC_CONNECT                 0xFFu
+#define CC_DISCONNECT              0xFEu
+#define CC_GET_STATUS              0xFDu
+#define CC_SYNCH                   0xFCu
+#define CC_GET_COMM_MODE_INFO      0xFBu
+#define CC_SET_MTA                 0xF6u
+#define CC_UPLOAD                  0xF5u
+#define CC_SHORT_UPLOAD            0xF4u
+#define CC_CLEAR_DAQ_LIST          0xE3u
+#define CC_SET_DAQ_PTR             0xE2u
+#define CC_WRITE_DAQ               0xE1u
+#define CC_SET_DAQ_LIST_MODE       0xE0u
+#define CC_GET_DAQ_LIST_MODE       0xDFu
+#define CC_START_STOP_DAQ_LIST     0xDEu
+#define CC_START_STOP_SYNCH        0xDDu
+#define CC_GET_DAQ_PROCESSOR_INFO  0xDAu
+#define CC_GET_DAQ_RESOLUTION_INFO 0xD9u
+#define CC_GET_DAQ_EVENT_INFO      0xD7u
+#define CC_FREE_DAQ                0xD6u
+#define CC_ALLOC_DAQ               0xD5u
+#define CC_ALLOC_ODT               0xD4u
+#define CC_ALLOC_ODT_ENTRY         0xD3u
+
+#define ERR_CMD_SYNCH              0x00u
+#define ERR_DAQ_ACTIVE             0x11u
+#define ERR_CMD_UNKNOWN            0x20u
+#define ERR_CMD_SYNTAX             0x21u
+#define ERR_OUT_OF_RANGE           0x22u
+#define ERR_WRITE_PROTECTED        0x23u
+#define ERR_ACCESS_DENIED          0x24u
+#define ERR_MODE_NOT_VALID         0x27u
+#define ERR_SEQUENCE               0x29u
+#define ERR_DAQ_CONFIG             0x2Au
+#define ERR_MEMORY_OVERFLOW        0x30u
+
+/* DAQ list flags (bit positions match GET_DAQ_LIST_MODE where they overlap). */
+#define DAQ_FLAG_SELECTED          0x01u
+#define DAQ_FLAG_RUNNING           0x40u
+#define DAQ_FLAG_PREDEFINED        0x80u
+
+/* Session status bits. */
+#define SS_DAQ_RUNNING             0x40u
+
+/* Dynamic allocation sequence (FREE_DAQ -> ALLOC_DAQ -> ALLOC_ODT -> ALLOC_ODT_ENTRY). */
+typedef enum {
+    ALLOC_FREED = 0,
+    ALLOC_DAQ_DONE,
+    ALLOC_ODT_DONE,
+    ALLOC_ENTRY_DONE
+} xcp_alloc_state_t;
+
+typedef struct {
+    uint8_t first_odt;
+    uint8_t odt_count;
+    uint8_t event;
+    uint8_t prescaler;
+    uint8_t countdown;
+    uint8_t priority;
+    uint8_t flags;
+} xcp_daq_t;
+
+typedef struct {
+    uint8_t first_entry;
+    uint8_t entry_count;
+} xcp_odt_t;
+
+/* ===== Private state ===== */
+
+static bool     s_connected = false;
+static uint32_t s_mta = 0u;
+
+static xcp_daq_t s_daq[XCP_MAX_DAQ];
+static xcp_odt_t s_odt[XCP_MAX_ODT];
+static uint32_t  s_entry_addr[XCP_MAX_ODT_ENTRIES];
+static uint8_t   s_entry_size[XCP_MAX_ODT_ENTRIES];
+
+static uint8_t s_min_daq = 0u;      /* number of predefined lists */
+static uint8_t s_daq_count = 0u;    /* predefined + dynamic */
+static uint8_t s_odt_used = 0u;
+static uint8_t s_entry_used = 0u;
+static uint8_t s_pre_odt_used = 0u;
+static uint8_t s_pre_entry_used = 0u;
+static xcp_daq_refresh_t s_pre_refresh = NULL;
+static xcp_alloc_state_t s_alloc_state = ALLOC_FREED;
+
+/* DAQ pointer set by SET_DAQ_PTR and advanced by WRITE_DAQ. */
+static uint8_t s_ptr_daq = 0u;
+static uint8_t s_ptr_odt = 0u;      /* absolute ODT index */
+static uint8_t s_ptr_entry = 0u;    /* absolute entry index */
+static bool    s_ptr_valid = false;
+
+/* Sampled DTOs waiting for a mailbox. Producers run with IRQs masked. */
+static uint8_t          s_dto_buf[XCP_DTO_QUEUE_LEN][XCP_MAX_DTO];
+static uint8_t          s_dto_len[XCP_DTO_QUEUE_LEN];
+static volatile uint8_t s_dto_head = 0u;
+static volatile uint8_t s_dto_tail = 0u;
+static volatile uint32_t s_overrun_count = 0u;
+
+static const char s_event_name_adc[]  = "ADC_SCAN";
+static const char s_event_name_proc[] = "PROCESS";
+
+/* ===== Helpers ===== */
+
+static uint16_t get_u16_le(const uint8_t *p)
+{
+    return (uint16_t)(p[0] | ((uint16_t)p[1] << 8));
+}
+
+static uint32_t get_u32_le(const uint8_t *p)
+{
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static void put_u16_le(uint8_t *p, uint16_t v)
+{
+    p[0] = (uint8_t)(v & 0xFFu);
+    p[1] = (uint8_t)(v >> 8);
+}
+
+static bool in_window(uint32_t addr, uint32_t len, uint32_t start, uint32_t size)
+{
+    return (addr >= start) && (len <= size) && ((addr - start) <= (size - len));
+}
+
+/* True if [addr, addr+len) lies entirely in one readable memory window. */
+static bool addr_is_readable(uint32_t addr, uint32_t len)
+{
+    return in_window(addr, len, XCP_RAM_START, XCP_RAM_SIZE)
+        || in_window(addr, len, XCP_FLASH_START, XCP_FLASH_SIZE)
+        || in_window(addr, len, XCP_SYSMEM_START, XCP_SYSMEM_SIZE);
+}
+
+static void send_dto(const uint8_t *data, uint8_t len)
+{
+    const uint16_t id = Id_Plan_Module_Std_Id(XCP_DTO_ID_OFFSET);
+    (void)CAN_Module_Send_Std(id, data, len, XCP_RESP_TIMEOUT_MS);
+}
+
+static void send_error(uint8_t code)
+{
+    const uint8_t resp[2] = { XCP_PID_ERR, code };
+    send_dto(resp, 2u);
+}
+
+static void send_ok(void)
+{
+    const uint8_t resp[1] = { XCP_PID_RES };
+    send_dto(resp, 1u);
+}
+
+static bool any_daq_running(void)
+{
+    for (uint8_t d = 0u; d < s_daq_count; ++d) {
+        if (s_daq[d].flags & DAQ_FLAG_RUNNING) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void stop_all_daq(void)
+{
+    for (uint8_t d = 0u; d < s_daq_count; ++d) {
+        s_daq[d].flags &= (uint8_t)~(DAQ_FLAG_RUNNING | DAQ_FLAG_SELECTED);
+    }
+}
+
+/* Drops all dynamic lists and returns their ODTs and entries to the pool. */
+static void free_dynamic_daq(void)
+{
+    stop_all_daq();
+    s_daq_count = s_min_daq;
+    s_odt_used = s_pre_odt_used;
+    s_entry_used = s_pre_entry_used;
+    s_alloc_state = ALLOC_FREED;
+    s_ptr_valid = false;
+}
+
+/* Bytes currently described by an ODT. */
+static uint8_t odt_byte_count(const xcp_odt_t *odt)
+{
+    uint8_t n = 0u;
+    for (uint8_t e = 0u; e < odt->entry_count; ++e) {
+        n = (uint8_t)(n + s_entry_size[odt->first_entry + e]);
+    }
+    return n;
+}
+
+static void start_daq(xcp_daq_t *daq)
+{
+    daq->countdown = 1u;   /* sample on the next event */
+    daq->flags |= DAQ_FLAG_RUNNING;
+}
+
+/* Copies every ODT of a list into the DTO queue. All-or-nothing so the list
+ * stays consistent; the whole copy runs with interrupts masked because lists
+ * can be sampled from both the main loop and the DMA interrupt.
+ */
+static void sample_daq(const xcp_daq_t *daq)
+{
+    const uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+
+    const uint8_t head = s_dto_head;
+    const uint8_t used = (uint8_t)((head + XCP_DTO_QUEUE_LEN - s_dto_tail) % XCP_DTO_QUEUE_LEN);
+    const uint8_t space = (uint8_t)(XCP_DTO_QUEUE_LEN - 1u - used);
+
+    if (daq->odt_count > space) {
+        s_overrun_count++;
+        __set_PRIMASK(primask);
+        return;
+    }
+
+    if ((daq->flags & DAQ_FLAG_PREDEFINED) && s_pre_refresh != NULL) {
+        s_pre_refresh();
+    }
+
+    uint8_t slot = head;
+    for (uint8_t o = 0u; o < daq->odt_count; ++o) {
+        const uint8_t odt_idx = (uint8_t)(daq->first_odt + o);
+        const xcp_odt_t *odt = &s_odt[odt_idx];
+        uint8_t *buf = s_dto_buf[slot];
+        uint8_t len = 1u;
+
+        buf[0] = odt_idx;  /* absolute ODT number as PID */
+        for (uint8_t e = 0u; e < odt->entry_count; ++e) {
+            const uint8_t idx = (uint8_t)(odt->first_entry + e);
+            const uint8_t size = s_entry_size[idx];
+            memcpy(&buf[len], XCP_ADDR_TO_PTR(s_entry_addr[idx]), size);
+            len = (uint8_t)(len + size);
+        }
+        s_dto_len[slot] = len;
+        slot = (uint8_t)((slot + 1u) % XCP_DTO_QUEUE_LEN);
+    }
+    s_dto_head = slot;
+
+    __set_PRIMASK(primask);
+}
+
+/* ===== Command handlers ===== */
+
+static void cmd_connect(void)
+{
+    s_connected = true;
+
+    uint8_t resp[8];
+    resp[0] = XCP_PID_RES;
+    resp[1] = 0x04u;          /* RESOURCE: DAQ */
+    resp[2] = 0x80u;          /* COMM_MODE_BASIC: Intel, byte granularity, optional info */
+    resp[3] = XCP_MAX_CTO;
+    put_u16_le(&resp[4], XCP_MAX_DTO);
+    resp[6] = 0x01u;          /* protocol layer version */
+    resp[7] = 0x01u;          /* transport layer version */
+    send_dto(resp, 8u);
+}
+
+static void cmd_get_status(void)
+{
+    uint8_t resp[6] = { XCP_PID_RES, 0u, 0u, 0u, 0u, 0u };
+    if (any_daq_running()) {
+        resp[1] |= SS_DAQ_RUNNING;
+    }
+    send_dto(resp, 6u);
+}
+
+static void cmd_get_comm_mode_info(void)
+{
+    const uint8_t resp[8] = { XCP_PID_RES, 0u, 0u, 0u, 0u, 0u, 0u, 0x10u };
+    send_dto(resp, 8u);
+}
+
+static void cmd_upload(uint8_t n)
+{
+    if (n == 0u || n > (XCP_MAX_CTO - 1u)) {
+        send_error(ERR_OUT_OF_RANGE);
+        return;
+    }
+    if (!addr_is_readable(s_mta, n)) {
+        send_error(ERR_ACCESS_DENIED);
+        return;
+    }
+
+    uint8_t resp[8];
+    resp[0] = XCP_PID_RES;
+    memcpy(&resp[1], XCP_ADDR_TO_PTR(s_mta), n);
+    s_mta += n;
+    send_dto(resp, (uint8_t)(n + 1u));
+}
+
+static void cmd_clear_daq_list(uint16_t daq)
+{
+    if (daq >= s_daq_count) {
+        send_error(ERR_OUT_OF_RANGE);
+        return;
+    }
+    xcp_daq_t *d = &s_daq[daq];
+    d->flags &= (uint8_t)~(DAQ_FLAG_RUNNING | DAQ_FLAG_SELECTED);
+    if (!(d->flags & DAQ_FLAG_PREDEFINED)) {
+        for (uint8_t o = 0u; o < d->odt_count; ++o) {
+            const xcp_odt_t *odt = &s_odt[d->first_odt + o];
+            memset(&s_entry_size[odt->first_entry], 0, odt->entry_count);
+        }
+    }
+    send_ok();
+}
+
+static void cmd_set_daq_ptr(uint16_t daq, uint8_t odt, uint8_t entry)
+{
+    if (daq >= s_daq_count || odt >= s_daq[daq].odt_count) {
+        send_error(ERR_OUT_OF_RANGE);
+        return;
+    }
+    const uint8_t odt_idx = (uint8_t)(s_daq[daq].first_odt + odt);
+    if (entry >= s_odt[odt_idx].entry_count) {
+        send_error(ERR_OUT_OF_RANGE);
+        return;
+    }
+    if (s_daq[daq].flags & DAQ_FLAG_RUNNING) {
+        send_error(ERR_DAQ_ACTIVE);
+        return;
+    }
+    s_ptr_daq = (uint8_t)daq;
+    s_ptr_odt = odt_idx;
+    s_ptr_entry = (uint8_t)(s_odt[odt_idx].first_entry + entry);
+    s_ptr_valid = true;
+    send_ok();
+}
+
+static void cmd_write_daq(uint8_t bit_offset, uint8_t size, uint32_t addr)
+{
+    if (!s_ptr_valid) {
+        send_error(ERR_SEQUENCE);
+        return;
+    }
+    const xcp_odt_t *odt = &s_odt[s_ptr_odt];
+    if (s_ptr_entry >= (uint8_t)(odt->first_entry + odt->entry_count)) {
+        send_error(ERR_OUT_OF_RANGE);
+        return;
+    }
+    if (s_daq[s_ptr_daq].flags & DAQ_FLAG_PREDEFINED) {
+        send_error(ERR_WRITE_PROTECTED);
+        return;
+    }
+    if (bit_offset != 0xFFu || size > XCP_ODT_MAX_BYTES) {
+        send_error(ERR_OUT_OF_RANGE);
+        return;
+    }
+    if (size > 0u && !addr_is_readable(addr, size)) {
+        send_error(ERR_ACCESS_DENIED);
+        return;
+    }
+    const uint8_t others = (uint8_t)(odt_byte_count(odt) - s_entry_size[s_ptr_entry]);
+    if ((uint8_t)(others + size) > XCP_ODT_MAX_BYTES) {
+        send_error(ERR_DAQ_CONFIG);
+        return;
+    }
+
+    s_entry_addr[s_ptr_entry] = addr;
+    s_entry_size[s_ptr_entry] = size;
+    s_ptr_entry++;
+    send_ok();
+}
+
+static void cmd_set_daq_list_mode(uint8_t mode, uint16_t daq, uint16_t event, uint8_t prescaler, uint8_t priority)
+{
+    if (daq >= s_daq_count || event >= XCP_MAX_EVENT_CHANNEL || prescaler == 0u) {
+        send_error(ERR_OUT_OF_RANGE);
+        return;
+    }
+    if (mode != 0u) {
+        /* STIM, timestamps and PID_OFF are not supported. */
+        send_error(ERR_MODE_NOT_VALID);
+        return;
+    }
+    xcp_daq_t *d = &s_daq[daq];
+    if (d->flags & DAQ_FLAG_RUNNING) {
+        send_error(ERR_DAQ_ACTIVE);
+        return;
+    }
+    d->event = (uint8_t)event;
+    d->prescaler = prescaler;
+    d->priority = priority;
+    send_ok();
+}
+
+static void cmd_get_daq_list_mode(uint16_t daq)
+{
+    if (daq >= s_daq_count) {
+        send_error(ERR_OUT_OF_RANGE);
+        return;
+    }
+    const xcp_daq_t *d = &s_daq[daq];
+    uint8_t resp[8];
+    resp[0] = XCP_PID_RES;
+    resp[1] = (uint8_t)(d->flags & (DAQ_FLAG_SELECTED | DAQ_FLAG_RUNNING));
+    resp[2] = 0u;
+    resp[3] = 0u;
+    put_u16_le(&resp[4], d->event);
+    resp[6] = d->prescaler;
+    resp[7] = d->priority;
+    send_dto(resp, 8u);
+}
+
+static void cmd_start_stop_daq_list(uint8_t mode, uint16_t daq)
+{
+    if (daq >= s_daq_count || mode > 2u) {
+        send_error(ERR_OUT_OF_RANGE);
+        return;
+    }
+    xcp_daq_t *d = &s_daq[daq];
+    if (mode != 0u) {
+        if (d->odt_count == 0u) {
+            send_error(ERR_DAQ_CONFIG);
+            return;
+        }
+        for (uint8_t o = 0u; o < d->odt_count; ++o) {
+            if (odt_byte_count(&s_odt[d->first_odt + o]) == 0u) {
+                send_error(ERR_DAQ_CONFIG);
+                return;
+            }
+        }
+    }
+
+    switch (mode) {
+    case 0u:
+        d->flags &= (uint8_t)~DAQ_FLAG_RUNNING;
+        break;
+    case 1u:
+        start_daq(d);
+        break;
+    default:
+        d->flags |= DAQ_FLAG_SELECTED;
+        break;
+    }
+
+    const uint8_t resp[2] = { XCP_PID_RES, d->first_odt };
+    send_dto(resp, 2u);
+}
+
+static void cmd_start_stop_synch(uint8_t mode)
+{
+    if (mode > 2u) {
+        send_error(ERR_OUT_OF_RANGE);
+        return;
+    }
+    for (uint8_t i = 0u; i < s_daq_count; ++i) {
+        xcp_daq_t *d = &s_daq[i];
+        if (mode == 0u) {
+            d->flags &= (uint8_t)~DAQ_FLAG_RUNNING;
+        } else if (d->flags & DAQ_FLAG_SELECTED) {
+            if (mode == 1u) {
+                start_daq(d);
+            } else {
+                d->flags &= (uint8_t)~DAQ_FLAG_RUNNING;
+            }
+        }
+        d->flags &= (uint8_t)~DAQ_FLAG_SELECTED;
+    }
+    send_ok();
+}
+
+static void cmd_get_daq_processor_info(void)
+{
+    uint8_t resp[8];
+    resp[0] = XCP_PID_RES;
+    resp[1] = 0x03u;                  /* DAQ_PROPERTIES: dynamic config, prescaler */
+    put_u16_le(&resp[2], XCP_MAX_DAQ);
+    put_u16_le(&resp[4], XCP_MAX_EVENT_CHANNEL);
+    resp[6] = s_min_daq;
+    resp[7] = 0x00u;                  /* DAQ_KEY_BYTE: absolute ODT number as PID */
+    send_dto(resp, 8u);
+}
+
+static void cmd_get_daq_resolution_info(void)
+{
+    const uint8_t resp[8] = { XCP_PID_RES, 1u, XCP_ODT_MAX_BYTES, 1u, 0u, 0u, 0u, 0u };
+    send_dto(resp, 8u);
+}
+
+static void cmd_get_daq_event_info(uint16_t event)
+{
+    if (event >= XCP_MAX_EVENT_CHANNEL) {
+        send_error(ERR_OUT_OF_RANGE);
+        return;
+    }
+
+    const char *name = (event == XCP_EVENT_ADC_SCAN) ? s_event_name_adc : s_event_name_proc;
+    const uint8_t name_len = (uint8_t)((event == XCP_EVENT_ADC_SCAN) ? sizeof(s_event_name_adc)
+                                                                    : sizeof(s_event_name_proc)) - 1u;
+    /* The master reads the name with UPLOAD from the MTA. */
+    s_mta = (uint32_t)(uintptr_t)name;
+
+    uint8_t resp[7];
+    resp[0] = XCP_PID_RES;
+    resp[1] = 0x04u;                  /* DAQ direction */
+    resp[2] = XCP_MAX_DAQ;            /* MAX_DAQ_LIST */
+    resp[3] = name_len;
+    resp[4] = 0u;                     /* not cyclic (time unit ignored) */
+    resp[5] = 0u;
+    resp[6] = (event == XCP_EVENT_ADC_SCAN) ? 0xFFu : 0x00u;  /* priority */
+    send_dto(resp, 7u);
+}
+
+static void cmd_alloc_daq(uint16_t count)
+{
+    if (s_alloc_state != ALLOC_FREED) {
+        send_error(ERR_SEQUENCE);
+        return;
+    }
+    if (count > (uint16_t)(XCP_MAX_DAQ - s_min_daq)) {
+        send_error(ERR_MEMORY_OVERFLOW);
+        return;
+    }
+    for (uint16_t i = 0u; i < count; ++i) {
+        xcp_daq_t *d = &s_daq[s_min_daq + i];
+        memset(d, 0, sizeof(*d));
+        d->prescaler = 1u;
+    }
+    s_daq_count = (uint8_t)(s_min_daq + count);
+    s_alloc_state = ALLOC_DAQ_DONE;
+    send_ok();
+}
+
+static void cmd_alloc_odt(uint16_t daq, uint8_t count)
+{
+    if (s_alloc_state != ALLOC_DAQ_DONE && s_alloc_state != ALLOC_ODT_DONE) {
+        send_error(ERR_SEQUENCE);
+        return;
+    }
+    if (daq < s_min_daq || daq >= s_daq_count || s_daq[daq].odt_count != 0u) {
+        send_error(ERR_OUT_OF_RANGE);
+        return;
+    }
+    if (count > (uint8_t)(XCP_MAX_ODT - s_odt_used)) {
+        send_error(ERR_MEMORY_OVERFLOW);
+        return;
+    }
+    xcp_daq_t *d = &s_daq[daq];
+    d->first_odt = s_odt_used;
+    d->odt_count = count;
+    for (uint8_t o = 0u; o < count; ++o) {
+        s_odt[s_odt_used + o].first_entry = 0u;
+        s_odt[s_odt_used + o].entry_count = 0u;
+    }
+    s_odt_used = (uint8_t)(s_odt_used + count);
+    s_alloc_state = ALLOC_ODT_DONE;
+    send_ok();
+}
+
+static void cmd_alloc_odt_entry(uint16_t daq, uint8_t odt, uint8_t count)
+{
+    if (s_alloc_state != ALLOC_ODT_DONE && s_alloc_state != ALLOC_ENTRY_DONE) {
+        send_error(ERR_SEQUENCE);
+        return;
+    }
+    if (daq < s_min_daq || daq >= s_daq_count || odt >= s_daq[daq].odt_count) {
+        send_error(ERR_OUT_OF_RANGE);
+        return;
+    }
+    xcp_odt_t *o = &s_odt[s_daq[daq].first_odt + odt];
+    if (o->entry_count != 0u || count == 0u || count > XCP_ODT_MAX_BYTES) {
+        send_error(ERR_OUT_OF_RANGE);
+        return;
+    }
+    if (count > (uint8_t)(XCP_MAX_ODT_ENTRIES - s_entry_used)) {
+        send_error(ERR_MEMORY_OVERFLOW);
+        return;
+    }
+    o->first_entry = s_entry_used;
+    o->entry_count = count;
+    memset(&s_entry_size[s_entry_used], 0, count);
+    s_entry_used = (uint8_t)(s_entry_used + count);
+    s_alloc_state = ALLOC_ENTRY_DONE;
+    send_ok();
+}
+
+/* ===== Public API ===== */
+
+void XCP_Module_Init(const xcp_daq_entry_t *entries, size_t count, uint8_t event_channel,
+                     xcp_daq_refresh_t refresh)
+{
+    s_connected = false;
+    s_pre_refresh = refresh;
+    s_mta = 0u;
+    s_min_daq = 0u;
+    s_daq_count = 0u;
+    s_odt_used = 0u;
+    s_entry_used = 0u;
+    s_dto_head = 0u;
+    s_dto_tail = 0u;
+    s_overrun_count = 0u;
+
+    if (entries != NULL && count > 0u && count <= XCP_MAX_ODT_ENTRIES
+            && event_channel < XCP_MAX_EVENT_CHANNEL) {
+        xcp_daq_t *d = &s_daq[0];
+        memset(d, 0, sizeof(*d));
+        d->event = event_channel;
+        d->prescaler = 1u;
+        d->flags = DAQ_FLAG_PREDEFINED;
+
+        /* Pack entries greedily into ODTs of at most XCP_ODT_MAX_BYTES. */
+        xcp_odt_t *odt = NULL;
+        uint8_t odt_bytes = 0u;
+        for (size_t i = 0u; i < count; ++i) {
+            const uint8_t size = entries[i].size;
+            if (size == 0u || size > XCP_ODT_MAX_BYTES) {
+                continue;
+            }
+            if (odt == NULL || (uint8_t)(odt_bytes + size) > XCP_ODT_MAX_BYTES) {
+                if (s_odt_used >= XCP_MAX_ODT) {
+                    break;
+                }
+                odt = &s_odt[s_odt_used++];
+                odt->first_entry = s_entry_used;
+                odt->entry_count = 0u;
+                odt_bytes = 0u;
+                d->odt_count++;
+            }
+            s_entry_addr[s_entry_used] = (uint32_t)(uintptr_t)entries[i].addr;
+            s_entry_size[s_entry_used] = size;
+            s_entry_used++;
+            odt->entry_count++;
+            odt_bytes = (uint8_t)(odt_bytes + size);
+        }
+
+        if (d->odt_count > 0u) {
+            s_min_daq = 1u;
+        }
+    }
+
+    s_pre_odt_used = s_odt_used;
+    s_pre_entry_used = s_entry_used;
+    free_dynamic_daq();
+}
+
+bool XCP_Module_Handle_Frame(uint16_t std_id, const uint8_t *data, uint8_t dlc)
+{
+    if (std_id != Id_Plan_Module_Std_Id(XCP_CRO_ID_OFFSET)) {
+        return false;
+    }
+    if (data == NULL || dlc == 0u) {
+        return true;
+    }
+
+    const uint8_t cmd = data[0];
+
+    /* While disconnected the slave stays silent for everything but CONNECT. */
+    if (!s_connected && cmd != CC_CONNECT) {
+        return true;
+    }
+
+    /* Parameter bytes beyond DLC read as zero. */
+    uint8_t p[8] = {0};
+    memcpy(p, data, (dlc > 8u) ? 8u : dlc);
+
+    switch (cmd) {
+    case CC_CONNECT:
+        cmd_connect();
+        break;
+    case CC_DISCONNECT:
+        stop_all_daq();
+        s_connected = false;
+        send_ok();
+        break;
+    case CC_GET_STATUS:
+        cmd_get_status();
+        break;
+    case CC_SYNCH:
+        send_error(ERR_CMD_SYNCH);
+        break;
+    case CC_GET_COMM_MODE_INFO:
+        cmd_get_comm_mode_info();
+        break;
+    case CC_SET_MTA:
+        s_mta = get_u32_le(&p[4]);
+        send_ok();
+        break;
+    case CC_UPLOAD:
+        cmd_upload(p[1]);
+        break;
+    case CC_SHORT_UPLOAD:
+        s_mta = get_u32_le(&p[4]);
+        cmd_upload(p[1]);
+        break;
+    case CC_CLEAR_DAQ_LIST:
+        cmd_clear_daq_list(get_u16_le(&p[2]));
+        break;
+    case CC_SET_DAQ_PTR:
+        cmd_set_daq_ptr(get_u16_le(&p[2]), p[4], p[5]);
+        break;
+    case CC_WRITE_DAQ:
+        cmd_write_daq(p[1], p[2], get_u32_le(&p[4]));
+        break;
+    case CC_SET_DAQ_LIST_MODE:
+        cmd_set_daq_list_mode(p[1], get_u16_le(&p[2]), get_u16_le(&p[4]), p[6], p[7]);
+        break;
+    case CC_GET_DAQ_LIST_MODE:
+        cmd_get_daq_list_mode(get_u16_le(&p[2]));
+        break;
+    case CC_START_STOP_DAQ_LIST:
+        cmd_start_stop_daq_list(p[1], get_u16_le(&p[2]));
+        break;
+    case CC_START_STOP_SYNCH:
+        cmd_start_stop_synch(p[1]);
+        break;
+    case CC_GET_DAQ_PROCESSOR_INFO:
+        cmd_get_daq_processor_info();
+        break;
+    case CC_GET_DAQ_RESOLUTION_INFO:
+        cmd_get_daq_resolution_info();
+        break;
+    case CC_GET_DAQ_EVENT_INFO:
+        cmd_get_daq_event_info(get_u16_le(&p[2]));
+        break;
+    case CC_FREE_DAQ:
+        free_dynamic_daq();
+        send_ok();
+        break;
+    case CC_ALLOC_DAQ:
+        cmd_alloc_daq(get_u16_le(&p[2]));
+        break;
+    case CC_ALLOC_ODT:
+        cmd_alloc_odt(get_u16_le(&p[2]), p[4]);
+        break;
+    case CC_ALLOC_ODT_ENTRY:
+        cmd_alloc_odt_entry(get_u16_le(&p[2]), p[4], p[5]);
+        break;
+    default:
+        send_error(ERR_CMD_UNKNOWN);
+        break;
+    }
+
+    return true;
+}
+
+void XCP_Module_Event(uint8_t event_channel)
+{
+    for (uint8_t i = 0u; i < s_daq_count; ++i) {
+        xcp_daq_t *d = &s_daq[i];
+        if (!(d->flags & DAQ_FLAG_RUNNING) || d->event != event_channel) {
+            continue;
+        }
+        if (--d->countdown != 0u) {
+            continue;
+        }
+        d->countdown = d->prescaler;
+        sample_daq(d);
+    }
+}
+
+void XCP_Module_Task(void)
+{
+    const uint16_t id = Id_Plan_Module_Std_Id(XCP_DTO_ID_OFFSET);
+
+    while (s_dto_tail != s_dto_head) {
+        const uint8_t slot = s_dto_tail;
+        if (CAN_Module_Send_Std(id, s_dto_buf[slot], s_dto_len[slot], 0u) != HAL_OK) {
+            break;  /* all mailboxes busy, retry next loop */
+        }
+        s_dto_tail = (uint8_t)((slot + 1u) % XCP_DTO_QUEUE_LEN);
+    }
+}
+
+uint32_t XCP_Module_Get_Overrun_Count(void)
+{
+    return s_overrun_count;
+}
+
+#else
+
+void XCP_Module_Init(const xcp_daq_entry_t *entries, size_t count, uint8_t event_channel,
+                     xcp_daq_refresh_t refresh)
+{
+    (void)entries;
+    (void)count;
+    (void)event_channel;
+    (void)refresh;
+}
+
+bool XCP_Module_Handle_Frame(uint16_t std_id, const uint8_t *data, uint8_t dlc)
+{
+    (void)std_id;
+    (void)data;
+    (void)dlc;
+    return false;
+}
+
+void XCP_Module_Event(uint8_t event_channel)
+{
+    (void)event_channel;
+}
+
+void XCP_Module_Task(void)
+{
+}
+
+uint32_t XCP_Module_Get_Overrun_Count(void)
+{
+    return 0u;
+}
+
+#endif